@@ -3,6 +3,7 @@
 #include "config.h"
 #include "eosapplication.h"
 #include "eosattribution-private.h"
+#include "eosprofile-private.h"
 
 #include <glib/gi18n-lib.h>
 #include <gtk/gtk.h>
@@ -231,6 +232,9 @@ typedef struct {
   GFile *image_attribution_file;
 
   EosWindow *main_application_window;
+
+  /* The beginning of the first ::activate emission, for the profiler */
+  gint64 activate_start;
 } EosApplicationPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (EosApplication, eos_application, GTK_TYPE_APPLICATION)
@@ -381,6 +385,45 @@ eos_application_activate (GApplication *application)
   /* TODO: Should it be required to override activate() as in GApplication? */
 }
 
+/* ::activate is a RUN_LAST signal, and subclasses create their windows
+ * after chaining up, so the startup span covers the whole emission: it
+ * begins in an emission hook, which runs before any handler, and ends
+ * in a handler run after the class handler
+ */
+static gboolean
+on_activate_emission (GSignalInvocationHint *ihint,
+                      guint                  n_param_values,
+                      const GValue          *param_values,
+                      gpointer               data)
+{
+  GObject *instance = g_value_get_object (&param_values[0]);
+
+  if (EOS_IS_APPLICATION (instance))
+    {
+      EosApplication *self = EOS_APPLICATION (instance);
+      EosApplicationPrivate *priv = eos_application_get_instance_private (self);
+
+      if (priv->activate_start == 0)
+        priv->activate_start = g_get_monotonic_time ();
+    }
+
+  return TRUE;
+}
+
+static void
+on_activate_finished (GApplication *application,
+                      gpointer      data)
+{
+  EosApplication *self = EOS_APPLICATION (application);
+  EosApplicationPrivate *priv = eos_application_get_instance_private (self);
+
+  if (priv->activate_start > 0)
+    {
+      eos_profile_startup_span ("activate", priv->activate_start);
+      priv->activate_start = -1;
+    }
+}
+
 static gpointer
 ensure_config_dir_exists_and_is_writable (EosApplication *self)
 {
@@ -439,9 +482,15 @@ eos_application_startup (GApplication *application)
 {
   EosApplication *self = EOS_APPLICATION (application);
   EosApplicationPrivate *priv = eos_application_get_instance_private (self);
+  g_autoptr(EosProfileProbe) probe =
+    EOS_PROFILE_PROBE ("/com/endlessm/Sdk/application/startup");
+  gint64 startup_start = g_get_monotonic_time ();
 
   G_APPLICATION_CLASS (eos_application_parent_class)->startup (application);
 
+  /* GTK is initialized, so we can instrument the signals of its types */
+  eos_profile_signals_install ();
+
   /* Set up the hotkey for the quit action */
   static const gchar * const quit_accels[] = { "<Primary>q", NULL };
   gtk_application_set_accels_for_action (GTK_APPLICATION (application),
@@ -454,6 +503,7 @@ eos_application_startup (GApplication *application)
                                          "app.image-credits",
                                          credits_accels);
 
+  gint64 theme_start = g_get_monotonic_time ();
   GtkCssProvider *provider = gtk_css_provider_new ();
 
   /* Reset CSS for SDK applications and apply our own theme on top of it. This
@@ -469,9 +519,14 @@ eos_application_startup (GApplication *application)
   g_debug ("Initialized theme\n");
 
   g_object_unref (provider);
+  eos_profile_startup_span ("theme", theme_start);
 
+  gint64 config_dir_start = g_get_monotonic_time ();
   g_once (&priv->init_config_dir_once,
           (GThreadFunc)ensure_config_dir_exists_and_is_writable, self);
+  eos_profile_startup_span ("config-dir", config_dir_start);
+
+  eos_profile_startup_span ("application-startup", startup_start);
 }
 
 static void
@@ -552,6 +607,9 @@ eos_application_class_init (EosApplicationClass *klass)
   gtk_application_class->window_added = eos_application_window_added;
   gtk_application_class->window_removed = eos_application_window_removed;
 
+  g_signal_add_emission_hook (g_signal_lookup ("activate", G_TYPE_APPLICATION),
+                              0, on_activate_emission, NULL, NULL);
+
   /**
    * EosApplication:config-dir:
    *
@@ -641,6 +699,8 @@ set_image_credits_action_enabled (EosApplication *self,
 static void
 eos_application_init (EosApplication *self)
 {
+  eos_profile_census_construct (EOS_TYPE_APPLICATION);
+
   EosApplicationPrivate *priv = eos_application_get_instance_private (self);
   priv->init_config_dir_once = (GOnce)G_ONCE_INIT;
 
@@ -658,6 +718,8 @@ eos_application_init (EosApplication *self)
 
   g_signal_connect (self, "notify::application-id",
                     G_CALLBACK (on_app_id_set), self);
+  g_signal_connect_after (self, "activate",
+                          G_CALLBACK (on_activate_finished), NULL);
 }
 
 /* Public API */
@@ -6,6 +6,7 @@
 #include <json-glib/json-glib.h>
 
 #include "eosattribution-private.h"
+#include "eosprofile-private.h"
 #include "eoscellrendererpixbuflink-private.h"
 #include "eoscellrenderertextlink-private.h"
 #include "eoslicense.h"
@@ -361,6 +362,8 @@ render_usage_notes (GtkTreeViewColumn *column,
 static void
 eos_attribution_init (EosAttribution *self)
 {
+  eos_profile_census_construct (EOS_TYPE_ATTRIBUTION);
+
   EosAttributionPrivate *priv = eos_attribution_get_instance_private (self);
   priv->model = gtk_list_store_new (NUM_MODEL_COLUMNS,
                                     GDK_TYPE_PIXBUF,
@@ -458,6 +461,8 @@ eos_attribution_initable_init (GInitable    *initable,
 {
   EosAttribution *self = EOS_ATTRIBUTION (initable);
   EosAttributionPrivate *priv = eos_attribution_get_instance_private (self);
+  g_autoptr(EosProfileProbe) probe =
+    EOS_PROFILE_PROBE ("/com/endlessm/Sdk/attribution/load");
 
   GInputStream *stream = G_INPUT_STREAM (g_file_read (priv->file, cancellable,
                                                       error));
@@ -3,6 +3,7 @@
 #include <gtk/gtk.h>
 
 #include "eoscellrendererpixbuflink-private.h"
+#include "eosprofile-private.h"
 
 G_DEFINE_TYPE (EosCellRendererPixbufLink, eos_cell_renderer_pixbuf_link, GTK_TYPE_CELL_RENDERER_PIXBUF)
 
@@ -46,6 +47,8 @@ eos_cell_renderer_pixbuf_link_class_init (EosCellRendererPixbufLinkClass *klass)
 static void
 eos_cell_renderer_pixbuf_link_init (EosCellRendererPixbufLink *self)
 {
+  eos_profile_census_construct (EOS_TYPE_CELL_RENDERER_PIXBUF_LINK);
+
   g_object_set (self,
                 "mode", GTK_CELL_RENDERER_MODE_ACTIVATABLE,
                 NULL);
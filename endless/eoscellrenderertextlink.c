@@ -3,6 +3,7 @@
 #include <gtk/gtk.h>
 
 #include "eoscellrenderertextlink-private.h"
+#include "eosprofile-private.h"
 
 #define LINK_NORMAL_FOREGROUND_COLOR "#3465a4"  /* sky blue 2 */
 #define LINK_HOVER_FOREGROUND_COLOR "#729fcf"  /* sky blue 3 */
@@ -72,6 +73,8 @@ eos_cell_renderer_text_link_class_init (EosCellRendererTextLinkClass *klass)
 static void
 eos_cell_renderer_text_link_init (EosCellRendererTextLink *self)
 {
+  eos_profile_census_construct (EOS_TYPE_CELL_RENDERER_TEXT_LINK);
+
   g_object_set (self,
                 "mode", GTK_CELL_RENDERER_MODE_ACTIVATABLE,
                 NULL);
@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "eoscustomcontainer.h"
+#include "eosprofile-private.h"
 
 #include <gtk/gtk.h>
 
@@ -101,6 +102,8 @@ eos_custom_container_class_init (EosCustomContainerClass *klass)
 static void
 eos_custom_container_init (EosCustomContainer *self)
 {
+  eos_profile_census_construct (EOS_TYPE_CUSTOM_CONTAINER);
+
   GtkWidget *widget = GTK_WIDGET (self);
   gtk_widget_set_has_window (widget, FALSE);
 }
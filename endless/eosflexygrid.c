@@ -16,6 +16,7 @@
 
 #define EOS_SDK_DISABLE_DEPRECATION_WARNINGS
 #include "eosflexygrid-private.h"
+#include "eosprofile-private.h"
 
 #include <string.h>
 #include <glib-object.h>
@@ -34,9 +35,42 @@ G_GNUC_BEGIN_IGNORE_DEPRECATIONS
 #define DEBUG(x)
 #endif
 
+#define N_CACHED_LAYOUTS        2
+
+typedef struct _Layout          Layout;
+
 typedef struct {
   GSequence *children;
 
+  Layout *layouts[N_CACHED_LAYOUTS];
+
+  /* The layout of the last allocation, while it is valid */
+  Layout *allocated_layout;
+  int allocated_width;
+
+  /* While the layout is frozen, the first cell that changed, and the
+   * height of the layout before
+   */
+  guint freeze_count;
+  guint frozen_from;
+  int layout_height;
+
+  /* The bound model, and the shape of each of its items */
+  GListModel *model;
+  GArray *shapes;
+  EosFlexyGridShapeFunc shape_func;
+  EosFlexyGridBindCellFunc bind_func;
+  gpointer bind_data;
+  GDestroyNotify bind_notify;
+
+  /* The cells of the items around the visible area, by index, and the
+   * cells that can show other items
+   */
+  GHashTable *bound_cells;
+  GPtrArray *free_cells;
+  GdkRectangle bound_area;
+  GtkAdjustment *vadjustment;
+
   EosFlexyGridSortFunc sort_func;
   gpointer sort_data;
   GDestroyNotify sort_notify;
@@ -109,84 +143,261 @@ eos_flexy_grid_update_cell_prelight (EosFlexyGrid *grid,
   gtk_widget_queue_draw (GTK_WIDGET (grid));
 }
 
-static inline void
-add_new_empty_line (GArray *array,
-                    guint   n_cols)
+/* The occupancy of the grid is a bitset for each line, in which the bits
+ * of the free slots are set; the bits past the last column are never set,
+ * so cells spanning two columns cannot wrap around the end of a line.
+ *
+ * Lines are made of 64-bit words, so finding a free slot, or a slot for a
+ * cell spanning two columns or two lines, tests 64 slots at a time. Slots
+ * are numbered by their bit in the bitset, and lines have a power of two
+ * words, so the line and the column of a slot do not need a division.
+ *
+ * Slots are only ever occupied, and searches never start before the
+ * previous one, so there is no room for a shape before the slot found by
+ * its previous search; each search for a shape resumes from there instead
+ * of going again over the holes left behind by larger cells.
+ */
+#define BITS_PER_WORD   64
+#define N_SHAPES        (EOS_FLEXY_SHAPE_LARGE + 1)
+
+typedef struct {
+  GArray *words;
+  guint n_cols;
+  guint words_per_line;
+  guint line_shift;
+  guint n_lines;
+
+  guint last_slot[N_SHAPES];
+} Occupancy;
+
+#define get_line(occupancy,pos)                 ((pos) >> (occupancy)->line_shift)
+#define get_column(occupancy,pos)               ((pos) & ((1u << (occupancy)->line_shift) - 1))
+#define get_slot(occupancy,line,column)         (((line) << (occupancy)->line_shift) | (column))
+
+static inline guint
+bit_ctz (guint64 word)
 {
-  guint start = array->len;
+#ifdef __GNUC__
+  return __builtin_ctzll (word);
+#else
+  guint res = 0;
+
+  while ((word & 1) == 0)
+    {
+      word >>= 1;
+      res += 1;
+    }
 
-  g_array_set_size (array, array->len + n_cols);
-  for (guint i = start; i < array->len; i++)
-    g_array_index (array, gboolean, i) = TRUE;
+  return res;
+#endif
 }
 
-static guint
-get_next_free_slot (GArray *array,
-                    guint   pos,
-                    guint   n_cols)
+static void
+add_new_empty_line (Occupancy *occupancy)
 {
-  guint new_pos = pos;
+  guint start = occupancy->words->len;
 
-  if (new_pos >= array->len)
+  g_array_set_size (occupancy->words, start + occupancy->words_per_line);
+
+  for (guint i = 0; i < occupancy->words_per_line; i++)
     {
-      DEBUG (g_print ("Adding empty line to cover for %u\n", pos));
-      add_new_empty_line (array, n_cols);
+      guint first_column = i * BITS_PER_WORD;
+      guint64 word;
+
+      if (first_column >= occupancy->n_cols)
+        word = 0;
+      else if (occupancy->n_cols - first_column >= BITS_PER_WORD)
+        word = G_MAXUINT64;
+      else
+        word = ((guint64) 1 << (occupancy->n_cols - first_column)) - 1;
+
+      g_array_index (occupancy->words, guint64, start + i) = word;
     }
 
-  while (g_array_index (array, gboolean, new_pos) == FALSE)
+  occupancy->n_lines += 1;
+}
+
+static void
+occupancy_init (Occupancy *occupancy,
+                guint      n_cols)
+{
+  occupancy->n_cols = n_cols;
+  occupancy->words_per_line = 1;
+  occupancy->line_shift = 6;
+
+  while (occupancy->words_per_line * BITS_PER_WORD < n_cols)
     {
-      new_pos += 1;
-      if (new_pos >= array->len)
-        add_new_empty_line (array, n_cols);
+      occupancy->words_per_line *= 2;
+      occupancy->line_shift += 1;
     }
 
-  DEBUG (g_print ("Next free slot after %u: %u\n", pos, new_pos));
+  occupancy->words = g_array_new (FALSE, FALSE, sizeof (guint64));
+  occupancy->n_lines = 0;
 
-  return new_pos;
+  for (guint i = 0; i < N_SHAPES; i++)
+    occupancy->last_slot[i] = 0;
+
+  add_new_empty_line (occupancy);
 }
 
-static gboolean
-check_free_slot (GArray *array,
-                 guint   pos,
-                 guint   n_cols)
+static void
+occupancy_clear (Occupancy *occupancy)
+{
+  g_clear_pointer (&occupancy->words, g_array_unref);
+}
+
+static inline void
+ensure_lines (Occupancy *occupancy,
+              guint      n_lines)
+{
+  while (occupancy->n_lines < n_lines)
+    {
+      DEBUG (g_print ("Adding empty line to cover for line %u\n", n_lines - 1));
+      add_new_empty_line (occupancy);
+    }
+}
+
+static inline guint64 *
+get_line_words (Occupancy *occupancy,
+                guint      line)
+{
+  return &g_array_index (occupancy->words, guint64, line * occupancy->words_per_line);
+}
+
+/* Returns the slots of a word followed by a free slot on the same line */
+static inline guint64
+get_free_pairs (const guint64 *line,
+                guint          word,
+                guint          words_per_line)
+{
+  guint64 slots = line[word];
+  guint64 next = word + 1 < words_per_line ? line[word + 1] : 0;
+
+  return slots & ((slots >> 1) | (next << (BITS_PER_WORD - 1)));
+}
+
+/* Returns the slots of a word of @line where a cell of @shape fits */
+static inline guint64
+get_fitting_slots (const guint64 *line,
+                   guint          words_per_line,
+                   EosFlexyShape  shape,
+                   guint          word)
 {
-  while (pos >= array->len)
+  const guint64 *next_line = line + words_per_line;
+
+  switch (shape)
     {
-      DEBUG (g_print ("Adding empty line to cover for pos %u\n", pos));
-      add_new_empty_line (array, n_cols);
+    case EOS_FLEXY_SHAPE_SMALL:
+      return line[word];
+
+    case EOS_FLEXY_SHAPE_MEDIUM_HORIZONTAL:
+      /* two adjacent cells on the same line must be free */
+      return get_free_pairs (line, word, words_per_line);
+
+    case EOS_FLEXY_SHAPE_MEDIUM_VERTICAL:
+      /* two adjacent cells on the same column must be free */
+      return line[word] & next_line[word];
+
+    case EOS_FLEXY_SHAPE_LARGE:
+      return get_free_pairs (line, word, words_per_line) &
+             get_free_pairs (next_line, word, words_per_line);
     }
 
-  DEBUG (g_print ("Slot %u is %s\n", pos, g_array_index (array, gboolean, pos) ? "free" : "occupied"));
+  g_assert_not_reached ();
+
+  return 0;
+}
+
+/* Returns the first slot from @pos where a cell of @shape fits; there is
+ * always one, since a grid has at least two columns and grows as needed
+ */
+static guint
+find_slot (Occupancy     *occupancy,
+           guint          pos,
+           EosFlexyShape  shape)
+{
+  guint words_per_line = occupancy->words_per_line;
+
+  pos = MAX (pos, occupancy->last_slot[shape]);
+
+  guint line = get_line (occupancy, pos);
+  guint word = get_column (occupancy, pos) / BITS_PER_WORD;
+  guint64 mask = G_MAXUINT64 << (pos % BITS_PER_WORD);
 
-  return g_array_index (array, gboolean, pos) == TRUE;
+  while (TRUE)
+    {
+      /* Cells spanning two lines look at the next line too */
+      ensure_lines (occupancy, line + 2);
+
+      const guint64 *words = get_line_words (occupancy, line);
+
+      for (; word < words_per_line; word++)
+        {
+          guint64 slots = get_fitting_slots (words, words_per_line, shape, word) & mask;
+
+          if (slots != 0)
+            {
+              pos = get_slot (occupancy, line, word * BITS_PER_WORD + bit_ctz (slots));
+              occupancy->last_slot[shape] = pos;
+
+              return pos;
+            }
+
+          mask = G_MAXUINT64;
+        }
+
+      word = 0;
+      line += 1;
+    }
 }
 
-#define get_column(n_cols,pos)  ((pos) % (n_cols))
-#define get_line(n_cols,pos)    ((pos) / (n_cols))
+static guint
+get_next_free_slot (Occupancy *occupancy,
+                    guint      pos)
+{
+  guint new_pos = find_slot (occupancy, pos, EOS_FLEXY_SHAPE_SMALL);
+
+  DEBUG (g_print ("Next free slot after %u: %u\n", pos, new_pos));
+
+  return new_pos;
+}
 
 static inline void
 set_position (GtkAllocation *request,
-              guint          n_cols,
+              Occupancy     *occupancy,
               guint          pos,
               guint          cell_width,
               guint          spacing)
 {
   guint width = cell_width + spacing;
 
-  request->y = get_line (n_cols, pos) * width;
-  request->x = get_column (n_cols, pos) * width;
+  request->y = get_line (occupancy, pos) * width;
+  request->x = get_column (occupancy, pos) * width;
 }
 
+/* Marks the slots of a cell @width columns wide and @height lines high */
 static inline void
-mark_occupied_slot (GArray *array,
-                    guint   pos)
+mark_occupied_slots (Occupancy *occupancy,
+                     guint      pos,
+                     guint      width,
+                     guint      height)
 {
-  g_array_index (array, gboolean, pos) = FALSE;
+  guint line = get_line (occupancy, pos);
+  guint column = get_column (occupancy, pos);
+
+  ensure_lines (occupancy, line + height);
+
+  for (guint i = 0; i < height; i++)
+    {
+      guint64 *words = get_line_words (occupancy, line + i);
+
+      for (guint j = column; j < column + width; j++)
+        words[j / BITS_PER_WORD] &= ~((guint64) 1 << (j % BITS_PER_WORD));
+    }
 }
 
 static guint
-allocate_small_cell (GArray        *array,
-                     guint          n_cols,
+allocate_small_cell (Occupancy     *occupancy,
                      guint          pos,
                      guint          cell_width,
                      guint          spacing,
@@ -195,31 +406,29 @@ allocate_small_cell (GArray        *array,
   request->width = cell_width;
   request->height = cell_width;
 
-  set_position (request, n_cols, pos, cell_width, spacing);
-  mark_occupied_slot (array, pos);
+  set_position (request, occupancy, pos, cell_width, spacing);
+  mark_occupied_slots (occupancy, pos, 1, 1);
 
   DEBUG (g_print ("1-Cell[%u (column %u of %u, line %u)] = { %d, %d - %d x %d }, next: %u\n",
-                  pos, get_column (n_cols, pos), n_cols, get_line (n_cols, pos),
+                  pos, get_column (occupancy, pos), occupancy->n_cols, get_line (occupancy, pos),
                   request->x,
                   request->y,
                   request->width,
                   request->height,
-                  get_next_free_slot (array, pos, n_cols)));
+                  get_next_free_slot (occupancy, pos)));
 
-  return get_next_free_slot (array, pos, n_cols);
+  return get_next_free_slot (occupancy, pos);
 }
 
 static guint
-allocate_medium_cell (GArray         *array,
-                      guint           n_cols,
+allocate_medium_cell (Occupancy      *occupancy,
                       guint           pos,
                       guint           cell_width,
                       guint           spacing,
                       GtkOrientation  orientation,
                       GtkAllocation  *request)
 {
-  guint check_pos = pos;
-  guint check_column = get_column (n_cols, check_pos);
+  guint check_pos;
 
   switch (orientation)
     {
@@ -227,51 +436,36 @@ allocate_medium_cell (GArray         *array,
       request->width = 2 * cell_width + spacing;
       request->height = cell_width;
 
-      /* two adjacent cells on the same line must be free */
-      while (!(check_column < (n_cols - 1) && check_free_slot (array, check_pos + 1, n_cols)))
-        {
-          check_pos += 1;
-          check_pos = get_next_free_slot (array, check_pos, n_cols);
-          check_column = get_column (n_cols, check_pos);
-        }
+      check_pos = find_slot (occupancy, pos, EOS_FLEXY_SHAPE_MEDIUM_HORIZONTAL);
 
-      set_position (request, n_cols, check_pos, cell_width, spacing);
-      mark_occupied_slot (array, check_pos);
-      mark_occupied_slot (array, check_pos + 1);
+      set_position (request, occupancy, check_pos, cell_width, spacing);
+      mark_occupied_slots (occupancy, check_pos, 2, 1);
       break;
 
     case GTK_ORIENTATION_VERTICAL:
       request->width = cell_width;
       request->height = 2 * cell_width + spacing;
 
-      /* two adjacent cells on the same column must be free */
-      while (!check_free_slot (array, check_pos + n_cols, n_cols))
-        {
-          check_pos += 1;
-          check_pos = get_next_free_slot (array, check_pos, n_cols);
-          check_column = get_column (n_cols, check_pos);
-        }
+      check_pos = find_slot (occupancy, pos, EOS_FLEXY_SHAPE_MEDIUM_VERTICAL);
 
-      set_position (request, n_cols, check_pos, cell_width, spacing);
-      mark_occupied_slot (array, check_pos);
-      mark_occupied_slot (array, check_pos + n_cols);
+      set_position (request, occupancy, check_pos, cell_width, spacing);
+      mark_occupied_slots (occupancy, check_pos, 1, 2);
       break;
     }
 
   DEBUG (g_print ("2-Cell[%u (column %u of %u, line %u)] = { %d, %d - %d x %d }, next: %u\n",
-                  pos, get_column (n_cols, pos), n_cols, get_line (n_cols, pos),
+                  pos, get_column (occupancy, pos), occupancy->n_cols, get_line (occupancy, pos),
                   request->x,
                   request->y,
                   request->width,
                   request->height,
-                  get_next_free_slot (array, pos, n_cols)));
+                  get_next_free_slot (occupancy, pos)));
 
-  return get_next_free_slot (array, pos, n_cols);
+  return get_next_free_slot (occupancy, pos);
 }
 
 static guint
-allocate_large_cell (GArray        *array,
-                     guint          n_cols,
+allocate_large_cell (Occupancy     *occupancy,
                      guint          pos,
                      guint          cell_width,
                      guint          spacing,
@@ -280,112 +474,806 @@ allocate_large_cell (GArray        *array,
   request->width = 2 * cell_width + spacing;
   request->height = 2 * cell_width + spacing;
 
-  guint check_pos = pos;
-  guint check_column = get_column (n_cols, check_pos);
+  guint check_pos = find_slot (occupancy, pos, EOS_FLEXY_SHAPE_LARGE);
+
+  set_position (request, occupancy, check_pos, cell_width, spacing);
+  mark_occupied_slots (occupancy, check_pos, 2, 2);
+
+  DEBUG (g_print ("4-Cell[%u (column %u of %u, line %u)] = { %d, %d - %d x %d }, next: %u\n",
+                  pos, get_column (occupancy, pos), occupancy->n_cols, get_line (occupancy, pos),
+                  request->x,
+                  request->y,
+                  request->width,
+                  request->height,
+                  get_next_free_slot (occupancy, pos)));
+
+  return get_next_free_slot (occupancy, pos);
+}
+
+/* The placement of the cells only depends on their shapes and on the
+ * number of columns, so it is cached between size negotiations, which
+ * measure the height for a width and then allocate that width; the last
+ * few layouts are kept, since the grid may be measured at several widths.
+ *
+ * Changing a cell only invalidates the placement of the cells after it.
+ * The placement resumes from the last cell whose placement is still
+ * valid, or from a checkpoint of the occupancy before it; all the slots
+ * before the current position are occupied, so a checkpoint only needs
+ * the lines from there on.
+ *
+ * The layout also records the cell occupying each slot, so finding the
+ * cells at a point or in a rectangle does not need to go through all of
+ * them. The slots that are free after placing the cells again may still
+ * name a previous occupant, so the position of the cell is checked too.
+ */
+#define CHECKPOINT_INTERVAL     64
+#define MAX_CHECKPOINT_LINES    64
+
+typedef struct {
+  guint n_cells;
+  guint current_pos;
+  guint last_slot[N_SHAPES];
+  int max_height;
+
+  /* The occupancy of the lines from first_line */
+  guint first_line;
+  GArray *words;
+} LayoutCheckpoint;
+
+struct _Layout {
+  guint n_columns;
+  int cell_width;
+  int spacing;
+
+  /* The placement of the first requests->len cells */
+  GArray *requests;
+  GArray *checkpoints;
+
+  /* The index of the cell in each slot, plus one, or 0 */
+  GArray *owners;
+
+  /* The state after placing the first n_placed cells */
+  Occupancy occupancy;
+  guint n_placed;
+  guint current_pos;
+  int max_height;
+};
+
+static void
+layout_checkpoint_clear (gpointer data)
+{
+  LayoutCheckpoint *checkpoint = data;
+
+  g_clear_pointer (&checkpoint->words, g_array_unref);
+}
+
+static Layout *
+layout_new (guint n_columns,
+            int   cell_width,
+            int   spacing)
+{
+  Layout *layout = g_slice_new0 (Layout);
+
+  layout->n_columns = n_columns;
+  layout->cell_width = cell_width;
+  layout->spacing = spacing;
+  layout->requests = g_array_new (FALSE, FALSE, sizeof (GtkAllocation));
+  layout->checkpoints = g_array_new (FALSE, FALSE, sizeof (LayoutCheckpoint));
+  g_array_set_clear_func (layout->checkpoints, layout_checkpoint_clear);
+  layout->owners = g_array_new (FALSE, TRUE, sizeof (guint));
+  layout->max_height = cell_width;
+
+  occupancy_init (&layout->occupancy, n_columns);
+
+  return layout;
+}
+
+static void
+layout_free (Layout *layout)
+{
+  if (layout == NULL)
+    return;
+
+  occupancy_clear (&layout->occupancy);
+  g_array_unref (layout->requests);
+  g_array_unref (layout->checkpoints);
+  g_array_unref (layout->owners);
+
+  g_slice_free (Layout, layout);
+}
+
+/* Forgets the placement of the cells from @index */
+static void
+layout_invalidate_from (Layout *layout,
+                        guint   index)
+{
+  if (index < layout->requests->len)
+    g_array_set_size (layout->requests, index);
+}
+
+static void
+layout_add_checkpoint (Layout *layout)
+{
+  Occupancy *occupancy = &layout->occupancy;
+  guint first_line = get_line (occupancy, layout->current_pos);
+  guint n_checkpoints = layout->checkpoints->len;
+
+  /* Placing the cells again from a checkpoint passes by it */
+  if (n_checkpoints > 0 &&
+      g_array_index (layout->checkpoints, LayoutCheckpoint, n_checkpoints - 1).n_cells == layout->n_placed)
+    return;
+
+  if (occupancy->n_lines - first_line > MAX_CHECKPOINT_LINES)
+    return;
+
+  LayoutCheckpoint checkpoint = {
+    .n_cells = layout->n_placed,
+    .current_pos = layout->current_pos,
+    .max_height = layout->max_height,
+    .first_line = first_line,
+    .words = g_array_new (FALSE, FALSE, sizeof (guint64)),
+  };
+
+  memcpy (checkpoint.last_slot, occupancy->last_slot, sizeof (checkpoint.last_slot));
+  g_array_append_vals (checkpoint.words,
+                       get_line_words (occupancy, first_line),
+                       (occupancy->n_lines - first_line) * occupancy->words_per_line);
+
+  g_array_append_val (layout->checkpoints, checkpoint);
+}
+
+/* Rewinds the placement to the last checkpoint before the first cell
+ * that has to be placed again
+ */
+static void
+layout_rewind (Layout *layout)
+{
+  Occupancy *occupancy = &layout->occupancy;
+  guint n_valid = layout->requests->len;
+  int i;
+
+  for (i = layout->checkpoints->len - 1; i >= 0; i--)
+    if (g_array_index (layout->checkpoints, LayoutCheckpoint, i).n_cells <= n_valid)
+      break;
+
+  g_array_set_size (layout->checkpoints, i + 1);
+
+  if (i < 0)
+    {
+      DEBUG (g_print ("Placing all the cells again\n"));
+
+      occupancy_clear (occupancy);
+      occupancy_init (occupancy, layout->n_columns);
+
+      g_array_set_size (layout->requests, 0);
+      g_array_set_size (layout->owners, 0);
+      layout->n_placed = 0;
+      layout->current_pos = 0;
+      layout->max_height = layout->cell_width;
+      return;
+    }
+
+  const LayoutCheckpoint *checkpoint = &g_array_index (layout->checkpoints, LayoutCheckpoint, i);
+  guint n_lines = checkpoint->first_line + checkpoint->words->len / occupancy->words_per_line;
+
+  DEBUG (g_print ("Placing the cells again from %u\n", checkpoint->n_cells));
+
+  /* The lines before the checkpoint are completely occupied */
+  g_array_set_size (occupancy->words, n_lines * occupancy->words_per_line);
+  memset (occupancy->words->data, 0,
+          checkpoint->first_line * occupancy->words_per_line * sizeof (guint64));
+  memcpy (get_line_words (occupancy, checkpoint->first_line),
+          checkpoint->words->data,
+          checkpoint->words->len * sizeof (guint64));
+  occupancy->n_lines = n_lines;
+  memcpy (occupancy->last_slot, checkpoint->last_slot, sizeof (occupancy->last_slot));
+
+  g_array_set_size (layout->requests, checkpoint->n_cells);
+  layout->n_placed = checkpoint->n_cells;
+  layout->current_pos = checkpoint->current_pos;
+  layout->max_height = checkpoint->max_height;
+}
+
+/* Records the cell at @index as the occupant of the slots of @request */
+static void
+layout_set_owner (Layout              *layout,
+                  const GtkAllocation *request,
+                  guint                index)
+{
+  int pitch = layout->cell_width + layout->spacing;
+  guint line = request->y / pitch;
+  guint column = request->x / pitch;
+  guint n_lines = (request->height + layout->spacing) / pitch;
+  guint n_cols = (request->width + layout->spacing) / pitch;
+  guint end = (line + n_lines) * layout->n_columns;
+
+  if (layout->owners->len < end)
+    g_array_set_size (layout->owners, end);
+
+  for (guint i = line; i < line + n_lines; i++)
+    for (guint j = column; j < column + n_cols; j++)
+      g_array_index (layout->owners, guint, i * layout->n_columns + j) = index + 1;
+}
+
+/* Returns the placement of the cell occupying the slot at @line and
+ * @column, or %NULL if the slot is free
+ */
+static const GtkAllocation *
+layout_get_owner (Layout *layout,
+                  guint   line,
+                  guint   column,
+                  guint  *index)
+{
+  int pitch = layout->cell_width + layout->spacing;
+  guint slot = line * layout->n_columns + column;
+
+  if (column >= layout->n_columns || slot >= layout->owners->len)
+    return NULL;
+
+  guint owner = g_array_index (layout->owners, guint, slot);
+  if (owner == 0 || owner > layout->requests->len)
+    return NULL;
+
+  const GtkAllocation *request = &g_array_index (layout->requests, GtkAllocation, owner - 1);
+  guint first_line = request->y / pitch;
+  guint first_column = request->x / pitch;
+
+  /* A previous occupant of a slot that is now free */
+  if (line < first_line || line >= first_line + (request->height + layout->spacing) / pitch ||
+      column < first_column || column >= first_column + (request->width + layout->spacing) / pitch)
+    return NULL;
+
+  *index = owner - 1;
+
+  return request;
+}
+
+/* Returns the index of the cell at @x and @y, if any */
+static gboolean
+layout_get_cell_at (Layout *layout,
+                    double  x,
+                    double  y,
+                    guint  *index)
+{
+  int pitch = layout->cell_width + layout->spacing;
+
+  if (x < 0 || y < 0)
+    return FALSE;
+
+  const GtkAllocation *request = layout_get_owner (layout, y / pitch, x / pitch, index);
+
+  /* The point may be in the spacing around the cell */
+  return request != NULL &&
+         x >= request->x && x < request->x + request->width &&
+         y >= request->y && y < request->y + request->height;
+}
+
+/* Adds the indices of the cells in the slots intersecting @rect */
+static void
+layout_get_cells_in_rect (Layout             *layout,
+                          const GdkRectangle *rect,
+                          GArray             *indices)
+{
+  int pitch = layout->cell_width + layout->spacing;
+  int x_start = MAX (rect->x, 0);
+  int y_start = MAX (rect->y, 0);
+  int x_end = rect->x + rect->width;
+  int y_end = rect->y + rect->height;
+
+  if (x_end <= x_start || y_end <= y_start || layout->owners->len == 0)
+    return;
+
+  guint first_column = x_start / pitch;
+  guint last_column = MIN ((guint) (x_end - 1) / pitch, layout->n_columns - 1);
+  guint first_line = y_start / pitch;
+  guint last_line = MIN ((guint) (y_end - 1) / pitch,
+                         layout->owners->len / layout->n_columns - 1);
+
+  for (guint line = first_line; line <= last_line; line++)
+    for (guint column = first_column; column <= last_column; column++)
+      {
+        guint index;
+        const GtkAllocation *request = layout_get_owner (layout, line, column, &index);
+
+        if (request == NULL)
+          continue;
+
+        /* Each cell is added once, from its first slot in @rect */
+        if (line != MAX ((guint) request->y / pitch, first_line) ||
+            column != MAX ((guint) request->x / pitch, first_column))
+          continue;
+
+        g_array_append_val (indices, index);
+      }
+}
+
+/* Places a cell of @shape after the cells already placed */
+static void
+layout_place_cell (Layout        *layout,
+                   EosFlexyShape  shape)
+{
+  guint real_width = layout->cell_width;
+  guint spacing = layout->spacing;
+  GtkAllocation request = { 0, };
+
+  if (layout->n_placed % CHECKPOINT_INTERVAL == 0)
+    layout_add_checkpoint (layout);
+
+  switch (shape)
+    {
+    case EOS_FLEXY_SHAPE_SMALL:
+      layout->current_pos = allocate_small_cell (&layout->occupancy,
+                                                 layout->current_pos,
+                                                 real_width, spacing,
+                                                 &request);
+      break;
+
+    case EOS_FLEXY_SHAPE_MEDIUM_HORIZONTAL:
+      layout->current_pos = allocate_medium_cell (&layout->occupancy,
+                                                  layout->current_pos,
+                                                  real_width, spacing,
+                                                  GTK_ORIENTATION_HORIZONTAL,
+                                                  &request);
+      break;
+
+    case EOS_FLEXY_SHAPE_MEDIUM_VERTICAL:
+      layout->current_pos = allocate_medium_cell (&layout->occupancy,
+                                                  layout->current_pos,
+                                                  real_width, spacing,
+                                                  GTK_ORIENTATION_VERTICAL,
+                                                  &request);
+      break;
+
+    case EOS_FLEXY_SHAPE_LARGE:
+      layout->current_pos = allocate_large_cell (&layout->occupancy,
+                                                 layout->current_pos,
+                                                 real_width, spacing,
+                                                 &request);
+      break;
+    }
+
+  layout->max_height = MAX (layout->max_height, request.y + request.height + (int) spacing);
+
+  layout_set_owner (layout, &request, layout->n_placed);
+  g_array_append_val (layout->requests, request);
+  layout->n_placed += 1;
+}
+
+/* Places the first @n_cells cells, if their placement is not known */
+static void
+layout_update (Layout    *layout,
+               GSequence *children,
+               guint      n_cells)
+{
+  if (layout->requests->len < layout->n_placed)
+    layout_rewind (layout);
+
+  GSequenceIter *iter;
+  for (iter = g_sequence_get_iter_at_pos (children, layout->n_placed);
+       !g_sequence_iter_is_end (iter) && layout->n_placed < n_cells;
+       iter = g_sequence_iter_next (iter))
+    layout_place_cell (layout, eos_flexy_grid_cell_get_shape (g_sequence_get (iter)));
+}
+
+/* Places the first @n_items items of a model, if their placement is not
+ * known
+ */
+static void
+layout_update_shapes (Layout *layout,
+                      GArray *shapes,
+                      guint   n_items)
+{
+  if (layout->requests->len < layout->n_placed)
+    layout_rewind (layout);
+
+  for (guint i = layout->n_placed; i < shapes->len && i < n_items; i++)
+    layout_place_cell (layout, g_array_index (shapes, guint8, i));
+}
+
+/* Returns the layout for @n_columns, creating it if needed */
+static Layout *
+get_layout (EosFlexyGrid *grid,
+            guint         n_columns,
+            int           cell_width,
+            int           spacing)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  Layout *layout = NULL;
+  int i;
+
+  for (i = 0; i < N_CACHED_LAYOUTS; i++)
+    {
+      layout = priv->layouts[i];
+
+      if (layout != NULL &&
+          layout->n_columns == n_columns &&
+          layout->cell_width == cell_width &&
+          layout->spacing == spacing)
+        break;
+    }
+
+  if (i == N_CACHED_LAYOUTS)
+    {
+      /* Replaces the least recently used layout */
+      i = N_CACHED_LAYOUTS - 1;
+
+      if (priv->layouts[i] == priv->allocated_layout)
+        priv->allocated_layout = NULL;
+
+      layout_free (priv->layouts[i]);
+      layout = layout_new (n_columns, cell_width, spacing);
+    }
+
+  /* Keeps the most recently used layout first */
+  for (; i > 0; i--)
+    priv->layouts[i] = priv->layouts[i - 1];
+
+  priv->layouts[0] = layout;
+
+  return layout;
+}
+
+static void
+invalidate_layouts_from (EosFlexyGrid *grid,
+                         guint         index)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  /* The cells keep their allocation until the next one */
+  priv->allocated_layout = NULL;
+
+  if (priv->freeze_count > 0)
+    {
+      priv->frozen_from = MIN (priv->frozen_from, index);
+      return;
+    }
+
+  for (int i = 0; i < N_CACHED_LAYOUTS; i++)
+    if (priv->layouts[i] != NULL)
+      layout_invalidate_from (priv->layouts[i], index);
+}
+
+static void
+clear_layouts (EosFlexyGrid *grid)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  priv->allocated_layout = NULL;
+
+  for (int i = 0; i < N_CACHED_LAYOUTS; i++)
+    g_clear_pointer (&priv->layouts[i], layout_free);
+}
+
+static void
+allocate_cell (EosFlexyGridCell    *cell,
+               const GtkAllocation *request,
+               int                  available_width)
+{
+  GtkAllocation allocation = *request;
+  GtkTextDirection text_dir = gtk_widget_get_direction (GTK_WIDGET (cell));
+
+  /* Flip horizontal allocation for RTL */
+  if (text_dir == GTK_TEXT_DIR_RTL)
+    allocation.x = available_width - allocation.x - allocation.width;
+
+  gtk_widget_size_allocate (GTK_WIDGET (cell), &allocation);
+}
+
+/* Returns the cell of the item at @index, or %NULL if the item of the
+ * bound model has no cell
+ */
+static EosFlexyGridCell *
+get_cell_at_index (EosFlexyGrid *grid,
+                   guint         index)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  if (priv->model != NULL)
+    return g_hash_table_lookup (priv->bound_cells, GUINT_TO_POINTER (index));
+
+  return g_sequence_get (g_sequence_get_iter_at_pos (priv->children, index));
+}
+
+static void
+unset_cell_state (EosFlexyGrid     *grid,
+                  EosFlexyGridCell *cell)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  if (cell == priv->prelight_cell)
+    {
+      gtk_widget_unset_state_flags (GTK_WIDGET (priv->prelight_cell),
+                                    GTK_STATE_FLAG_PRELIGHT);
+      priv->prelight_cell = NULL;
+    }
+
+  if (cell == priv->active_cell)
+    {
+      gtk_widget_unset_state_flags (GTK_WIDGET (priv->active_cell),
+                                    GTK_STATE_FLAG_ACTIVE);
+      priv->active_cell = NULL;
+    }
+}
+
+/* Hides @cell, until it shows another item of the model */
+static void
+recycle_cell (EosFlexyGrid     *grid,
+              EosFlexyGridCell *cell)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  unset_cell_state (grid, cell);
+  gtk_widget_set_child_visible (GTK_WIDGET (cell), FALSE);
+
+  g_ptr_array_add (priv->free_cells, cell);
+}
+
+/* Recycles the cells of the items from @index on */
+static void
+recycle_cells_from (EosFlexyGrid *grid,
+                    guint         index)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, priv->bound_cells);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (GPOINTER_TO_UINT (key) < index)
+        continue;
+
+      recycle_cell (grid, value);
+      g_hash_table_iter_remove (&iter);
+    }
+}
+
+/* Returns a cell showing the item of the model at @index */
+static EosFlexyGridCell *
+bind_cell (EosFlexyGrid *grid,
+           guint         index)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  EosFlexyGridCell *cell;
+
+  if (priv->free_cells->len > 0)
+    cell = g_ptr_array_remove_index_fast (priv->free_cells, priv->free_cells->len - 1);
+  else
+    {
+      cell = EOS_FLEXY_GRID_CELL (eos_flexy_grid_cell_new ());
+      eos_flexy_grid_cell_set_iter (cell, g_sequence_append (priv->children, cell));
+
+      gtk_widget_set_parent (GTK_WIDGET (cell), GTK_WIDGET (grid));
+      gtk_widget_show (GTK_WIDGET (cell));
+    }
+
+  gpointer item = g_list_model_get_item (priv->model, index);
+
+  eos_flexy_grid_cell_set_shape (cell, g_array_index (priv->shapes, guint8, index));
+  priv->bind_func (cell, item, priv->bind_data);
+
+  g_object_unref (item);
+
+  gtk_widget_set_child_visible (GTK_WIDGET (cell), TRUE);
+  g_hash_table_insert (priv->bound_cells, GUINT_TO_POINTER (index), cell);
+
+  return cell;
+}
+
+/* Returns the area of @grid in the viewport of the enclosing scrolled
+ * window, or all of @grid if there is none
+ */
+static void
+get_visible_area (EosFlexyGrid *grid,
+                  GdkRectangle *area)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  GtkWidget *scrolled = gtk_widget_get_ancestor (GTK_WIDGET (grid), GTK_TYPE_SCROLLED_WINDOW);
+
+  area->x = 0;
+  area->width = priv->allocated_width;
+
+  if (scrolled == NULL || priv->vadjustment == NULL)
+    {
+      area->y = 0;
+      area->height = gtk_widget_get_allocated_height (GTK_WIDGET (grid));
+      return;
+    }
+
+  GtkWidget *view = gtk_bin_get_child (GTK_BIN (scrolled));
+  int x, y;
+
+  area->height = gtk_adjustment_get_page_size (priv->vadjustment);
+
+  /* Until it is realized, @grid is assumed to be at the top */
+  if (view != NULL && gtk_widget_get_realized (GTK_WIDGET (grid)) &&
+      gtk_widget_translate_coordinates (GTK_WIDGET (grid), view, 0, 0, &x, &y))
+    area->y = -y;
+  else
+    area->y = gtk_adjustment_get_value (priv->vadjustment);
+}
+
+static void
+on_vadjustment_changed (GtkAdjustment *adjustment,
+                        EosFlexyGrid  *grid)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  GdkRectangle area;
+
+  /* The cells will be bound on the next allocation anyway */
+  if (priv->allocated_layout == NULL)
+    return;
+
+  get_visible_area (grid, &area);
+
+  if (area.y < priv->bound_area.y ||
+      area.y + area.height > priv->bound_area.y + priv->bound_area.height)
+    gtk_widget_queue_allocate (GTK_WIDGET (grid));
+}
+
+static void
+set_vadjustment (EosFlexyGrid  *grid,
+                 GtkAdjustment *adjustment)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  if (priv->vadjustment == adjustment)
+    return;
+
+  if (priv->vadjustment != NULL)
+    g_signal_handlers_disconnect_by_func (priv->vadjustment, on_vadjustment_changed, grid);
+
+  g_set_object (&priv->vadjustment, adjustment);
+
+  if (adjustment != NULL)
+    {
+      g_signal_connect (adjustment, "value-changed", G_CALLBACK (on_vadjustment_changed), grid);
+      g_signal_connect (adjustment, "changed", G_CALLBACK (on_vadjustment_changed), grid);
+    }
+}
+
+/* Binds cells to the items around the visible area, and allocates them;
+ * the area extends by a page on each side, so that scrolling does not
+ * need to bind cells on every frame
+ */
+/* Binds the items before @n_items that are close to the visible area */
+static void
+bind_visible_cells (EosFlexyGrid *grid,
+                    Layout       *layout,
+                    int           available_width,
+                    guint         n_items)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  GtkWidget *scrolled = gtk_widget_get_ancestor (GTK_WIDGET (grid), GTK_TYPE_SCROLLED_WINDOW);
+  GdkRectangle area;
+
+  set_vadjustment (grid,
+                   scrolled != NULL
+                   ? gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scrolled))
+                   : NULL);
+
+  priv->allocated_width = available_width;
+  get_visible_area (grid, &area);
+
+  area.y -= area.height;
+  area.height *= 3;
+  priv->bound_area = area;
+
+  g_autoptr(GArray) indices = g_array_new (FALSE, FALSE, sizeof (guint));
+  layout_get_cells_in_rect (layout, &area, indices);
 
-  while (!(check_column < (n_cols - 1) &&
-           check_free_slot (array, check_pos + n_cols, n_cols) &&
-           check_free_slot (array, check_pos + 1, n_cols) &&
-           check_free_slot (array, check_pos + n_cols + 1, n_cols)))
+  for (guint i = indices->len; i > 0; i--)
+    if (g_array_index (indices, guint, i - 1) >= n_items)
+      g_array_remove_index_fast (indices, i - 1);
+
+  /* Keeps the cells of the items that are still in the area */
+  GHashTable *bound_cells = g_hash_table_new (NULL, NULL);
+
+  for (guint i = 0; i < indices->len; i++)
     {
-      check_pos += 1;
-      check_pos = get_next_free_slot (array, check_pos, n_cols);
-      check_column = get_column (n_cols, check_pos);
+      gpointer key = GUINT_TO_POINTER (g_array_index (indices, guint, i));
+      gpointer cell = g_hash_table_lookup (priv->bound_cells, key);
+
+      if (cell != NULL)
+        {
+          g_hash_table_steal (priv->bound_cells, key);
+          g_hash_table_insert (bound_cells, key, cell);
+        }
     }
 
-  set_position (request, n_cols, check_pos, cell_width, spacing);
-  mark_occupied_slot (array, check_pos);
-  mark_occupied_slot (array, check_pos + 1);
-  mark_occupied_slot (array, check_pos + n_cols);
-  mark_occupied_slot (array, check_pos + n_cols + 1);
+  recycle_cells_from (grid, 0);
+  g_hash_table_unref (priv->bound_cells);
+  priv->bound_cells = bound_cells;
 
-  DEBUG (g_print ("4-Cell[%u (column %u of %u, line %u)] = { %d, %d - %d x %d }, next: %u\n",
-                  pos, get_column (n_cols, pos), n_cols, get_line (n_cols, pos),
-                  request->x,
-                  request->y,
-                  request->width,
-                  request->height,
-                  get_next_free_slot (array, pos, n_cols)));
+  for (guint i = 0; i < indices->len; i++)
+    {
+      guint index = g_array_index (indices, guint, i);
+      EosFlexyGridCell *cell = g_hash_table_lookup (bound_cells, GUINT_TO_POINTER (index));
+
+      if (cell == NULL)
+        cell = bind_cell (grid, index);
 
-  return get_next_free_slot (array, pos, n_cols);
+      allocate_cell (cell, &g_array_index (layout->requests, GtkAllocation, index), available_width);
+    }
 }
 
 static int
-distribute_layout (GSequence *children,
-                   int        available_width,
-                   int        cell_width,
-                   int        spacing,
-                   gboolean   allocate)
+distribute_layout (EosFlexyGrid *grid,
+                   int           available_width,
+                   int           cell_width,
+                   int           spacing,
+                   gboolean      allocate)
 {
+  g_autoptr(EosProfileProbe) probe =
+    EOS_PROFILE_PROBE (allocate
+                       ? "/com/endlessm/Sdk/flexy-grid/distribute-layout/allocate"
+                       : "/com/endlessm/Sdk/flexy-grid/distribute-layout/measure");
+
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  /* While the layout is frozen, only the cells before the first one that
+   * changed are placed; the cells after it keep their allocation, and the
+   * ones inserted in the meantime stay hidden, until the layout is thawed
+   */
+  gboolean frozen = priv->frozen_from != G_MAXUINT;
+  guint n_placed = priv->frozen_from;
+
+  if (frozen && !allocate)
+    return priv->layout_height;
+
   guint n_columns = MAX (available_width / (cell_width + spacing), 2);
-  guint real_width = cell_width;
-  GArray *array = g_array_new (FALSE, FALSE, sizeof (gboolean));
-  guint current_pos = 0;
-  int max_height = cell_width;
+  Layout *layout = get_layout (grid, n_columns, cell_width, spacing);
 
-  add_new_empty_line (array, n_columns);
+  if (priv->model != NULL)
+    layout_update_shapes (layout, priv->shapes, n_placed);
+  else
+    layout_update (layout, priv->children, n_placed);
 
-  GSequenceIter *iter;
-  for (iter = g_sequence_get_begin_iter (children);
-       !g_sequence_iter_is_end (iter);
-       iter = g_sequence_iter_next (iter))
+  if (allocate)
     {
-      EosFlexyGridCell *cell = g_sequence_get (iter);
-      EosFlexyShape shape = eos_flexy_grid_cell_get_shape (cell);
-      GtkAllocation request = { 0, };
-      GtkTextDirection text_dir = gtk_widget_get_direction (GTK_WIDGET (cell));
-
-      switch (shape)
+      if (priv->model != NULL)
+        bind_visible_cells (grid, layout, available_width, n_placed);
+      else
         {
-        case EOS_FLEXY_SHAPE_SMALL:
-          current_pos = allocate_small_cell (array,
-                                             n_columns, current_pos,
-                                             real_width, spacing,
-                                             &request);
-          break;
-
-        case EOS_FLEXY_SHAPE_MEDIUM_HORIZONTAL:
-          current_pos = allocate_medium_cell (array,
-                                              n_columns, current_pos,
-                                              real_width, spacing,
-                                              GTK_ORIENTATION_HORIZONTAL,
-                                              &request);
-          break;
-
-        case EOS_FLEXY_SHAPE_MEDIUM_VERTICAL:
-          current_pos = allocate_medium_cell (array,
-                                              n_columns, current_pos,
-                                              real_width, spacing,
-                                              GTK_ORIENTATION_VERTICAL,
-                                              &request);
-          break;
-
-        case EOS_FLEXY_SHAPE_LARGE:
-          current_pos = allocate_large_cell (array,
-                                             n_columns, current_pos,
-                                             real_width, spacing,
-                                             &request);
-          break;
+          GSequenceIter *iter;
+          guint i;
+
+          for (iter = g_sequence_get_begin_iter (priv->children), i = 0;
+               !g_sequence_iter_is_end (iter);
+               iter = g_sequence_iter_next (iter), i++)
+            {
+              gpointer cell = g_sequence_get (iter);
+
+              if (i < n_placed)
+                allocate_cell (cell,
+                               &g_array_index (layout->requests, GtkAllocation, i),
+                               available_width);
+              else if (gtk_widget_get_child_visible (cell))
+                {
+                  GtkAllocation allocation;
+
+                  gtk_widget_get_allocation (cell, &allocation);
+                  gtk_widget_size_allocate (cell, &allocation);
+                }
+            }
         }
 
-      max_height = MAX (max_height, request.y + request.height + spacing);
+      /* The placement of the cells that changed is not known yet */
+      if (frozen)
+        return priv->layout_height;
 
-      /* Flip horizontal allocation for RTL */
-      if (text_dir == GTK_TEXT_DIR_RTL)
-	request.x = available_width - request.x - request.width;
-
-      if (allocate)
-        gtk_widget_size_allocate (GTK_WIDGET (cell), &request);
+      priv->allocated_layout = layout;
+      priv->allocated_width = available_width;
     }
 
-  g_array_unref (array);
-
   DEBUG (g_print ("%s size: { %d x %d }\n",
                   allocate ? "Allocated" : "Preferred",
                   available_width,
-                  max_height));
+                  layout->max_height));
 
-  return max_height;
+  priv->layout_height = layout->max_height;
+
+  return layout->max_height;
 }
 
 static GtkSizeRequestMode
@@ -394,6 +1282,33 @@ eos_flexy_grid_get_request_mode (GtkWidget *widget)
   return GTK_SIZE_REQUEST_HEIGHT_FOR_WIDTH;
 }
 
+static int
+get_shape_width (EosFlexyShape shape,
+                 int           column_size)
+{
+  switch (shape)
+    {
+    case EOS_FLEXY_SHAPE_SMALL:
+      /* b1 */
+      return column_size;
+
+    case EOS_FLEXY_SHAPE_MEDIUM_HORIZONTAL:
+      /* b2h */
+      return column_size * 2;
+
+    case EOS_FLEXY_SHAPE_MEDIUM_VERTICAL:
+      /* b2v */
+      return column_size;
+
+    case EOS_FLEXY_SHAPE_LARGE:
+      /* b4 */
+      return column_size * 2;
+    }
+
+  g_assert_not_reached ();
+  return 0;
+}
+
 static void
 eos_flexy_grid_get_preferred_width (GtkWidget *widget,
                                     gint      *minimum_width_out,
@@ -410,39 +1325,24 @@ eos_flexy_grid_get_preferred_width (GtkWidget *widget,
   int width = 0;
 
   /* natural width: the maximum width of all the cells on a single row */
-  GSequenceIter *iter;
-  for (iter = g_sequence_get_begin_iter (priv->children);
-       !g_sequence_iter_is_end (iter);
-       iter = g_sequence_iter_next (iter))
+  if (priv->model != NULL)
     {
-      EosFlexyGridCell *cell = g_sequence_get (iter);
-
-      if (!gtk_widget_get_visible (GTK_WIDGET (cell)))
-        continue;
+      for (guint i = 0; i < priv->shapes->len; i++)
+        width += get_shape_width (g_array_index (priv->shapes, guint8, i), target_column_size);
+    }
+  else
+    {
+      GSequenceIter *iter;
+      for (iter = g_sequence_get_begin_iter (priv->children);
+           !g_sequence_iter_is_end (iter);
+           iter = g_sequence_iter_next (iter))
+        {
+          EosFlexyGridCell *cell = g_sequence_get (iter);
 
-      EosFlexyShape cell_shape = eos_flexy_grid_cell_get_shape (cell);
+          if (!gtk_widget_get_visible (GTK_WIDGET (cell)))
+            continue;
 
-      switch (cell_shape)
-        {
-        case EOS_FLEXY_SHAPE_SMALL:
-          /* b1 */
-          width += target_column_size;
-          break;
-
-        case EOS_FLEXY_SHAPE_MEDIUM_HORIZONTAL:
-          /* b2h */
-          width += target_column_size * 2;
-          break;
-
-        case EOS_FLEXY_SHAPE_MEDIUM_VERTICAL:
-          /* b2v */
-          width += target_column_size;
-          break;
-
-        case EOS_FLEXY_SHAPE_LARGE:
-          /* b4 */
-          width += target_column_size * 2;
-          break;
+          width += get_shape_width (eos_flexy_grid_cell_get_shape (cell), target_column_size);
         }
     }
 
@@ -475,7 +1375,7 @@ eos_flexy_grid_get_preferred_height_for_width (GtkWidget *widget,
   int cell_spacing = priv->cell_spacing < 0 ? DEFAULT_SPACING : priv->cell_spacing;
   int layout_height;
 
-  layout_height = distribute_layout (priv->children, for_width, cell_size, cell_spacing, FALSE);
+  layout_height = distribute_layout (EOS_FLEXY_GRID (widget), for_width, cell_size, cell_spacing, FALSE);
 
   if (minimum_height_out)
     *minimum_height_out = layout_height;
@@ -515,7 +1415,7 @@ eos_flexy_grid_size_allocate (GtkWidget     *widget,
   int cell_spacing = priv->cell_spacing < 0 ? DEFAULT_SPACING : priv->cell_spacing;
   int available_width = allocation->width;
 
-  distribute_layout (priv->children, available_width, cell_size, cell_spacing, TRUE);
+  distribute_layout (EOS_FLEXY_GRID (widget), available_width, cell_size, cell_spacing, TRUE);
 }
 
 static void
@@ -560,7 +1460,30 @@ eos_flexy_grid_draw (GtkWidget *widget,
   gtk_render_background (context, cr, 0, 0, allocation.width, allocation.height);
   gtk_render_frame (context, cr, 0, 0, allocation.width, allocation.height);
 
-  GTK_WIDGET_CLASS (eos_flexy_grid_parent_class)->draw (widget, cr);
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (EOS_FLEXY_GRID (widget));
+  GdkRectangle clip;
+
+  if (priv->allocated_layout == NULL || !gdk_cairo_get_clip_rectangle (cr, &clip))
+    {
+      GTK_WIDGET_CLASS (eos_flexy_grid_parent_class)->draw (widget, cr);
+      return TRUE;
+    }
+
+  /* Only draws the cells in the area to redraw */
+  if (gtk_widget_get_direction (widget) == GTK_TEXT_DIR_RTL)
+    clip.x = priv->allocated_width - clip.x - clip.width;
+
+  g_autoptr(GArray) indices = g_array_new (FALSE, FALSE, sizeof (guint));
+  layout_get_cells_in_rect (priv->allocated_layout, &clip, indices);
+
+  for (guint i = 0; i < indices->len; i++)
+    {
+      guint index = g_array_index (indices, guint, i);
+      EosFlexyGridCell *cell = get_cell_at_index (EOS_FLEXY_GRID (widget), index);
+
+      if (cell != NULL)
+        gtk_container_propagate_draw (GTK_CONTAINER (widget), GTK_WIDGET (cell), cr);
+    }
 
   return TRUE;
 }
@@ -572,6 +1495,14 @@ eos_flexy_grid_add (GtkContainer *container,
   eos_flexy_grid_insert (EOS_FLEXY_GRID (container), child, -1);
 }
 
+static gboolean
+is_cell (gpointer key,
+         gpointer value,
+         gpointer data)
+{
+  return value == data;
+}
+
 static void
 eos_flexy_grid_remove (GtkContainer *container,
                        GtkWidget    *widget)
@@ -594,19 +1525,16 @@ eos_flexy_grid_remove (GtkContainer *container,
 
   gboolean was_visible = gtk_widget_get_visible (widget);
 
-  if (cell == priv->prelight_cell)
-    {
-      gtk_widget_unset_state_flags (GTK_WIDGET (priv->prelight_cell),
-                                    GTK_STATE_FLAG_PRELIGHT);
-      priv->prelight_cell = NULL;
-    }
+  unset_cell_state (EOS_FLEXY_GRID (container), cell);
 
-  if (cell == priv->active_cell)
+  /* The item of the model keeps its place, and gets another cell */
+  if (priv->model != NULL)
     {
-      gtk_widget_unset_state_flags (GTK_WIDGET (priv->active_cell),
-                                    GTK_STATE_FLAG_ACTIVE);
-      priv->active_cell = NULL;
+      g_hash_table_foreach_remove (priv->bound_cells, is_cell, cell);
+      g_ptr_array_remove_fast (priv->free_cells, cell);
     }
+  else
+    invalidate_layouts_from (EOS_FLEXY_GRID (container), g_sequence_iter_get_position (iter));
 
   gtk_widget_unparent (widget);
   g_sequence_remove (iter);
@@ -831,6 +1759,75 @@ eos_flexy_grid_get_property (GObject    *gobject,
     }
 }
 
+static void
+on_model_items_changed (GListModel   *model,
+                        guint         position,
+                        guint         removed,
+                        guint         added,
+                        EosFlexyGrid *grid)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  g_autoptr(GArray) shapes = g_array_sized_new (FALSE, FALSE, sizeof (guint8), added);
+
+  for (guint i = 0; i < added; i++)
+    {
+      gpointer item = g_list_model_get_item (model, position + i);
+      guint8 shape = EOS_FLEXY_SHAPE_SMALL;
+
+      if (priv->shape_func != NULL)
+        shape = priv->shape_func (item, priv->bind_data);
+
+      g_array_append_val (shapes, shape);
+      g_object_unref (item);
+    }
+
+  if (removed > 0)
+    g_array_remove_range (priv->shapes, position, removed);
+
+  g_array_insert_vals (priv->shapes, position, shapes->data, added);
+
+  /* The items after @position moved, so they get their cells again */
+  recycle_cells_from (grid, position);
+  invalidate_layouts_from (grid, position);
+
+  gtk_widget_queue_resize (GTK_WIDGET (grid));
+}
+
+static void
+unbind_model (EosFlexyGrid *grid)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  if (priv->model == NULL)
+    return;
+
+  g_signal_handlers_disconnect_by_func (priv->model, on_model_items_changed, grid);
+  g_clear_object (&priv->model);
+
+  if (priv->bind_notify != NULL)
+    priv->bind_notify (priv->bind_data);
+
+  priv->shape_func = NULL;
+  priv->bind_func = NULL;
+  priv->bind_data = NULL;
+  priv->bind_notify = NULL;
+
+  /* The cells stay children of @grid, like the ones that were inserted */
+  g_array_set_size (priv->shapes, 0);
+  g_hash_table_remove_all (priv->bound_cells);
+  g_ptr_array_set_size (priv->free_cells, 0);
+  set_vadjustment (grid, NULL);
+  clear_layouts (grid);
+}
+
+static void
+eos_flexy_grid_dispose (GObject *gobject)
+{
+  unbind_model (EOS_FLEXY_GRID (gobject));
+
+  G_OBJECT_CLASS (eos_flexy_grid_parent_class)->dispose (gobject);
+}
+
 static void
 eos_flexy_grid_finalize (GObject *gobject)
 {
@@ -840,6 +1837,11 @@ eos_flexy_grid_finalize (GObject *gobject)
     priv->sort_notify (priv->sort_data);
 
   g_sequence_free (priv->children);
+  clear_layouts (EOS_FLEXY_GRID (gobject));
+
+  g_array_unref (priv->shapes);
+  g_hash_table_unref (priv->bound_cells);
+  g_ptr_array_unref (priv->free_cells);
 
   G_OBJECT_CLASS (eos_flexy_grid_parent_class)->finalize (gobject);
 }
@@ -848,6 +1850,7 @@ static void
 eos_flexy_grid_class_init (EosFlexyGridClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->dispose = eos_flexy_grid_dispose;
   gobject_class->finalize = eos_flexy_grid_finalize;
   gobject_class->set_property = eos_flexy_grid_set_property;
   gobject_class->get_property = eos_flexy_grid_get_property;
@@ -949,9 +1952,15 @@ eos_flexy_grid_class_init (EosFlexyGridClass *klass)
 static void
 eos_flexy_grid_init (EosFlexyGrid *self)
 {
+  eos_profile_census_construct (EOS_TYPE_FLEXY_GRID);
+
   EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (self);
 
   priv->children = g_sequence_new (NULL);
+  priv->frozen_from = G_MAXUINT;
+  priv->shapes = g_array_new (FALSE, FALSE, sizeof (guint8));
+  priv->bound_cells = g_hash_table_new (NULL, NULL);
+  priv->free_cells = g_ptr_array_new ();
 
   /* we use the same width as the discovery center layout */
   priv->cell_size = -1;
@@ -1019,6 +2028,68 @@ eos_flexy_grid_set_sort_func (EosFlexyGrid         *grid,
   priv->sort_notify = notify;
 }
 
+/**
+ * eos_flexy_grid_bind_model:
+ * @grid: a #EosFlexyGrid
+ * @model: (allow-none): the #GListModel to show, or %NULL to unbind the
+ *   current one
+ * @shape_func: (scope notified) (allow-none): a function returning the
+ *   shape of the cell of each item, or %NULL to make all the cells small
+ * @bind_func: (scope notified) (allow-none): a function filling a cell
+ *   with the contents of an item; it cannot be %NULL if @model is not
+ * @user_data: (closure): data to pass to @shape_func and @bind_func
+ * @user_data_free_func: function called when @model is unbound, or the
+ *   @grid widget is destroyed
+ *
+ * Binds @grid to @model, so that the cells of @grid show its items in
+ * the same order. The children of @grid are removed.
+ *
+ * The shape of the cell of every item is known, so the layout covers
+ * all the items of @model; but only the items in the visible area of
+ * the #GtkScrolledWindow containing @grid, and a page around it, have
+ * a cell. The cells of the items that are scrolled away are used for
+ * other items, so @bind_func can update the child of the cell it gets,
+ * if the cell already has one.
+ *
+ * The shape of an item is only requested when it is added to @model;
+ * if it changes, the item must be replaced, as with
+ * g_list_store_splice().
+ *
+ * While @grid is bound to a model, no cell can be added to it with
+ * eos_flexy_grid_insert(), and its sort function is not used.
+ *
+ * Since: 0.6
+ */
+void
+eos_flexy_grid_bind_model (EosFlexyGrid             *grid,
+                           GListModel               *model,
+                           EosFlexyGridShapeFunc     shape_func,
+                           EosFlexyGridBindCellFunc  bind_func,
+                           gpointer                  user_data,
+                           GDestroyNotify            user_data_free_func)
+{
+  g_return_if_fail (EOS_IS_FLEXY_GRID (grid));
+  g_return_if_fail (model == NULL || G_IS_LIST_MODEL (model));
+  g_return_if_fail (model == NULL || bind_func != NULL);
+
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  unbind_model (grid);
+  gtk_container_foreach (GTK_CONTAINER (grid), (GtkCallback) gtk_widget_destroy, NULL);
+
+  if (model == NULL)
+    return;
+
+  priv->model = g_object_ref (model);
+  priv->shape_func = shape_func;
+  priv->bind_func = bind_func;
+  priv->bind_data = user_data;
+  priv->bind_notify = user_data_free_func;
+
+  g_signal_connect (model, "items-changed", G_CALLBACK (on_model_items_changed), grid);
+  on_model_items_changed (model, 0, 0, g_list_model_get_n_items (model), grid);
+}
+
 /**
  * eos_flexy_grid_set_cell_size:
  * @grid: a #EosFlexyGrid
@@ -1129,6 +2200,20 @@ do_grid_sort (gconstpointer row_a,
                           priv->sort_data);
 }
 
+/* Returns @child, or a new cell containing it */
+static EosFlexyGridCell *
+ensure_cell (GtkWidget *child)
+{
+  if (EOS_IS_FLEXY_GRID_CELL (child))
+    return EOS_FLEXY_GRID_CELL (child);
+
+  GtkWidget *cell = eos_flexy_grid_cell_new ();
+  gtk_container_add (GTK_CONTAINER (cell), child);
+  gtk_widget_show (cell);
+
+  return EOS_FLEXY_GRID_CELL (cell);
+}
+
 /**
  * eos_flexy_grid_insert:
  * @grid: a #EosFlexyGrid
@@ -1145,6 +2230,9 @@ do_grid_sort (gconstpointer row_a,
  *
  * If @index_ is 0, the child is prepended at the beginning of the grid.
  *
+ * This function cannot be used while @grid is bound to a model with
+ * eos_flexy_grid_bind_model().
+ *
  * Deprecated: 0.2: Use a #GtkGrid instead
  */
 void
@@ -1155,18 +2243,10 @@ eos_flexy_grid_insert (EosFlexyGrid *grid,
   g_return_if_fail (EOS_IS_FLEXY_GRID (grid));
   g_return_if_fail (EOS_IS_FLEXY_GRID_CELL (child) || GTK_IS_WIDGET (child));
 
-  EosFlexyGridCell *cell;
-
-  if (EOS_IS_FLEXY_GRID_CELL (child))
-    cell = EOS_FLEXY_GRID_CELL (child);
-  else
-    {
-      cell = EOS_FLEXY_GRID_CELL (eos_flexy_grid_cell_new ());
-      gtk_container_add (GTK_CONTAINER (cell), child);
-      gtk_widget_show (GTK_WIDGET (cell));
-    }
-
   EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  g_return_if_fail (priv->model == NULL);
+
+  EosFlexyGridCell *cell = ensure_cell (child);
   GSequenceIter *iter;
 
   if (priv->sort_func != NULL)
@@ -1187,9 +2267,210 @@ eos_flexy_grid_insert (EosFlexyGrid *grid,
     }
 
   eos_flexy_grid_cell_set_iter (cell, iter);
+  invalidate_layouts_from (grid, g_sequence_iter_get_position (iter));
 
+  /* Cells inserted while the layout is frozen are shown once placed */
   gtk_widget_set_parent (GTK_WIDGET (cell), GTK_WIDGET (grid));
-  gtk_widget_set_child_visible (GTK_WIDGET (cell), TRUE);
+  gtk_widget_set_child_visible (GTK_WIDGET (cell), priv->freeze_count == 0);
+}
+
+static gint
+do_cells_sort (gconstpointer cell_a,
+               gconstpointer cell_b,
+               gpointer      data)
+{
+  return do_grid_sort (*(EosFlexyGridCell **) cell_a,
+                       *(EosFlexyGridCell **) cell_b,
+                       data);
+}
+
+/**
+ * eos_flexy_grid_insert_many:
+ * @grid: a #EosFlexyGrid
+ * @children: (array length=n_children): the #GtkWidget<!-- -->s to insert
+ * @n_children: the number of widgets in @children
+ * @index_: the position of the first of @children
+ *
+ * Inserts @children inside @grid, at the given @index_, like
+ * eos_flexy_grid_insert() does for each of them, but placing them in
+ * the layout at once.
+ *
+ * If @grid has a sort function, the @index_ is ignored; @children are
+ * sorted together, and then merged with the children of @grid, which
+ * takes fewer comparisons than inserting them one by one.
+ *
+ * If @index_ is less than 0, @children are appended at the end of the
+ * grid.
+ *
+ * Since: 0.6
+ */
+void
+eos_flexy_grid_insert_many (EosFlexyGrid  *grid,
+                            GtkWidget    **children,
+                            guint          n_children,
+                            gint           index_)
+{
+  g_return_if_fail (EOS_IS_FLEXY_GRID (grid));
+  g_return_if_fail (children != NULL || n_children == 0);
+
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  g_return_if_fail (priv->model == NULL);
+
+  if (n_children == 0)
+    return;
+
+  for (guint i = 0; i < n_children; i++)
+    g_return_if_fail (GTK_IS_WIDGET (children[i]));
+
+  g_autoptr(GPtrArray) cells = g_ptr_array_sized_new (n_children);
+  for (guint i = 0; i < n_children; i++)
+    g_ptr_array_add (cells, ensure_cell (children[i]));
+
+  guint first_position = 0;
+
+  if (priv->sort_func != NULL)
+    {
+      g_ptr_array_sort_with_data (cells, do_cells_sort, grid);
+
+      /* Both the children and @cells are sorted, so each cell goes after
+       * the previous one
+       */
+      GSequenceIter *iter = g_sequence_get_begin_iter (priv->children);
+
+      for (guint i = 0; i < cells->len; i++)
+        {
+          EosFlexyGridCell *cell = g_ptr_array_index (cells, i);
+
+          while (!g_sequence_iter_is_end (iter) &&
+                 do_grid_sort (g_sequence_get (iter), cell, grid) <= 0)
+            iter = g_sequence_iter_next (iter);
+
+          GSequenceIter *cell_iter = g_sequence_insert_before (iter, cell);
+          eos_flexy_grid_cell_set_iter (cell, cell_iter);
+
+          if (i == 0)
+            first_position = g_sequence_iter_get_position (cell_iter);
+        }
+    }
+  else
+    {
+      GSequenceIter *iter = index_ < 0
+                          ? g_sequence_get_end_iter (priv->children)
+                          : g_sequence_get_iter_at_pos (priv->children, index_);
+
+      first_position = g_sequence_iter_get_position (iter);
+
+      for (guint i = 0; i < cells->len; i++)
+        {
+          EosFlexyGridCell *cell = g_ptr_array_index (cells, i);
+
+          eos_flexy_grid_cell_set_iter (cell, g_sequence_insert_before (iter, cell));
+        }
+    }
+
+  invalidate_layouts_from (grid, first_position);
+
+  for (guint i = 0; i < cells->len; i++)
+    {
+      GtkWidget *cell = g_ptr_array_index (cells, i);
+
+      gtk_widget_set_parent (cell, GTK_WIDGET (grid));
+      gtk_widget_set_child_visible (cell, priv->freeze_count == 0);
+    }
+}
+
+/**
+ * eos_flexy_grid_freeze_layout:
+ * @grid: a #EosFlexyGrid
+ *
+ * Stops @grid from placing its cells when they are added, removed, or
+ * change shape, until eos_flexy_grid_thaw_layout() is called; then, all
+ * the changes are placed at once.
+ *
+ * While the layout is frozen, @grid keeps its size, and the cells keep
+ * their allocation; the cells added in the meantime are not shown until
+ * they are placed.
+ *
+ * Calls to this function can be nested, and each one must be matched by
+ * a call to eos_flexy_grid_thaw_layout().
+ *
+ * Since: 0.6
+ */
+void
+eos_flexy_grid_freeze_layout (EosFlexyGrid *grid)
+{
+  g_return_if_fail (EOS_IS_FLEXY_GRID (grid));
+
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+
+  priv->freeze_count += 1;
+}
+
+/**
+ * eos_flexy_grid_thaw_layout:
+ * @grid: a #EosFlexyGrid
+ *
+ * Reverts the effect of a call to eos_flexy_grid_freeze_layout(), and
+ * places the cells that changed in the meantime once all the calls are
+ * reverted.
+ *
+ * Since: 0.6
+ */
+void
+eos_flexy_grid_thaw_layout (EosFlexyGrid *grid)
+{
+  g_return_if_fail (EOS_IS_FLEXY_GRID (grid));
+
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  g_return_if_fail (priv->freeze_count > 0);
+
+  priv->freeze_count -= 1;
+
+  if (priv->freeze_count > 0 || priv->frozen_from == G_MAXUINT)
+    return;
+
+  guint index = priv->frozen_from;
+
+  priv->frozen_from = G_MAXUINT;
+  invalidate_layouts_from (grid, index);
+
+  /* Shows the cells inserted while the layout was frozen */
+  if (priv->model == NULL)
+    {
+      GSequenceIter *iter;
+
+      for (iter = g_sequence_get_iter_at_pos (priv->children, index);
+           !g_sequence_iter_is_end (iter);
+           iter = g_sequence_iter_next (iter))
+        gtk_widget_set_child_visible (g_sequence_get (iter), TRUE);
+    }
+
+  gtk_widget_queue_resize (GTK_WIDGET (grid));
+}
+
+/*< private >
+ * eos_flexy_grid_invalidate_cell:
+ * @grid: a #EosFlexyGrid
+ * @cell: a child of @grid
+ *
+ * Forgets the placement of @cell, and of the cells after it, when its
+ * shape changes.
+ */
+void
+eos_flexy_grid_invalidate_cell (EosFlexyGrid     *grid,
+                                EosFlexyGridCell *cell)
+{
+  EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
+  GSequenceIter *iter = eos_flexy_grid_cell_get_iter (cell);
+
+  /* The shapes of the items of a model do not change with their cells */
+  if (priv->model != NULL)
+    return;
+
+  if (iter == NULL || g_sequence_iter_get_sequence (iter) != priv->children)
+    return;
+
+  invalidate_layouts_from (grid, g_sequence_iter_get_position (iter));
 }
 
 /**
@@ -1216,7 +2497,20 @@ eos_flexy_grid_get_cell_at_coords (EosFlexyGrid *grid,
   EosFlexyGridPrivate *priv = eos_flexy_grid_get_instance_private (grid);
   GSequenceIter *iter;
 
-  /* naive hit detection */
+  if (priv->allocated_layout != NULL)
+    {
+      guint index;
+
+      if (gtk_widget_get_direction (GTK_WIDGET (grid)) == GTK_TEXT_DIR_RTL)
+        x_pos = priv->allocated_width - x_pos;
+
+      if (!layout_get_cell_at (priv->allocated_layout, x_pos, y_pos, &index))
+        return NULL;
+
+      return get_cell_at_index (grid, index);
+    }
+
+  /* naive hit detection, until the cells are allocated again */
   for (iter = g_sequence_get_begin_iter (priv->children);
        !g_sequence_iter_is_end (iter);
        iter = g_sequence_iter_next (iter))
@@ -1224,6 +2518,10 @@ eos_flexy_grid_get_cell_at_coords (EosFlexyGrid *grid,
       GtkWidget *widget = g_sequence_get (iter);
       GtkAllocation allocation;
 
+      /* A cell that shows no item of the model */
+      if (!gtk_widget_get_child_visible (widget))
+        continue;
+
       gtk_widget_get_allocation (widget, &allocation);
 
       if (x_pos >= allocation.x && x_pos < allocation.x + allocation.width &&
@@ -79,6 +79,38 @@ typedef gint (* EosFlexyGridSortFunc) (EosFlexyGridCell *cell_a,
                                        EosFlexyGridCell *cell_b,
                                        gpointer          user_data);
 
+/**
+ * EosFlexyGridShapeFunc:
+ * @item: (type GObject): an item of the model bound to the grid
+ * @user_data: data passed to eos_flexy_grid_bind_model()
+ *
+ * Type for functions that determine the shape of the cell of an item of
+ * the model bound with eos_flexy_grid_bind_model().
+ *
+ * Returns: the shape of the cell of @item
+ *
+ * Since: 0.6
+ */
+typedef EosFlexyShape (* EosFlexyGridShapeFunc) (gpointer item,
+                                                 gpointer user_data);
+
+/**
+ * EosFlexyGridBindCellFunc:
+ * @cell: the #EosFlexyGridCell showing @item
+ * @item: (type GObject): an item of the model bound to the grid
+ * @user_data: data passed to eos_flexy_grid_bind_model()
+ *
+ * Type for functions that fill a cell with the contents of an item of
+ * the model bound with eos_flexy_grid_bind_model().
+ *
+ * The @cell may have shown another item before, and keeps its child.
+ *
+ * Since: 0.6
+ */
+typedef void (* EosFlexyGridBindCellFunc) (EosFlexyGridCell *cell,
+                                           gpointer          item,
+                                           gpointer          user_data);
+
 struct _EosFlexyGrid
 {
   /*< private >*/
@@ -126,6 +158,22 @@ EOS_SDK_DEPRECATED_IN_0_2_FOR (GtkGrid)
 EosFlexyGridCell *      eos_flexy_grid_get_cell_at_coords       (EosFlexyGrid         *grid,
                                                                  double                x_pos,
                                                                  double                y_pos);
+EOS_SDK_AVAILABLE_IN_0_6
+void                    eos_flexy_grid_insert_many              (EosFlexyGrid             *grid,
+                                                                 GtkWidget               **children,
+                                                                 guint                     n_children,
+                                                                 int                       index_);
+EOS_SDK_AVAILABLE_IN_0_6
+void                    eos_flexy_grid_freeze_layout            (EosFlexyGrid             *grid);
+EOS_SDK_AVAILABLE_IN_0_6
+void                    eos_flexy_grid_thaw_layout              (EosFlexyGrid             *grid);
+EOS_SDK_AVAILABLE_IN_0_6
+void                    eos_flexy_grid_bind_model               (EosFlexyGrid             *grid,
+                                                                 GListModel               *model,
+                                                                 EosFlexyGridShapeFunc     shape_func,
+                                                                 EosFlexyGridBindCellFunc  bind_func,
+                                                                 gpointer                  user_data,
+                                                                 GDestroyNotify            user_data_free_func);
 
 struct _EosFlexyGridCell
 {
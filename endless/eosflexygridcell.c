@@ -4,6 +4,7 @@
 
 #define EOS_SDK_DISABLE_DEPRECATION_WARNINGS
 #include "eosflexygrid-private.h"
+#include "eosprofile-private.h"
 
 #include <glib-object.h>
 #include <gtk/gtk.h>
@@ -104,6 +105,8 @@ eos_flexy_grid_cell_class_init (EosFlexyGridCellClass *klass)
 static void
 eos_flexy_grid_cell_init (EosFlexyGridCell *self)
 {
+  eos_profile_census_construct (EOS_TYPE_FLEXY_GRID_CELL);
+
   EosFlexyGridCellPrivate *priv = EOS_FLEXY_GRID_CELL_GET_PRIV (self);
 
   priv->shape = EOS_FLEXY_SHAPE_SMALL;
@@ -154,6 +157,10 @@ eos_flexy_grid_cell_set_shape (EosFlexyGridCell *cell,
 
       g_object_notify_by_pspec (G_OBJECT (cell), obj_props[PROP_SHAPE]);
 
+      GtkWidget *parent = gtk_widget_get_parent (GTK_WIDGET (cell));
+      if (EOS_IS_FLEXY_GRID (parent))
+        eos_flexy_grid_invalidate_cell (EOS_FLEXY_GRID (parent), cell);
+
       gtk_widget_queue_resize (GTK_WIDGET (cell));
     }
 }
@@ -35,11 +35,14 @@ _eos_init (void)
 {
   if (G_UNLIKELY (!_eos_initialized))
     {
+      gint64 init_start = g_get_monotonic_time ();
+
       /* Initialize Gettext */
       bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
       bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 
       eos_profile_state_init ();
+      eos_profile_startup_span ("init", init_start);
 
       _eos_initialized = TRUE;
     }
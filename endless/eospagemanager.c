@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "eospagemanager.h"
+#include "eosprofile-private.h"
 
 #include <gtk/gtk.h>
 
@@ -439,6 +440,8 @@ eos_page_manager_class_init (EosPageManagerClass *klass)
 static void
 eos_page_manager_init (EosPageManager *self)
 {
+  eos_profile_census_construct (EOS_TYPE_PAGE_MANAGER);
+
   EosPageManagerPrivate *priv = eos_page_manager_get_instance_private (self);
   priv->pages_by_widget = g_hash_table_new (g_direct_hash,
                                             g_direct_equal);
@@ -4,26 +4,121 @@
 
 #include "eosprofile.h"
 
+#include "gvdb/gvdb-builder.h"
+
+#include <gtk/gtk.h>
+
 G_BEGIN_DECLS
 
-/* Increase every time the probe format changes */
-#define PROBE_DB_VERSION                1
+/* Increase every time the probe format changes; version 2 captures use
+ * perfect hash tables, but version 1 captures can still be read
+ */
+#define PROBE_DB_VERSION                2
+#define PROBE_DB_MIN_VERSION            1
 
 #define PROBE_DB_META_BASE_KEY          "/com/endlessm/Sdk/meta"
 #define PROBE_DB_META_VERSION_KEY       PROBE_DB_META_BASE_KEY "/db_version"
 #define PROBE_DB_META_APPID_KEY         PROBE_DB_META_BASE_KEY "/app_id"
 #define PROBE_DB_META_START_KEY         PROBE_DB_META_BASE_KEY "/start_time"
 #define PROBE_DB_META_PROFILE_KEY       PROBE_DB_META_BASE_KEY "/profile_time"
+#define PROBE_DB_META_PID_KEY           PROBE_DB_META_BASE_KEY "/pid"
+#define PROBE_DB_META_PPID_KEY          PROBE_DB_META_BASE_KEY "/ppid"
+#define PROBE_DB_META_BOOT_ID_KEY       PROBE_DB_META_BASE_KEY "/boot_id"
+#define PROBE_DB_META_SESSION_KEY       PROBE_DB_META_BASE_KEY "/session"
 
 #define PROBE_DB_META_PROBE_TYPE        "(sssuua(xx))"
+/* (name, [(time, value)]) */
+#define PROBE_DB_META_COUNTER_TYPE      "(sa(xx))"
+
+/* Stack samples collected with EOS_PROFILE=sample */
+#define PROBE_DB_SAMPLES_BASE_KEY       "/com/endlessm/Sdk/samples"
+#define PROBE_DB_SAMPLES_FREQUENCY_KEY  PROBE_DB_SAMPLES_BASE_KEY "/frequency"
+#define PROBE_DB_SAMPLES_MODULES_KEY    PROBE_DB_SAMPLES_BASE_KEY "/modules"
+#define PROBE_DB_SAMPLES_THREADS_KEY    PROBE_DB_SAMPLES_BASE_KEY "/threads"
+
+/* Probes recorded with EOS_PROFILE=mainloop */
+#define PROBE_DB_MAINLOOP_BASE_KEY      "/com/endlessm/Sdk/mainloop"
+
+/* Probes and counters recorded with EOS_PROFILE=frames */
+#define PROBE_DB_FRAMES_BASE_KEY        "/com/endlessm/Sdk/frames"
+
+/* Counters recorded with EOS_PROFILE=memory, in bytes */
+#define PROBE_DB_MEMORY_BASE_KEY        "/com/endlessm/Sdk/memory"
+
+/* Counters recorded with EOS_PROFILE=census, named after each type */
+#define PROBE_DB_CENSUS_BASE_KEY        "/com/endlessm/Sdk/census"
+#define PROBE_DB_CENSUS_LIVE_KEY        PROBE_DB_CENSUS_BASE_KEY "/live"
+#define PROBE_DB_CENSUS_CONSTRUCTED_KEY PROBE_DB_CENSUS_BASE_KEY "/constructed"
+
+/* Spans and marks of the startup timeline */
+#define PROBE_DB_STARTUP_BASE_KEY       "/com/endlessm/Sdk/startup"
+#define PROBE_DB_STARTUP_PROCESS_START  "process-start"
+#define PROBE_DB_STARTUP_FIRST_FRAME    "first-frame"
+
+/* Probes recorded with EOS_PROFILE=signals */
+#define PROBE_DB_SIGNALS_BASE_KEY       "/com/endlessm/Sdk/signals"
+
+/* Capture sessions live in a directory under $XDG_CACHE_HOME, with a
+ * capture file for each process, and a manifest listing them
+ */
+#define PROBE_SESSION_ENV               "EOS_PROFILE_SESSION"
+#define PROBE_SESSION_BASE_DIR          "com.endlessm.Sdk.Profile"
+#define PROBE_SESSION_MANIFEST          "session.ini"
+#define PROBE_SESSION_GROUP             "Session"
+#define PROBE_SESSION_PROCESS_GROUP     "Process "
+
+/* (start address, end address, file offset, path) */
+#define PROBE_DB_SAMPLES_MODULES_TYPE   "a(ttts)"
+/* (dropped samples, [(time, active probe, [return addresses])]) */
+#define PROBE_DB_SAMPLES_THREAD_TYPE    "(ua(xsat))"
 
 typedef struct {
   /* element-type (key utf8) (value EosProfileProbe) */
   GHashTable *probes;
 
+  /* element-type (key utf8) (value GArray<ProfileCounterSample>) */
+  GHashTable *counters;
+
   gboolean capture;
   char *capture_file;
 
+  /* The capture session shared with the processes we spawn */
+  char *session;
+
+  /* Updated when forking */
+  int pid;
+  int ppid;
+
+  char *boot_id;
+
+  /* Stack sampling frequency, in Hz; 0 if disabled */
+  guint sample_frequency;
+
+  /* Whether the main loop is instrumented */
+  gboolean mainloop;
+
+  /* Whether signal emissions are instrumented */
+  gboolean signals;
+
+  /* Whether the frame clock of each EosWindow is instrumented */
+  gboolean frames;
+
+  /* Memory sampling interval, in milliseconds; 0 if disabled */
+  guint memory_interval;
+
+  /* Instance census interval, in milliseconds; 0 if disabled */
+  guint census_interval;
+
+  /* Capture snapshot interval, in milliseconds; 0 if disabled */
+  guint live_interval;
+
+  /* The capture file the snapshots are appended to, if any */
+  char *live_file;
+
+  /* The number of values of each counter already in live_file */
+  /* element-type (key utf8) (value guint) */
+  GHashTable *live_counters;
+
   /* Wallclock time */
   gint64 start_time;
 
@@ -32,9 +127,6 @@ typedef struct {
   gint64 profile_end;
 } ProfileState;
 
-G_LOCK_DEFINE_STATIC (profile_state);
-static ProfileState *profile_state;
-
 struct _EosProfileProbe {
   char *file;
   gint32 line;
@@ -44,6 +136,9 @@ struct _EosProfileProbe {
   /* element-type ProfileSample */
   GArray *samples;
 
+  /* The number of samples already in the live capture file */
+  guint n_live_samples;
+
   GMutex probe_lock;
 };
 
@@ -52,10 +147,154 @@ typedef struct {
   gint64 end_time;
 } ProfileSample;
 
+typedef struct {
+  gint64 time;
+  gint64 value;
+} ProfileCounterSample;
+
+G_GNUC_INTERNAL
 void
 eos_profile_state_init (void);
 
+G_GNUC_INTERNAL
 void
 eos_profile_state_dump (void);
 
+G_GNUC_INTERNAL
+void
+eos_profile_state_snapshot (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_state_add_sample (const char *file,
+                              gsize       line,
+                              const char *function,
+                              const char *name,
+                              gint64      start_time,
+                              gint64      end_time);
+
+G_GNUC_INTERNAL
+void
+eos_profile_state_add_counter (const char *name,
+                               gint64      time,
+                               gint64      value);
+
+
+/* eosprofilesampler.c */
+G_GNUC_INTERNAL
+gboolean
+eos_profile_sampler_start (guint frequency);
+
+G_GNUC_INTERNAL
+void
+eos_profile_sampler_stop (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_sampler_push_probe (EosProfileProbe *probe);
+
+G_GNUC_INTERNAL
+void
+eos_profile_sampler_pop_probe (EosProfileProbe *probe);
+
+G_GNUC_INTERNAL
+void
+eos_profile_sampler_dump (GHashTable *db_table);
+
+/* eosprofilemainloop.c */
+G_GNUC_INTERNAL
+void
+eos_profile_mainloop_start (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_mainloop_stop (void);
+
+/* eosprofileframes.c */
+G_GNUC_INTERNAL
+void
+eos_profile_frames_enable (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_frames_attach (GtkWidget *widget);
+
+/* eosprofilememory.c */
+G_GNUC_INTERNAL
+void
+eos_profile_memory_start (guint interval);
+
+G_GNUC_INTERNAL
+void
+eos_profile_memory_stop (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_memory_snapshot (void);
+
+/* eosprofilecensus.c */
+G_GNUC_INTERNAL
+void
+eos_profile_census_start (guint interval);
+
+G_GNUC_INTERNAL
+void
+eos_profile_census_stop (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_census_construct (GType type);
+
+/* eosprofilelive.c */
+G_GNUC_INTERNAL
+void
+eos_profile_live_start (guint interval);
+
+G_GNUC_INTERNAL
+void
+eos_profile_live_stop (void);
+
+/* eosprofiledb.c */
+G_GNUC_INTERNAL
+GvdbItem *
+eos_profile_db_insert (GHashTable *db_table,
+                       const char *key);
+
+/* eosprofileterminal.c */
+G_GNUC_INTERNAL
+gboolean
+eos_profile_get_terminal_size (guint *columns,
+                               guint *rows);
+
+/* eosprofilestartup.c */
+G_GNUC_INTERNAL
+void
+eos_profile_startup_init (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_startup_span (const char *phase,
+                          gint64      start_time);
+
+G_GNUC_INTERNAL
+void
+eos_profile_startup_mark (const char *phase);
+
+G_GNUC_INTERNAL
+void
+eos_profile_startup_watch_first_frame (GtkWidget *widget);
+
+/* eosprofilesignals.c */
+G_GNUC_INTERNAL
+void
+eos_profile_signals_enable (const char *spec);
+
+G_GNUC_INTERNAL
+void
+eos_profile_signals_install (void);
+
+G_GNUC_INTERNAL
+void
+eos_profile_signals_stop (void);
+
 G_END_DECLS
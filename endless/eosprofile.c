@@ -4,12 +4,15 @@
 
 #include "eosprofile-private.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
 #include <sys/ioctl.h>
 #include <math.h>
 
@@ -71,6 +74,36 @@
  * inner function is called. In either cases, both the `outer` and `inner`
  * probes are automatically stopped once they get out of scope.
  *
+ * ### Writing benchmarks
+ *
+ * Instead of timing a loop around the code you wish to measure, you can
+ * use eos_profile_bench_run(), which runs a function a few times to warm
+ * up, then as many times as needed for the mean duration to be stable,
+ * and records each iteration as a sample of a probe, leaving out the
+ * iterations disturbed by the rest of the system:
+ *
+ * |[<!-- language="C" -->
+ * static void
+ * parse_document (gpointer data)
+ * {
+ *   g_autoptr(SomeDocument) doc = some_document_parse (data);
+ * }
+ *
+ * ...
+ *
+ *   g_autoptr(EosProfileBenchOptions) options = eos_profile_bench_options_new ();
+ *
+ *   options->cpu = 0;
+ *
+ *   double median = eos_profile_bench_run ("/com/example/parse-document",
+ *                                          parse_document, contents,
+ *                                          options);
+ * ]|
+ *
+ * The number of warm-up and measured iterations, the precision required,
+ * and how far from the median an iteration can be before it is rejected
+ * can all be set using #EosProfileBenchOptions.
+ *
  * ### Capturing profiling data
  *
  * By default, when the `EOS_PROFILE` environment variable is set, you will
@@ -80,14 +113,157 @@
  * setting the `EOS_PROFILE` environment variable to the `capture` value. In
  * that case, the profiling data will be stored in a binary format at the
  * end of the process, and you can use the `eos-profile` tool to extract the
- * probes, timings, and generate a summary. The default filename for the
- * captured data is based on the name of the binary and the process ID, and
- * it's saved under the `$XDG_CACHE_HOME` directory (see: g_get_user_cache_dir()).
+ * probes, timings, and generate a summary.
+ *
+ * Each capture file belongs to a session: a directory under
+ * `$XDG_CACHE_HOME/com.endlessm.Sdk.Profile` (see: g_get_user_cache_dir())
+ * holding one capture file for each process, named after the binary and
+ * the process ID, and a `session.ini` manifest listing them. Processes
+ * spawned by a profiled process join the same session, and so do the
+ * children created by fork(), which only keep the data recorded after
+ * they were forked. By default each run of an application starts a new
+ * session, named after the time it started; you can pick the name of the
+ * session with `session:NAME`, or with the `EOS_PROFILE_SESSION`
+ * environment variable, in order to collect several runs together. The
+ * `eos-profile` tool accepts a session directory, or the name of a
+ * session, wherever it accepts a capture file.
  *
  * You can also specify the name of the capture file, by setting the
- * `EOS_PROFILE` environment variable to `capture:/path/to/file`.
+ * `EOS_PROFILE` environment variable to `capture:/path/to/file`; in that
+ * case, forked children append their process ID to the file name.
+ *
+ * Multiple options can be specified in the `EOS_PROFILE` environment
+ * variable by separating them with a comma, for instance:
+ * `EOS_PROFILE=capture:/tmp/example.db,sample`.
+ *
+ * ### Following a running process
+ *
+ * Setting the `EOS_PROFILE` environment variable to `live` will write a
+ * snapshot of the capture file every second while the process is running,
+ * instead of only at the end; the interval can be changed by using
+ * `live:INTERVAL`, in milliseconds. You can follow the probes of the
+ * process with `eos-profile top`, using its process ID, its session, or
+ * the capture file. Snapshots do not include the stack samples, which
+ * are only written at the end. Each snapshot only adds the samples
+ * recorded since the previous one to the capture file, and the final
+ * capture replaces them all; if the process does not terminate cleanly,
+ * `eos-profile compact` turns the snapshots into a regular capture file,
+ * though all the tools can read them as they are.
+ *
+ * ### Sampling the stack
+ *
+ * Profiling probes only measure the sections of code you explicitly
+ * annotated. In order to find out where the time is spent in the rest
+ * of the code, you can set the `EOS_PROFILE` environment variable to
+ * `sample`; in that case, each thread that uses a profiling probe will
+ * periodically record its call stack, alongside the innermost probe in
+ * flight at the time. The default sampling frequency is 100 Hz of CPU time,
+ * and it can be changed by using `sample:FREQUENCY`, for instance
+ * `sample:500`.
+ *
+ * Stack samples are always stored in a capture file, and can be inspected
+ * using the `eos-profile samples` command.
+ *
+ * ### Instrumenting the main loop
+ *
+ * Setting the `EOS_PROFILE` environment variable to `mainloop` will measure
+ * each iteration of the default main context, from the main loop waking up
+ * to it going back to sleep, under `/com/endlessm/Sdk/mainloop/iteration`.
+ *
+ * While an iteration lasts, the main loop is also sampled every millisecond
+ * to find out which #GSource is being dispatched, including idle and timeout
+ * sources; the time spent dispatching each source, and the delay between the
+ * main loop waking up and the source being dispatched, are recorded
+ * respectively under `/com/endlessm/Sdk/mainloop/dispatch` and
+ * `/com/endlessm/Sdk/mainloop/latency`, using the name of the source as set
+ * by g_source_set_name(); sources without a name are grouped together.
+ * Sources dispatching in less than a millisecond may only be accounted for
+ * by the iteration probe, and the durations are accurate to a millisecond.
+ *
+ * ### Timing signal emissions
+ *
+ * Setting the `EOS_PROFILE` environment variable to `signals` will measure
+ * each emission of the signals of the SDK types, including the time spent
+ * in all the connected handlers; emissions are recorded as probes under
+ * `/com/endlessm/Sdk/signals`, using the type of the emitting instance
+ * and the name of the signal, for instance
+ * `/com/endlessm/Sdk/signals/EosWindow/size-allocate`. You can restrict
+ * the instrumented signals, or instrument types outside of the SDK, by
+ * listing them after a colon and separated by a plus sign, for instance
+ * `signals:EosPageManager::notify+GtkButton::clicked`; a type name on
+ * its own selects all its signals.
+ *
+ * Signals are instrumented once the #EosApplication has started up.
+ * Signals returning a value, like the #GtkWidget::draw signal and the
+ * input events, are not instrumented, as measuring them could change
+ * the value they return.
+ *
+ * ### Measuring frames
+ *
+ * Setting the `EOS_PROFILE` environment variable to `frames` will record
+ * the duration of each phase of every frame painted by an #EosWindow, for
+ * instance `/com/endlessm/Sdk/frames/layout` and
+ * `/com/endlessm/Sdk/frames/paint`, as well as the whole frame, under
+ * `/com/endlessm/Sdk/frames/frame`. While the window is painting
+ * continuously, like during an #EosPageManager transition, the interval
+ * between frames is recorded under `/com/endlessm/Sdk/frames/interval`,
+ * and the number of frames missed with respect to the refresh rate of
+ * the monitor is kept in the `/com/endlessm/Sdk/frames/dropped` counter.
+ * Stalls of any length are counted while an animation is running; the
+ * rest of the time, long intervals are considered idle time.
+ *
+ * Counters are values sampled over time, instead of durations; they are
+ * stored in the capture file alongside the probes.
+ *
+ * ### The startup timeline
+ *
+ * Whenever profiling is enabled, the SDK records the startup of the
+ * application under `/com/endlessm/Sdk/startup`, from the start of the
+ * process to the first frame painted by the #EosWindow: the
+ * initialization of the library, the #GApplication::startup and
+ * #GApplication::activate phases, the construction of the window and
+ * the time it's first mapped. The whole #GApplication::activate
+ * emission is timed, including what subclasses do after chaining up.
+ * The first frame is marked at the time the compositor presented
+ * it, when the windowing system reports it, or else at the time GTK
+ * finished painting it. The start of the process is only known with the
+ * precision of the kernel clock tick, usually 10 milliseconds.
+ * You can compare the timeline of different runs using the
+ * `eos-profile startup` command.
+ *
+ * ### Sampling the memory footprint
+ *
+ * Setting the `EOS_PROFILE` environment variable to `memory` will record
+ * the memory used by the process every 250 milliseconds, as counters
+ * under `/com/endlessm/Sdk/memory`: the virtual size, the resident set,
+ * the shared pages, the proportional set size and the heap usage, all in
+ * bytes. The interval can be changed by using `memory:INTERVAL`, for
+ * instance `memory:50`. A snapshot is also taken at the end of the
+ * startup timeline, and when the capture is written.
+ *
+ * ### Counting instances
+ *
+ * Setting the `EOS_PROFILE` environment variable to `census` will take a
+ * census of the GObject instances every second, and record it as counters:
+ * the number of live instances of each type that had at least one, under
+ * `/com/endlessm/Sdk/census/live`, and the number of instances of each
+ * SDK type constructed so far, under `/com/endlessm/Sdk/census/constructed`.
+ * The interval can be changed by using `census:INTERVAL`, in milliseconds.
+ *
+ * GObject only counts the live instances if the `GOBJECT_DEBUG`
+ * environment variable contains `instance-count`, for instance:
+ *
+ * |[
+ *   GOBJECT_DEBUG=instance-count EOS_PROFILE=census,capture ./my-app
+ * ]|
+ *
+ * You can list the types whose instances grew between two points in time
+ * using the `eos-profile census` command, which is useful to find leaks.
  */
 
+G_LOCK_DEFINE_STATIC (profile_state);
+static ProfileState *profile_state;
+
 static int
 sample_compare (gconstpointer a,
                 gconstpointer b)
@@ -110,6 +286,13 @@ sample_compare (gconstpointer a,
 
 #define N_SAMPLES       64
 
+#define DEFAULT_SAMPLE_FREQUENCY        100
+#define MAX_SAMPLE_FREQUENCY            10000
+
+#define DEFAULT_MEMORY_INTERVAL         250
+#define DEFAULT_CENSUS_INTERVAL         1000
+#define DEFAULT_LIVE_INTERVAL           1000
+
 static EosProfileProbe eos_profile_dummy_probe;
 
 static EosProfileProbe *
@@ -183,16 +366,17 @@ eos_profile_probe_start (const char *file,
                          const char *function,
                          const char *name)
 {
-  /* Don't measure the lock */
-  gint64 sample_time = g_get_monotonic_time ();
-
   /* We can take this out of the lock because by the time we reach
    * eos_profile_probe_stop() the profile state is guaranteed to
-   * either always exist, or not
+   * either always exist, or not; we check it before anything else,
+   * as the SDK uses probes in hot paths
    */
-  if (profile_state == NULL)
+  if (G_LIKELY (profile_state == NULL))
     return &eos_profile_dummy_probe;
 
+  /* Don't measure the lock */
+  gint64 sample_time = g_get_monotonic_time ();
+
   G_LOCK (profile_state);
 
   EosProfileProbe *res = g_hash_table_lookup (profile_state->probes, name);
@@ -212,6 +396,9 @@ eos_profile_probe_start (const char *file,
 
   G_UNLOCK (profile_state);
 
+  if (profile_state->sample_frequency != 0)
+    eos_profile_sampler_push_probe (res);
+
   return (EosProfileProbe *) res;
 }
 
@@ -232,6 +419,9 @@ eos_profile_probe_stop (EosProfileProbe *probe)
   /* Don't measure the lock */
   gint64 sample_time = g_get_monotonic_time ();
 
+  if (profile_state != NULL && profile_state->sample_frequency != 0)
+    eos_profile_sampler_pop_probe (probe);
+
   g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&probe->probe_lock);
 
   /* Ideally, we just want to update the sample we just created, which means
@@ -270,6 +460,354 @@ eos_profile_probe_stop (EosProfileProbe *probe)
     }
 }
 
+/* Checks whether @option is @name, optionally followed by an argument
+ * separated by a colon; the argument, if any, is returned in @arg
+ */
+static gboolean
+option_matches (const char  *option,
+                const char  *name,
+                const char **arg)
+{
+  gsize name_len = strlen (name);
+
+  if (g_ascii_strncasecmp (option, name, name_len) != 0)
+    return FALSE;
+
+  if (option[name_len] == '\0')
+    {
+      *arg = NULL;
+      return TRUE;
+    }
+
+  if (option[name_len] == ':')
+    {
+      *arg = option[name_len + 1] != '\0' ? option + name_len + 1 : NULL;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Session names are used as directory names */
+static gboolean
+is_valid_session_name (const char *name)
+{
+  if (name == NULL || *name == '\0')
+    return FALSE;
+
+  if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+    return FALSE;
+
+  return strchr (name, G_DIR_SEPARATOR) == NULL;
+}
+
+static void
+profile_state_parse_options (const char *str)
+{
+  g_auto(GStrv) options = g_strsplit (str, ",", -1);
+
+  for (int i = 0; options[i] != NULL; i++)
+    {
+      const char *arg = NULL;
+
+      if (option_matches (options[i], "capture", &arg))
+        {
+          profile_state->capture = TRUE;
+
+          if (arg != NULL)
+            {
+              g_free (profile_state->capture_file);
+              profile_state->capture_file = g_strdup (arg);
+            }
+        }
+      else if (option_matches (options[i], "session", &arg))
+        {
+          if (!is_valid_session_name (arg))
+            {
+              g_printerr ("PROFILE: Invalid session name '%s'\n", arg);
+              continue;
+            }
+
+          g_free (profile_state->session);
+          profile_state->session = g_strdup (arg);
+        }
+      else if (option_matches (options[i], "sample", &arg))
+        {
+          guint64 frequency = DEFAULT_SAMPLE_FREQUENCY;
+
+          if (arg != NULL)
+            frequency = g_ascii_strtoull (arg, NULL, 10);
+
+          if (frequency == 0 || frequency > MAX_SAMPLE_FREQUENCY)
+            {
+              g_printerr ("PROFILE: Invalid sampling frequency '%s'\n", arg);
+              frequency = DEFAULT_SAMPLE_FREQUENCY;
+            }
+
+          profile_state->sample_frequency = frequency;
+
+          /* Stack samples need to be symbolized offline */
+          profile_state->capture = TRUE;
+        }
+      else if (option_matches (options[i], "mainloop", &arg))
+        {
+          profile_state->mainloop = TRUE;
+        }
+      else if (option_matches (options[i], "signals", &arg))
+        {
+          profile_state->signals = TRUE;
+          eos_profile_signals_enable (arg);
+        }
+      else if (option_matches (options[i], "frames", &arg))
+        {
+          profile_state->frames = TRUE;
+          eos_profile_frames_enable ();
+        }
+      else if (option_matches (options[i], "live", &arg))
+        {
+          guint64 interval = DEFAULT_LIVE_INTERVAL;
+
+          if (arg != NULL)
+            interval = g_ascii_strtoull (arg, NULL, 10);
+
+          if (interval == 0 || interval > G_MAXUINT)
+            {
+              g_printerr ("PROFILE: Invalid snapshot interval '%s'\n", arg);
+              interval = DEFAULT_LIVE_INTERVAL;
+            }
+
+          profile_state->live_interval = interval;
+
+          /* Snapshots are written to the capture file */
+          profile_state->capture = TRUE;
+        }
+      else if (option_matches (options[i], "census", &arg))
+        {
+          guint64 interval = DEFAULT_CENSUS_INTERVAL;
+
+          if (arg != NULL)
+            interval = g_ascii_strtoull (arg, NULL, 10);
+
+          if (interval == 0 || interval > G_MAXUINT)
+            {
+              g_printerr ("PROFILE: Invalid census interval '%s'\n", arg);
+              interval = DEFAULT_CENSUS_INTERVAL;
+            }
+
+          profile_state->census_interval = interval;
+        }
+      else if (option_matches (options[i], "memory", &arg))
+        {
+          guint64 interval = DEFAULT_MEMORY_INTERVAL;
+
+          if (arg != NULL)
+            interval = g_ascii_strtoull (arg, NULL, 10);
+
+          if (interval == 0 || interval > G_MAXUINT)
+            {
+              g_printerr ("PROFILE: Invalid memory sampling interval '%s'\n", arg);
+              interval = DEFAULT_MEMORY_INTERVAL;
+            }
+
+          profile_state->memory_interval = interval;
+        }
+    }
+}
+
+/*< private >
+ * eos_profile_state_add_sample:
+ * @file: the source file for the probe
+ * @line: the line in the source @file
+ * @function: the function for the probe
+ * @name: a unique name for the probe
+ * @start_time: the start of the sample, in monotonic time
+ * @end_time: the end of the sample, in monotonic time
+ *
+ * Adds a complete sample to the probe for @name, creating it if necessary.
+ *
+ * This is used by the SDK to record timings that cannot be measured by
+ * starting and stopping a probe around a section of code.
+ */
+void
+eos_profile_state_add_sample (const char *file,
+                              gsize       line,
+                              const char *function,
+                              const char *name,
+                              gint64      start_time,
+                              gint64      end_time)
+{
+  if (profile_state == NULL)
+    return;
+
+  G_LOCK (profile_state);
+
+  EosProfileProbe *probe = g_hash_table_lookup (profile_state->probes, name);
+  if (probe == NULL)
+    {
+      probe = eos_profile_probe_new (file, line, function, name);
+
+      g_hash_table_insert (profile_state->probes, probe->name, probe);
+    }
+
+  g_mutex_lock (&probe->probe_lock);
+  g_array_append_vals (probe->samples,
+                       &(ProfileSample) {
+                         .start_time = start_time,
+                         .end_time = end_time,
+                       },
+                       1);
+  g_mutex_unlock (&probe->probe_lock);
+
+  G_UNLOCK (profile_state);
+}
+
+/*< private >
+ * eos_profile_state_add_counter:
+ * @name: a unique name for the counter
+ * @time: the time of the measurement, in monotonic time
+ * @value: the value of the counter at @time
+ *
+ * Records the @value of the counter for @name, creating it if necessary.
+ */
+void
+eos_profile_state_add_counter (const char *name,
+                               gint64      time,
+                               gint64      value)
+{
+  if (profile_state == NULL)
+    return;
+
+  G_LOCK (profile_state);
+
+  GArray *samples = g_hash_table_lookup (profile_state->counters, name);
+  if (samples == NULL)
+    {
+      samples = g_array_new (FALSE, FALSE, sizeof (ProfileCounterSample));
+
+      g_hash_table_insert (profile_state->counters, g_strdup (name), samples);
+    }
+
+  g_array_append_vals (samples,
+                       &(ProfileCounterSample) {
+                         .time = time,
+                         .value = value,
+                       },
+                       1);
+
+  G_UNLOCK (profile_state);
+}
+
+/* Processes spawned by a profiled process inherit its session through
+ * the environment, so that all their captures end up in the same place
+ */
+static void
+profile_state_init_session (void)
+{
+  if (profile_state->session == NULL)
+    {
+      const char *env = g_getenv (PROBE_SESSION_ENV);
+
+      if (is_valid_session_name (env))
+        profile_state->session = g_strdup (env);
+      else if (env != NULL)
+        g_printerr ("PROFILE: Invalid session name '%s'\n", env);
+    }
+
+  if (profile_state->session == NULL)
+    {
+      g_autoptr(GDateTime) now = g_date_time_new_now_local ();
+      g_autofree char *timestamp = g_date_time_format (now, "%Y%m%d-%H%M%S");
+
+      profile_state->session = g_strdup_printf ("%s-%d", timestamp, profile_state->pid);
+    }
+
+  g_setenv (PROBE_SESSION_ENV, profile_state->session, TRUE);
+}
+
+static char *
+get_boot_id (void)
+{
+  char *contents = NULL;
+
+  if (!g_file_get_contents ("/proc/sys/kernel/random/boot_id", &contents, NULL, NULL))
+    return NULL;
+
+  return g_strstrip (contents);
+}
+
+static void
+profile_state_fork_prepare (void)
+{
+  G_LOCK (profile_state);
+}
+
+static void
+profile_state_fork_parent (void)
+{
+  G_UNLOCK (profile_state);
+}
+
+/* The child inherits everything its parent recorded so far, which we
+ * drop, so that it does not end up in both captures; the threads that
+ * sample the process are not inherited, so we stop sampling in the child
+ */
+static void
+profile_state_fork_child (void)
+{
+  G_UNLOCK (profile_state);
+
+  if (profile_state == NULL)
+    return;
+
+  profile_state->pid = getpid ();
+  profile_state->ppid = getppid ();
+
+  GTimeVal now;
+  g_get_current_time (&now);
+  profile_state->start_time = now.tv_sec;
+  profile_state->profile_start = g_get_monotonic_time ();
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init (&iter, profile_state->probes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      EosProfileProbe *probe = value;
+
+      /* Another thread may have been holding the lock when we forked */
+      g_mutex_init (&probe->probe_lock);
+
+      /* Samples still in flight are completed by the child */
+      guint n_in_flight = 0;
+      for (guint i = 0; i < probe->samples->len; i++)
+        {
+          const ProfileSample *sample = &g_array_index (probe->samples, ProfileSample, i);
+
+          if (sample->end_time < 0)
+            g_array_index (probe->samples, ProfileSample, n_in_flight++) = *sample;
+        }
+
+      g_array_set_size (probe->samples, n_in_flight);
+      probe->n_live_samples = 0;
+    }
+
+  g_hash_table_remove_all (profile_state->counters);
+  g_hash_table_remove_all (profile_state->live_counters);
+  g_clear_pointer (&profile_state->live_file, g_free);
+
+  profile_state->sample_frequency = 0;
+  profile_state->memory_interval = 0;
+  profile_state->census_interval = 0;
+  profile_state->live_interval = 0;
+
+  if (profile_state->capture_file != NULL)
+    {
+      g_autofree char *parent_file = g_steal_pointer (&profile_state->capture_file);
+
+      profile_state->capture_file = g_strdup_printf ("%s.%d", parent_file, profile_state->pid);
+    }
+}
+
 void
 eos_profile_state_init (void)
 {
@@ -287,44 +825,180 @@ eos_profile_state_init (void)
       profile_state->probes = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                      NULL,
                                                      eos_profile_probe_destroy);
+      profile_state->counters = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                       g_free,
+                                                       (GDestroyNotify) g_array_unref);
+      profile_state->live_counters = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                            g_free,
+                                                            NULL);
+
+      profile_state->pid = getpid ();
+      profile_state->ppid = getppid ();
+      profile_state->boot_id = get_boot_id ();
+
+      profile_state_parse_options (str);
+      profile_state_init_session ();
+
+      pthread_atfork (profile_state_fork_prepare,
+                      profile_state_fork_parent,
+                      profile_state_fork_child);
+
+      GTimeVal now;
+      g_get_current_time (&now);
+      profile_state->start_time = now.tv_sec;
+
+      profile_state->profile_start = g_get_monotonic_time ();
+
+      eos_profile_startup_init ();
+
+      if (profile_state->sample_frequency != 0 &&
+          !eos_profile_sampler_start (profile_state->sample_frequency))
+        profile_state->sample_frequency = 0;
+
+      if (profile_state->mainloop)
+        eos_profile_mainloop_start ();
 
-      int capture_prefix_len = strlen ("capture");
+      if (profile_state->memory_interval != 0)
+        eos_profile_memory_start (profile_state->memory_interval);
 
-      if (g_ascii_strncasecmp (str, "capture", capture_prefix_len) == 0)
+      if (profile_state->census_interval != 0)
+        eos_profile_census_start (profile_state->census_interval);
+
+      if (profile_state->live_interval != 0)
+        eos_profile_live_start (profile_state->live_interval);
+    }
+}
+
+/* The program name is usually not available when the profiling state is
+ * initialized, so we need to defer building the default capture file name
+ * until we dump the data
+ */
+static char *
+get_default_capture_file (void)
+{
+  g_autofree char *capture_dir = g_build_filename (g_get_user_cache_dir (),
+                                                   PROBE_SESSION_BASE_DIR,
+                                                   profile_state->session,
+                                                   NULL);
+
+  if (g_mkdir_with_parents (capture_dir, 0700) < 0)
+    {
+      g_free (capture_dir);
+      capture_dir = g_get_current_dir ();
+    }
+
+  const char *prgname = g_get_prgname ();
+  if (prgname == NULL)
+    prgname = "unknown";
+
+  return g_strdup_printf ("%s%s%s-%d.db",
+                          capture_dir,
+                          G_DIR_SEPARATOR_S,
+                          prgname,
+                          profile_state->pid);
+}
+
+static gboolean
+write_all (int         fd,
+           const char *data,
+           gsize       len)
+{
+  while (len > 0)
+    {
+      ssize_t res = write (fd, data, len);
+
+      if (res < 0)
         {
-          profile_state->capture = TRUE;
+          if (errno == EINTR)
+            continue;
 
-          const char *filename = str + capture_prefix_len;
-          if (*filename == ':')
-            {
-              filename += 1;
+          return FALSE;
+        }
 
-              if (*filename != '\0')
-                profile_state->capture_file = g_strdup (filename);
-            }
+      data += res;
+      len -= res;
+    }
 
-          if (profile_state->capture_file == NULL || *profile_state->capture_file == '\0')
-            {
-              g_autofree char *capture_dir = g_build_filename (g_get_user_cache_dir (),
-                                                               "com.endlessm.Sdk.Profile",
-                                                               NULL);
+  return TRUE;
+}
 
-              if (g_mkdir_with_parents (capture_dir, 0700) < 0)
-                capture_dir = g_get_current_dir ();
+/* Adds this process to the manifest of the session; the manifest is
+ * locked, as the processes of a session can terminate at the same time
+ */
+static void
+session_add_process (const char *capture_file)
+{
+  g_autofree char *session_dir = g_path_get_dirname (capture_file);
+  g_autofree char *manifest = g_build_filename (session_dir, PROBE_SESSION_MANIFEST, NULL);
 
-              profile_state->capture_file = g_strdup_printf ("%s%s%s.db",
-                                                             capture_dir,
-                                                             G_DIR_SEPARATOR_S,
-                                                             g_get_prgname ());
-            }
+  int fd = open (manifest, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0)
+    {
+      g_printerr ("PROFILE: Unable to open '%s': %s\n", manifest, g_strerror (errno));
+      return;
+    }
+
+  while (flock (fd, LOCK_EX) < 0)
+    {
+      if (errno != EINTR)
+        {
+          g_printerr ("PROFILE: Unable to lock '%s': %s\n", manifest, g_strerror (errno));
+          close (fd);
+          return;
         }
+    }
 
-      GTimeVal now;
-      g_get_current_time (&now);
-      profile_state->start_time = now.tv_sec;
+  g_autoptr(GString) contents = g_string_new (NULL);
+  char buf[4096];
 
-      profile_state->profile_start = g_get_monotonic_time ();
+  for (;;)
+    {
+      ssize_t res = read (fd, buf, sizeof (buf));
+
+      if (res < 0 && errno == EINTR)
+        continue;
+
+      if (res <= 0)
+        break;
+
+      g_string_append_len (contents, buf, res);
     }
+
+  /* A damaged manifest is replaced */
+  g_autoptr(GKeyFile) keyfile = g_key_file_new ();
+  if (contents->len > 0)
+    g_key_file_load_from_data (keyfile, contents->str, contents->len,
+                               G_KEY_FILE_KEEP_COMMENTS,
+                               NULL);
+
+  g_key_file_set_string (keyfile, PROBE_SESSION_GROUP, "Name", profile_state->session);
+  if (profile_state->boot_id != NULL)
+    g_key_file_set_string (keyfile, PROBE_SESSION_GROUP, "BootId", profile_state->boot_id);
+
+  g_autofree char *group = g_strdup_printf (PROBE_SESSION_PROCESS_GROUP "%d", profile_state->pid);
+  g_autofree char *basename = g_path_get_basename (capture_file);
+  const char *prgname = g_get_prgname ();
+
+  g_key_file_set_string (keyfile, group, "CaptureFile", basename);
+  g_key_file_set_string (keyfile, group, "Program", prgname != NULL ? prgname : "unknown");
+  g_key_file_set_integer (keyfile, group, "ParentPid", profile_state->ppid);
+  g_key_file_set_int64 (keyfile, group, "StartTime", profile_state->start_time);
+  g_key_file_set_int64 (keyfile, group, "ProfileStart", profile_state->profile_start);
+
+  GApplication *app = g_application_get_default ();
+  if (app != NULL && g_application_get_application_id (app) != NULL)
+    g_key_file_set_string (keyfile, group, "AppId", g_application_get_application_id (app));
+
+  gsize len = 0;
+  g_autofree char *data = g_key_file_to_data (keyfile, &len, NULL);
+
+  if (ftruncate (fd, 0) < 0 ||
+      lseek (fd, 0, SEEK_SET) < 0 ||
+      !write_all (fd, data, len))
+    g_printerr ("PROFILE: Unable to write '%s': %s\n", manifest, g_strerror (errno));
+
+  /* Releases the lock */
+  close (fd);
 }
 
 static const double
@@ -367,15 +1041,10 @@ static void
 profile_state_dump_to_console (void)
 {
   gushort max_columns = 256;
+  guint columns;
 
-  if (isatty (STDOUT_FILENO))
-    {
-      struct winsize w;
-
-      ioctl (STDOUT_FILENO, TIOCGWINSZ, &w);
-
-      max_columns = w.ws_col;
-    }
+  if (eos_profile_get_terminal_size (&columns, NULL) && columns > 0)
+    max_columns = columns;
 
   GHashTableIter iter;
   gpointer value;
@@ -425,7 +1094,7 @@ profile_state_dump_to_console (void)
           double s = 0;
           double s_part = 0;
 
-          for (int i = 1; i < valid_samples->len - 1; i++)
+          for (int i = 0; i < valid_samples->len; i++)
             {
               guint idx = g_array_index (valid_samples, guint, i);
               const ProfileSample *sample = &g_array_index (sorted_samples, ProfileSample, idx);
@@ -438,7 +1107,7 @@ profile_state_dump_to_console (void)
             }
 
           if (valid_samples->len > 1)
-            s = sqrt (s_part / (double) valid_samples->len - 1);
+            s = sqrt (s_part / (valid_samples->len - 1));
           else
             s = 0.0;
 
@@ -485,51 +1154,54 @@ profile_state_dump_to_console (void)
                probe->function,
                probe->file, probe->line);
     }
-}
 
-/* Get the immediate parent table in the GVDB table, using the
- * key separator '/' to determine the nesting level. If needed,
- * this function will create the intermediate tables
- */
-static GvdbItem *
-get_parent (GHashTable *table,
-            char       *key,
-            int         length)
-{
-  GvdbItem *grandparent, *parent;
+  gpointer key;
+  g_hash_table_iter_init (&iter, profile_state->counters);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const char *name = key;
+      GArray *samples = value;
 
-  if (length == 1)
-    return NULL;
+      if (samples->len == 0)
+        continue;
 
-  while (key[--length - 1] != '/')
-    ;
+      gint64 min_value = G_MAXINT64, max_value = G_MININT64;
 
-  key[length] = '\0';
+      for (int i = 0; i < samples->len; i++)
+        {
+          const ProfileCounterSample *sample = &g_array_index (samples, ProfileCounterSample, i);
 
-  parent = g_hash_table_lookup (table, key);
+          min_value = MIN (min_value, sample->value);
+          max_value = MAX (max_value, sample->value);
+        }
 
-  if (parent == NULL)
-    {
-      parent = gvdb_hash_table_insert (table, key);
+      const ProfileCounterSample *last =
+        &g_array_index (samples, ProfileCounterSample, samples->len - 1);
 
-      grandparent = get_parent (table, key, length);
+      g_autofree char *msg =
+        g_strdup_printf ("%d values: last:%" G_GINT64_FORMAT
+                         ", min:%" G_GINT64_FORMAT
+                         ", max:%" G_GINT64_FORMAT,
+                         samples->len,
+                         last->value,
+                         min_value,
+                         max_value);
 
-      if (grandparent != NULL)
-        gvdb_item_set_parent (parent, grandparent);
-    }
+      int msg_len = strlen (msg);
+      int padding = MAX ((int) max_columns - (int) strlen (name) - msg_len, 1);
 
-  return parent;
+      g_print ("%s%*c%s\n\n", name, padding, ' ', msg);
+    }
 }
 
 static void
 add_metadata (GHashTable *table)
 {
+  GvdbItem *item;
+
   /* version */
-  g_autofree char *version_key = g_strdup (PROBE_DB_META_VERSION_KEY);
-  gsize version_key_len = strlen (version_key);
-  GvdbItem *key_meta = gvdb_hash_table_insert (table, PROBE_DB_META_VERSION_KEY);
-  gvdb_item_set_parent (key_meta, get_parent (table, version_key, version_key_len));
-  gvdb_item_set_value (key_meta, g_variant_new_int32 (PROBE_DB_VERSION));
+  item = eos_profile_db_insert (table, PROBE_DB_META_VERSION_KEY);
+  gvdb_item_set_value (item, g_variant_new_int32 (PROBE_DB_VERSION));
 
   /* application id */
   GApplication *app = g_application_get_default ();
@@ -537,48 +1209,111 @@ add_metadata (GHashTable *table)
     {
       const char *appid = g_application_get_application_id (app);
 
-      g_autofree char *appid_key = g_strdup (PROBE_DB_META_APPID_KEY);
-      gsize appid_key_len = strlen (appid_key);
-      GvdbItem *appid_meta = gvdb_hash_table_insert (table, PROBE_DB_META_APPID_KEY);
-      gvdb_item_set_parent (appid_meta, get_parent (table, appid_key, appid_key_len));
-      gvdb_item_set_value (appid_meta, g_variant_new_string (appid));
+      item = eos_profile_db_insert (table, PROBE_DB_META_APPID_KEY);
+      gvdb_item_set_value (item, g_variant_new_string (appid));
     }
 
   /* start time */
-  g_autofree char *start_key = g_strdup (PROBE_DB_META_START_KEY);
-  gsize start_key_len = strlen (start_key);
-  GvdbItem *start_meta = gvdb_hash_table_insert (table, PROBE_DB_META_START_KEY);
-  gvdb_item_set_parent (start_meta, get_parent (table, start_key, start_key_len));
-  gvdb_item_set_value (start_meta, g_variant_new_int64 (profile_state->start_time));
+  item = eos_profile_db_insert (table, PROBE_DB_META_START_KEY);
+  gvdb_item_set_value (item, g_variant_new_int64 (profile_state->start_time));
 
   /* profile time */
-  g_autofree char *profile_key = g_strdup (PROBE_DB_META_PROFILE_KEY);
-  gsize profile_key_len = strlen (profile_key);
-  GvdbItem *profile_meta = gvdb_hash_table_insert (table, PROBE_DB_META_PROFILE_KEY);
-  gvdb_item_set_parent (profile_meta, get_parent (table, profile_key, profile_key_len));
   gint64 profile_time = profile_state->profile_end - profile_state->profile_start;
-  gvdb_item_set_value (profile_meta, g_variant_new_int64 (profile_time));
-}
+  item = eos_profile_db_insert (table, PROBE_DB_META_PROFILE_KEY);
+  gvdb_item_set_value (item, g_variant_new_int64 (profile_time));
 
-void
-eos_profile_state_dump (void)
-{
-  if (profile_state == NULL)
-    return;
+  /* process */
+  item = eos_profile_db_insert (table, PROBE_DB_META_PID_KEY);
+  gvdb_item_set_value (item, g_variant_new_int32 (profile_state->pid));
 
-  profile_state->profile_end = g_get_monotonic_time ();
+  item = eos_profile_db_insert (table, PROBE_DB_META_PPID_KEY);
+  gvdb_item_set_value (item, g_variant_new_int32 (profile_state->ppid));
 
-  if (!profile_state->capture)
+  if (profile_state->boot_id != NULL)
     {
-      profile_state_dump_to_console ();
-      return;
+      item = eos_profile_db_insert (table, PROBE_DB_META_BOOT_ID_KEY);
+      gvdb_item_set_value (item, g_variant_new_string (profile_state->boot_id));
+    }
+
+  item = eos_profile_db_insert (table, PROBE_DB_META_SESSION_KEY);
+  gvdb_item_set_value (item, g_variant_new_string (profile_state->session));
+}
+
+/* ProfileSample and ProfileCounterSample have the same layout as the
+ * serialized form of (xx), so their arrays can be used as is
+ */
+G_STATIC_ASSERT (sizeof (ProfileSample) == 2 * sizeof (gint64));
+G_STATIC_ASSERT (sizeof (ProfileCounterSample) == 2 * sizeof (gint64));
+
+/* Wraps an array of samples into an a(xx) GVariant, without building a
+ * GVariant for each sample; the variant takes ownership of @samples
+ */
+static GVariant *
+samples_to_variant (GArray *samples)
+{
+  if (samples->len == 0)
+    {
+      g_array_unref (samples);
+      return g_variant_new_array (G_VARIANT_TYPE ("(xx)"), NULL, 0);
     }
 
-  g_autoptr(GHashTable) db_table = gvdb_hash_table_new (NULL, NULL);
+  return g_variant_new_from_data (G_VARIANT_TYPE ("a(xx)"),
+                                  samples->data,
+                                  samples->len * g_array_get_element_size (samples),
+                                  TRUE,
+                                  (GDestroyNotify) g_array_unref,
+                                  samples);
+}
+
+typedef enum {
+  /* All the data, at the end of the process */
+  CAPTURE_FINAL,
+
+  /* The samples completed so far */
+  CAPTURE_SNAPSHOT,
+
+  /* The samples completed since the previous snapshot */
+  CAPTURE_DELTA,
+} CaptureKind;
+
+/* Copies the samples of @probe that are not in the live capture yet, and
+ * marks them as written; samples are written in order, so the copy stops
+ * at the first sample still in flight
+ */
+static GArray *
+probe_collect_live_samples (EosProfileProbe *probe,
+                            gboolean         from_start)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&probe->probe_lock);
+
+  guint first = from_start ? 0 : probe->n_live_samples;
+  guint last = first;
+
+  while (last < probe->samples->len &&
+         g_array_index (probe->samples, ProfileSample, last).end_time >= 0)
+    last++;
+
+  GArray *res = g_array_sized_new (FALSE, FALSE, sizeof (ProfileSample), last - first);
+  g_array_append_vals (res, probe->samples->data + first * sizeof (ProfileSample), last - first);
+
+  probe->n_live_samples = last;
+
+  return res;
+}
+
+/* Serializes the probes and counters into a GVDB table; snapshots copy
+ * the samples, while the final capture takes ownership of them
+ */
+static GHashTable *
+profile_state_build_db (CaptureKind kind)
+{
+  GHashTable *db_table = gvdb_hash_table_new (NULL, NULL);
 
   /* Metadata for the DB */
   add_metadata (db_table);
 
+  G_LOCK (profile_state);
+
   /* Iterate over the probes */
   GHashTableIter iter;
   gpointer value;
@@ -586,60 +1321,213 @@ eos_profile_state_dump (void)
   while (g_hash_table_iter_next (&iter, NULL, &value))
     {
       EosProfileProbe *probe = value;
+      GArray *sorted_samples;
 
-      g_autofree char *key = g_strdup (probe->name);
-      gsize key_len = strlen (probe->name);
+      if (kind == CAPTURE_FINAL)
+        {
+          /* Take ownership of the samples in order to sort them */
+          sorted_samples = g_steal_pointer (&(probe->samples));
+        }
+      else
+        {
+          sorted_samples = probe_collect_live_samples (probe, kind == CAPTURE_SNAPSHOT);
 
-      GvdbItem *item = gvdb_hash_table_insert (db_table, key);
-      gvdb_item_set_parent (item, get_parent (db_table, key, key_len));
+          /* Deltas only list the probes with new samples */
+          if (kind == CAPTURE_DELTA && sorted_samples->len == 0)
+            {
+              g_array_unref (sorted_samples);
+              continue;
+            }
+        }
 
-      GVariantBuilder builder;
+      /* We want to pre-sort the samples so that we can easily discard the
+       * outliers when doing our analysis, later on
+       */
+      g_array_sort (sorted_samples, sample_compare);
 
-      g_variant_builder_init (&builder, G_VARIANT_TYPE (PROBE_DB_META_PROBE_TYPE));
+      GvdbItem *item = eos_profile_db_insert (db_table, probe->name);
 
-      g_variant_builder_add (&builder, "s", probe->name);
-      g_variant_builder_add (&builder, "s", probe->function);
-      g_variant_builder_add (&builder, "s", probe->file);
-      g_variant_builder_add (&builder, "u", probe->line);
+      guint n_samples = sorted_samples->len;
+      GVariant *samples = samples_to_variant (g_steal_pointer (&sorted_samples));
 
-      g_variant_builder_add (&builder, "u", probe->samples->len);
+      gvdb_item_set_value (item, g_variant_new ("(sssuu@a(xx))",
+                                                probe->name,
+                                                probe->function,
+                                                probe->file,
+                                                probe->line,
+                                                n_samples,
+                                                samples));
+    }
 
-      /* Take ownership of the samples in order to sort them; we want to
-       * pre-sort so that we can easily discard the outliers when doing
-       * our analysis, later on
-       */
-      GArray *sorted_samples = g_steal_pointer (&(probe->samples));
-      g_array_sort (sorted_samples, sample_compare);
+  g_hash_table_iter_init (&iter, profile_state->counters);
 
-      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(xx)"));
+  gpointer key;
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const char *name = key;
+      GArray *samples = value;
+      guint first = 0;
 
-      for (int i = 0; i < sorted_samples->len; i++)
+      if (kind == CAPTURE_DELTA)
         {
-          const ProfileSample *sample = &g_array_index (sorted_samples, ProfileSample, i);
+          first = GPOINTER_TO_UINT (g_hash_table_lookup (profile_state->live_counters, name));
 
-          g_variant_builder_open (&builder, G_VARIANT_TYPE ("(xx)"));
-          g_variant_builder_add (&builder, "x", sample->start_time);
-          g_variant_builder_add (&builder, "x", sample->end_time);
-          g_variant_builder_close (&builder);
+          if (first == samples->len)
+            continue;
         }
 
-      g_variant_builder_close (&builder);
+      if (kind != CAPTURE_FINAL)
+        g_hash_table_insert (profile_state->live_counters,
+                             g_strdup (name),
+                             GUINT_TO_POINTER (samples->len));
+
+      GvdbItem *item = eos_profile_db_insert (db_table, name);
 
-      g_array_free (sorted_samples, TRUE);
+      /* Counters keep being updated while taking a snapshot */
+      GArray *copy = g_array_sized_new (FALSE, FALSE, sizeof (ProfileCounterSample),
+                                        samples->len - first);
+      g_array_append_vals (copy,
+                           samples->data + first * sizeof (ProfileCounterSample),
+                           samples->len - first);
 
-      gvdb_item_set_value (item, g_variant_builder_end (&builder));
+      gvdb_item_set_value (item, g_variant_new ("(s@a(xx))",
+                                                name,
+                                                samples_to_variant (copy)));
     }
 
+  G_UNLOCK (profile_state);
+
+  /* Stack samples can only be collected once the sampler is stopped */
+  if (kind == CAPTURE_FINAL && profile_state->sample_frequency != 0)
+    eos_profile_sampler_dump (db_table);
+
+  return db_table;
+}
+
+/*< private >
+ * eos_profile_state_snapshot:
+ *
+ * Writes the data collected so far to the capture file, without
+ * stopping the profiling.
+ */
+void
+eos_profile_state_snapshot (void)
+{
+  static gboolean session_registered;
+
+  if (profile_state == NULL || !profile_state->capture)
+    return;
+
+  profile_state->profile_end = g_get_monotonic_time ();
+
+  /* The program name may not be set yet */
+  gboolean in_session = profile_state->capture_file == NULL;
+  g_autofree char *capture_file = in_session
+    ? get_default_capture_file ()
+    : g_strdup (profile_state->capture_file);
+
+  /* Only the first snapshot writes all the samples; the following ones
+   * are appended to it, so their cost does not grow over time
+   */
+  gboolean append = g_strcmp0 (profile_state->live_file, capture_file) == 0;
+
+  g_autoptr(GHashTable) db_table =
+    profile_state_build_db (append ? CAPTURE_DELTA : CAPTURE_SNAPSHOT);
+
+  g_autoptr(GError) error = NULL;
+  if (append)
+    gvdb_table_append_contents (db_table, capture_file,
+                                G_BYTE_ORDER != G_LITTLE_ENDIAN,
+                                GVDB_WRITE_FLAGS_NONE,
+                                &error);
+  else
+    gvdb_table_write_contents_with_flags (db_table, capture_file,
+                                          G_BYTE_ORDER != G_LITTLE_ENDIAN,
+                                          GVDB_WRITE_FLAGS_PERFECT_HASH,
+                                          &error);
+
+  /* Start over with all the samples if the capture cannot be trusted */
+  g_free (profile_state->live_file);
+  profile_state->live_file = error == NULL ? g_strdup (capture_file) : NULL;
+
+  if (error != NULL)
+    {
+      g_printerr ("PROFILE: %s\n", error->message);
+      return;
+    }
+
+  /* Let the tools find the capture while the process is running */
+  if (in_session && !session_registered)
+    {
+      session_add_process (capture_file);
+      session_registered = TRUE;
+    }
+}
+
+void
+eos_profile_state_dump (void)
+{
+  if (profile_state == NULL)
+    return;
+
+  /* Stop the snapshots before the final capture */
+  if (profile_state->live_interval != 0)
+    eos_profile_live_stop ();
+
+  profile_state->profile_end = g_get_monotonic_time ();
+
+  /* Stop sampling before we start writing the capture */
+  if (profile_state->sample_frequency != 0)
+    eos_profile_sampler_stop ();
+
+  if (profile_state->mainloop)
+    eos_profile_mainloop_stop ();
+
+  if (profile_state->signals)
+    eos_profile_signals_stop ();
+
+  if (profile_state->memory_interval != 0)
+    eos_profile_memory_stop ();
+
+  if (profile_state->census_interval != 0)
+    eos_profile_census_stop ();
+
+  if (!profile_state->capture)
+    {
+      profile_state_dump_to_console ();
+      return;
+    }
+
+  g_autoptr(GHashTable) db_table = profile_state_build_db (CAPTURE_FINAL);
+
+  /* Only the default capture files are part of the session directory */
+  gboolean in_session = profile_state->capture_file == NULL;
+
+  if (in_session)
+    profile_state->capture_file = get_default_capture_file ();
+
   g_autoptr(GError) error = NULL;
-  gvdb_table_write_contents (db_table, profile_state->capture_file,
-                             G_BYTE_ORDER != G_LITTLE_ENDIAN,
-                             &error);
+  gvdb_table_write_contents_with_flags (db_table, profile_state->capture_file,
+                                        G_BYTE_ORDER != G_LITTLE_ENDIAN,
+                                        GVDB_WRITE_FLAGS_PERFECT_HASH,
+                                        &error);
 
   if (error != NULL)
     g_printerr ("PROFILE: %s\n", error->message);
+  else if (in_session)
+    session_add_process (profile_state->capture_file);
 
   /* Clean up */
-  g_hash_table_unref (profile_state->probes);
-  g_free (profile_state->capture_file);
-  g_free (profile_state);
+  G_LOCK (profile_state);
+  ProfileState *state = g_steal_pointer (&profile_state);
+  G_UNLOCK (profile_state);
+
+  g_hash_table_unref (state->probes);
+  g_hash_table_unref (state->counters);
+  g_hash_table_unref (state->live_counters);
+  g_free (state->live_file);
+  g_free (state->capture_file);
+  g_free (state->session);
+  g_free (state->boot_id);
+  g_free (state);
 }
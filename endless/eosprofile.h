@@ -45,4 +45,65 @@ void                    eos_profile_probe_stop  (EosProfileProbe *probe);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(EosProfileProbe, eos_profile_probe_stop)
 
+/**
+ * EosProfileBenchOptions:
+ * @warmup_iterations: the number of iterations run before measuring
+ * @min_iterations: the minimum number of measured iterations
+ * @max_iterations: the maximum number of measured iterations
+ * @max_relative_error: the relative standard error of the mean duration
+ *   below which the measured iterations stop, for instance 0.01 for 1%
+ * @cpu: the CPU to pin the benchmark to, or -1 to leave it to the
+ *   scheduler
+ * @outlier_threshold: how many deviations away from the median an
+ *   iteration can be before it is rejected, or 0 to keep all iterations
+ *
+ * The options of a benchmark run by eos_profile_bench_run().
+ *
+ * Since: 0.6
+ */
+typedef struct _EosProfileBenchOptions  EosProfileBenchOptions;
+
+struct _EosProfileBenchOptions
+{
+  guint warmup_iterations;
+  guint min_iterations;
+  guint max_iterations;
+  double max_relative_error;
+  int cpu;
+  double outlier_threshold;
+
+  /*< private >*/
+  gpointer _padding[8];
+};
+
+/**
+ * EosProfileBenchFunc:
+ * @data: the data passed to eos_profile_bench_run()
+ *
+ * The function run by each iteration of a benchmark.
+ *
+ * Since: 0.6
+ */
+typedef void (* EosProfileBenchFunc) (gpointer data);
+
+#define EOS_TYPE_PROFILE_BENCH_OPTIONS (eos_profile_bench_options_get_type ())
+
+EOS_SDK_AVAILABLE_IN_0_6
+GType eos_profile_bench_options_get_type (void) G_GNUC_CONST;
+
+EOS_SDK_AVAILABLE_IN_0_6
+EosProfileBenchOptions *        eos_profile_bench_options_new   (void);
+EOS_SDK_AVAILABLE_IN_0_6
+EosProfileBenchOptions *        eos_profile_bench_options_copy  (const EosProfileBenchOptions *options);
+EOS_SDK_AVAILABLE_IN_0_6
+void                            eos_profile_bench_options_free  (EosProfileBenchOptions       *options);
+
+EOS_SDK_AVAILABLE_IN_0_6
+double                          eos_profile_bench_run           (const char                   *name,
+                                                                 EosProfileBenchFunc           func,
+                                                                 gpointer                      data,
+                                                                 const EosProfileBenchOptions *options);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(EosProfileBenchOptions, eos_profile_bench_options_free)
+
 G_END_DECLS
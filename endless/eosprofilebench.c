@@ -0,0 +1,306 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+/* sched_setaffinity() and the CPU_* macros are GNU extensions */
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <string.h>
+
+/* Benchmarks
+ *
+ * A benchmark runs a function a number of times to warm up the caches,
+ * then times each call until the mean duration is known precisely enough,
+ * according to its relative standard error, or the maximum number of
+ * iterations is reached. Iterations that are too far from the median,
+ * typically because the thread got preempted, are rejected using the
+ * median absolute deviation, which outliers do not skew.
+ *
+ * The remaining iterations are recorded as the samples of a probe, so
+ * benchmarks can be inspected with the same tools as any other probe.
+ */
+
+#define DEFAULT_WARMUP_ITERATIONS       10
+#define DEFAULT_MIN_ITERATIONS          20
+#define DEFAULT_MAX_ITERATIONS          10000
+#define DEFAULT_MAX_RELATIVE_ERROR      0.01
+#define DEFAULT_OUTLIER_THRESHOLD       3.5
+
+/* Scales the median absolute deviation to the standard deviation of a
+ * normal distribution
+ */
+#define MAD_SCALE                       1.4826
+
+/**
+ * eos_profile_bench_options_new:
+ *
+ * Creates a new #EosProfileBenchOptions with the default values: 10
+ * warm-up iterations, between 20 and 10000 measured iterations until
+ * the relative standard error of the mean is below 1%, no CPU pinning,
+ * and the rejection of the iterations more than 3.5 deviations away
+ * from the median.
+ *
+ * Returns: (transfer full): the newly created options
+ *
+ * Since: 0.6
+ */
+EosProfileBenchOptions *
+eos_profile_bench_options_new (void)
+{
+  EosProfileBenchOptions *res = g_new0 (EosProfileBenchOptions, 1);
+
+  res->warmup_iterations = DEFAULT_WARMUP_ITERATIONS;
+  res->min_iterations = DEFAULT_MIN_ITERATIONS;
+  res->max_iterations = DEFAULT_MAX_ITERATIONS;
+  res->max_relative_error = DEFAULT_MAX_RELATIVE_ERROR;
+  res->cpu = -1;
+  res->outlier_threshold = DEFAULT_OUTLIER_THRESHOLD;
+
+  return res;
+}
+
+/**
+ * eos_profile_bench_options_copy:
+ * @options: a #EosProfileBenchOptions
+ *
+ * Copies @options.
+ *
+ * Returns: (transfer full): a copy of @options
+ *
+ * Since: 0.6
+ */
+EosProfileBenchOptions *
+eos_profile_bench_options_copy (const EosProfileBenchOptions *options)
+{
+  return g_memdup (options, sizeof (EosProfileBenchOptions));
+}
+
+/**
+ * eos_profile_bench_options_free:
+ * @options: a #EosProfileBenchOptions
+ *
+ * Frees @options.
+ *
+ * Since: 0.6
+ */
+void
+eos_profile_bench_options_free (EosProfileBenchOptions *options)
+{
+  g_free (options);
+}
+
+G_DEFINE_BOXED_TYPE (EosProfileBenchOptions, eos_profile_bench_options,
+                     eos_profile_bench_options_copy,
+                     eos_profile_bench_options_free)
+
+static int
+duration_compare (gconstpointer a,
+                  gconstpointer b)
+{
+  double duration_a = *(const double *) a;
+  double duration_b = *(const double *) b;
+
+  if (duration_a < duration_b)
+    return -1;
+
+  if (duration_a > duration_b)
+    return 1;
+
+  return 0;
+}
+
+static double
+median_of (GArray *values)
+{
+  g_array_sort (values, duration_compare);
+
+  guint half = values->len / 2;
+
+  if (values->len % 2 == 0)
+    return (g_array_index (values, double, half - 1) + g_array_index (values, double, half)) / 2.0;
+
+  return g_array_index (values, double, half);
+}
+
+static double
+median_duration (GArray *samples)
+{
+  g_autoptr(GArray) durations = g_array_sized_new (FALSE, FALSE, sizeof (double), samples->len);
+
+  for (int i = 0; i < samples->len; i++)
+    {
+      const ProfileSample *sample = &g_array_index (samples, ProfileSample, i);
+      double duration = sample->end_time - sample->start_time;
+
+      g_array_append_val (durations, duration);
+    }
+
+  return median_of (durations);
+}
+
+static void
+reject_outliers (GArray *samples,
+                 double  threshold)
+{
+  if (threshold <= 0.0 || samples->len < 3)
+    return;
+
+  double median = median_duration (samples);
+
+  g_autoptr(GArray) deviations = g_array_sized_new (FALSE, FALSE, sizeof (double), samples->len);
+
+  for (int i = 0; i < samples->len; i++)
+    {
+      const ProfileSample *sample = &g_array_index (samples, ProfileSample, i);
+      double deviation = fabs ((sample->end_time - sample->start_time) - median);
+
+      g_array_append_val (deviations, deviation);
+    }
+
+  double mad = median_of (deviations) * MAD_SCALE;
+
+  /* More than half of the iterations took exactly the same time */
+  if (mad == 0.0)
+    return;
+
+  for (int i = samples->len - 1; i >= 0; i--)
+    {
+      const ProfileSample *sample = &g_array_index (samples, ProfileSample, i);
+      double deviation = fabs ((sample->end_time - sample->start_time) - median);
+
+      if (deviation / mad > threshold)
+        g_array_remove_index (samples, i);
+    }
+}
+
+/**
+ * eos_profile_bench_run:
+ * @name: a unique name for the probe recording the benchmark
+ * @func: (scope call) (closure data): the function to benchmark
+ * @data: data for @func
+ * @options: (nullable): the options of the benchmark, or %NULL to use
+ *   the defaults of eos_profile_bench_options_new()
+ *
+ * Runs @func repeatedly, and records the duration of each iteration as
+ * a sample of the probe for @name, as if each call was surrounded by
+ * eos_profile_probe_start() and eos_profile_probe_stop().
+ *
+ * The first iterations only warm up the caches and are not measured; the
+ * measured iterations continue until the relative standard error of their
+ * mean duration is below the threshold of @options, or their maximum
+ * number is reached. The iterations that are too far away from the
+ * median are not recorded.
+ *
+ * Durations are measured with g_get_monotonic_time(), so @func should
+ * take at least a few microseconds; faster operations should be repeated
+ * inside @func.
+ *
+ * Benchmarks run even if profiling is not enabled, and only the samples
+ * are not recorded; this way, the result can be used directly.
+ *
+ * Returns: the median duration of the recorded iterations, in
+ *   microseconds
+ *
+ * Since: 0.6
+ */
+double
+eos_profile_bench_run (const char                   *name,
+                       EosProfileBenchFunc           func,
+                       gpointer                      data,
+                       const EosProfileBenchOptions *options)
+{
+  g_return_val_if_fail (name != NULL, 0.0);
+  g_return_val_if_fail (func != NULL, 0.0);
+
+  g_autoptr(EosProfileBenchOptions) defaults = NULL;
+
+  if (options == NULL)
+    options = defaults = eos_profile_bench_options_new ();
+
+  guint max_iterations = MAX (options->max_iterations, 1);
+  guint min_iterations = CLAMP (options->min_iterations, 1, max_iterations);
+
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t saved_cpus;
+  gboolean pinned = FALSE;
+
+  if (options->cpu >= 0 && options->cpu < CPU_SETSIZE &&
+      sched_getaffinity (0, sizeof (cpu_set_t), &saved_cpus) == 0)
+    {
+      cpu_set_t cpus;
+
+      CPU_ZERO (&cpus);
+      CPU_SET (options->cpu, &cpus);
+
+      pinned = sched_setaffinity (0, sizeof (cpu_set_t), &cpus) == 0;
+      if (!pinned)
+        g_warning ("Unable to pin the benchmark '%s' to CPU %d: %s",
+                   name,
+                   options->cpu,
+                   g_strerror (errno));
+    }
+#endif
+
+  for (guint i = 0; i < options->warmup_iterations; i++)
+    func (data);
+
+  g_autoptr(GArray) samples = g_array_new (FALSE, FALSE, sizeof (ProfileSample));
+
+  /* Welford's online algorithm for the running mean and variance */
+  double mean = 0.0;
+  double squares = 0.0;
+
+  for (guint i = 0; i < max_iterations; i++)
+    {
+      gint64 start_time = g_get_monotonic_time ();
+
+      func (data);
+
+      gint64 end_time = g_get_monotonic_time ();
+
+      g_array_append_vals (samples,
+                           &(ProfileSample) {
+                             .start_time = start_time,
+                             .end_time = end_time,
+                           }, 1);
+
+      double duration = end_time - start_time;
+      double delta = duration - mean;
+
+      mean += delta / samples->len;
+      squares += delta * (duration - mean);
+
+      if (samples->len < min_iterations || samples->len < 2)
+        continue;
+
+      /* Iterations below the resolution of the clock are all equal */
+      double stddev = sqrt (squares / (samples->len - 1));
+      double relative_error = mean > 0.0 ? stddev / sqrt (samples->len) / mean : 0.0;
+
+      if (relative_error <= options->max_relative_error)
+        break;
+    }
+
+#ifdef HAVE_SCHED_SETAFFINITY
+  if (pinned)
+    sched_setaffinity (0, sizeof (cpu_set_t), &saved_cpus);
+#endif
+
+  reject_outliers (samples, options->outlier_threshold);
+
+  for (int i = 0; i < samples->len; i++)
+    {
+      const ProfileSample *sample = &g_array_index (samples, ProfileSample, i);
+
+      eos_profile_state_add_sample ("", 0, "eos_profile_bench_run", name,
+                                    sample->start_time,
+                                    sample->end_time);
+    }
+
+  return median_duration (samples);
+}
@@ -0,0 +1,207 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <string.h>
+
+/* Instance census
+ *
+ * A background thread periodically records, as counters:
+ *
+ *  - the number of live instances of every GObject type, under
+ *    /com/endlessm/Sdk/census/live; GObject only keeps track of them if
+ *    the GOBJECT_DEBUG environment variable contains "instance-count"
+ *    when the process starts, and we only record the types that had at
+ *    least one live instance at some point
+ *  - the number of instances of the SDK types constructed since the
+ *    start of the process, under /com/endlessm/Sdk/census/constructed;
+ *    the SDK types report their own construction
+ */
+
+static GThread *census_thread;
+static GMutex census_lock;
+static GCond census_cond;
+static gboolean census_running;
+static guint census_interval;
+static gboolean census_has_instance_count;
+
+/* Only accessed by the census thread
+ *
+ * element-type GType
+ */
+static GHashTable *census_seen_types;
+
+G_LOCK_DEFINE_STATIC (construct_counts);
+static volatile int census_enabled;
+
+/* element-type (key GType) (value guint) */
+static GHashTable *construct_counts;
+
+/*< private >
+ * eos_profile_census_construct:
+ * @type: the #GType of an SDK class
+ *
+ * Counts the construction of an instance of @type; SDK classes call this
+ * from their instance initialization function.
+ */
+void
+eos_profile_census_construct (GType type)
+{
+  if (G_LIKELY (!census_enabled))
+    return;
+
+  G_LOCK (construct_counts);
+
+  guint count = GPOINTER_TO_UINT (g_hash_table_lookup (construct_counts, GSIZE_TO_POINTER (type)));
+  g_hash_table_insert (construct_counts, GSIZE_TO_POINTER (type), GUINT_TO_POINTER (count + 1));
+
+  G_UNLOCK (construct_counts);
+}
+
+static void
+census_add_live_counts (GType  type,
+                        gint64 now)
+{
+  int count = g_type_get_instance_count (type);
+
+  if (count > 0)
+    g_hash_table_add (census_seen_types, GSIZE_TO_POINTER (type));
+
+  if (g_hash_table_contains (census_seen_types, GSIZE_TO_POINTER (type)))
+    {
+      g_autofree char *name =
+        g_strconcat (PROBE_DB_CENSUS_LIVE_KEY "/", g_type_name (type), NULL);
+
+      eos_profile_state_add_counter (name, now, count);
+    }
+
+  guint n_children = 0;
+  g_autofree GType *children = g_type_children (type, &n_children);
+
+  for (guint i = 0; i < n_children; i++)
+    census_add_live_counts (children[i], now);
+}
+
+static void
+census_add_construct_counts (gint64 now)
+{
+  G_LOCK (construct_counts);
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init (&iter, construct_counts);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      g_autofree char *name =
+        g_strconcat (PROBE_DB_CENSUS_CONSTRUCTED_KEY "/",
+                     g_type_name ((GType) GPOINTER_TO_SIZE (key)),
+                     NULL);
+
+      eos_profile_state_add_counter (name, now, GPOINTER_TO_UINT (value));
+    }
+
+  G_UNLOCK (construct_counts);
+}
+
+static void
+census_snapshot (void)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (census_has_instance_count)
+    census_add_live_counts (G_TYPE_OBJECT, now);
+
+  census_add_construct_counts (now);
+}
+
+static gpointer
+census_thread_func (gpointer data)
+{
+  g_mutex_lock (&census_lock);
+
+  while (census_running)
+    {
+      g_mutex_unlock (&census_lock);
+
+      census_snapshot ();
+
+      g_mutex_lock (&census_lock);
+
+      gint64 deadline = g_get_monotonic_time () + census_interval * G_TIME_SPAN_MILLISECOND;
+
+      while (census_running)
+        {
+          if (!g_cond_wait_until (&census_cond, &census_lock, deadline))
+            break;
+        }
+    }
+
+  g_mutex_unlock (&census_lock);
+
+  return NULL;
+}
+
+static gboolean
+has_instance_count_debug (void)
+{
+  const GDebugKey keys[] = {
+    { "instance-count", 1 },
+  };
+
+  const char *str = g_getenv ("GOBJECT_DEBUG");
+  if (str == NULL)
+    return FALSE;
+
+  return g_parse_debug_string (str, keys, G_N_ELEMENTS (keys)) != 0;
+}
+
+/*< private >
+ * eos_profile_census_start:
+ * @interval: the interval between snapshots, in milliseconds
+ *
+ * Starts taking periodic snapshots of the live instances.
+ */
+void
+eos_profile_census_start (guint interval)
+{
+  if (census_thread != NULL)
+    return;
+
+  census_has_instance_count = has_instance_count_debug ();
+  if (!census_has_instance_count)
+    g_printerr ("PROFILE: Set GOBJECT_DEBUG=instance-count to record the number "
+                "of live instances of each type\n");
+
+  construct_counts = g_hash_table_new (NULL, NULL);
+  census_seen_types = g_hash_table_new (NULL, NULL);
+  census_enabled = TRUE;
+
+  census_interval = interval;
+  census_running = TRUE;
+  census_thread = g_thread_new ("eos-profile-census", census_thread_func, NULL);
+}
+
+/*< private >
+ * eos_profile_census_stop:
+ *
+ * Stops taking snapshots of the live instances, and takes a final one.
+ */
+void
+eos_profile_census_stop (void)
+{
+  if (census_thread == NULL)
+    return;
+
+  g_mutex_lock (&census_lock);
+  census_running = FALSE;
+  g_cond_signal (&census_cond);
+  g_mutex_unlock (&census_lock);
+
+  g_thread_join (g_steal_pointer (&census_thread));
+
+  census_snapshot ();
+
+  census_enabled = FALSE;
+}
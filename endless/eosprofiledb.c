@@ -0,0 +1,72 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <string.h>
+
+/* This file is also built into the programs that write captures without
+ * linking to the library, like the eos-profile tool and the GVDB tests,
+ * so that they lay out the nested tables the same way
+ */
+
+/* Get the immediate parent table in the GVDB table, using the
+ * key separator '/' to determine the nesting level. If needed,
+ * this function will create the intermediate tables
+ */
+static GvdbItem *
+get_parent (GHashTable *table,
+            char       *key,
+            int         length)
+{
+  GvdbItem *grandparent, *parent;
+
+  if (length == 1)
+    return NULL;
+
+  while (key[--length - 1] != '/')
+    ;
+
+  key[length] = '\0';
+
+  parent = g_hash_table_lookup (table, key);
+
+  if (parent == NULL)
+    {
+      parent = gvdb_hash_table_insert (table, key);
+
+      grandparent = get_parent (table, key, length);
+
+      if (grandparent != NULL)
+        gvdb_item_set_parent (parent, grandparent);
+    }
+
+  return parent;
+}
+
+/*< private >
+ * eos_profile_db_insert:
+ * @db_table: the GVDB table
+ * @key: the key to insert
+ *
+ * Inserts @key inside @db_table, and creates all the intermediate tables
+ * needed to reach it.
+ *
+ * Returns: (transfer none): the newly inserted item
+ */
+GvdbItem *
+eos_profile_db_insert (GHashTable *db_table,
+                       const char *key)
+{
+  g_autofree char *parent_key = g_strdup (key);
+  gsize parent_key_len = strlen (parent_key);
+
+  GvdbItem *item = gvdb_hash_table_insert (db_table, key);
+  GvdbItem *parent = get_parent (db_table, parent_key, parent_key_len);
+
+  if (parent != NULL)
+    gvdb_item_set_parent (item, parent);
+
+  return item;
+}
@@ -0,0 +1,231 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <gtk/gtk.h>
+
+/* Frame clock instrumentation
+ *
+ * Each frame of a toplevel goes through a sequence of phases, which the
+ * GdkFrameClock announces by emitting a signal at the beginning of each
+ * one; phases that were not requested are skipped. We record the time at
+ * which each phase begins, and close the current phase when the next one
+ * begins.
+ *
+ * The interval between two frames is only meaningful while the clock is
+ * painting continuously. The clock only runs the update phase while an
+ * animation or a tick callback needs it, and it then paints every frame,
+ * so when two frames in a row ran the update phase, any interval between
+ * them is a stall. Otherwise, we ignore intervals that are too long
+ * compared to the refresh interval, as they are just the clock being idle.
+ */
+
+#define FRAMES_QUARK_NAME       "eos-profile-frames"
+
+/* Outside of animations, intervals longer than this number of refresh
+ * intervals are idle time
+ */
+#define MAX_FRAME_INTERVALS     4
+
+/* Used if the frame clock does not know the refresh rate of the monitor */
+#define DEFAULT_REFRESH_INTERVAL        (G_USEC_PER_SEC / 60)
+
+typedef enum {
+  FRAME_PHASE_NONE = -1,
+
+  FRAME_PHASE_FLUSH_EVENTS,
+  FRAME_PHASE_BEFORE_PAINT,
+  FRAME_PHASE_UPDATE,
+  FRAME_PHASE_LAYOUT,
+  FRAME_PHASE_PAINT,
+  FRAME_PHASE_AFTER_PAINT,
+  FRAME_PHASE_RESUME_EVENTS,
+
+  N_FRAME_PHASES
+} FramePhase;
+
+static const struct {
+  const char *signal_name;
+  const char *probe_name;
+} frame_phases[N_FRAME_PHASES] = {
+  [FRAME_PHASE_FLUSH_EVENTS] = { "flush-events", PROBE_DB_FRAMES_BASE_KEY "/flush-events" },
+  [FRAME_PHASE_BEFORE_PAINT] = { "before-paint", PROBE_DB_FRAMES_BASE_KEY "/before-paint" },
+  [FRAME_PHASE_UPDATE] = { "update", PROBE_DB_FRAMES_BASE_KEY "/update" },
+  [FRAME_PHASE_LAYOUT] = { "layout", PROBE_DB_FRAMES_BASE_KEY "/layout" },
+  [FRAME_PHASE_PAINT] = { "paint", PROBE_DB_FRAMES_BASE_KEY "/paint" },
+  [FRAME_PHASE_AFTER_PAINT] = { "after-paint", PROBE_DB_FRAMES_BASE_KEY "/after-paint" },
+  [FRAME_PHASE_RESUME_EVENTS] = { "resume-events", PROBE_DB_FRAMES_BASE_KEY "/resume-events" },
+};
+
+typedef struct {
+  FramePhase current_phase;
+  gint64 phase_start;
+
+  gint64 frame_start;
+  gint64 last_frame_start;
+
+  /* Whether the current and the previous frames ran the update phase */
+  gboolean frame_updating;
+  gboolean last_frame_updating;
+
+  gint64 dropped_frames;
+} FrameTimings;
+
+static gboolean frames_enabled;
+
+void
+eos_profile_frames_enable (void)
+{
+  frames_enabled = TRUE;
+}
+
+static void
+frame_timings_close_phase (FrameTimings *timings,
+                           gint64        now)
+{
+  if (timings->current_phase == FRAME_PHASE_NONE)
+    return;
+
+  eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                frame_phases[timings->current_phase].probe_name,
+                                timings->phase_start, now);
+
+  timings->current_phase = FRAME_PHASE_NONE;
+}
+
+static gint64
+get_refresh_interval (GdkFrameClock *clock)
+{
+  gint64 refresh_interval = 0;
+
+  gdk_frame_clock_get_refresh_info (clock, 0, &refresh_interval, NULL);
+
+  return refresh_interval > 0 ? refresh_interval : DEFAULT_REFRESH_INTERVAL;
+}
+
+static void
+frame_timings_begin_frame (FrameTimings *timings,
+                           gint64        now)
+{
+  timings->last_frame_start = timings->frame_start;
+  timings->frame_start = now;
+
+  timings->last_frame_updating = timings->frame_updating;
+  timings->frame_updating = FALSE;
+}
+
+/* Records the interval since the previous frame, once we know whether
+ * the current frame is part of an animation
+ */
+static void
+frame_timings_end_frame (FrameTimings  *timings,
+                         GdkFrameClock *clock)
+{
+  if (timings->last_frame_start == 0)
+    return;
+
+  gint64 interval = timings->frame_start - timings->last_frame_start;
+  gint64 refresh_interval = get_refresh_interval (clock);
+  gboolean animating = timings->frame_updating && timings->last_frame_updating;
+
+  if (!animating && interval > refresh_interval * MAX_FRAME_INTERVALS)
+    return;
+
+  eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                PROBE_DB_FRAMES_BASE_KEY "/interval",
+                                timings->last_frame_start, timings->frame_start);
+
+  /* Round to the nearest number of refresh intervals */
+  gint64 missed = (interval + refresh_interval / 2) / refresh_interval - 1;
+
+  if (missed > 0)
+    {
+      timings->dropped_frames += missed;
+
+      eos_profile_state_add_counter (PROBE_DB_FRAMES_BASE_KEY "/dropped",
+                                     timings->frame_start,
+                                     timings->dropped_frames);
+    }
+}
+
+static void
+on_frame_phase (GdkFrameClock *clock,
+                gpointer       data)
+{
+  gint64 now = g_get_monotonic_time ();
+  FrameTimings *timings = g_object_get_qdata (G_OBJECT (clock),
+                                              g_quark_from_static_string (FRAMES_QUARK_NAME));
+  FramePhase phase = GPOINTER_TO_INT (data);
+
+  frame_timings_close_phase (timings, now);
+
+  if (phase == FRAME_PHASE_FLUSH_EVENTS)
+    frame_timings_begin_frame (timings, now);
+  else if (phase == FRAME_PHASE_UPDATE)
+    timings->frame_updating = TRUE;
+
+  timings->current_phase = phase;
+  timings->phase_start = now;
+}
+
+static void
+on_frame_end (GdkFrameClock *clock,
+              gpointer       data)
+{
+  gint64 now = g_get_monotonic_time ();
+  FrameTimings *timings = g_object_get_qdata (G_OBJECT (clock),
+                                              g_quark_from_static_string (FRAMES_QUARK_NAME));
+
+  frame_timings_close_phase (timings, now);
+
+  if (timings->frame_start == 0)
+    return;
+
+  eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                PROBE_DB_FRAMES_BASE_KEY "/frame",
+                                timings->frame_start, now);
+
+  frame_timings_end_frame (timings, clock);
+}
+
+/*< private >
+ * eos_profile_frames_attach:
+ * @widget: a realized toplevel #GtkWidget
+ *
+ * Records the timings of each frame painted by the frame clock of
+ * @widget, if frame profiling is enabled.
+ */
+void
+eos_profile_frames_attach (GtkWidget *widget)
+{
+  if (!frames_enabled)
+    return;
+
+  GdkFrameClock *clock = gtk_widget_get_frame_clock (widget);
+  if (clock == NULL)
+    return;
+
+  GQuark quark = g_quark_from_static_string (FRAMES_QUARK_NAME);
+
+  /* The frame clock goes away with the GdkWindow, so a window that has been
+   * unrealized and realized again gets a new clock
+   */
+  if (g_object_get_qdata (G_OBJECT (clock), quark) != NULL)
+    return;
+
+  FrameTimings *timings = g_new0 (FrameTimings, 1);
+  timings->current_phase = FRAME_PHASE_NONE;
+
+  g_object_set_qdata_full (G_OBJECT (clock), quark, timings, g_free);
+
+  for (int i = 0; i < N_FRAME_PHASES; i++)
+    g_signal_connect (clock, frame_phases[i].signal_name,
+                      G_CALLBACK (on_frame_phase),
+                      GINT_TO_POINTER (i));
+
+  g_signal_connect_after (clock, "resume-events",
+                          G_CALLBACK (on_frame_end),
+                          NULL);
+}
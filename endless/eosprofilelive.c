@@ -0,0 +1,87 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+/* Live captures
+ *
+ * A background thread periodically writes a snapshot of the data
+ * collected so far to the capture file, so that tools like `eos-profile
+ * top` can follow a process while it's running. The first snapshot
+ * writes the capture file, and the following ones append the samples
+ * completed since as segments of the file; the final capture replaces
+ * the file with a single table when the process terminates.
+ */
+
+static GThread *live_thread;
+static GMutex live_lock;
+static GCond live_cond;
+static gboolean live_running;
+static guint live_interval;
+
+static gpointer
+live_thread_func (gpointer data)
+{
+  g_mutex_lock (&live_lock);
+
+  while (live_running)
+    {
+      gint64 deadline = g_get_monotonic_time () + live_interval * G_TIME_SPAN_MILLISECOND;
+
+      while (live_running)
+        {
+          if (!g_cond_wait_until (&live_cond, &live_lock, deadline))
+            break;
+        }
+
+      if (!live_running)
+        break;
+
+      g_mutex_unlock (&live_lock);
+
+      eos_profile_state_snapshot ();
+
+      g_mutex_lock (&live_lock);
+    }
+
+  g_mutex_unlock (&live_lock);
+
+  return NULL;
+}
+
+/*< private >
+ * eos_profile_live_start:
+ * @interval: the interval between snapshots, in milliseconds
+ *
+ * Starts writing periodic snapshots of the capture.
+ */
+void
+eos_profile_live_start (guint interval)
+{
+  if (live_thread != NULL)
+    return;
+
+  live_interval = interval;
+  live_running = TRUE;
+  live_thread = g_thread_new ("eos-profile-live", live_thread_func, NULL);
+}
+
+/*< private >
+ * eos_profile_live_stop:
+ *
+ * Stops writing snapshots of the capture.
+ */
+void
+eos_profile_live_stop (void)
+{
+  if (live_thread == NULL)
+    return;
+
+  g_mutex_lock (&live_lock);
+  live_running = FALSE;
+  g_cond_signal (&live_cond);
+  g_mutex_unlock (&live_lock);
+
+  g_thread_join (g_steal_pointer (&live_thread));
+}
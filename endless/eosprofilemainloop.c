@@ -0,0 +1,341 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+/* Main loop instrumentation
+ *
+ * GLib does not provide a way to observe the dispatch of a GSource, and
+ * we do not want to change the sources seen by the application, so we
+ * only interpose ourselves in the poll function of the default main
+ * context: everything that happens between the main loop waking up from
+ * a poll and going back to it is one iteration, which we time as a whole.
+ *
+ * In order to know which sources were dispatched during an iteration, we
+ * arm a timer on the thread when it wakes up; while the iteration lasts,
+ * the timer sends a signal to the thread every SAMPLE_INTERVAL, and the
+ * signal handler notes the source returned by g_main_current_source().
+ * A source is timed from the first to the last time it has been seen, so
+ * callbacks that return within SAMPLE_INTERVAL are only accounted for by
+ * the iteration; those are not the ones that block the main loop.
+ *
+ * The signal handler cannot allocate or take locks, so it only fills a
+ * fixed table of the sources seen during the current iteration, which we
+ * turn into samples when the thread goes back to poll.
+ */
+
+/* glibc only exposes the field name with _GNU_SOURCE */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#define SAMPLE_INTERVAL         1000    /* µs */
+#define MAX_ITERATION_SOURCES   16
+#define MAX_SOURCE_NAME         64
+
+typedef struct {
+  GSource *source;
+  char name[MAX_SOURCE_NAME];
+  gint64 first_seen;
+  gint64 last_seen;
+} SeenSource;
+
+static GMainContext *mainloop_context;
+static GPollFunc mainloop_poll_func;
+static volatile int mainloop_running;
+
+static int mainloop_signal;
+static struct sigaction mainloop_old_action;
+static gboolean has_signal_handler;
+
+/* Only accessed by the thread iterating the main context, and by the
+ * signal handler running on the thread owning the timer
+ */
+static pid_t timer_tid;
+static timer_t timer;
+static gboolean has_timer;
+static gboolean timer_failed;
+static gint64 last_wakeup;
+
+static SeenSource seen_sources[MAX_ITERATION_SOURCES];
+static volatile int n_seen_sources;
+static volatile int sampling;
+
+static inline gint64
+mainloop_get_time (void)
+{
+  struct timespec ts;
+
+  /* clock_gettime() is async-signal safe, g_get_monotonic_time() is not
+   * guaranteed to be
+   */
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (((gint64) ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static void
+mainloop_signal_handler (int        signum,
+                         siginfo_t *info,
+                         void      *context)
+{
+  int errno_sv = errno;
+
+  if (!sampling || (pid_t) syscall (SYS_gettid) != timer_tid)
+    goto out;
+
+  GSource *source = g_main_current_source ();
+  if (source == NULL)
+    goto out;
+
+  gint64 now = mainloop_get_time ();
+  int n_seen = n_seen_sources;
+
+  for (int i = 0; i < n_seen; i++)
+    {
+      if (seen_sources[i].source == source)
+        {
+          seen_sources[i].last_seen = now;
+          goto out;
+        }
+    }
+
+  if (n_seen >= MAX_ITERATION_SOURCES)
+    goto out;
+
+  SeenSource *seen = &seen_sources[n_seen];
+
+  /* The source is kept alive by GLib while it's being dispatched */
+  const char *name = g_source_get_name (source);
+  int len = 0;
+
+  if (name != NULL)
+    {
+      for (; len < MAX_SOURCE_NAME - 1 && name[len] != '\0'; len++)
+        seen->name[len] = name[len];
+    }
+
+  seen->name[len] = '\0';
+  seen->source = source;
+  seen->first_seen = now;
+  seen->last_seen = now;
+
+  n_seen_sources = n_seen + 1;
+
+out:
+  errno = errno_sv;
+}
+
+static char *
+get_probe_name (const char *category,
+                const char *name)
+{
+  if (*name == '\0')
+    name = "unnamed";
+
+  char *res = g_strconcat (PROBE_DB_MAINLOOP_BASE_KEY "/", category, "/", name, NULL);
+
+  /* Source names are free form, but slashes have a special meaning
+   * for probes
+   */
+  for (char *p = res + strlen (PROBE_DB_MAINLOOP_BASE_KEY "/") + strlen (category) + 1; *p != '\0'; p++)
+    {
+      if (*p == '/')
+        *p = '_';
+    }
+
+  return res;
+}
+
+/* The timer belongs to the first thread iterating the main context */
+static gboolean
+ensure_timer (void)
+{
+  if (has_timer)
+    return (pid_t) syscall (SYS_gettid) == timer_tid;
+
+  if (timer_failed || !has_signal_handler)
+    return FALSE;
+
+  /* GLib allocates the dispatch state of the thread the first time it's
+   * needed, which is not something we can do inside a signal handler
+   */
+  g_main_current_source ();
+
+  struct sigevent sev;
+
+  memset (&sev, 0, sizeof (sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = mainloop_signal;
+  sev.sigev_notify_thread_id = (pid_t) syscall (SYS_gettid);
+
+  if (timer_create (CLOCK_MONOTONIC, &sev, &timer) < 0)
+    {
+      int errno_sv = errno;
+
+      g_printerr ("PROFILE: Unable to create the main loop timer: %s\n",
+                  g_strerror (errno_sv));
+      timer_failed = TRUE;
+      return FALSE;
+    }
+
+  timer_tid = sev.sigev_notify_thread_id;
+  has_timer = TRUE;
+
+  return TRUE;
+}
+
+static void
+start_iteration (void)
+{
+  last_wakeup = mainloop_get_time ();
+
+  if (!ensure_timer ())
+    return;
+
+  struct itimerspec spec = {
+    .it_interval = { 0, SAMPLE_INTERVAL * 1000 },
+    .it_value = { 0, SAMPLE_INTERVAL * 1000 },
+  };
+
+  n_seen_sources = 0;
+  sampling = TRUE;
+
+  if (timer_settime (timer, 0, &spec, NULL) < 0)
+    sampling = FALSE;
+}
+
+static void
+finish_iteration (void)
+{
+  if (last_wakeup == 0)
+    return;
+
+  gint64 now = mainloop_get_time ();
+
+  /* Stop the signal handler from touching the table before disarming
+   * the timer, as a signal may still be pending
+   */
+  if (sampling)
+    {
+      struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+
+      sampling = FALSE;
+      timer_settime (timer, 0, &spec, NULL);
+    }
+
+  eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                PROBE_DB_MAINLOOP_BASE_KEY "/iteration",
+                                last_wakeup, now);
+
+  for (int i = 0; i < n_seen_sources; i++)
+    {
+      const SeenSource *seen = &seen_sources[i];
+
+      /* The source started at most one interval before we first saw it */
+      gint64 start_time = MAX (last_wakeup, seen->first_seen - SAMPLE_INTERVAL);
+
+      g_autofree char *dispatch_name = get_probe_name ("dispatch", seen->name);
+      eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                    dispatch_name,
+                                    start_time, seen->last_seen);
+
+      g_autofree char *latency_name = get_probe_name ("latency", seen->name);
+      eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                    latency_name,
+                                    last_wakeup, start_time);
+    }
+
+  n_seen_sources = 0;
+  last_wakeup = 0;
+}
+
+static gint
+instrumented_poll (GPollFD *fds,
+                   guint    n_fds,
+                   gint     timeout)
+{
+  if (mainloop_running)
+    finish_iteration ();
+
+  gint res = mainloop_poll_func (fds, n_fds, timeout);
+
+  if (mainloop_running)
+    start_iteration ();
+
+  return res;
+}
+
+void
+eos_profile_mainloop_start (void)
+{
+  if (mainloop_context != NULL)
+    return;
+
+  /* The realtime signals are not used by GLib or GTK; we still check that
+   * nobody else has claimed ours
+   */
+  mainloop_signal = SIGRTMIN + 1;
+
+  if (sigaction (mainloop_signal, NULL, &mainloop_old_action) == 0 &&
+      (mainloop_old_action.sa_flags & SA_SIGINFO) == 0 &&
+      mainloop_old_action.sa_handler == SIG_DFL)
+    {
+      struct sigaction sa;
+
+      memset (&sa, 0, sizeof (sa));
+      sa.sa_sigaction = mainloop_signal_handler;
+      sa.sa_flags = SA_SIGINFO | SA_RESTART;
+      sigemptyset (&sa.sa_mask);
+
+      has_signal_handler = sigaction (mainloop_signal, &sa, NULL) == 0;
+    }
+
+  if (!has_signal_handler)
+    g_printerr ("PROFILE: Unable to install the main loop signal handler; "
+                "only the iterations will be timed\n");
+
+  mainloop_context = g_main_context_ref (g_main_context_default ());
+  mainloop_poll_func = g_main_context_get_poll_func (mainloop_context);
+  g_main_context_set_poll_func (mainloop_context, instrumented_poll);
+
+  mainloop_running = TRUE;
+}
+
+void
+eos_profile_mainloop_stop (void)
+{
+  if (mainloop_context == NULL)
+    return;
+
+  mainloop_running = FALSE;
+  sampling = FALSE;
+
+  g_main_context_set_poll_func (mainloop_context, mainloop_poll_func);
+  g_clear_pointer (&mainloop_context, g_main_context_unref);
+
+  if (has_timer)
+    {
+      timer_delete (timer);
+      has_timer = FALSE;
+    }
+
+  if (has_signal_handler)
+    {
+      sigaction (mainloop_signal, &mainloop_old_action, NULL);
+      has_signal_handler = FALSE;
+    }
+
+  timer_failed = FALSE;
+  last_wakeup = 0;
+  n_seen_sources = 0;
+}
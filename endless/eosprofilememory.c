@@ -0,0 +1,180 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Memory footprint sampler
+ *
+ * A background thread periodically records the memory used by the process
+ * as counters under /com/endlessm/Sdk/memory, all in bytes:
+ *
+ *  - the virtual size, the resident set and the shared pages, from
+ *    /proc/self/statm
+ *  - the proportional set size, from /proc/self/smaps_rollup, which
+ *    accounts for the pages shared with other processes; not every
+ *    kernel provides it
+ *  - the memory allocated on the heap, and the memory the allocator
+ *    obtained from the system, from mallinfo2()
+ */
+
+#define MEMORY_VIRTUAL_KEY      PROBE_DB_MEMORY_BASE_KEY "/virtual"
+#define MEMORY_RESIDENT_KEY     PROBE_DB_MEMORY_BASE_KEY "/resident"
+#define MEMORY_SHARED_KEY       PROBE_DB_MEMORY_BASE_KEY "/shared"
+#define MEMORY_PSS_KEY          PROBE_DB_MEMORY_BASE_KEY "/pss"
+#define MEMORY_HEAP_USED_KEY    PROBE_DB_MEMORY_BASE_KEY "/heap-used"
+#define MEMORY_HEAP_TOTAL_KEY   PROBE_DB_MEMORY_BASE_KEY "/heap-total"
+
+static GThread *sampler_thread;
+static GMutex sampler_lock;
+static GCond sampler_cond;
+static gboolean sampler_running;
+static guint sampler_interval;
+
+static gboolean has_smaps_rollup = TRUE;
+
+static void
+sample_statm (gint64 now)
+{
+  g_autofree char *contents = NULL;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    return;
+
+  guint64 size = 0, resident = 0, shared = 0;
+  if (sscanf (contents, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+              &size, &resident, &shared) != 3)
+    return;
+
+  long page_size = sysconf (_SC_PAGESIZE);
+
+  eos_profile_state_add_counter (MEMORY_VIRTUAL_KEY, now, size * page_size);
+  eos_profile_state_add_counter (MEMORY_RESIDENT_KEY, now, resident * page_size);
+  eos_profile_state_add_counter (MEMORY_SHARED_KEY, now, shared * page_size);
+}
+
+static void
+sample_smaps_rollup (gint64 now)
+{
+  g_autofree char *contents = NULL;
+
+  if (!has_smaps_rollup)
+    return;
+
+  /* Added in Linux 4.14 */
+  if (!g_file_get_contents ("/proc/self/smaps_rollup", &contents, NULL, NULL))
+    {
+      has_smaps_rollup = FALSE;
+      return;
+    }
+
+  const char *pss = strstr (contents, "\nPss:");
+  if (pss == NULL)
+    return;
+
+  guint64 pss_kb = g_ascii_strtoull (pss + strlen ("\nPss:"), NULL, 10);
+
+  eos_profile_state_add_counter (MEMORY_PSS_KEY, now, pss_kb * 1024);
+}
+
+static void
+sample_heap (gint64 now)
+{
+#ifdef HAVE_MALLINFO2
+  struct mallinfo2 info = mallinfo2 ();
+
+  eos_profile_state_add_counter (MEMORY_HEAP_USED_KEY, now, info.uordblks + info.hblkhd);
+  eos_profile_state_add_counter (MEMORY_HEAP_TOTAL_KEY, now, info.arena + info.hblkhd);
+#endif
+}
+
+/*< private >
+ * eos_profile_memory_snapshot:
+ *
+ * Records the memory footprint of the process at this moment.
+ */
+void
+eos_profile_memory_snapshot (void)
+{
+  if (sampler_interval == 0)
+    return;
+
+  gint64 now = g_get_monotonic_time ();
+
+  sample_statm (now);
+  sample_smaps_rollup (now);
+  sample_heap (now);
+}
+
+static gpointer
+memory_sampler_thread (gpointer data)
+{
+  g_mutex_lock (&sampler_lock);
+
+  while (sampler_running)
+    {
+      g_mutex_unlock (&sampler_lock);
+
+      eos_profile_memory_snapshot ();
+
+      g_mutex_lock (&sampler_lock);
+
+      gint64 deadline = g_get_monotonic_time () + sampler_interval * G_TIME_SPAN_MILLISECOND;
+
+      while (sampler_running)
+        {
+          if (!g_cond_wait_until (&sampler_cond, &sampler_lock, deadline))
+            break;
+        }
+    }
+
+  g_mutex_unlock (&sampler_lock);
+
+  return NULL;
+}
+
+/*< private >
+ * eos_profile_memory_start:
+ * @interval: the sampling interval, in milliseconds
+ *
+ * Starts sampling the memory footprint of the process.
+ */
+void
+eos_profile_memory_start (guint interval)
+{
+  if (sampler_thread != NULL)
+    return;
+
+  sampler_interval = interval;
+  sampler_running = TRUE;
+  sampler_thread = g_thread_new ("eos-profile-memory", memory_sampler_thread, NULL);
+}
+
+/*< private >
+ * eos_profile_memory_stop:
+ *
+ * Stops sampling the memory footprint of the process, and takes a
+ * final snapshot.
+ */
+void
+eos_profile_memory_stop (void)
+{
+  if (sampler_thread == NULL)
+    return;
+
+  g_mutex_lock (&sampler_lock);
+  sampler_running = FALSE;
+  g_cond_signal (&sampler_cond);
+  g_mutex_unlock (&sampler_lock);
+
+  g_thread_join (g_steal_pointer (&sampler_thread));
+
+  eos_profile_memory_snapshot ();
+
+  sampler_interval = 0;
+}
@@ -0,0 +1,423 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+/* Statistical stack sampler
+ *
+ * Each thread that runs profiling probes gets its own POSIX timer, ticking
+ * on the CPU time consumed by the thread itself; every time the timer fires
+ * we receive a SIGPROF on that same thread, and the signal handler captures
+ * the current stack using backtrace(), alongside the innermost probe that is
+ * in flight on the thread.
+ *
+ * The signal handler cannot allocate or take locks, so each thread owns a
+ * pre-allocated buffer of samples; the handler is the only writer, and the
+ * buffer is only read once all the timers have been deleted.
+ */
+
+/* glibc only exposes the field name with _GNU_SOURCE */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* The first two frames are the signal handler and the signal trampoline */
+#define N_SKIPPED_FRAMES        2
+#define MAX_FRAMES              (32 + N_SKIPPED_FRAMES)
+#define MAX_PROBE_DEPTH         32
+#define N_STACK_SAMPLES         16384
+
+typedef struct {
+  gint64 time;
+  EosProfileProbe *probe;
+  int n_frames;
+  gpointer frames[MAX_FRAMES];
+} StackSample;
+
+typedef struct {
+  pid_t tid;
+
+  timer_t timer;
+  gboolean has_timer;
+
+  /* Only written by the signal handler running on the thread */
+  StackSample *samples;
+  volatile int n_samples;
+  volatile guint n_dropped;
+
+  /* Stack of probes in flight on the thread; depth can go past
+   * MAX_PROBE_DEPTH, in which case we stop recording the probes
+   */
+  EosProfileProbe *probes[MAX_PROBE_DEPTH];
+  volatile int probe_depth;
+} ThreadSampler;
+
+static guint sampler_frequency;
+static volatile int sampler_running;
+
+/* We use a compiler-level thread local variable instead of GPrivate because
+ * we need to access it from the signal handler; the variable is always
+ * set before the timer for the thread is created, which means that the
+ * TLS block has already been allocated by the time the signal handler
+ * reads it
+ */
+static __thread ThreadSampler *current_sampler;
+
+static void thread_sampler_detach (gpointer data);
+
+static GPrivate sampler_key = G_PRIVATE_INIT (thread_sampler_detach);
+
+G_LOCK_DEFINE_STATIC (samplers);
+static GPtrArray *samplers;
+
+static inline gint64
+sampler_get_time (void)
+{
+  struct timespec ts;
+
+  /* clock_gettime() is async-signal safe, g_get_monotonic_time() is not
+   * guaranteed to be
+   */
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (((gint64) ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static void
+sigprof_handler (int        signum,
+                 siginfo_t *info,
+                 void      *context)
+{
+  int errno_sv = errno;
+
+  ThreadSampler *sampler = current_sampler;
+
+  if (!sampler_running || sampler == NULL || sampler->samples == NULL)
+    goto out;
+
+  int idx = sampler->n_samples;
+  if (idx >= N_STACK_SAMPLES)
+    {
+      sampler->n_dropped += 1;
+      goto out;
+    }
+
+  StackSample *sample = &sampler->samples[idx];
+
+  sample->time = sampler_get_time ();
+
+  int depth = MIN (sampler->probe_depth, MAX_PROBE_DEPTH);
+  sample->probe = depth > 0 ? sampler->probes[depth - 1] : NULL;
+
+  sample->n_frames = backtrace (sample->frames, MAX_FRAMES);
+
+  /* Publish the sample only once it has been filled */
+  g_atomic_int_set (&sampler->n_samples, idx + 1);
+
+out:
+  errno = errno_sv;
+}
+
+static void
+thread_sampler_disarm (ThreadSampler *sampler)
+{
+  if (!sampler->has_timer)
+    return;
+
+  timer_delete (sampler->timer);
+  sampler->has_timer = FALSE;
+}
+
+static void
+thread_sampler_detach (gpointer data)
+{
+  ThreadSampler *sampler = data;
+
+  /* The thread is going away; we keep the samples around until the
+   * capture is written, but we must not keep the timer alive
+   */
+  G_LOCK (samplers);
+  thread_sampler_disarm (sampler);
+  G_UNLOCK (samplers);
+}
+
+static ThreadSampler *
+thread_sampler_get (void)
+{
+  ThreadSampler *sampler = current_sampler;
+
+  if (G_LIKELY (sampler != NULL))
+    return sampler;
+
+  sampler = g_new0 (ThreadSampler, 1);
+  sampler->tid = (pid_t) syscall (SYS_gettid);
+  sampler->samples = g_new0 (StackSample, N_STACK_SAMPLES);
+
+  current_sampler = sampler;
+  g_private_set (&sampler_key, sampler);
+
+  G_LOCK (samplers);
+
+  if (samplers != NULL && sampler_running)
+    {
+      struct sigevent sev;
+
+      memset (&sev, 0, sizeof (sev));
+      sev.sigev_notify = SIGEV_THREAD_ID;
+      sev.sigev_signo = SIGPROF;
+      sev.sigev_notify_thread_id = sampler->tid;
+
+      if (timer_create (CLOCK_THREAD_CPUTIME_ID, &sev, &sampler->timer) == 0)
+        {
+          long interval = 1000000000L / sampler_frequency;
+          struct itimerspec spec = {
+            .it_interval = { interval / 1000000000L, interval % 1000000000L },
+            .it_value = { interval / 1000000000L, interval % 1000000000L },
+          };
+
+          sampler->has_timer = TRUE;
+
+          if (timer_settime (sampler->timer, 0, &spec, NULL) < 0)
+            thread_sampler_disarm (sampler);
+        }
+
+      if (!sampler->has_timer)
+        {
+          int errno_sv = errno;
+
+          g_printerr ("PROFILE: Unable to create the sampling timer for thread %d: %s\n",
+                      (int) sampler->tid,
+                      g_strerror (errno_sv));
+        }
+
+      g_ptr_array_add (samplers, sampler);
+    }
+
+  G_UNLOCK (samplers);
+
+  return sampler;
+}
+
+gboolean
+eos_profile_sampler_start (guint frequency)
+{
+  g_return_val_if_fail (frequency > 0, FALSE);
+
+  struct sigaction sa;
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_sigaction = sigprof_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset (&sa.sa_mask);
+
+  if (sigaction (SIGPROF, &sa, NULL) < 0)
+    {
+      int errno_sv = errno;
+
+      g_printerr ("PROFILE: Unable to install the SIGPROF handler: %s\n",
+                  g_strerror (errno_sv));
+      return FALSE;
+    }
+
+  /* backtrace() lazily loads the unwinder the first time it's called,
+   * which is not something we can do inside a signal handler
+   */
+  gpointer frames[4];
+  backtrace (frames, G_N_ELEMENTS (frames));
+
+  G_LOCK (samplers);
+  samplers = g_ptr_array_new ();
+  sampler_frequency = frequency;
+  sampler_running = TRUE;
+  G_UNLOCK (samplers);
+
+  /* Always sample the thread that initialized the profiler */
+  thread_sampler_get ();
+
+  return TRUE;
+}
+
+void
+eos_profile_sampler_stop (void)
+{
+  G_LOCK (samplers);
+
+  sampler_running = FALSE;
+
+  if (samplers != NULL)
+    {
+      for (int i = 0; i < samplers->len; i++)
+        thread_sampler_disarm (g_ptr_array_index (samplers, i));
+    }
+
+  G_UNLOCK (samplers);
+}
+
+void
+eos_profile_sampler_push_probe (EosProfileProbe *probe)
+{
+  if (!sampler_running)
+    return;
+
+  ThreadSampler *sampler = thread_sampler_get ();
+
+  int depth = sampler->probe_depth;
+
+  if (depth < MAX_PROBE_DEPTH)
+    sampler->probes[depth] = probe;
+
+  /* Make sure the probe is stored before the signal handler can see it */
+  g_atomic_int_set (&sampler->probe_depth, depth + 1);
+}
+
+void
+eos_profile_sampler_pop_probe (EosProfileProbe *probe)
+{
+  ThreadSampler *sampler = current_sampler;
+
+  if (!sampler_running || sampler == NULL || sampler->probe_depth == 0)
+    return;
+
+  int depth = sampler->probe_depth;
+
+  if (depth > MAX_PROBE_DEPTH)
+    {
+      g_atomic_int_set (&sampler->probe_depth, depth - 1);
+      return;
+    }
+
+  /* Probes are not guaranteed to be stopped in the same order they
+   * were started, so we unwind the stack up to the probe
+   */
+  for (int i = depth - 1; i >= 0; i--)
+    {
+      if (sampler->probes[i] == probe)
+        {
+          g_atomic_int_set (&sampler->probe_depth, i);
+          return;
+        }
+    }
+}
+
+static GVariant *
+collect_modules (void)
+{
+  g_autofree char *maps = NULL;
+  g_autoptr(GError) error = NULL;
+
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (PROBE_DB_SAMPLES_MODULES_TYPE));
+
+  if (!g_file_get_contents ("/proc/self/maps", &maps, NULL, &error))
+    {
+      g_printerr ("PROFILE: Unable to read the module maps: %s\n", error->message);
+      return g_variant_builder_end (&builder);
+    }
+
+  g_auto(GStrv) lines = g_strsplit (maps, "\n", -1);
+
+  for (int i = 0; lines[i] != NULL; i++)
+    {
+      guint64 start, end, offset;
+      char perms[5];
+      int path_offset = 0;
+
+      if (sscanf (lines[i], "%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x %4s %" G_GINT64_MODIFIER "x %*s %*s %n",
+                  &start, &end, perms, &offset, &path_offset) < 4)
+        continue;
+
+      /* We only care about executable mappings backed by a file */
+      if (perms[2] != 'x' || path_offset == 0 || lines[i][path_offset] != '/')
+        continue;
+
+      g_variant_builder_add (&builder, "(ttts)",
+                             start, end, offset,
+                             lines[i] + path_offset);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+void
+eos_profile_sampler_dump (GHashTable *db_table)
+{
+  g_autoptr(GPtrArray) thread_samplers = NULL;
+
+  G_LOCK (samplers);
+  thread_samplers = g_steal_pointer (&samplers);
+  G_UNLOCK (samplers);
+
+  if (thread_samplers == NULL)
+    return;
+
+  GvdbItem *item;
+
+  item = eos_profile_db_insert (db_table, PROBE_DB_SAMPLES_FREQUENCY_KEY);
+  gvdb_item_set_value (item, g_variant_new_uint32 (sampler_frequency));
+
+  item = eos_profile_db_insert (db_table, PROBE_DB_SAMPLES_MODULES_KEY);
+  gvdb_item_set_value (item, collect_modules ());
+
+  for (int i = 0; i < thread_samplers->len; i++)
+    {
+      ThreadSampler *sampler = g_ptr_array_index (thread_samplers, i);
+      int n_samples = g_atomic_int_get (&sampler->n_samples);
+
+      if (n_samples == 0)
+        continue;
+
+      GVariantBuilder builder;
+      g_variant_builder_init (&builder, G_VARIANT_TYPE (PROBE_DB_SAMPLES_THREAD_TYPE));
+
+      g_variant_builder_add (&builder, "u", sampler->n_dropped);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(xsat)"));
+
+      for (int j = 0; j < n_samples; j++)
+        {
+          const StackSample *sample = &sampler->samples[j];
+
+          if (sample->n_frames <= N_SKIPPED_FRAMES)
+            continue;
+
+          g_variant_builder_open (&builder, G_VARIANT_TYPE ("(xsat)"));
+          g_variant_builder_add (&builder, "x", sample->time);
+          g_variant_builder_add (&builder, "s", sample->probe != NULL ? sample->probe->name : "");
+
+          g_variant_builder_open (&builder, G_VARIANT_TYPE ("at"));
+          for (int k = N_SKIPPED_FRAMES; k < sample->n_frames; k++)
+            g_variant_builder_add (&builder, "t", (guint64) GPOINTER_TO_SIZE (sample->frames[k]));
+          g_variant_builder_close (&builder);
+
+          g_variant_builder_close (&builder);
+        }
+
+      g_variant_builder_close (&builder);
+
+      g_autofree char *key = g_strdup_printf ("%s/%d", PROBE_DB_SAMPLES_THREADS_KEY, (int) sampler->tid);
+
+      item = eos_profile_db_insert (db_table, key);
+      gvdb_item_set_value (item, g_variant_builder_end (&builder));
+    }
+
+  /* The per-thread state is still reachable from the threads themselves,
+   * so we only release the sample buffers
+   */
+  for (int i = 0; i < thread_samplers->len; i++)
+    {
+      ThreadSampler *sampler = g_ptr_array_index (thread_samplers, i);
+
+      g_clear_pointer (&sampler->samples, g_free);
+    }
+}
@@ -0,0 +1,365 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include "eosapplication.h"
+#include "eosattribution-private.h"
+#include "eoscustomcontainer.h"
+#include "eosflexygrid.h"
+#include "eospagemanager.h"
+#include "eostopbar-private.h"
+#include "eoswindow.h"
+
+/* Signal emission instrumentation
+ *
+ * Emission hooks are called at the beginning of each emission, after the
+ * class handlers of G_SIGNAL_RUN_FIRST signals; there is no hook for the
+ * end of the emission, so the first time we see a signal emitted on an
+ * instance we connect a handler that runs after all the other handlers,
+ * and we use it to close the emission. The hooks run before GObject looks
+ * up the handlers of the instance, so the new handler closes the first
+ * emission as well.
+ *
+ * Signals with a return value are not instrumented: an additional handler
+ * would go through their accumulator, and could change their result, and
+ * it would not be called at all once a handler stops the emission by
+ * returning TRUE.
+ */
+
+#define MAX_EMISSION_DEPTH      256
+
+typedef struct {
+  gpointer instance;
+  guint signal_id;
+  gint64 start_time;
+} Emission;
+
+typedef struct {
+  guint signal_id;
+  gulong hook_id;
+
+  /* The types whose instances we want to track for the signal */
+  GArray *types;
+} HookedSignal;
+
+static char *signals_spec;
+static gboolean signals_enabled;
+static volatile int signals_running;
+
+/* element-type (key guint) (value HookedSignal) */
+static GHashTable *hooked_signals;
+
+static GQuark quark_tracked_signals;
+
+static void emission_stack_free (gpointer data);
+
+static GPrivate emission_stack = G_PRIVATE_INIT (emission_stack_free);
+
+static void
+emission_stack_free (gpointer data)
+{
+  g_array_unref (data);
+}
+
+static GArray *
+get_emission_stack (void)
+{
+  GArray *res = g_private_get (&emission_stack);
+
+  if (res == NULL)
+    {
+      res = g_array_new (FALSE, FALSE, sizeof (Emission));
+      g_private_set (&emission_stack, res);
+    }
+
+  return res;
+}
+
+static void
+record_emission (gpointer instance,
+                 guint    signal_id,
+                 gint64   start_time,
+                 gint64   end_time)
+{
+  g_autofree char *name =
+    g_strdup_printf (PROBE_DB_SIGNALS_BASE_KEY "/%s/%s",
+                     G_OBJECT_TYPE_NAME (instance),
+                     g_signal_name (signal_id));
+
+  eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                name,
+                                start_time, end_time);
+}
+
+static void
+emission_end_marshal (GClosure     *closure,
+                      GValue       *return_value,
+                      guint         n_param_values,
+                      const GValue *param_values,
+                      gpointer      invocation_hint,
+                      gpointer      marshal_data)
+{
+  GSignalInvocationHint *ihint = invocation_hint;
+
+  if (!signals_running)
+    return;
+
+  gint64 end_time = g_get_monotonic_time ();
+  gpointer instance = g_value_peek_pointer (&param_values[0]);
+  GArray *stack = get_emission_stack ();
+
+  /* Emissions without an end, for instance because the handler was
+   * connected during the emission, are left on the stack; we discard
+   * them once an outer emission ends
+   */
+  for (int i = stack->len - 1; i >= 0; i--)
+    {
+      const Emission *emission = &g_array_index (stack, Emission, i);
+
+      if (emission->instance == instance && emission->signal_id == ihint->signal_id)
+        {
+          record_emission (instance, emission->signal_id, emission->start_time, end_time);
+          g_array_set_size (stack, i);
+          break;
+        }
+    }
+}
+
+static gboolean
+instance_is_tracked (gpointer      instance,
+                     HookedSignal *hooked)
+{
+  GType instance_type = G_TYPE_FROM_INSTANCE (instance);
+
+  for (int i = 0; i < hooked->types->len; i++)
+    {
+      if (g_type_is_a (instance_type, g_array_index (hooked->types, GType, i)))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+ensure_end_handler (GObject *instance,
+                    guint    signal_id)
+{
+  GHashTable *tracked = g_object_get_qdata (instance, quark_tracked_signals);
+
+  if (tracked == NULL)
+    {
+      tracked = g_hash_table_new (NULL, NULL);
+      g_object_set_qdata_full (instance, quark_tracked_signals,
+                               tracked,
+                               (GDestroyNotify) g_hash_table_unref);
+    }
+
+  if (!g_hash_table_add (tracked, GUINT_TO_POINTER (signal_id)))
+    return;
+
+  GClosure *closure = g_closure_new_simple (sizeof (GClosure), NULL);
+  g_closure_set_marshal (closure, emission_end_marshal);
+  g_signal_connect_closure_by_id (instance, signal_id, 0, closure, TRUE);
+}
+
+static gboolean
+emission_hook (GSignalInvocationHint *ihint,
+               guint                  n_param_values,
+               const GValue          *param_values,
+               gpointer               data)
+{
+  if (!signals_running)
+    return TRUE;
+
+  HookedSignal *hooked = data;
+  gpointer instance = g_value_peek_pointer (&param_values[0]);
+
+  if (instance == NULL || !G_IS_OBJECT (instance) || !instance_is_tracked (instance, hooked))
+    return TRUE;
+
+  ensure_end_handler (instance, ihint->signal_id);
+
+  gint64 start_time = g_get_monotonic_time ();
+  GArray *stack = get_emission_stack ();
+
+  /* A handler stopping the emission prevents us from seeing its end */
+  if (stack->len >= MAX_EMISSION_DEPTH)
+    g_array_set_size (stack, 0);
+
+  g_array_append_vals (stack,
+                       &(Emission) {
+                         .instance = instance,
+                         .signal_id = ihint->signal_id,
+                         .start_time = start_time,
+                       }, 1);
+
+  return TRUE;
+}
+
+static void
+hook_signal (guint signal_id,
+             GType type)
+{
+  HookedSignal *hooked = g_hash_table_lookup (hooked_signals, GUINT_TO_POINTER (signal_id));
+
+  if (hooked == NULL)
+    {
+      GSignalQuery query;
+      g_signal_query (signal_id, &query);
+
+      if (query.signal_id == 0 || (query.signal_flags & G_SIGNAL_NO_HOOKS) != 0)
+        return;
+
+      if ((query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE) != G_TYPE_NONE)
+        return;
+
+      hooked = g_new0 (HookedSignal, 1);
+      hooked->signal_id = signal_id;
+      hooked->types = g_array_new (FALSE, FALSE, sizeof (GType));
+      hooked->hook_id = g_signal_add_emission_hook (signal_id, 0,
+                                                    emission_hook,
+                                                    hooked,
+                                                    NULL);
+
+      g_hash_table_insert (hooked_signals, GUINT_TO_POINTER (signal_id), hooked);
+    }
+
+  for (int i = 0; i < hooked->types->len; i++)
+    {
+      if (g_array_index (hooked->types, GType, i) == type)
+        return;
+    }
+
+  g_array_append_val (hooked->types, type);
+}
+
+/* Hooks all the signals that can be emitted by instances of @type,
+ * including the ones defined by its ancestors and interfaces
+ */
+static void
+hook_all_signals (GType type)
+{
+  g_autoptr(GTypeClass) klass = g_type_class_ref (type);
+
+  for (GType t = type; t != 0; t = g_type_parent (t))
+    {
+      guint n_ids = 0;
+      g_autofree guint *ids = g_signal_list_ids (t, &n_ids);
+
+      for (guint i = 0; i < n_ids; i++)
+        hook_signal (ids[i], type);
+    }
+
+  guint n_ifaces = 0;
+  g_autofree GType *ifaces = g_type_interfaces (type, &n_ifaces);
+
+  for (guint i = 0; i < n_ifaces; i++)
+    {
+      guint n_ids = 0;
+      g_autofree guint *ids = g_signal_list_ids (ifaces[i], &n_ids);
+
+      for (guint j = 0; j < n_ids; j++)
+        hook_signal (ids[j], type);
+    }
+}
+
+static void
+hook_selection (const char *selection)
+{
+  g_auto(GStrv) parts = g_strsplit (selection, "::", 2);
+  GType type = g_type_from_name (parts[0]);
+
+  if (type == G_TYPE_INVALID || !G_TYPE_IS_INSTANTIATABLE (type))
+    {
+      g_printerr ("PROFILE: Unknown type '%s'\n", parts[0]);
+      return;
+    }
+
+  if (parts[1] == NULL)
+    {
+      hook_all_signals (type);
+      return;
+    }
+
+  g_autoptr(GTypeClass) klass = g_type_class_ref (type);
+  guint signal_id = g_signal_lookup (parts[1], type);
+
+  if (signal_id == 0)
+    {
+      g_printerr ("PROFILE: Unknown signal '%s' for type '%s'\n", parts[1], parts[0]);
+      return;
+    }
+
+  GSignalQuery query;
+  g_signal_query (signal_id, &query);
+
+  if ((query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE) != G_TYPE_NONE)
+    {
+      g_printerr ("PROFILE: Signal '%s' of type '%s' returns a value and cannot be timed\n",
+                  parts[1], parts[0]);
+      return;
+    }
+
+  hook_signal (signal_id, type);
+}
+
+void
+eos_profile_signals_enable (const char *spec)
+{
+  g_free (signals_spec);
+  signals_spec = g_strdup (spec);
+  signals_enabled = TRUE;
+}
+
+/* Emission hooks can only be installed on registered types, so we need
+ * to wait until the SDK types can be safely initialized
+ */
+void
+eos_profile_signals_install (void)
+{
+  if (!signals_enabled || hooked_signals != NULL)
+    return;
+
+  quark_tracked_signals = g_quark_from_static_string ("eos-profile-tracked-signals");
+  hooked_signals = g_hash_table_new (NULL, NULL);
+
+  /* This also registers the SDK types, so that they can be found by
+   * name when parsing the selection
+   */
+  const GType sdk_types[] = {
+    EOS_TYPE_APPLICATION,
+    EOS_TYPE_ATTRIBUTION,
+    EOS_TYPE_CUSTOM_CONTAINER,
+    EOS_TYPE_FLEXY_GRID,
+    EOS_TYPE_FLEXY_GRID_CELL,
+    EOS_TYPE_PAGE_MANAGER,
+    EOS_TYPE_TOP_BAR,
+    EOS_TYPE_WINDOW,
+  };
+
+  if (signals_spec != NULL)
+    {
+      g_auto(GStrv) selections = g_strsplit (signals_spec, "+", -1);
+
+      for (int i = 0; selections[i] != NULL; i++)
+        {
+          if (*selections[i] != '\0')
+            hook_selection (selections[i]);
+        }
+    }
+  else
+    {
+      for (int i = 0; i < G_N_ELEMENTS (sdk_types); i++)
+        hook_all_signals (sdk_types[i]);
+    }
+
+  signals_running = TRUE;
+}
+
+void
+eos_profile_signals_stop (void)
+{
+  signals_running = FALSE;
+}
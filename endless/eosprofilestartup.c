@@ -0,0 +1,219 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Startup timeline
+ *
+ * The startup of an application is recorded as a set of spans and marks
+ * under /com/endlessm/Sdk/startup; marks are samples with the same start
+ * and end time. Every timestamp uses the monotonic clock, including the
+ * start of the process, which the kernel gives us in clock ticks since
+ * boot.
+ *
+ * The timeline ends with the first frame of the first window; anything
+ * that happens after that is not part of the startup, and it's ignored.
+ * The first frame is marked when the compositor presented it on screen,
+ * if the windowing system tells us; otherwise, when GTK finished painting
+ * it, which can be a few milliseconds earlier.
+ */
+
+/* How many frames we wait for the presentation time of the first frame */
+#define MAX_PRESENTATION_WAIT   8
+
+static gboolean startup_enabled;
+static gboolean startup_complete;
+
+static gint64 first_frame_counter = -1;
+static gint64 first_frame_paint_time;
+static guint n_presentation_waits;
+
+/* element-type utf8 */
+static GHashTable *recorded_phases;
+
+/* Converts the start time of the process to monotonic time */
+static gint64
+get_process_start_time (void)
+{
+  g_autofree char *contents = NULL;
+
+  if (!g_file_get_contents ("/proc/self/stat", &contents, NULL, NULL))
+    return -1;
+
+  /* The second field is the executable name, which can contain spaces and
+   * parentheses, so we skip past the last closing parenthesis
+   */
+  const char *p = strrchr (contents, ')');
+  if (p == NULL || p[1] != ' ')
+    return -1;
+
+  /* The start time is the 22nd field; the first one after the name is
+   * the 3rd
+   */
+  g_auto(GStrv) fields = g_strsplit (p + 2, " ", -1);
+  if (g_strv_length (fields) < 20)
+    return -1;
+
+  guint64 start_ticks = g_ascii_strtoull (fields[19], NULL, 10);
+  long ticks_per_second = sysconf (_SC_CLK_TCK);
+  if (ticks_per_second <= 0)
+    return -1;
+
+  struct timespec boot_time;
+  if (clock_gettime (CLOCK_BOOTTIME, &boot_time) < 0)
+    return -1;
+
+  gint64 now = g_get_monotonic_time ();
+  gint64 since_boot = boot_time.tv_sec * G_USEC_PER_SEC + boot_time.tv_nsec / 1000;
+  gint64 start_since_boot = start_ticks * G_USEC_PER_SEC / ticks_per_second;
+
+  if (start_since_boot > since_boot)
+    return -1;
+
+  return now - (since_boot - start_since_boot);
+}
+
+static void
+record_phase (const char *phase,
+              gint64      start_time,
+              gint64      end_time)
+{
+  if (!startup_enabled || startup_complete)
+    return;
+
+  if (!g_hash_table_add (recorded_phases, g_strdup (phase)))
+    return;
+
+  g_autofree char *name = g_strconcat (PROBE_DB_STARTUP_BASE_KEY "/", phase, NULL);
+
+  eos_profile_state_add_sample (__FILE__, __LINE__, G_STRFUNC,
+                                name,
+                                start_time, end_time);
+}
+
+/*< private >
+ * eos_profile_startup_init:
+ *
+ * Starts the startup timeline from the beginning of the process.
+ */
+void
+eos_profile_startup_init (void)
+{
+  recorded_phases = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  startup_enabled = TRUE;
+
+  gint64 process_start_time = get_process_start_time ();
+
+  if (process_start_time < 0)
+    return;
+
+  record_phase (PROBE_DB_STARTUP_PROCESS_START, process_start_time, process_start_time);
+
+  /* Everything from the exec() to our constructor: dynamic linking,
+   * relocations, and the constructors of the libraries we depend on
+   */
+  record_phase ("exec", process_start_time, g_get_monotonic_time ());
+}
+
+/*< private >
+ * eos_profile_startup_span:
+ * @phase: the name of the startup phase
+ * @start_time: the beginning of the phase, in monotonic time
+ *
+ * Records a startup phase that began at @start_time and ended now. Only
+ * the first occurrence of each phase is recorded.
+ */
+void
+eos_profile_startup_span (const char *phase,
+                          gint64      start_time)
+{
+  record_phase (phase, start_time, g_get_monotonic_time ());
+}
+
+/*< private >
+ * eos_profile_startup_mark:
+ * @phase: the name of the startup event
+ *
+ * Records the first occurrence of a startup event.
+ */
+void
+eos_profile_startup_mark (const char *phase)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  record_phase (phase, now, now);
+}
+
+static void
+on_first_after_paint (GdkFrameClock *clock,
+                      gpointer       data)
+{
+  if (startup_complete)
+    {
+      g_signal_handlers_disconnect_by_func (clock, on_first_after_paint, data);
+      return;
+    }
+
+  if (first_frame_counter < 0)
+    {
+      first_frame_counter = gdk_frame_clock_get_frame_counter (clock);
+      first_frame_paint_time = g_get_monotonic_time ();
+    }
+
+  /* The timings of a frame are completed once the compositor reports
+   * back, which may take a few more frames
+   */
+  GdkFrameTimings *timings = gdk_frame_clock_get_timings (clock, first_frame_counter);
+
+  if (timings != NULL &&
+      !gdk_frame_timings_get_complete (timings) &&
+      n_presentation_waits++ < MAX_PRESENTATION_WAIT)
+    {
+      gdk_frame_clock_request_phase (clock, GDK_FRAME_CLOCK_PHASE_AFTER_PAINT);
+      return;
+    }
+
+  g_signal_handlers_disconnect_by_func (clock, on_first_after_paint, data);
+
+  gint64 first_frame_time = first_frame_paint_time;
+
+  if (timings != NULL && gdk_frame_timings_get_complete (timings))
+    {
+      gint64 presentation_time = gdk_frame_timings_get_presentation_time (timings);
+
+      if (presentation_time != 0)
+        first_frame_time = presentation_time;
+    }
+
+  record_phase (PROBE_DB_STARTUP_FIRST_FRAME, first_frame_time, first_frame_time);
+  eos_profile_memory_snapshot ();
+
+  startup_complete = TRUE;
+}
+
+/*< private >
+ * eos_profile_startup_watch_first_frame:
+ * @widget: a mapped toplevel #GtkWidget
+ *
+ * Marks the end of the startup once the first frame of @widget has been
+ * presented, or painted if the presentation time is not available.
+ */
+void
+eos_profile_startup_watch_first_frame (GtkWidget *widget)
+{
+  if (!startup_enabled || startup_complete)
+    return;
+
+  GdkFrameClock *clock = gtk_widget_get_frame_clock (widget);
+  if (clock == NULL)
+    return;
+
+  g_signal_connect (clock, "after-paint",
+                    G_CALLBACK (on_first_after_paint),
+                    NULL);
+}
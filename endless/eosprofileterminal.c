@@ -0,0 +1,40 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include "eosprofile-private.h"
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/* This file is also built into the eos-profile tool, so that the console
+ * dump of the library and the reports of the tool agree on the size of
+ * the terminal
+ */
+
+/*< private >
+ * eos_profile_get_terminal_size:
+ * @columns: (out) (optional): return location for the number of columns
+ * @rows: (out) (optional): return location for the number of rows
+ *
+ * Gets the size of the terminal connected to the standard output.
+ *
+ * Returns: %TRUE if the standard output is a terminal of a known size
+ */
+gboolean
+eos_profile_get_terminal_size (guint *columns,
+                               guint *rows)
+{
+  struct winsize w;
+
+  if (!isatty (STDOUT_FILENO) || ioctl (STDOUT_FILENO, TIOCGWINSZ, &w) != 0)
+    return FALSE;
+
+  if (columns != NULL)
+    *columns = w.ws_col;
+
+  if (rows != NULL)
+    *rows = w.ws_row;
+
+  return TRUE;
+}
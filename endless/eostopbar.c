@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "eostopbar-private.h"
+#include "eosprofile-private.h"
 
 #include <glib-object.h>
 #include <gtk/gtk.h>
@@ -138,7 +139,13 @@ eos_top_bar_class_init (EosTopBarClass *klass)
 static void
 eos_top_bar_init (EosTopBar *self)
 {
+  eos_profile_census_construct (EOS_TYPE_TOP_BAR);
+
+  gint64 template_start = g_get_monotonic_time ();
+
   gtk_widget_init_template (GTK_WIDGET (self));
+
+  eos_profile_startup_span ("top-bar-template", template_start);
 }
 
 GtkWidget *
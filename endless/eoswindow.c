@@ -4,6 +4,7 @@
 #include "string.h"
 #include "endless.h"
 #include "eostopbar-private.h"
+#include "eosprofile-private.h"
 
 #include <gtk/gtk.h>
 
@@ -119,6 +120,8 @@ typedef struct {
   gint width;
   gint height;
 
+  /* For the startup timeline */
+  gint64 construct_start;
 } EosWindowPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (EosWindow, eos_window, GTK_TYPE_APPLICATION_WINDOW)
@@ -142,6 +145,9 @@ static void
 override_background_css(EosWindow *self, gchar *background_css)
 {
   EosWindowPrivate *priv = eos_window_get_instance_private (self);
+  g_autoptr(EosProfileProbe) probe =
+    EOS_PROFILE_PROBE ("/com/endlessm/Sdk/window/override-background-css");
+
   // Override the css
   GtkStyleProvider *provider =
     GTK_STYLE_PROVIDER (priv->background_provider);
@@ -258,6 +264,10 @@ update_page_background (EosWindow *self)
   // If no page set, do not transition
   if (page == NULL)
     return;
+
+  g_autoptr(EosProfileProbe) probe =
+    EOS_PROFILE_PROBE ("/com/endlessm/Sdk/window/update-page-background");
+
   // Set up css override for transition background...
   gchar *next_background_css_props = format_background_css (pm,
                                                             page);
@@ -375,6 +385,8 @@ eos_window_constructed (GObject *object)
                                        (credits_file != NULL));
   g_signal_connect (application, "action-enabled-changed::image-credits",
                     G_CALLBACK (on_image_credits_enabled_changed), self);
+
+  eos_profile_startup_span ("window-construct", priv->construct_start);
 }
 
 static void
@@ -500,6 +512,9 @@ eos_window_font_scale (EosWindow *self,
   if (!priv->font_scaling_active)
     return;
 
+  g_autoptr(EosProfileProbe) probe =
+    EOS_PROFILE_PROBE ("/com/endlessm/Sdk/window/font-scale");
+
   GtkStyleProvider *provider = GTK_STYLE_PROVIDER (priv->font_size_provider);
   gdouble new_size = priv->font_scaling_default_size *
     ((gdouble) allocated_height / priv->font_scaling_default_window_size);
@@ -571,6 +586,7 @@ eos_window_configure_event (GtkWidget *widget, GdkEventConfigure *event)
                                          "in-resize");
 
           priv->in_resize_id = g_timeout_add (500, in_resize_timeout, widget);
+          g_source_set_name_by_id (priv->in_resize_id, "[endless] in_resize_timeout");
         }
 
       priv->width = event->width;
@@ -581,6 +597,24 @@ eos_window_configure_event (GtkWidget *widget, GdkEventConfigure *event)
   return GTK_WIDGET_CLASS (eos_window_parent_class)->configure_event (widget, event);
 }
 
+static void
+eos_window_realize (GtkWidget *widget)
+{
+  GTK_WIDGET_CLASS (eos_window_parent_class)->realize (widget);
+
+  /* The frame clock is only available once we have a GdkWindow */
+  eos_profile_frames_attach (widget);
+}
+
+static void
+eos_window_map (GtkWidget *widget)
+{
+  GTK_WIDGET_CLASS (eos_window_parent_class)->map (widget);
+
+  eos_profile_startup_mark ("first-map");
+  eos_profile_startup_watch_first_frame (widget);
+}
+
 static void
 eos_window_class_init (EosWindowClass *klass)
 {
@@ -593,6 +627,8 @@ eos_window_class_init (EosWindowClass *klass)
   object_class->finalize = eos_window_finalize;
   widget_class->size_allocate = eos_window_size_allocate;
   widget_class->configure_event = eos_window_configure_event;
+  widget_class->realize = eos_window_realize;
+  widget_class->map = eos_window_map;
 
   gtk_widget_class_set_css_name (widget_class, "EosWindow");
 
@@ -727,6 +763,8 @@ on_maximize_state_change (EosWindow  *self,
       priv->unmaximize_timeout_id =
         g_timeout_add_seconds (10, (GSourceFunc) record_unmaximize_metric,
                                self);
+      g_source_set_name_by_id (priv->unmaximize_timeout_id,
+                               "[endless] record_unmaximize_metric");
     }
 }
 
@@ -745,8 +783,12 @@ on_credits_clicked (GtkWidget *top_bar,
 static void
 eos_window_init (EosWindow *self)
 {
+  eos_profile_census_construct (EOS_TYPE_WINDOW);
+
   EosWindowPrivate *priv = eos_window_get_instance_private (self);
 
+  priv->construct_start = g_get_monotonic_time ();
+
   priv->top_bar = eos_top_bar_new ();
   gtk_widget_show_all (priv->top_bar);
   gtk_window_set_titlebar (GTK_WINDOW (self), priv->top_bar);
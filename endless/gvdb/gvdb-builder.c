@@ -23,10 +23,16 @@
 #include "gvdb-format.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
 #include <fcntl.h>
 #if !defined(G_OS_WIN32) || !defined(_MSC_VER)
 #include <unistd.h>
 #endif
+#ifdef G_OS_UNIX
+#include <limits.h>
+#include <sys/uio.h>
+#endif
 #include <string.h>
 
 
@@ -216,6 +222,7 @@ typedef struct
   GQueue *chunks;
   guint64 offset;
   gboolean byteswap;
+  GvdbWriteFlags flags;
 } FileBuilder;
 
 typedef struct
@@ -223,8 +230,24 @@ typedef struct
   gsize offset;
   gsize size;
   gpointer data;
+
+  /* Values are only serialised into @data right before being written, so
+   * that the whole database is never copied in memory at once
+   */
+  GVariant *value;
 } FileChunk;
 
+static void
+file_chunk_free (FileChunk *chunk)
+{
+  if (chunk->value != NULL)
+    g_variant_unref (chunk->value);
+
+  g_free (chunk->data);
+
+  g_slice_free (FileChunk, chunk);
+}
+
 static gpointer
 file_builder_allocate (FileBuilder         *fb,
                        guint                alignment,
@@ -241,6 +264,7 @@ file_builder_allocate (FileBuilder         *fb,
   chunk->offset = fb->offset;
   chunk->size = size;
   chunk->data = g_malloc (size);
+  chunk->value = NULL;
 
   pointer->start = guint32_to_le (fb->offset);
   fb->offset += size;
@@ -256,26 +280,72 @@ file_builder_add_value (FileBuilder         *fb,
                         GVariant            *value,
                         struct gvdb_pointer *pointer)
 {
-  GVariant *variant, *normal;
-  gpointer data;
+  GVariant *variant;
+  FileChunk *chunk;
   gsize size;
 
-  if (fb->byteswap)
+  /* Values built in memory are already in normal form; only the ones read
+   * from untrusted data need to be copied
+   */
+  if (g_variant_is_normal_form (value))
+    value = g_variant_ref_sink (value);
+  else
+    value = g_variant_get_normal_form (value);
+
+  /* Sizing a value does not serialise it */
+  variant = g_variant_new_variant (value);
+  size = g_variant_get_size (variant);
+  g_variant_unref (g_variant_ref_sink (variant));
+
+  fb->offset += (-fb->offset) & 7;
+
+  /* An empty value still needs a valid pointer, but has no data to write */
+  if (size == 0)
     {
-      value = g_variant_byteswap (value);
-      variant = g_variant_new_variant (value);
+      pointer->start = guint32_to_le (fb->offset);
+      pointer->end = guint32_to_le (fb->offset);
       g_variant_unref (value);
+      return;
     }
+
+  chunk = g_slice_new (FileChunk);
+  chunk->offset = fb->offset;
+  chunk->size = size;
+  chunk->data = NULL;
+  chunk->value = value;
+
+  pointer->start = guint32_to_le (fb->offset);
+  fb->offset += size;
+  pointer->end = guint32_to_le (fb->offset);
+
+  g_queue_push_tail (fb->chunks, chunk);
+}
+
+/* Serialises the value of @chunk, if any, into a buffer of its own */
+static void
+file_chunk_serialise (FileChunk *chunk,
+                      gboolean   byteswap)
+{
+  GVariant *value, *variant;
+
+  if (chunk->value == NULL)
+    return;
+
+  if (byteswap)
+    value = g_variant_byteswap (chunk->value);
   else
-    variant = g_variant_new_variant (value);
+    value = g_variant_ref (chunk->value);
 
-  normal = g_variant_get_normal_form (variant);
+  variant = g_variant_ref_sink (g_variant_new_variant (value));
+  g_variant_unref (value);
+
+  g_assert (g_variant_get_size (variant) == chunk->size);
+
+  chunk->data = g_malloc (chunk->size);
+  g_variant_store (variant, chunk->data);
   g_variant_unref (variant);
 
-  size = g_variant_get_size (normal);
-  data = file_builder_allocate (fb, 8, size, pointer);
-  g_variant_store (normal, data);
-  g_variant_unref (normal);
+  g_clear_pointer (&chunk->value, g_variant_unref);
 }
 
 static void
@@ -293,6 +363,7 @@ file_builder_add_string (FileBuilder *fb,
   chunk->offset = fb->offset;
   chunk->size = length;
   chunk->data = g_malloc (length);
+  chunk->value = NULL;
   if (length != 0)
     memcpy (chunk->data, string, length);
 
@@ -306,6 +377,7 @@ file_builder_add_string (FileBuilder *fb,
 static void
 file_builder_allocate_for_hash (FileBuilder            *fb,
                                 gsize                   n_buckets,
+                                gboolean                perfect_hash,
                                 gsize                   n_items,
                                 guint                   bloom_shift,
                                 gsize                   n_bloom_words,
@@ -319,9 +391,10 @@ file_builder_allocate_for_hash (FileBuilder            *fb,
   gsize size;
 
   g_assert (n_bloom_words < (1u << 27));
+  g_assert (n_buckets < GVDB_HASH_PERFECT);
 
   bloom_hdr = guint32_to_le (bloom_shift << 27 | n_bloom_words);
-  table_hdr = guint32_to_le (n_buckets);
+  table_hdr = guint32_to_le (n_buckets | (perfect_hash ? GVDB_HASH_PERFECT : 0));
 
   size = sizeof bloom_hdr + sizeof table_hdr +
          n_bloom_words * sizeof (guint32_le) +
@@ -341,98 +414,328 @@ file_builder_allocate_for_hash (FileBuilder            *fb,
 #undef chunk
 
   memset (*bloom_filter, 0, n_bloom_words * sizeof (guint32_le));
+}
 
-  /* NOTE - the code to actually fill in the bloom filter here is missing.
-   * Patches welcome! 
-   *
-   * http://en.wikipedia.org/wiki/Bloom_filter
-   * http://0pointer.de/blog/projects/bloom.html
-   */
+/* Each key sets two bits of the same word of the bloom filter: the word
+ * and the first bit come from the low bits of its hash, and the second
+ * bit from the bits above BLOOM_SHIFT, which the choice of the word does
+ * not depend on for filters of up to 2^22 words
+ *
+ * http://en.wikipedia.org/wiki/Bloom_filter
+ * http://0pointer.de/blog/projects/bloom.html
+ */
+#define BLOOM_BITS_PER_ITEM     16
+#define BLOOM_SHIFT             27
+
+static gsize
+bloom_filter_size (gsize n_items)
+{
+  gsize n_words = (n_items * BLOOM_BITS_PER_ITEM + 31) / 32;
+
+  return MIN (n_words, (1u << 27) - 1);
 }
 
 static void
-file_builder_add_hash (FileBuilder         *fb,
-                       GHashTable          *table,
-                       struct gvdb_pointer *pointer)
+bloom_filter_add (guint32_le *bloom_filter,
+                  gsize       n_bloom_words,
+                  guint32     hash_value)
 {
-  guint32_le *buckets, *bloom_filter;
-  struct gvdb_hash_item *items;
-  HashTable *mytable;
+  guint32 word, mask;
+
+  word = (hash_value / 32) % n_bloom_words;
+  mask = 1u << (hash_value & 31);
+  mask |= 1u << ((hash_value >> BLOOM_SHIFT) & 31);
+
+  bloom_filter[word] = guint32_to_le (guint32_from_le (bloom_filter[word]) | mask);
+}
+
+/* The perfect layout hashes the keys into buckets of a few keys, then
+ * looks for the displacement of each bucket, largest first, that sends
+ * its keys to free slots; see "Hash, displace, and compress" by Belazzougui,
+ * Botelho and Dietzfelbinger.
+ */
+#define PERFECT_HASH_ITEMS_PER_BUCKET   4
+#define PERFECT_HASH_MAX_DISPLACEMENT   (1u << 24)
+
+static gint
+bucket_size_compare (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+  GPtrArray **buckets = user_data;
+  GPtrArray *bucket_a = buckets[*(const guint32 *) a];
+  GPtrArray *bucket_b = buckets[*(const guint32 *) b];
+  guint size_a = bucket_a != NULL ? bucket_a->len : 0;
+  guint size_b = bucket_b != NULL ? bucket_b->len : 0;
+
+  if (size_a != size_b)
+    return size_a > size_b ? -1 : 1;
+
+  return 0;
+}
+
+static gboolean
+bucket_has_equal_hashes (GPtrArray *bucket)
+{
+  guint i, j;
+
+  for (i = 0; i < bucket->len; i++)
+    for (j = 0; j < i; j++)
+      {
+        GvdbItem *item_i = g_ptr_array_index (bucket, i);
+        GvdbItem *item_j = g_ptr_array_index (bucket, j);
+
+        if (item_i->hash_value == item_j->hash_value)
+          return TRUE;
+      }
+
+  return FALSE;
+}
+
+static gboolean
+perfect_hash_place (GPtrArray *bucket,
+                    guint32    displacement,
+                    guint8    *taken,
+                    guint32   *slots,
+                    guint32    n_items)
+{
+  guint i, j;
+
+  for (i = 0; i < bucket->len; i++)
+    {
+      GvdbItem *item = g_ptr_array_index (bucket, i);
+
+      slots[i] = gvdb_perfect_hash_slot (item->hash_value, displacement, n_items);
+
+      if (taken[slots[i]])
+        return FALSE;
+
+      for (j = 0; j < i; j++)
+        if (slots[j] == slots[i])
+          return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Assigns the index of each item of @table in the perfect layout, and
+ * returns the displacement of each of the @n_buckets buckets, or %NULL
+ * if some keys cannot be told apart because their hashes are equal, in
+ * which case the caller falls back to the chained layout
+ */
+static guint32 *
+perfect_hash_assign (GHashTable *table,
+                     guint32    *n_buckets)
+{
+  guint32 n_items = g_hash_table_size (table);
+  guint32 *displacements, *order, *slots;
+  GPtrArray **buckets;
+  GHashTableIter iter;
   GvdbItem *item;
-  guint32 index;
-  gint bucket;
+  guint8 *taken;
+  guint32 i, j;
 
-  mytable = hash_table_new (g_hash_table_size (table));
-  g_hash_table_foreach (table, hash_table_insert, mytable);
-  index = 0;
+  *n_buckets = (n_items + PERFECT_HASH_ITEMS_PER_BUCKET - 1) / PERFECT_HASH_ITEMS_PER_BUCKET;
 
-  for (bucket = 0; bucket < mytable->n_buckets; bucket++)
-    for (item = mytable->buckets[bucket]; item; item = item->next)
-      item->assigned_index = guint32_to_le (index++);
+  buckets = g_new0 (GPtrArray *, *n_buckets);
+  displacements = g_new0 (guint32, *n_buckets);
+  order = g_new (guint32, *n_buckets);
+  taken = g_new0 (guint8, n_items);
+  slots = NULL;
 
-  file_builder_allocate_for_hash (fb, mytable->n_buckets, index, 5, 0,
-                                  &bloom_filter, &buckets, &items, pointer);
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+    {
+      guint32 bucket = gvdb_perfect_hash_bucket (item->hash_value, *n_buckets);
 
-  index = 0;
-  for (bucket = 0; bucket < mytable->n_buckets; bucket++)
+      if (buckets[bucket] == NULL)
+        buckets[bucket] = g_ptr_array_new ();
+
+      g_ptr_array_add (buckets[bucket], item);
+    }
+
+  for (i = 0; i < *n_buckets; i++)
+    order[i] = i;
+
+  g_qsort_with_data (order, *n_buckets, sizeof (guint32), bucket_size_compare, buckets);
+
+  if (*n_buckets > 0 && buckets[order[0]] != NULL)
+    slots = g_new (guint32, buckets[order[0]]->len);
+
+  for (i = 0; i < *n_buckets; i++)
     {
-      buckets[bucket] = guint32_to_le (index);
+      GPtrArray *bucket = buckets[order[i]];
+      guint32 displacement;
 
-      for (item = mytable->buckets[bucket]; item; item = item->next)
+      /* The buckets are sorted by size, so the rest are empty */
+      if (bucket == NULL)
+        break;
+
+      /* No displacement can send them to different slots */
+      if (bucket_has_equal_hashes (bucket))
         {
-          struct gvdb_hash_item *entry = items++;
-          const gchar *basename;
+          g_clear_pointer (&displacements, g_free);
+          break;
+        }
 
-          g_assert (index == guint32_from_le (item->assigned_index));
-          entry->hash_value = guint32_to_le (item->hash_value);
-          entry->parent = item_to_index (item->parent);
-          entry->unused = 0;
+      for (displacement = 0; displacement < PERFECT_HASH_MAX_DISPLACEMENT; displacement++)
+        if (perfect_hash_place (bucket, displacement, taken, slots, n_items))
+          break;
 
-          if (item->parent != NULL)
-            basename = item->key + strlen (item->parent->key);
-          else
-            basename = item->key;
+      if (displacement == PERFECT_HASH_MAX_DISPLACEMENT)
+        {
+          g_clear_pointer (&displacements, g_free);
+          break;
+        }
+
+      displacements[order[i]] = displacement;
 
-          file_builder_add_string (fb, basename,
-                                   &entry->key_start,
-                                   &entry->key_size);
+      for (j = 0; j < bucket->len; j++)
+        {
+          item = g_ptr_array_index (bucket, j);
+          item->assigned_index = guint32_to_le (slots[j]);
+          taken[slots[j]] = TRUE;
+        }
+    }
 
-          if (item->value != NULL)
-            {
-              g_assert (item->child == NULL && item->table == NULL);
+  for (i = 0; i < *n_buckets; i++)
+    if (buckets[i] != NULL)
+      g_ptr_array_unref (buckets[i]);
 
-              file_builder_add_value (fb, item->value, &entry->value.pointer);
-              entry->type = 'v';
-            }
+  g_free (buckets);
+  g_free (order);
+  g_free (taken);
+  g_free (slots);
 
-          if (item->child != NULL)
-            {
-              guint32 children = 0, i = 0;
-              guint32_le *offsets;
-              GvdbItem *child;
+  return displacements;
+}
 
-              g_assert (item->table == NULL);
+static void file_builder_add_hash (FileBuilder         *fb,
+                                   GHashTable          *table,
+                                   struct gvdb_pointer *pointer);
 
-              for (child = item->child; child; child = child->sibling)
-                children++;
+static void
+file_builder_add_item (FileBuilder           *fb,
+                       GvdbItem              *item,
+                       struct gvdb_hash_item *entry)
+{
+  const gchar *basename;
 
-              offsets = file_builder_allocate (fb, 4, 4 * children,
-                                               &entry->value.pointer);
-              entry->type = 'L';
+  entry->hash_value = guint32_to_le (item->hash_value);
+  entry->parent = item_to_index (item->parent);
+  entry->unused = 0;
 
-              for (child = item->child; child; child = child->sibling)
-                offsets[i++] = child->assigned_index;
+  if (item->parent != NULL)
+    basename = item->key + strlen (item->parent->key);
+  else
+    basename = item->key;
 
-              g_assert (children == i);
-            }
+  file_builder_add_string (fb, basename,
+                           &entry->key_start,
+                           &entry->key_size);
 
-          if (item->table != NULL)
-            {
-              entry->type = 'H';
-              file_builder_add_hash (fb, item->table, &entry->value.pointer);
-            }
+  if (item->value != NULL)
+    {
+      g_assert (item->child == NULL && item->table == NULL);
 
-          index++;
+      file_builder_add_value (fb, item->value, &entry->value.pointer);
+      entry->type = 'v';
+    }
+
+  if (item->child != NULL)
+    {
+      guint32 children = 0, i = 0;
+      guint32_le *offsets;
+      GvdbItem *child;
+
+      g_assert (item->table == NULL);
+
+      for (child = item->child; child; child = child->sibling)
+        children++;
+
+      offsets = file_builder_allocate (fb, 4, 4 * children,
+                                       &entry->value.pointer);
+      entry->type = 'L';
+
+      for (child = item->child; child; child = child->sibling)
+        offsets[i++] = child->assigned_index;
+
+      g_assert (children == i);
+    }
+
+  if (item->table != NULL)
+    {
+      entry->type = 'H';
+      file_builder_add_hash (fb, item->table, &entry->value.pointer);
+    }
+}
+
+static void
+file_builder_add_hash (FileBuilder         *fb,
+                       GHashTable          *table,
+                       struct gvdb_pointer *pointer)
+{
+  guint32_le *buckets, *bloom_filter;
+  struct gvdb_hash_item *items;
+  guint32 *displacements = NULL;
+  HashTable *mytable = NULL;
+  GHashTableIter iter;
+  GvdbItem *item;
+  guint32 n_buckets;
+  guint32 n_items;
+  gsize n_bloom_words;
+  guint32 index;
+  gint bucket;
+
+  n_items = g_hash_table_size (table);
+
+  if ((fb->flags & GVDB_WRITE_FLAGS_PERFECT_HASH) && n_items > 0)
+    displacements = perfect_hash_assign (table, &n_buckets);
+
+  if (displacements == NULL)
+    {
+      mytable = hash_table_new (n_items);
+      g_hash_table_foreach (table, hash_table_insert, mytable);
+      n_buckets = mytable->n_buckets;
+      index = 0;
+
+      for (bucket = 0; bucket < mytable->n_buckets; bucket++)
+        for (item = mytable->buckets[bucket]; item; item = item->next)
+          item->assigned_index = guint32_to_le (index++);
+    }
+
+  n_bloom_words = bloom_filter_size (n_items);
+
+  file_builder_allocate_for_hash (fb, n_buckets, displacements != NULL,
+                                  n_items, BLOOM_SHIFT, n_bloom_words,
+                                  &bloom_filter, &buckets, &items, pointer);
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+    bloom_filter_add (bloom_filter, n_bloom_words, item->hash_value);
+
+  if (displacements != NULL)
+    {
+      for (bucket = 0; bucket < n_buckets; bucket++)
+        buckets[bucket] = guint32_to_le (displacements[bucket]);
+
+      g_hash_table_iter_init (&iter, table);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+        file_builder_add_item (fb, item, &items[guint32_from_le (item->assigned_index)]);
+
+      g_free (displacements);
+      return;
+    }
+
+  index = 0;
+  for (bucket = 0; bucket < mytable->n_buckets; bucket++)
+    {
+      buckets[bucket] = guint32_to_le (index);
+
+      for (item = mytable->buckets[bucket]; item; item = item->next)
+        {
+          g_assert (index == guint32_from_le (item->assigned_index));
+          file_builder_add_item (fb, item, &items[index++]);
         }
     }
 
@@ -440,7 +743,8 @@ file_builder_add_hash (FileBuilder         *fb,
 }
 
 static FileBuilder *
-file_builder_new (gboolean byteswap)
+file_builder_new (gboolean       byteswap,
+                  GvdbWriteFlags flags)
 {
   FileBuilder *builder;
 
@@ -448,33 +752,53 @@ file_builder_new (gboolean byteswap)
   builder->chunks = g_queue_new ();
   builder->offset = sizeof (struct gvdb_header);
   builder->byteswap = byteswap;
+  builder->flags = flags;
 
   return builder;
 }
 
-static GString *
-file_builder_serialise (FileBuilder          *fb,
-                        struct gvdb_pointer   root)
+static void
+file_builder_fill_header (FileBuilder         *fb,
+                          struct gvdb_pointer  root,
+                          struct gvdb_header  *header)
 {
-  struct gvdb_header header;
-  GString *result;
-
-  memset (&header, 0, sizeof (struct gvdb_header));
+  memset (header, 0, sizeof (struct gvdb_header));
 
   if (fb->byteswap)
     {
-      header.signature[0] = GVDB_SWAPPED_SIGNATURE0;
-      header.signature[1] = GVDB_SWAPPED_SIGNATURE1;
+      header->signature[0] = GVDB_SWAPPED_SIGNATURE0;
+      header->signature[1] = GVDB_SWAPPED_SIGNATURE1;
     }
   else
     {
-      header.signature[0] = GVDB_SIGNATURE0;
-      header.signature[1] = GVDB_SIGNATURE1;
+      header->signature[0] = GVDB_SIGNATURE0;
+      header->signature[1] = GVDB_SIGNATURE1;
     }
 
-  result = g_string_new (NULL);
+  if (fb->flags & GVDB_WRITE_FLAGS_PERFECT_HASH)
+    header->version = guint32_to_le (GVDB_VERSION_PERFECT_HASH);
+
+  header->root = root;
+}
+
+static void
+file_builder_free (FileBuilder *fb)
+{
+  g_queue_free_full (fb->chunks, (GDestroyNotify) file_chunk_free);
+  g_slice_free (FileBuilder, fb);
+}
+
+static GString *
+file_builder_serialise (FileBuilder          *fb,
+                        struct gvdb_pointer   root)
+{
+  struct gvdb_header header;
+  GString *result;
+
+  file_builder_fill_header (fb, root, &header);
+
+  result = g_string_sized_new (fb->offset);
 
-  header.root = root;
   g_string_append_len (result, (gpointer) &header, sizeof header);
 
   while (!g_queue_is_empty (fb->chunks))
@@ -492,28 +816,159 @@ file_builder_serialise (FileBuilder          *fb,
           g_assert (result->len == chunk->offset);
         }
 
+      file_chunk_serialise (chunk, fb->byteswap);
       g_string_append_len (result, chunk->data, chunk->size);
-      g_free (chunk->data);
-
-      g_slice_free (FileChunk, chunk);
+      file_chunk_free (chunk);
     }
 
-  g_queue_free (fb->chunks);
-  g_slice_free (FileBuilder, fb);
+  file_builder_free (fb);
 
   return result;
 }
 
+#ifdef G_OS_UNIX
+/* The number of chunks, and of the padding before them, written at once;
+ * a batch is also written as soon as it holds N_WRITE_BYTES, so that only
+ * a few serialised values are in memory at any time
+ */
+#define N_WRITE_CHUNKS 64
+#define N_WRITE_BYTES  (64 * 1024)
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+static gboolean
+write_all (int            fd,
+           struct iovec  *iov,
+           int            n_iov,
+           GError       **error)
+{
+  while (n_iov > 0)
+    {
+      gssize written = writev (fd, iov, MIN (n_iov, IOV_MAX));
+
+      if (written < 0)
+        {
+          int saved_errno = errno;
+
+          if (saved_errno == EINTR)
+            continue;
+
+          g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                       "Failed to write the database: %s",
+                       g_strerror (saved_errno));
+          return FALSE;
+        }
+
+      while (n_iov > 0 && (gsize) written >= iov->iov_len)
+        {
+          written -= iov->iov_len;
+          iov++;
+          n_iov--;
+        }
+
+      if (n_iov > 0)
+        {
+          iov->iov_base = (gchar *) iov->iov_base + written;
+          iov->iov_len -= written;
+        }
+    }
+
+  return TRUE;
+}
+
+/* Writes the chunks in order, without assembling the whole file in memory
+ * first; each value is serialised right before being written, and each
+ * chunk is released as soon as it is written
+ */
+static gboolean
+file_builder_write_fd (FileBuilder          *fb,
+                       struct gvdb_pointer   root,
+                       int                   fd,
+                       GError              **error)
+{
+  static const gchar zero[8] = { 0, };
+  struct iovec iov[2 * N_WRITE_CHUNKS + 1];
+  FileChunk *written[N_WRITE_CHUNKS];
+  struct gvdb_header header;
+  gsize offset, n_bytes = 0;
+  gboolean status = TRUE;
+  int n_iov = 0, n_written = 0;
+
+  file_builder_fill_header (fb, root, &header);
+
+  iov[n_iov].iov_base = &header;
+  iov[n_iov].iov_len = sizeof header;
+  n_iov++;
+  offset = sizeof header;
+
+  while (status && !g_queue_is_empty (fb->chunks))
+    {
+      FileChunk *chunk = g_queue_pop_head (fb->chunks);
+
+      if (offset != chunk->offset)
+        {
+          g_assert (chunk->offset > offset);
+          g_assert (chunk->offset - offset < 8);
+
+          iov[n_iov].iov_base = (gpointer) zero;
+          iov[n_iov].iov_len = chunk->offset - offset;
+          n_iov++;
+        }
+
+      file_chunk_serialise (chunk, fb->byteswap);
+
+      iov[n_iov].iov_base = chunk->data;
+      iov[n_iov].iov_len = chunk->size;
+      n_iov++;
+      offset = chunk->offset + chunk->size;
+      n_bytes += chunk->size;
+
+      written[n_written++] = chunk;
+
+      if (n_written == N_WRITE_CHUNKS || n_bytes >= N_WRITE_BYTES ||
+          g_queue_is_empty (fb->chunks))
+        {
+          status = write_all (fd, iov, n_iov, error);
+
+          for (int i = 0; i < n_written; i++)
+            file_chunk_free (written[i]);
+
+          n_iov = 0;
+          n_written = 0;
+          n_bytes = 0;
+        }
+    }
+
+  /* An empty table only has the header */
+  if (status && n_iov > 0)
+    status = write_all (fd, iov, n_iov, error);
+
+  file_builder_free (fb);
+
+  return status;
+}
+#endif
+
 GBytes *
 gvdb_table_write_bytes (GHashTable  *table,
                         gboolean     byteswap)
+{
+  return gvdb_table_write_bytes_with_flags (table, byteswap, GVDB_WRITE_FLAGS_NONE);
+}
+
+GBytes *
+gvdb_table_write_bytes_with_flags (GHashTable     *table,
+                                   gboolean        byteswap,
+                                   GvdbWriteFlags  flags)
 {
   struct gvdb_pointer root;
   FileBuilder *fb;
   GString *str;
   GBytes *retval;
 
-  fb = file_builder_new (byteswap);
+  fb = file_builder_new (byteswap, flags);
   file_builder_add_hash (fb, table, &root);
   str = file_builder_serialise (fb, root);
 
@@ -528,18 +983,301 @@ gvdb_table_write_contents (GHashTable   *table,
                            const gchar  *filename,
                            gboolean      byteswap,
                            GError      **error)
+{
+  return gvdb_table_write_contents_with_flags (table, filename, byteswap,
+                                               GVDB_WRITE_FLAGS_NONE,
+                                               error);
+}
+
+gboolean
+gvdb_table_write_contents_with_flags (GHashTable      *table,
+                                      const gchar     *filename,
+                                      gboolean         byteswap,
+                                      GvdbWriteFlags   flags,
+                                      GError         **error)
 {
   struct gvdb_pointer root;
   gboolean status;
   FileBuilder *fb;
-  GString *str;
 
-  fb = file_builder_new (byteswap);
+  fb = file_builder_new (byteswap, flags);
   file_builder_add_hash (fb, table, &root);
-  str = file_builder_serialise (fb, root);
 
-  status = g_file_set_contents (filename, str->str, str->len, error);
-  g_string_free (str, TRUE);
+#ifdef G_OS_UNIX
+  {
+    /* Like g_file_set_contents(), write to a temporary file next to the
+     * destination, and atomically replace it once the data is on disk
+     */
+    gchar *tmp_filename = g_strdup_printf ("%s.XXXXXX", filename);
+    int fd = g_mkstemp_full (tmp_filename, O_RDWR, 0666);
+
+    if (fd < 0)
+      {
+        int saved_errno = errno;
+
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                     "Failed to create file '%s': %s",
+                     tmp_filename,
+                     g_strerror (saved_errno));
+        file_builder_free (fb);
+        g_free (tmp_filename);
+        return FALSE;
+      }
+
+    status = file_builder_write_fd (fb, root, fd, error);
+
+    if (status && g_fsync (fd) != 0)
+      {
+        int saved_errno = errno;
+
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                     "Failed to write file '%s': %s",
+                     tmp_filename,
+                     g_strerror (saved_errno));
+        status = FALSE;
+      }
+
+    if (!g_close (fd, status ? error : NULL))
+      status = FALSE;
+
+    if (status && g_rename (tmp_filename, filename) != 0)
+      {
+        int saved_errno = errno;
+
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                     "Failed to rename file '%s' to '%s': %s",
+                     tmp_filename,
+                     filename,
+                     g_strerror (saved_errno));
+        status = FALSE;
+      }
+
+    if (!status)
+      g_unlink (tmp_filename);
+
+    g_free (tmp_filename);
+  }
+#else
+  {
+    GString *str = file_builder_serialise (fb, root);
+
+    status = g_file_set_contents (filename, str->str, str->len, error);
+    g_string_free (str, TRUE);
+  }
+#endif
 
   return status;
 }
+
+#ifdef G_OS_UNIX
+/* An append that was interrupted leaves an incomplete segment after the
+ * last footer, which readers do not look for; this is the only case in
+ * which the whole file is scanned
+ */
+static gsize
+find_last_footer (const gchar *data,
+                  gsize        size)
+{
+  gsize offset;
+
+  if (size < sizeof (struct gvdb_header) + sizeof (struct gvdb_segment_footer))
+    return 0;
+
+  offset = (size - sizeof (struct gvdb_segment_footer)) & ~(gsize) 7;
+
+  for (; offset >= sizeof (struct gvdb_header); offset -= 8)
+    if (gvdb_segment_footer_is_valid (data, size, offset))
+      return offset;
+
+  return 0;
+}
+
+static gboolean
+read_segment_chain (const gchar          *filename,
+                    struct gvdb_header   *header,
+                    gsize                *size,
+                    guint32              *last_footer,
+                    guint32              *n_segments,
+                    GError              **error)
+{
+  GMappedFile *mapped;
+  const gchar *contents;
+
+  mapped = g_mapped_file_new (filename, FALSE, error);
+  if (mapped == NULL)
+    return FALSE;
+
+  contents = g_mapped_file_get_contents (mapped);
+  *size = g_mapped_file_get_length (mapped);
+
+  if (*size < sizeof (struct gvdb_header))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "%s: invalid gvdb header", filename);
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  memcpy (header, contents, sizeof (struct gvdb_header));
+
+  if (!((header->signature[0] == GVDB_SIGNATURE0 &&
+         header->signature[1] == GVDB_SIGNATURE1) ||
+        (header->signature[0] == GVDB_SWAPPED_SIGNATURE0 &&
+         header->signature[1] == GVDB_SWAPPED_SIGNATURE1)))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "%s: invalid gvdb header", filename);
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  if (guint32_from_le (header->version) > GVDB_VERSION_PERFECT_HASH)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "%s: unsupported gvdb version %u", filename,
+                   guint32_from_le (header->version));
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  *last_footer = 0;
+  *n_segments = 0;
+
+  if (guint32_from_le (header->options) & GVDB_OPTION_SEGMENTS)
+    {
+      *last_footer = gvdb_segment_get_last_footer (contents, *size);
+
+      if (*last_footer == 0)
+        *last_footer = find_last_footer (contents, *size);
+
+      if (*last_footer != 0)
+        {
+          const struct gvdb_segment_footer *footer =
+            (gconstpointer) (contents + *last_footer);
+
+          *n_segments = guint32_from_le (footer->n_segments);
+
+          /* The new segment replaces whatever follows the last footer */
+          *size = *last_footer + sizeof *footer;
+        }
+    }
+
+  g_mapped_file_unref (mapped);
+
+  return TRUE;
+}
+#endif
+
+/* Appends @table as a new segment of the GVDB file at @filename, which
+ * must already exist; unlike gvdb_table_write_contents(), the file is
+ * modified in place, and readers that opened it before only see the
+ * segments that were there at the time. The footer of the new segment
+ * always ends the file, so that readers find it without a scan.
+ */
+gboolean
+gvdb_table_append_contents (GHashTable      *table,
+                            const gchar     *filename,
+                            gboolean         byteswap,
+                            GvdbWriteFlags   flags,
+                            GError         **error)
+{
+#ifdef G_OS_UNIX
+  static const gchar zero[8] = { 0, };
+  struct gvdb_segment_footer footer;
+  struct gvdb_header header;
+  guint32 last_footer, n_segments;
+  gsize size, start, end, footer_offset;
+  struct iovec iov[4];
+  gboolean status;
+  GBytes *segment;
+  int fd;
+
+  if (!read_segment_chain (filename, &header, &size, &last_footer, &n_segments, error))
+    return FALSE;
+
+  segment = gvdb_table_write_bytes_with_flags (table, byteswap, flags);
+
+  start = size + ((-size) & 7);
+  end = start + g_bytes_get_size (segment);
+  footer_offset = end + ((-end) & 7);
+
+  if (footer_offset + sizeof footer > G_MAXUINT32)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FBIG,
+                   "Unable to append to '%s': the file is too large",
+                   filename);
+      g_bytes_unref (segment);
+      return FALSE;
+    }
+
+  footer.signature[0] = guint32_to_le (GVDB_SEGMENT_SIGNATURE0);
+  footer.signature[1] = guint32_to_le (GVDB_SEGMENT_SIGNATURE1);
+  footer.previous = guint32_to_le (last_footer);
+  footer.n_segments = guint32_to_le (n_segments + 1);
+  footer.segment.start = guint32_to_le (start);
+  footer.segment.end = guint32_to_le (end);
+
+  fd = g_open (filename, O_WRONLY, 0);
+  if (fd < 0 || lseek (fd, size, SEEK_SET) < 0)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Failed to open file '%s': %s",
+                   filename,
+                   g_strerror (saved_errno));
+      if (fd >= 0)
+        g_close (fd, NULL);
+      g_bytes_unref (segment);
+      return FALSE;
+    }
+
+  iov[0].iov_base = (gpointer) zero;
+  iov[0].iov_len = start - size;
+  iov[1].iov_base = (gpointer) g_bytes_get_data (segment, NULL);
+  iov[1].iov_len = end - start;
+  iov[2].iov_base = (gpointer) zero;
+  iov[2].iov_len = footer_offset - end;
+  iov[3].iov_base = &footer;
+  iov[3].iov_len = sizeof footer;
+
+  /* The footer only becomes the last one once the segment is on disk;
+   * an earlier interrupted append may have left data past it
+   */
+  status = write_all (fd, iov, 4, error) &&
+           ftruncate (fd, footer_offset + sizeof footer) == 0 &&
+           g_fsync (fd) == 0;
+
+  /* Readers only look for footers in files marked as having segments */
+  if (status && !(guint32_from_le (header.options) & GVDB_OPTION_SEGMENTS))
+    {
+      header.options = guint32_to_le (guint32_from_le (header.options) | GVDB_OPTION_SEGMENTS);
+
+      status = pwrite (fd, &header.options, sizeof header.options,
+                       G_STRUCT_OFFSET (struct gvdb_header, options)) == (gssize) sizeof header.options &&
+               g_fsync (fd) == 0;
+    }
+
+  if (!status && error != NULL && *error == NULL)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Failed to write file '%s': %s",
+                   filename,
+                   g_strerror (saved_errno));
+    }
+
+  if (!g_close (fd, status ? error : NULL))
+    status = FALSE;
+
+  g_bytes_unref (segment);
+
+  return status;
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               "Appending to '%s' is not supported on this platform",
+               filename);
+  return FALSE;
+#endif
+}
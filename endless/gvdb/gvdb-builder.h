@@ -26,6 +26,18 @@
 
 typedef struct _GvdbItem GvdbItem;
 
+/* GVDB_WRITE_FLAGS_PERFECT_HASH gives each key its own slot in the hash
+ * tables, so that lookups only check one item; it takes longer to write,
+ * and is meant for files that are written once and read often. Such
+ * files have a newer version in their header, which readers that predate
+ * this layout reject.
+ */
+typedef enum
+{
+  GVDB_WRITE_FLAGS_NONE         = 0,
+  GVDB_WRITE_FLAGS_PERFECT_HASH = 1 << 0
+} GvdbWriteFlags;
+
 G_GNUC_INTERNAL
 GHashTable *            gvdb_hash_table_new                             (GHashTable    *parent,
                                                                          const gchar   *key);
@@ -54,7 +66,23 @@ gboolean                gvdb_table_write_contents                       (GHashTa
                                                                          gboolean        byteswap,
                                                                          GError        **error);
 G_GNUC_INTERNAL
+gboolean                gvdb_table_write_contents_with_flags            (GHashTable     *table,
+                                                                         const gchar    *filename,
+                                                                         gboolean        byteswap,
+                                                                         GvdbWriteFlags  flags,
+                                                                         GError        **error);
+G_GNUC_INTERNAL
+gboolean                gvdb_table_append_contents                      (GHashTable     *table,
+                                                                         const gchar    *filename,
+                                                                         gboolean        byteswap,
+                                                                         GvdbWriteFlags  flags,
+                                                                         GError        **error);
+G_GNUC_INTERNAL
 GBytes *                gvdb_table_write_bytes                          (GHashTable     *table,
                                                                          gboolean        byteswap);
+G_GNUC_INTERNAL
+GBytes *                gvdb_table_write_bytes_with_flags               (GHashTable     *table,
+                                                                         gboolean        byteswap,
+                                                                         GvdbWriteFlags  flags);
 
 #endif /* __gvdb_builder_h__ */
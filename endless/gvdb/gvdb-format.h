@@ -79,9 +79,109 @@ static inline guint16 guint16_from_le (guint16_le value) {
   return GUINT16_FROM_LE (value.value);
 }
 
+/* Set in n_buckets for hash tables with one slot per key: each bucket
+ * holds the displacement that maps its keys to their slots, instead of
+ * the index of its first item, so a lookup touches a single item
+ */
+#define GVDB_HASH_PERFECT (1u << 31)
+
+/* The version in the header of files with perfect hash tables; readers
+ * that predate them only accept version 0, and reject those files instead
+ * of seeing their hash tables as empty
+ */
+#define GVDB_VERSION_PERFECT_HASH 1
+
+/* The finalizer of MurmurHash3, to spread the djb hash of similar keys */
+static inline guint32 gvdb_hash_mix (guint32 value) {
+  value ^= value >> 16;
+  value *= 0x85ebca6bu;
+  value ^= value >> 13;
+  value *= 0xc2b2ae35u;
+  value ^= value >> 16;
+  return value;
+}
+
+static inline guint32 gvdb_perfect_hash_bucket (guint32 hash_value,
+                                                guint32 n_buckets) {
+  return gvdb_hash_mix (hash_value) % n_buckets;
+}
+
+static inline guint32 gvdb_perfect_hash_slot (guint32 hash_value,
+                                              guint32 displacement,
+                                              guint32 n_items) {
+  return gvdb_hash_mix (hash_value ^ gvdb_hash_mix (displacement + 1)) % n_items;
+}
+
+/* Set in the options of the header of files with appended segments */
+#define GVDB_OPTION_SEGMENTS (1u << 0)
+
+/* A segment is a complete GVDB file, appended to an existing one and
+ * followed by a footer that links to the footer of the previous segment,
+ * so that the footer of the last segment ends the file
+ */
+struct gvdb_segment_footer {
+  guint32_le signature[2];
+  guint32_le previous;
+  guint32_le n_segments;
+
+  struct gvdb_pointer segment;
+};
+
+#define GVDB_SEGMENT_SIGNATURE0 1111774791 /* "GVDB" */
+#define GVDB_SEGMENT_SIGNATURE1 1835492723 /* "segm" */
+
 #define GVDB_SIGNATURE0 1918981703
 #define GVDB_SIGNATURE1 1953390953
 #define GVDB_SWAPPED_SIGNATURE0 GUINT32_SWAP_LE_BE (GVDB_SIGNATURE0)
 #define GVDB_SWAPPED_SIGNATURE1 GUINT32_SWAP_LE_BE (GVDB_SIGNATURE1)
 
+static inline gboolean gvdb_segment_footer_is_valid (const gchar *data,
+                                                     gsize        size,
+                                                     gsize        offset) {
+  const struct gvdb_segment_footer *footer;
+  guint32 start, end, previous, n_segments;
+
+  if (offset % 8 != 0 || offset > size || size - offset < sizeof *footer)
+    return FALSE;
+
+  footer = (gconstpointer) (data + offset);
+
+  if (guint32_from_le (footer->signature[0]) != GVDB_SEGMENT_SIGNATURE0 ||
+      guint32_from_le (footer->signature[1]) != GVDB_SEGMENT_SIGNATURE1)
+    return FALSE;
+
+  start = guint32_from_le (footer->segment.start);
+  end = guint32_from_le (footer->segment.end);
+  previous = guint32_from_le (footer->previous);
+  n_segments = guint32_from_le (footer->n_segments);
+
+  if (start % 8 != 0 || start > end || end > offset || n_segments == 0)
+    return FALSE;
+
+  if (previous == 0)
+    return n_segments == 1;
+
+  return previous % 8 == 0 && previous <= start &&
+         start - previous >= sizeof *footer;
+}
+
+/* Returns the offset of the last footer, or 0 if there is none; each
+ * append writes its footer at the end of the file, so it is only looked
+ * for there
+ */
+static inline gsize gvdb_segment_get_last_footer (const gchar *data,
+                                                  gsize        size) {
+  gsize offset;
+
+  if (size < sizeof (struct gvdb_header) + sizeof (struct gvdb_segment_footer))
+    return 0;
+
+  offset = size - sizeof (struct gvdb_segment_footer);
+
+  if (!gvdb_segment_footer_is_valid (data, size, offset))
+    return 0;
+
+  return offset;
+}
+
 #endif /* __gvdb_format_h__ */
@@ -39,9 +39,16 @@ struct _GvdbTable {
 
   const guint32_le *hash_buckets;
   guint32 n_buckets;
+  gboolean perfect_hash;
 
   struct gvdb_hash_item *hash_items;
   guint32 n_hash_items;
+
+  /* The segments appended to the file, oldest first; invalid segments
+   * are %NULL
+   */
+  GvdbTable **segments;
+  guint n_segments;
 };
 
 static const gchar *
@@ -98,7 +105,10 @@ gvdb_table_setup_root (GvdbTable                 *file,
 
   n_bloom_words = guint32_from_le (header->n_bloom_words);
   n_buckets = guint32_from_le (header->n_buckets);
+  file->bloom_shift = n_bloom_words >> 27;
   n_bloom_words &= (1u << 27) - 1;
+  file->perfect_hash = (n_buckets & GVDB_HASH_PERFECT) != 0;
+  n_buckets &= ~GVDB_HASH_PERFECT;
 
   if G_UNLIKELY (n_bloom_words * sizeof (guint32_le) > size)
     return;
@@ -122,6 +132,122 @@ gvdb_table_setup_root (GvdbTable                 *file,
   file->n_hash_items = size / sizeof (struct gvdb_hash_item);
 }
 
+static gboolean
+gvdb_table_check_header (GvdbTable  *file,
+                         GError    **error)
+{
+  const struct gvdb_header *header;
+
+  if (file->size < sizeof (struct gvdb_header))
+    goto invalid;
+
+  header = (gpointer) file->data;
+
+  if (header->signature[0] == GVDB_SIGNATURE0 &&
+      header->signature[1] == GVDB_SIGNATURE1)
+    file->byteswapped = FALSE;
+
+  else if (header->signature[0] == GVDB_SWAPPED_SIGNATURE0 &&
+           header->signature[1] == GVDB_SWAPPED_SIGNATURE1)
+    file->byteswapped = TRUE;
+
+  else
+    goto invalid;
+
+  if (guint32_from_le (header->version) > GVDB_VERSION_PERFECT_HASH)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "unsupported gvdb version %u",
+                   guint32_from_le (header->version));
+      return FALSE;
+    }
+
+  return TRUE;
+
+invalid:
+  g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "invalid gvdb header");
+
+  return FALSE;
+}
+
+/* Segments are complete files, but they cannot have segments of their own */
+static GvdbTable *
+gvdb_table_open_segment (GvdbTable                 *file,
+                         const struct gvdb_pointer *pointer)
+{
+  const struct gvdb_header *header;
+  GvdbTable *segment;
+  GBytes *bytes;
+  guint32 start, end;
+
+  start = guint32_from_le (pointer->start);
+  end = guint32_from_le (pointer->end);
+
+  bytes = g_bytes_new_from_bytes (file->bytes, start, end - start);
+
+  segment = g_slice_new0 (GvdbTable);
+  segment->bytes = bytes;
+  segment->data = g_bytes_get_data (bytes, &segment->size);
+  segment->trusted = file->trusted;
+
+  if (!gvdb_table_check_header (segment, NULL))
+    {
+      gvdb_table_free (segment);
+      return NULL;
+    }
+
+  header = (gpointer) segment->data;
+  gvdb_table_setup_root (segment, &header->root);
+
+  return segment;
+}
+
+static void
+gvdb_table_setup_segments (GvdbTable *file)
+{
+  const struct gvdb_segment_footer *footer;
+  struct gvdb_pointer *pointers;
+  guint32 n_segments;
+  gsize offset;
+  guint i;
+
+  offset = gvdb_segment_get_last_footer (file->data, file->size);
+  if (offset == 0)
+    return;
+
+  footer = (gconstpointer) (file->data + offset);
+  n_segments = guint32_from_le (footer->n_segments);
+
+  /* Each footer comes before the next one */
+  if G_UNLIKELY (n_segments > file->size / sizeof *footer)
+    return;
+
+  pointers = g_new (struct gvdb_pointer, n_segments);
+
+  for (i = n_segments; i > 0; i--)
+    {
+      if G_UNLIKELY (!gvdb_segment_footer_is_valid (file->data, file->size, offset))
+        goto out;
+
+      footer = (gconstpointer) (file->data + offset);
+      if G_UNLIKELY (guint32_from_le (footer->n_segments) != i)
+        goto out;
+
+      pointers[i - 1] = footer->segment;
+      offset = guint32_from_le (footer->previous);
+    }
+
+  /* The segments are opened once, as every lookup goes through them */
+  file->segments = g_new (GvdbTable *, n_segments);
+  for (i = 0; i < n_segments; i++)
+    file->segments[i] = gvdb_table_open_segment (file, &pointers[i]);
+
+  file->n_segments = n_segments;
+
+out:
+  g_free (pointers);
+}
+
 /**
  * gvdb_table_new_from_bytes:
  * @bytes: the #GBytes with the data
@@ -149,36 +275,20 @@ gvdb_table_new_from_bytes (GBytes    *bytes,
   file->data = g_bytes_get_data (bytes, &file->size);
   file->trusted = trusted;
 
-  if (file->size < sizeof (struct gvdb_header))
-    goto invalid;
+  if (!gvdb_table_check_header (file, error))
+    {
+      gvdb_table_free (file);
+      return NULL;
+    }
 
   header = (gpointer) file->data;
 
-  if (header->signature[0] == GVDB_SIGNATURE0 &&
-      header->signature[1] == GVDB_SIGNATURE1 &&
-      guint32_from_le (header->version) == 0)
-    file->byteswapped = FALSE;
-
-  else if (header->signature[0] == GVDB_SWAPPED_SIGNATURE0 &&
-           header->signature[1] == GVDB_SWAPPED_SIGNATURE1 &&
-           guint32_from_le (header->version) == 0)
-    file->byteswapped = TRUE;
-
-  else
-    goto invalid;
-
   gvdb_table_setup_root (file, &header->root);
 
-  return file;
-
-invalid:
-  g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "invalid gvdb header");
-
-  g_bytes_unref (file->bytes);
+  if (guint32_from_le (header->options) & GVDB_OPTION_SEGMENTS)
+    gvdb_table_setup_segments (file);
 
-  g_slice_free (GvdbTable, file);
-
-  return NULL;
+  return file;
 }
 
 /**
@@ -282,12 +392,24 @@ gvdb_table_lookup (GvdbTable   *file,
   if (!gvdb_table_bloom_filter (file, hash_value))
     return NULL;
 
-  bucket = hash_value % file->n_buckets;
-  itemno = guint32_from_le (file->hash_buckets[bucket]);
+  if (file->perfect_hash)
+    {
+      guint32 displacement;
 
-  if (bucket == file->n_buckets - 1 ||
-      (lastno = guint32_from_le(file->hash_buckets[bucket + 1])) > file->n_hash_items)
-    lastno = file->n_hash_items;
+      bucket = gvdb_perfect_hash_bucket (hash_value, file->n_buckets);
+      displacement = guint32_from_le (file->hash_buckets[bucket]);
+      itemno = gvdb_perfect_hash_slot (hash_value, displacement, file->n_hash_items);
+      lastno = itemno + 1;
+    }
+  else
+    {
+      bucket = hash_value % file->n_buckets;
+      itemno = guint32_from_le (file->hash_buckets[bucket]);
+
+      if (bucket == file->n_buckets - 1 ||
+          (lastno = guint32_from_le(file->hash_buckets[bucket + 1])) > file->n_hash_items)
+        lastno = file->n_hash_items;
+    }
 
   while G_LIKELY (itemno < lastno)
     {
@@ -304,6 +426,36 @@ gvdb_table_lookup (GvdbTable   *file,
   return NULL;
 }
 
+/* Looks up @key in the newest segment that has it, as the items of the
+ * later segments replace the ones of the earlier segments
+ */
+static const struct gvdb_hash_item *
+gvdb_table_lookup_segments (GvdbTable    *file,
+                            const gchar  *key,
+                            gchar         type,
+                            GvdbTable   **segment)
+{
+  const struct gvdb_hash_item *item;
+  guint i;
+
+  for (i = file->n_segments; i > 0; i--)
+    {
+      if (file->segments[i - 1] == NULL)
+        continue;
+
+      item = gvdb_table_lookup (file->segments[i - 1], key, type);
+      if (item != NULL)
+        {
+          *segment = file->segments[i - 1];
+          return item;
+        }
+    }
+
+  *segment = file;
+
+  return gvdb_table_lookup (file, key, type);
+}
+
 static gboolean
 gvdb_table_list_from_item (GvdbTable                    *table,
                            const struct gvdb_hash_item  *item,
@@ -472,27 +624,10 @@ gvdb_table_get_names (GvdbTable *table,
   return names;
 }
 
-/**
- * gvdb_table_list:
- * @file: a #GvdbTable
- * @key: a string
- * @returns: a %NULL-terminated string array
- *
- * List all of the keys that appear below @key.  The nesting of keys
- * within the hash file is defined by the program that created the hash
- * file.  One thing is constant: each item in the returned array can be
- * concatenated to @key to obtain the full name of that key.
- *
- * It is not possible to tell from this function if a given key is
- * itself a path, a value, or another hash table; you are expected to
- * know this for yourself.
- *
- * You should call g_strfreev() on the return result when you no longer
- * require it.
- **/
-gchar **
-gvdb_table_list (GvdbTable   *file,
-                 const gchar *key)
+/* Lists the keys below @key in @file only, without its segments */
+static gchar **
+gvdb_table_list_segment (GvdbTable   *file,
+                         const gchar *key)
 {
   const struct gvdb_hash_item *item;
   const guint32_le *list;
@@ -535,13 +670,97 @@ gvdb_table_list (GvdbTable   *file,
   return strv;
 }
 
+/**
+ * gvdb_table_list:
+ * @file: a #GvdbTable
+ * @key: a string
+ * @returns: a %NULL-terminated string array
+ *
+ * List all of the keys that appear below @key.  The nesting of keys
+ * within the hash file is defined by the program that created the hash
+ * file.  One thing is constant: each item in the returned array can be
+ * concatenated to @key to obtain the full name of that key.
+ *
+ * The keys listed below @key in every segment of @file are returned,
+ * each of them once.
+ *
+ * It is not possible to tell from this function if a given key is
+ * itself a path, a value, or another hash table; you are expected to
+ * know this for yourself.
+ *
+ * You should call g_strfreev() on the return result when you no longer
+ * require it.
+ **/
+gchar **
+gvdb_table_list (GvdbTable   *file,
+                 const gchar *key)
+{
+  GHashTable *seen;
+  GPtrArray *names;
+  gboolean found;
+  gchar **strv;
+  guint i, j;
+
+  strv = gvdb_table_list_segment (file, key);
+
+  if (file->n_segments == 0)
+    return strv;
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  names = g_ptr_array_new ();
+  found = FALSE;
+
+  for (i = 0; i <= file->n_segments; i++)
+    {
+      if (i > 0)
+        {
+          if (file->segments[i - 1] == NULL)
+            continue;
+
+          strv = gvdb_table_list_segment (file->segments[i - 1], key);
+        }
+
+      if (strv == NULL)
+        continue;
+
+      found = TRUE;
+
+      for (j = 0; strv[j] != NULL; j++)
+        {
+          if (g_hash_table_contains (seen, strv[j]))
+            {
+              g_free (strv[j]);
+              continue;
+            }
+
+          g_hash_table_add (seen, strv[j]);
+          g_ptr_array_add (names, strv[j]);
+        }
+
+      g_free (strv);
+      strv = NULL;
+    }
+
+  g_hash_table_unref (seen);
+
+  if (!found)
+    {
+      g_ptr_array_free (names, TRUE);
+      return NULL;
+    }
+
+  g_ptr_array_add (names, NULL);
+
+  return (gchar **) g_ptr_array_free (names, FALSE);
+}
+
 /**
  * gvdb_table_has_value:
  * @file: a #GvdbTable
  * @key: a string
  * @returns: %TRUE if @key is in the table
  *
- * Checks for a value named @key in @file.
+ * Checks for a value named @key in @file, or in any of its segments.
  *
  * Note: this function does not consider non-value nodes (other hash
  * tables, for example).
@@ -550,15 +769,16 @@ gboolean
 gvdb_table_has_value (GvdbTable    *file,
                       const gchar  *key)
 {
-  static const struct gvdb_hash_item *item;
+  const struct gvdb_hash_item *item;
+  GvdbTable *segment;
   gsize size;
 
-  item = gvdb_table_lookup (file, key, 'v');
+  item = gvdb_table_lookup_segments (file, key, 'v', &segment);
 
   if (item == NULL)
     return FALSE;
 
-  return gvdb_table_dereference (file, &item->value.pointer, 8, &size) != NULL;
+  return gvdb_table_dereference (segment, &item->value.pointer, 8, &size) != NULL;
 }
 
 static GVariant *
@@ -596,6 +816,9 @@ gvdb_table_value_from_item (GvdbTable                   *table,
  * #GVariant instance is returned.  The #GVariant does not depend on the
  * continued existence of @file.
  *
+ * If @file has segments, the value comes from the newest segment that
+ * has @key.
+ *
  * You should call g_variant_unref() on the return result when you no
  * longer require it.
  **/
@@ -604,14 +827,15 @@ gvdb_table_get_value (GvdbTable    *file,
                       const gchar  *key)
 {
   const struct gvdb_hash_item *item;
+  GvdbTable *segment;
   GVariant *value;
 
-  if ((item = gvdb_table_lookup (file, key, 'v')) == NULL)
+  if ((item = gvdb_table_lookup_segments (file, key, 'v', &segment)) == NULL)
     return NULL;
 
-  value = gvdb_table_value_from_item (file, item);
+  value = gvdb_table_value_from_item (segment, item);
 
-  if (value && file->byteswapped)
+  if (value && segment->byteswapped)
     {
       GVariant *tmp;
 
@@ -639,11 +863,52 @@ gvdb_table_get_raw_value (GvdbTable   *table,
                           const gchar *key)
 {
   const struct gvdb_hash_item *item;
+  GvdbTable *segment;
 
-  if ((item = gvdb_table_lookup (table, key, 'v')) == NULL)
+  if ((item = gvdb_table_lookup_segments (table, key, 'v', &segment)) == NULL)
     return NULL;
 
-  return gvdb_table_value_from_item (table, item);
+  return gvdb_table_value_from_item (segment, item);
+}
+
+/**
+ * gvdb_table_get_raw_values:
+ * @table: a #GvdbTable
+ * @key: a string
+ * @returns: (transfer full) (element-type GVariant): the values of @key
+ *
+ * Looks up the values named @key in every segment of @table, oldest
+ * first, for the callers that combine the values of the segments
+ * instead of only using the newest one.
+ *
+ * Like gvdb_table_get_raw_value(), this never byteswaps the values.
+ **/
+GPtrArray *
+gvdb_table_get_raw_values (GvdbTable   *table,
+                           const gchar *key)
+{
+  const struct gvdb_hash_item *item;
+  GPtrArray *values;
+  GVariant *value;
+  guint i;
+
+  values = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+
+  for (i = 0; i <= table->n_segments; i++)
+    {
+      GvdbTable *segment = i == 0 ? table : table->segments[i - 1];
+
+      if (segment == NULL)
+        continue;
+
+      if ((item = gvdb_table_lookup (segment, key, 'v')) == NULL)
+        continue;
+
+      if ((value = gvdb_table_value_from_item (segment, item)) != NULL)
+        g_ptr_array_add (values, value);
+    }
+
+  return values;
 }
 
 /**
@@ -698,6 +963,13 @@ gvdb_table_get_table (GvdbTable   *file,
 void
 gvdb_table_free (GvdbTable *file)
 {
+  guint i;
+
+  for (i = 0; i < file->n_segments; i++)
+    if (file->segments[i] != NULL)
+      gvdb_table_free (file->segments[i]);
+
+  g_free (file->segments);
   g_bytes_unref (file->bytes);
   g_slice_free (GvdbTable, file);
 }
@@ -718,3 +990,343 @@ gvdb_table_is_valid (GvdbTable *table)
 {
   return !!*table->data;
 }
+
+/**
+ * gvdb_table_iter_init:
+ * @iter: an uninitialised #GvdbTableIter
+ * @table: a #GvdbTable
+ *
+ * Initialises @iter to walk over all the items of @table, in the order
+ * in which they are stored, with gvdb_table_iter_next().
+ *
+ * Unlike gvdb_table_get_names(), iterating does not allocate: each item
+ * only exposes its own fragment of the key, and the index of its parent.
+ **/
+void
+gvdb_table_iter_init (GvdbTableIter *iter,
+                      GvdbTable     *table)
+{
+  iter->table = table;
+  iter->index = G_MAXUINT32;
+}
+
+/**
+ * gvdb_table_iter_next:
+ * @iter: a #GvdbTableIter
+ * @returns: %TRUE if @iter points to an item, %FALSE at the end
+ *
+ * Advances @iter to the next item of its table.
+ **/
+gboolean
+gvdb_table_iter_next (GvdbTableIter *iter)
+{
+  guint32 next = iter->index + 1;
+
+  if (next >= iter->table->n_hash_items)
+    {
+      iter->index = iter->table->n_hash_items;
+      return FALSE;
+    }
+
+  iter->index = next;
+
+  return TRUE;
+}
+
+static const struct gvdb_hash_item *
+gvdb_table_iter_get_item (GvdbTableIter *iter)
+{
+  g_return_val_if_fail (iter->index < iter->table->n_hash_items, NULL);
+
+  return &iter->table->hash_items[iter->index];
+}
+
+/**
+ * gvdb_table_iter_get_index:
+ * @iter: a #GvdbTableIter
+ * @returns: the index of the current item
+ *
+ * Gets the index of the item @iter points to, which is what
+ * gvdb_table_iter_get_parent() returns for its children.
+ **/
+guint32
+gvdb_table_iter_get_index (GvdbTableIter *iter)
+{
+  return iter->index;
+}
+
+/**
+ * gvdb_table_iter_get_key:
+ * @iter: a #GvdbTableIter
+ * @length: (out): return location for the length of the key
+ * @returns: (nullable): the key of the current item, which is not
+ *   nul-terminated, or %NULL if the table is corrupted
+ *
+ * Gets the part of the key of the current item that follows the key of
+ * its parent; the full key is the concatenation of the keys of all its
+ * ancestors and this one.
+ **/
+const gchar *
+gvdb_table_iter_get_key (GvdbTableIter *iter,
+                         gsize         *length)
+{
+  const struct gvdb_hash_item *item = gvdb_table_iter_get_item (iter);
+
+  if (item == NULL)
+    return NULL;
+
+  return gvdb_table_item_get_key (iter->table, item, length);
+}
+
+/**
+ * gvdb_table_iter_get_parent:
+ * @iter: a #GvdbTableIter
+ * @returns: the index of the parent of the current item, or
+ *   %G_MAXUINT32 for root items
+ **/
+guint32
+gvdb_table_iter_get_parent (GvdbTableIter *iter)
+{
+  const struct gvdb_hash_item *item = gvdb_table_iter_get_item (iter);
+  guint32 parent;
+
+  if (item == NULL)
+    return G_MAXUINT32;
+
+  parent = guint32_from_le (item->parent);
+  if (parent >= iter->table->n_hash_items)
+    return G_MAXUINT32;
+
+  return parent;
+}
+
+/**
+ * gvdb_table_iter_get_item_type:
+ * @iter: a #GvdbTableIter
+ * @returns: 'v' for values, 'L' for lists of children, and 'H' for
+ *   nested hash tables
+ **/
+gchar
+gvdb_table_iter_get_item_type (GvdbTableIter *iter)
+{
+  const struct gvdb_hash_item *item = gvdb_table_iter_get_item (iter);
+
+  if (item == NULL)
+    return '\0';
+
+  return item->type;
+}
+
+/**
+ * gvdb_table_iter_get_value_data:
+ * @iter: a #GvdbTableIter
+ * @size: (out): return location for the size of the data
+ * @returns: (nullable): the serialised value of the current item, as a
+ *   variant of type 'v', or %NULL if the item is not a value
+ *
+ * Gets the data of the value of the current item, inside of the table,
+ * without creating a #GVariant for it.
+ **/
+gconstpointer
+gvdb_table_iter_get_value_data (GvdbTableIter *iter,
+                                gsize         *size)
+{
+  const struct gvdb_hash_item *item = gvdb_table_iter_get_item (iter);
+
+  if (item == NULL || item->type != 'v')
+    return NULL;
+
+  return gvdb_table_dereference (iter->table, &item->value.pointer, 8, size);
+}
+
+/**
+ * gvdb_table_iter_get_raw_value:
+ * @iter: a #GvdbTableIter
+ * @returns: (nullable): a #GVariant, or %NULL if the item is not a value
+ *
+ * Gets the value of the current item, like gvdb_table_get_raw_value()
+ * does for a key, without looking it up.
+ **/
+GVariant *
+gvdb_table_iter_get_raw_value (GvdbTableIter *iter)
+{
+  const struct gvdb_hash_item *item = gvdb_table_iter_get_item (iter);
+
+  if (item == NULL || item->type != 'v')
+    return NULL;
+
+  return gvdb_table_value_from_item (iter->table, item);
+}
+
+/* Lists cannot be nested deeper than this; it protects the stack against
+ * corrupted files
+ */
+#define MAX_WALK_DEPTH 64
+
+static gboolean
+gvdb_table_walk_list (GvdbTable                   *table,
+                      const struct gvdb_hash_item *list_item,
+                      GString                     *path,
+                      GvdbTableWalkFunc            func,
+                      gpointer                     user_data,
+                      guint8                      *walked,
+                      guint                        depth)
+{
+  const guint32_le *list;
+  guint32 list_index;
+  guint length;
+  guint i;
+
+  if G_UNLIKELY (depth > MAX_WALK_DEPTH)
+    return TRUE;
+
+  /* Each list has a single parent in a valid file; in a corrupted one, a
+   * list appearing in several others would be walked an exponential
+   * number of times
+   */
+  list_index = list_item - table->hash_items;
+  if G_UNLIKELY (walked[list_index])
+    return TRUE;
+
+  walked[list_index] = TRUE;
+
+  if (!gvdb_table_list_from_item (table, list_item, &list, &length))
+    return TRUE;
+
+  for (i = 0; i < length; i++)
+    {
+      guint32 itemno = guint32_from_le (list[i]);
+      const struct gvdb_hash_item *item;
+      GvdbTableIter iter;
+      GvdbWalkResult res;
+      const gchar *key;
+      gsize key_length;
+      gsize path_length;
+
+      if G_UNLIKELY (itemno >= table->n_hash_items)
+        continue;
+
+      item = &table->hash_items[itemno];
+      key = gvdb_table_item_get_key (table, item, &key_length);
+      if G_UNLIKELY (key == NULL)
+        continue;
+
+      path_length = path->len;
+      g_string_append_len (path, key, key_length);
+
+      iter.table = table;
+      iter.index = itemno;
+
+      res = func (&iter, path->str, user_data);
+
+      if (res == GVDB_WALK_CONTINUE && item->type == 'L')
+        {
+          if (!gvdb_table_walk_list (table, item, path, func, user_data,
+                                     walked, depth + 1))
+            res = GVDB_WALK_STOP;
+        }
+
+      g_string_truncate (path, path_length);
+
+      if (res == GVDB_WALK_STOP)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * gvdb_table_walk:
+ * @table: a #GvdbTable
+ * @key: the key of a list, like "/" or "/org/example/"
+ * @func: the function to call for each item
+ * @user_data: data for @func
+ * @returns: %FALSE if @key is not a list in @table
+ *
+ * Walks the items below @key, depth first, following the lists of
+ * children that the builder creates for items with a parent; @func is
+ * called with an iterator pointing to each item and its full key.
+ *
+ * @func returns %GVDB_WALK_SKIP to avoid walking the children of a
+ * list, and %GVDB_WALK_STOP to stop the walk altogether.
+ **/
+gboolean
+gvdb_table_walk (GvdbTable         *table,
+                 const gchar       *key,
+                 GvdbTableWalkFunc  func,
+                 gpointer           user_data)
+{
+  const struct gvdb_hash_item *item;
+  guint8 *walked;
+  GString *path;
+
+  if ((item = gvdb_table_lookup (table, key, 'L')) == NULL)
+    return FALSE;
+
+  walked = g_new0 (guint8, table->n_hash_items);
+  path = g_string_new (key);
+  gvdb_table_walk_list (table, item, path, func, user_data, walked, 0);
+  g_string_free (path, TRUE);
+  g_free (walked);
+
+  return TRUE;
+}
+
+/**
+ * gvdb_table_get_n_segments:
+ * @table: a #GvdbTable
+ * @returns: the number of segments of @table
+ *
+ * Gets the number of segments in the file of @table: the table written
+ * by gvdb_table_write_contents(), followed by each of the tables added
+ * by gvdb_table_append_contents().
+ *
+ * Values are looked up in the newest segment that has them, and lists
+ * include the keys of every segment; gvdb_table_get_raw_values() returns
+ * the values of all the segments, for callers that combine them. Nested
+ * tables, iterators and walks only see the first segment, and the other
+ * ones have to be opened with gvdb_table_get_segment().
+ **/
+guint
+gvdb_table_get_n_segments (GvdbTable *table)
+{
+  return table->n_segments + 1;
+}
+
+/**
+ * gvdb_table_get_segment:
+ * @table: a #GvdbTable
+ * @index: the index of a segment, less than gvdb_table_get_n_segments()
+ * @returns: (nullable): a new #GvdbTable, or %NULL if the segment is
+ *   invalid
+ *
+ * Opens the segment at @index in the file of @table. Like with
+ * gvdb_table_get_table(), the newly-created #GvdbTable does not depend
+ * on the continued existence of @table.
+ **/
+GvdbTable *
+gvdb_table_get_segment (GvdbTable *table,
+                        guint      index)
+{
+  const struct gvdb_header *header;
+  GvdbTable *source, *segment;
+
+  g_return_val_if_fail (index <= table->n_segments, NULL);
+
+  source = index == 0 ? table : table->segments[index - 1];
+  if (source == NULL)
+    return NULL;
+
+  header = (gconstpointer) source->data;
+
+  segment = g_slice_new0 (GvdbTable);
+  segment->bytes = g_bytes_ref (source->bytes);
+  segment->byteswapped = source->byteswapped;
+  segment->trusted = source->trusted;
+  segment->data = source->data;
+  segment->size = source->size;
+
+  gvdb_table_setup_root (segment, &header->root);
+
+  return segment;
+}
@@ -26,6 +26,24 @@
 
 typedef struct _GvdbTable GvdbTable;
 
+typedef struct
+{
+  /*< private >*/
+  GvdbTable *table;
+  guint32 index;
+} GvdbTableIter;
+
+typedef enum
+{
+  GVDB_WALK_CONTINUE,
+  GVDB_WALK_SKIP,
+  GVDB_WALK_STOP
+} GvdbWalkResult;
+
+typedef GvdbWalkResult (* GvdbTableWalkFunc) (GvdbTableIter *iter,
+                                              const gchar   *path,
+                                              gpointer       user_data);
+
 G_BEGIN_DECLS
 
 G_GNUC_INTERNAL
@@ -51,6 +69,9 @@ G_GNUC_INTERNAL
 GVariant *              gvdb_table_get_raw_value                        (GvdbTable    *table,
                                                                          const gchar  *key);
 G_GNUC_INTERNAL
+GPtrArray *             gvdb_table_get_raw_values                       (GvdbTable    *table,
+                                                                         const gchar  *key);
+G_GNUC_INTERNAL
 GVariant *              gvdb_table_get_value                            (GvdbTable    *table,
                                                                          const gchar  *key);
 
@@ -60,6 +81,38 @@ gboolean                gvdb_table_has_value                            (GvdbTab
 G_GNUC_INTERNAL
 gboolean                gvdb_table_is_valid                             (GvdbTable    *table);
 
+G_GNUC_INTERNAL
+guint                   gvdb_table_get_n_segments                       (GvdbTable    *table);
+G_GNUC_INTERNAL
+GvdbTable *             gvdb_table_get_segment                          (GvdbTable    *table,
+                                                                         guint         index);
+
+G_GNUC_INTERNAL
+void                    gvdb_table_iter_init                            (GvdbTableIter *iter,
+                                                                         GvdbTable     *table);
+G_GNUC_INTERNAL
+gboolean                gvdb_table_iter_next                            (GvdbTableIter *iter);
+G_GNUC_INTERNAL
+guint32                 gvdb_table_iter_get_index                       (GvdbTableIter *iter);
+G_GNUC_INTERNAL
+const gchar *           gvdb_table_iter_get_key                         (GvdbTableIter *iter,
+                                                                         gsize         *length);
+G_GNUC_INTERNAL
+guint32                 gvdb_table_iter_get_parent                      (GvdbTableIter *iter);
+G_GNUC_INTERNAL
+gchar                   gvdb_table_iter_get_item_type                   (GvdbTableIter *iter);
+G_GNUC_INTERNAL
+gconstpointer           gvdb_table_iter_get_value_data                  (GvdbTableIter *iter,
+                                                                         gsize         *size);
+G_GNUC_INTERNAL
+GVariant *              gvdb_table_iter_get_raw_value                   (GvdbTableIter *iter);
+
+G_GNUC_INTERNAL
+gboolean                gvdb_table_walk                                 (GvdbTable         *table,
+                                                                         const gchar       *key,
+                                                                         GvdbTableWalkFunc  func,
+                                                                         gpointer           user_data);
+
 G_END_DECLS
 
 #endif /* __gvdb_reader_h__ */
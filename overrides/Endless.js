@@ -23,6 +23,42 @@ function getCurrentFileDir() {
 
 imports.searchPath.unshift(getCurrentFileDir());
 
+// Returns the location of the caller of the function calling this one, as
+// [file, line, function]; this parses a stack trace, so it is slow
+function _getCallerLocation() {
+    let exc = new Error();
+    let splits = exc.stack.split('\n')[2].split(':');
+    let [line] = splits.slice(-2);
+    let loc = splits.slice(0, -2).join(':');
+    let [func, file] = loc.split('@');
+    if (func === '') {
+        func = '<main>';
+    }
+    return [file, line, func];
+}
+
+// A profiling probe whose location is resolved once, when it is created,
+// instead of every time it is started
+const ProfileProbeHandle = function(name, location) {
+    this.name = name;
+    this._location = location;
+    this._probe = null;
+};
+
+ProfileProbeHandle.prototype.start = function() {
+    let [file, line, func] = this._location;
+    this._probe = Endless.ProfileProbe._start_real(file, line, func, this.name);
+    return this._probe;
+};
+
+ProfileProbeHandle.prototype.stop = function() {
+    // The C probe is shared by every sample with the same name, and stops
+    // the outermost sample in flight
+    if (this._probe !== null) {
+        this._probe.stop();
+    }
+};
+
 const TopbarHomeButton = imports.endless_private.topbar_home_button;
 const TopbarNavButton = imports.endless_private.topbar_nav_button;
 
@@ -47,17 +83,35 @@ function _init() {
 
     // Override Endless.ProfileProbe.start() to populate it with the location
     // in the JS file, like the EOS_PROFILE_PROBE pre-processor macro does for
-    // C files
+    // C files. A probe keeps the location of its first sample, so the stack
+    // is only parsed the first time each name is seen
+    let probeLocations = new Map();
     Endless.ProfileProbe._start_real = Endless.ProfileProbe.start;
     Endless.ProfileProbe.start = function(name) {
-        let exc = new Error();
-        let splits = exc.stack.split('\n')[1].split(':');
-        let [line] = splits.slice(-2);
-        let loc = splits.slice(0, -2).join(':');
-        let [func, file] = loc.split('@');
-        if (func === '') {
-            func = '<main>';
+        let location = probeLocations.get(name);
+        if (location === undefined) {
+            location = _getCallerLocation();
+            probeLocations.set(name, location);
         }
+        let [file, line, func] = location;
         return Endless.ProfileProbe._start_real(file, line, func, name);
     };
+
+    // Endless.ProfileProbe.register() returns a handle with start() and
+    // stop() methods, for probes in hot paths, like loops:
+    //
+    //   const probe = Endless.ProfileProbe.register('/com/example/loop');
+    //   for (let item of items) {
+    //       probe.start();
+    //       process(item);
+    //       probe.stop();
+    //   }
+    Endless.ProfileProbe.register = function(name) {
+        let location = probeLocations.get(name);
+        if (location === undefined) {
+            location = _getCallerLocation();
+            probeLocations.set(name, location);
+        }
+        return new ProfileProbeHandle(name, location);
+    };
 }
@@ -69,11 +69,781 @@ flexy_grid_cell_spacing_access (FlexyGridFixture *fixture,
   g_assert_cmpint (eos_flexy_grid_get_cell_spacing (fixture->grid), ==, 12);
 }
 
+/* Adds a cell for each character of @shapes: S for small, H and V for
+ * medium horizontal and vertical, and L for large
+ */
+static EosFlexyShape
+get_shape (char c)
+{
+  switch (c)
+    {
+    case 'S':
+      return EOS_FLEXY_SHAPE_SMALL;
+    case 'H':
+      return EOS_FLEXY_SHAPE_MEDIUM_HORIZONTAL;
+    case 'V':
+      return EOS_FLEXY_SHAPE_MEDIUM_VERTICAL;
+    case 'L':
+      return EOS_FLEXY_SHAPE_LARGE;
+    default:
+      g_assert_not_reached ();
+    }
+
+  return EOS_FLEXY_SHAPE_SMALL;
+}
+
+static void
+add_cells (EosFlexyGrid *grid,
+           const char   *shapes)
+{
+  for (const char *c = shapes; *c != '\0'; c++)
+    {
+      GtkWidget *cell = eos_flexy_grid_cell_new ();
+
+      eos_flexy_grid_cell_set_shape (EOS_FLEXY_GRID_CELL (cell), get_shape (*c));
+      gtk_widget_show (cell);
+      eos_flexy_grid_insert (grid, cell, -1);
+    }
+}
+
+static int
+get_layout_height (EosFlexyGrid *grid,
+                   int           width)
+{
+  int height = 0;
+
+  gtk_widget_queue_resize (GTK_WIDGET (grid));
+  gtk_widget_get_preferred_height_for_width (GTK_WIDGET (grid), width, &height, NULL);
+
+  return height;
+}
+
+static void
+flexy_grid_layout_holes (void)
+{
+  /* Later cells fill the holes left by the larger ones */
+  static const struct {
+    const char *shapes;
+    int n_columns;
+    int n_lines;
+  } layouts[] = {
+    { "S", 3, 1 },
+    { "SLLSSSS", 3, 5 },
+    { "SLLSSSS", 4, 4 },
+    { "HVHSLSV", 3, 6 },
+    { "LSVHHSS", 5, 3 },
+    { "VVVHHHL", 2, 9 },
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (layouts); i++)
+    {
+      GtkWidget *grid = g_object_ref_sink (eos_flexy_grid_new ());
+
+      eos_flexy_grid_set_cell_size (EOS_FLEXY_GRID (grid), 10);
+      eos_flexy_grid_set_cell_spacing (EOS_FLEXY_GRID (grid), 0);
+      add_cells (EOS_FLEXY_GRID (grid), layouts[i].shapes);
+
+      int height = get_layout_height (EOS_FLEXY_GRID (grid), layouts[i].n_columns * 10);
+      g_assert_cmpint (height, ==, layouts[i].n_lines * 10);
+
+      gtk_widget_destroy (grid);
+      g_object_unref (grid);
+    }
+}
+
+static EosFlexyGridCell *
+get_cell_at (EosFlexyGrid *grid,
+             guint         index)
+{
+  GList *children = gtk_container_get_children (GTK_CONTAINER (grid));
+  EosFlexyGridCell *cell = g_list_nth_data (children, index);
+
+  g_list_free (children);
+
+  return cell;
+}
+
+/* Compares the layout of @grid to the one of a new grid with the same cells */
+static void
+assert_layout_equal (EosFlexyGrid *grid,
+                     const char   *shapes,
+                     int           width)
+{
+  GtkWidget *expected = g_object_ref_sink (eos_flexy_grid_new ());
+
+  eos_flexy_grid_set_cell_size (EOS_FLEXY_GRID (expected), 10);
+  eos_flexy_grid_set_cell_spacing (EOS_FLEXY_GRID (expected), 0);
+  add_cells (EOS_FLEXY_GRID (expected), shapes);
+
+  g_assert_cmpint (get_layout_height (grid, width), ==,
+                   get_layout_height (EOS_FLEXY_GRID (expected), width));
+
+  gtk_widget_destroy (expected);
+  g_object_unref (expected);
+}
+
+static void
+flexy_grid_layout_cache (FlexyGridFixture *fixture,
+                         gconstpointer     unused G_GNUC_UNUSED)
+{
+  static const char shapes[] = "SHVL";
+  g_autoptr(GString) cells = g_string_new (NULL);
+
+  eos_flexy_grid_set_cell_size (fixture->grid, 10);
+  eos_flexy_grid_set_cell_spacing (fixture->grid, 0);
+
+  for (int i = 0; i < 300; i++)
+    g_string_append_c (cells, shapes[g_test_rand_int_range (0, 4)]);
+
+  add_cells (fixture->grid, cells->str);
+
+  /* Each change is checked at two widths, which are both cached */
+  for (int i = 0; i < 20; i++)
+    {
+      char shape = shapes[g_test_rand_int_range (0, 4)];
+      guint index = g_test_rand_int_range (0, cells->len);
+      char one_cell[] = { shape, '\0' };
+      GtkWidget *cell;
+
+      switch (i % 4)
+        {
+        case 0:
+          add_cells (fixture->grid, one_cell);
+          g_string_append_c (cells, shape);
+          break;
+
+        case 1:
+          cell = eos_flexy_grid_cell_new ();
+          gtk_widget_show (cell);
+          eos_flexy_grid_insert (fixture->grid, cell, index);
+          g_string_insert_c (cells, index, 'S');
+          break;
+
+        case 2:
+          cell = GTK_WIDGET (get_cell_at (fixture->grid, index));
+          gtk_container_remove (GTK_CONTAINER (fixture->grid), cell);
+          g_string_erase (cells, index, 1);
+          break;
+
+        case 3:
+          eos_flexy_grid_cell_set_shape (get_cell_at (fixture->grid, index),
+                                         EOS_FLEXY_SHAPE_LARGE);
+          cells->str[index] = 'L';
+          break;
+        }
+
+      assert_layout_equal (fixture->grid, cells->str, 50);
+      assert_layout_equal (fixture->grid, cells->str, 130);
+    }
+}
+
+static void
+measure_cell (GtkWidget *cell,
+              gpointer   unused G_GNUC_UNUSED)
+{
+  gtk_widget_get_preferred_size (cell, NULL, NULL);
+}
+
+static void
+allocate_grid (EosFlexyGrid *grid,
+               int           width)
+{
+  GtkAllocation allocation = { 0, 0, width, get_layout_height (grid, width) };
+
+  /* The grid allocates the cells without measuring them */
+  gtk_widget_show (GTK_WIDGET (grid));
+  gtk_container_foreach (GTK_CONTAINER (grid), measure_cell, NULL);
+  gtk_widget_size_allocate (GTK_WIDGET (grid), &allocation);
+}
+
+static void
+assert_hits_equal (EosFlexyGrid *grid)
+{
+  GList *children = gtk_container_get_children (GTK_CONTAINER (grid));
+  GtkAllocation allocation;
+
+  gtk_widget_get_allocation (GTK_WIDGET (grid), &allocation);
+
+  for (int y = -2; y < allocation.height + 2; y++)
+    for (int x = -2; x < allocation.width + 2; x++)
+      {
+        EosFlexyGridCell *expected = NULL;
+
+        for (GList *l = children; l != NULL; l = l->next)
+          {
+            GtkAllocation cell_allocation;
+
+            gtk_widget_get_allocation (l->data, &cell_allocation);
+
+            if (x >= cell_allocation.x && x < cell_allocation.x + cell_allocation.width &&
+                y >= cell_allocation.y && y < cell_allocation.y + cell_allocation.height)
+              {
+                expected = l->data;
+                break;
+              }
+          }
+
+        g_assert_true (eos_flexy_grid_get_cell_at_coords (grid, x, y) == expected);
+      }
+
+  g_list_free (children);
+}
+
+static void
+flexy_grid_hit_test (FlexyGridFixture *fixture,
+                     gconstpointer     unused G_GNUC_UNUSED)
+{
+  static const char shapes[] = "SHVL";
+  char cells[201];
+
+  eos_flexy_grid_set_cell_size (fixture->grid, 10);
+  eos_flexy_grid_set_cell_spacing (fixture->grid, 2);
+
+  for (int i = 0; i < 200; i++)
+    cells[i] = shapes[g_test_rand_int_range (0, 4)];
+  cells[200] = '\0';
+
+  add_cells (fixture->grid, cells);
+
+  allocate_grid (fixture->grid, 130);
+  assert_hits_equal (fixture->grid);
+
+  /* The cells keep their allocation until the grid is allocated again */
+  GtkWidget *cell = eos_flexy_grid_cell_new ();
+  eos_flexy_grid_cell_set_shape (EOS_FLEXY_GRID_CELL (cell), EOS_FLEXY_SHAPE_LARGE);
+  gtk_widget_show (cell);
+  eos_flexy_grid_insert (fixture->grid, cell, 0);
+  assert_hits_equal (fixture->grid);
+
+  allocate_grid (fixture->grid, 130);
+  assert_hits_equal (fixture->grid);
+
+  /* The cells are mirrored in right-to-left locales */
+  gtk_widget_set_default_direction (GTK_TEXT_DIR_RTL);
+  allocate_grid (fixture->grid, 137);
+  assert_hits_equal (fixture->grid);
+  gtk_widget_set_default_direction (GTK_TEXT_DIR_LTR);
+}
+
+static EosFlexyShape
+get_item_shape (gpointer item,
+                gpointer unused G_GNUC_UNUSED)
+{
+  return get_shape (GPOINTER_TO_INT (g_object_get_data (item, "shape")));
+}
+
+static void
+bind_item (EosFlexyGridCell *cell,
+           gpointer          item,
+           gpointer          unused G_GNUC_UNUSED)
+{
+  g_object_set_data (G_OBJECT (cell), "item", item);
+}
+
+static GObject *
+create_item (char shape)
+{
+  GObject *item = g_object_new (G_TYPE_OBJECT, NULL);
+
+  g_object_set_data (item, "shape", GINT_TO_POINTER (shape));
+
+  return item;
+}
+
+static guint
+get_item_position (GListModel *model,
+                   gpointer    item)
+{
+  for (guint i = 0; i < g_list_model_get_n_items (model); i++)
+    {
+      g_autoptr(GObject) other = g_list_model_get_item (model, i);
+
+      if (other == item)
+        return i;
+    }
+
+  g_assert_not_reached ();
+  return 0;
+}
+
+/* Checks the cells showing the items of @model against the cells of a
+ * grid without model, and returns their number
+ */
+static guint
+assert_bound_cells_equal (EosFlexyGrid *grid,
+                          GListModel   *model,
+                          const char   *shapes)
+{
+  EosFlexyGrid *expected = EOS_FLEXY_GRID (g_object_ref_sink (eos_flexy_grid_new ()));
+  guint n_bound = 0;
+
+  eos_flexy_grid_set_cell_size (expected, 10);
+  eos_flexy_grid_set_cell_spacing (expected, 0);
+  add_cells (expected, shapes);
+  allocate_grid (expected, gtk_widget_get_allocated_width (GTK_WIDGET (grid)));
+
+  GList *children = gtk_container_get_children (GTK_CONTAINER (grid));
+
+  for (GList *l = children; l != NULL; l = l->next)
+    {
+      gpointer item = g_object_get_data (l->data, "item");
+      GtkAllocation allocation, expected_allocation;
+
+      if (!gtk_widget_get_child_visible (l->data))
+        continue;
+
+      guint position = get_item_position (model, item);
+
+      gtk_widget_get_allocation (l->data, &allocation);
+      gtk_widget_get_allocation (GTK_WIDGET (get_cell_at (expected, position)),
+                                 &expected_allocation);
+
+      g_assert_cmpint (allocation.x, ==, expected_allocation.x);
+      g_assert_cmpint (allocation.y, ==, expected_allocation.y);
+      g_assert_cmpint (allocation.width, ==, expected_allocation.width);
+      g_assert_cmpint (allocation.height, ==, expected_allocation.height);
+
+      n_bound++;
+    }
+
+  /* The cells of the items that are not around the viewport are reused */
+  g_assert_cmpuint (g_list_length (children), <=, 31 * 13);
+
+  g_list_free (children);
+  gtk_widget_destroy (GTK_WIDGET (expected));
+  g_object_unref (expected);
+
+  return n_bound;
+}
+
+static void
+flexy_grid_bind_model (void)
+{
+  static const char shapes[] = "SHVL";
+  g_autoptr(GListStore) store = g_list_store_new (G_TYPE_OBJECT);
+  g_autoptr(GString) cells = g_string_new (NULL);
+
+  for (int i = 0; i < 2000; i++)
+    {
+      char shape = shapes[g_test_rand_int_range (0, 4)];
+      g_autoptr(GObject) item = create_item (shape);
+
+      g_string_append_c (cells, shape);
+      g_list_store_append (store, item);
+    }
+
+  GtkWidget *grid = eos_flexy_grid_new ();
+  eos_flexy_grid_set_cell_size (EOS_FLEXY_GRID (grid), 10);
+  eos_flexy_grid_set_cell_spacing (EOS_FLEXY_GRID (grid), 0);
+  eos_flexy_grid_bind_model (EOS_FLEXY_GRID (grid), G_LIST_MODEL (store),
+                             get_item_shape, bind_item, NULL, NULL);
+
+  /* A viewport of 10 lines */
+  GtkWidget *scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+                                  GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_widget_set_size_request (scrolled, 130, 100);
+  gtk_container_add (GTK_CONTAINER (scrolled), grid);
+
+  GtkWidget *window = gtk_offscreen_window_new ();
+  gtk_container_add (GTK_CONTAINER (window), scrolled);
+  gtk_widget_show_all (window);
+  gtk_container_check_resize (GTK_CONTAINER (window));
+
+  g_assert_cmpuint (assert_bound_cells_equal (EOS_FLEXY_GRID (grid), G_LIST_MODEL (store),
+                                              cells->str), >, 0);
+
+  GtkAdjustment *adjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scrolled));
+  gtk_adjustment_set_value (adjustment, gtk_adjustment_get_upper (adjustment) / 2);
+  gtk_container_check_resize (GTK_CONTAINER (window));
+
+  assert_bound_cells_equal (EOS_FLEXY_GRID (grid), G_LIST_MODEL (store), cells->str);
+
+  /* The viewport has cells, even if some slots are empty */
+  int value = gtk_adjustment_get_value (adjustment);
+  EosFlexyGridCell *visible_cell = NULL;
+
+  for (int y = value + 5; y < value + 100 && visible_cell == NULL; y += 10)
+    for (int x = 5; x < 130 && visible_cell == NULL; x += 10)
+      visible_cell = eos_flexy_grid_get_cell_at_coords (EOS_FLEXY_GRID (grid), x, y);
+
+  g_assert_nonnull (visible_cell);
+
+  /* The items after the change move */
+  g_list_store_remove (store, 0);
+  g_string_erase (cells, 0, 1);
+
+  g_autoptr(GObject) item = create_item ('L');
+  g_list_store_insert (store, 1, item);
+  g_string_insert_c (cells, 1, 'L');
+
+  gtk_container_check_resize (GTK_CONTAINER (window));
+
+  assert_bound_cells_equal (EOS_FLEXY_GRID (grid), G_LIST_MODEL (store), cells->str);
+
+  gtk_widget_destroy (window);
+}
+
+/* A cell whose shape depends on its sort key, so that the layout of a
+ * sorted grid does not depend on the order of insertion
+ */
+static GtkWidget *
+create_sorted_cell (guint key)
+{
+  static const char shapes[] = "SHVL";
+  GtkWidget *cell = eos_flexy_grid_cell_new ();
+
+  g_object_set_data (G_OBJECT (cell), "sort-key", GUINT_TO_POINTER (key));
+  eos_flexy_grid_cell_set_shape (EOS_FLEXY_GRID_CELL (cell), get_shape (shapes[key % 4]));
+  gtk_widget_show (cell);
+
+  return cell;
+}
+
+static int
+compare_sort_keys (EosFlexyGridCell *cell_a,
+                   EosFlexyGridCell *cell_b,
+                   gpointer          unused G_GNUC_UNUSED)
+{
+  guint key_a = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (cell_a), "sort-key"));
+  guint key_b = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (cell_b), "sort-key"));
+
+  return (key_a > key_b) - (key_a < key_b);
+}
+
+static GString *
+get_sorted_shapes (EosFlexyGrid *grid)
+{
+  static const char shapes[] = "SHVL";
+  GList *children = gtk_container_get_children (GTK_CONTAINER (grid));
+  GString *cells = g_string_new (NULL);
+  guint previous_key = 0;
+
+  for (GList *l = children; l != NULL; l = l->next)
+    {
+      guint key = GPOINTER_TO_UINT (g_object_get_data (l->data, "sort-key"));
+
+      g_assert_cmpuint (key, >=, previous_key);
+      previous_key = key;
+
+      g_string_append_c (cells, shapes[eos_flexy_grid_cell_get_shape (l->data)]);
+    }
+
+  g_list_free (children);
+
+  return cells;
+}
+
+static void
+flexy_grid_insert_many (FlexyGridFixture *fixture,
+                        gconstpointer     unused G_GNUC_UNUSED)
+{
+  eos_flexy_grid_set_cell_size (fixture->grid, 10);
+  eos_flexy_grid_set_cell_spacing (fixture->grid, 0);
+  eos_flexy_grid_set_sort_func (fixture->grid, compare_sort_keys, NULL, NULL);
+
+  /* Each batch is merged with the cells already in the grid */
+  for (int batch = 0; batch < 3; batch++)
+    {
+      GtkWidget *cells[100];
+
+      for (int i = 0; i < 100; i++)
+        cells[i] = create_sorted_cell (g_test_rand_int_range (0, 1000));
+
+      eos_flexy_grid_insert_many (fixture->grid, cells, G_N_ELEMENTS (cells), -1);
+
+      g_autoptr(GString) shapes = get_sorted_shapes (fixture->grid);
+      g_assert_cmpuint (shapes->len, ==, (batch + 1) * 100);
+
+      assert_layout_equal (fixture->grid, shapes->str, 130);
+    }
+}
+
+static void
+flexy_grid_freeze_layout (FlexyGridFixture *fixture,
+                          gconstpointer     unused G_GNUC_UNUSED)
+{
+  eos_flexy_grid_set_cell_size (fixture->grid, 10);
+  eos_flexy_grid_set_cell_spacing (fixture->grid, 0);
+  add_cells (fixture->grid, "SLLSSSS");
+
+  int height = get_layout_height (fixture->grid, 40);
+
+  eos_flexy_grid_freeze_layout (fixture->grid);
+  eos_flexy_grid_freeze_layout (fixture->grid);
+
+  add_cells (fixture->grid, "LLLL");
+  gtk_container_remove (GTK_CONTAINER (fixture->grid),
+                        GTK_WIDGET (get_cell_at (fixture->grid, 0)));
+  eos_flexy_grid_cell_set_shape (get_cell_at (fixture->grid, 0), EOS_FLEXY_SHAPE_SMALL);
+
+  /* The changes are placed once all the freezes are thawed */
+  g_assert_cmpint (get_layout_height (fixture->grid, 40), ==, height);
+
+  eos_flexy_grid_thaw_layout (fixture->grid);
+  g_assert_cmpint (get_layout_height (fixture->grid, 40), ==, height);
+
+  eos_flexy_grid_thaw_layout (fixture->grid);
+  assert_layout_equal (fixture->grid, "SLSSSSLLLL", 40);
+}
+
+static void
+assert_cell_allocation (EosFlexyGridCell *cell,
+                        int               x,
+                        int               y)
+{
+  GtkAllocation allocation;
+
+  gtk_widget_get_allocation (GTK_WIDGET (cell), &allocation);
+  g_assert_cmpint (allocation.x, ==, x);
+  g_assert_cmpint (allocation.y, ==, y);
+  g_assert_cmpint (allocation.width, ==, 10);
+  g_assert_cmpint (allocation.height, ==, 10);
+}
+
+static void
+flexy_grid_freeze_allocate (FlexyGridFixture *fixture,
+                            gconstpointer     unused G_GNUC_UNUSED)
+{
+  eos_flexy_grid_set_cell_size (fixture->grid, 10);
+  eos_flexy_grid_set_cell_spacing (fixture->grid, 0);
+  add_cells (fixture->grid, "SSSS");
+  allocate_grid (fixture->grid, 20);
+
+  EosFlexyGridCell *last = get_cell_at (fixture->grid, 3);
+  assert_cell_allocation (last, 10, 10);
+
+  eos_flexy_grid_freeze_layout (fixture->grid);
+
+  GtkWidget *inserted = eos_flexy_grid_cell_new ();
+  gtk_widget_show (inserted);
+  eos_flexy_grid_insert (fixture->grid, inserted, 3);
+
+  /* The cells before the change are placed for the new width, the ones
+   * after it keep their allocation, and the new one is not shown yet
+   */
+  allocate_grid (fixture->grid, 40);
+
+  assert_cell_allocation (get_cell_at (fixture->grid, 0), 0, 0);
+  assert_cell_allocation (get_cell_at (fixture->grid, 1), 10, 0);
+  assert_cell_allocation (get_cell_at (fixture->grid, 2), 20, 0);
+  assert_cell_allocation (last, 10, 10);
+  g_assert_false (gtk_widget_get_child_visible (inserted));
+
+  eos_flexy_grid_thaw_layout (fixture->grid);
+  g_assert_true (gtk_widget_get_child_visible (inserted));
+
+  allocate_grid (fixture->grid, 40);
+
+  assert_cell_allocation (EOS_FLEXY_GRID_CELL (inserted), 30, 0);
+  assert_cell_allocation (last, 0, 10);
+  assert_layout_equal (fixture->grid, "SSSSS", 40);
+}
+
+typedef struct {
+  EosFlexyGrid *grid;
+  int width;
+  int n_columns;
+  guint iteration;
+} LayoutBench;
+
+/* Queueing a resize keeps the cached placement of the cells, so each
+ * iteration changes the cell size, keeping the same number of columns;
+ * cycling through more sizes than the grid caches layouts means that
+ * every iteration places all of the cells again
+ */
+#define N_BENCH_CELL_SIZES 3
+
+static void
+bench_layout (gpointer data)
+{
+  LayoutBench *bench = data;
+  int cell_size = 10 + (bench->iteration++ % N_BENCH_CELL_SIZES);
+
+  eos_flexy_grid_set_cell_size (bench->grid, cell_size);
+  get_layout_height (bench->grid, bench->n_columns * cell_size);
+}
+
+static void
+flexy_grid_layout_bench (FlexyGridFixture *fixture,
+                         gconstpointer     unused G_GNUC_UNUSED)
+{
+  static const int columns[] = { 3, 8, 32, 128 };
+  static const char shapes[] = "SHVL";
+
+  eos_flexy_grid_set_cell_size (fixture->grid, 10);
+  eos_flexy_grid_set_cell_spacing (fixture->grid, 0);
+
+  /* A catalog of mixed shapes, with about one large cell in four */
+  char cells[10001];
+  for (int i = 0; i < 10000; i++)
+    cells[i] = shapes[g_test_rand_int_range (0, 4)];
+  cells[10000] = '\0';
+
+  add_cells (fixture->grid, cells);
+
+  g_autoptr(EosProfileBenchOptions) options = eos_profile_bench_options_new ();
+  options->max_iterations = 200;
+
+  for (guint i = 0; i < G_N_ELEMENTS (columns); i++)
+    {
+      LayoutBench bench = { fixture->grid, columns[i] * 10, columns[i], 0 };
+      g_autofree char *name = g_strdup_printf ("/sdk/flexy-grid/layout/%d", columns[i]);
+
+      double median = eos_profile_bench_run (name, bench_layout, &bench, options);
+
+      g_test_message ("Layout of 10000 cells in %d columns: %.3f ms", columns[i], median / 1000.0);
+    }
+}
+
+static void
+bench_append (gpointer data)
+{
+  LayoutBench *bench = data;
+
+  add_cells (bench->grid, "S");
+  get_layout_height (bench->grid, bench->width);
+}
+
+static void
+flexy_grid_append_bench (FlexyGridFixture *fixture,
+                         gconstpointer     unused G_GNUC_UNUSED)
+{
+  static const int n_cells[] = { 1000, 10000 };
+
+  eos_flexy_grid_set_cell_size (fixture->grid, 10);
+  eos_flexy_grid_set_cell_spacing (fixture->grid, 0);
+
+  g_autoptr(EosProfileBenchOptions) options = eos_profile_bench_options_new ();
+  options->max_iterations = 200;
+
+  for (guint i = 0; i < G_N_ELEMENTS (n_cells); i++)
+    {
+      LayoutBench bench = { fixture->grid, 80 };
+
+      /* Grows the grid, all at once */
+      g_autofree char *cells = g_strnfill (n_cells[i] - (i > 0 ? n_cells[i - 1] : 0), 'S');
+      add_cells (fixture->grid, cells);
+      get_layout_height (fixture->grid, bench.width);
+
+      g_autofree char *name = g_strdup_printf ("/sdk/flexy-grid/append/%d", n_cells[i]);
+      double median = eos_profile_bench_run (name, bench_append, &bench, options);
+
+      g_test_message ("Appending a cell to %d cells: %.1f us", n_cells[i], median);
+    }
+}
+
+#define N_POPULATE_CELLS        5000
+
+static EosFlexyGrid *
+create_sorted_grid (void)
+{
+  EosFlexyGrid *grid = EOS_FLEXY_GRID (g_object_ref_sink (eos_flexy_grid_new ()));
+
+  eos_flexy_grid_set_cell_size (grid, 10);
+  eos_flexy_grid_set_cell_spacing (grid, 0);
+  eos_flexy_grid_set_sort_func (grid, compare_sort_keys, NULL, NULL);
+
+  return grid;
+}
+
+static void
+destroy_grid (EosFlexyGrid *grid)
+{
+  gtk_widget_destroy (GTK_WIDGET (grid));
+  g_object_unref (grid);
+}
+
+/* Like populating the grid in idle callbacks, with a layout after each
+ * batch of cells
+ */
+static void
+bench_populate_one_by_one (gpointer data)
+{
+  gboolean freeze = GPOINTER_TO_INT (data);
+  EosFlexyGrid *grid = create_sorted_grid ();
+
+  if (freeze)
+    eos_flexy_grid_freeze_layout (grid);
+
+  for (int i = 0; i < N_POPULATE_CELLS; i++)
+    {
+      eos_flexy_grid_insert (grid, create_sorted_cell (g_test_rand_int ()), -1);
+
+      if (i % 100 == 99)
+        get_layout_height (grid, 320);
+    }
+
+  if (freeze)
+    eos_flexy_grid_thaw_layout (grid);
+
+  get_layout_height (grid, 320);
+  destroy_grid (grid);
+}
+
+static void
+bench_populate_many (gpointer data G_GNUC_UNUSED)
+{
+  EosFlexyGrid *grid = create_sorted_grid ();
+  GtkWidget **cells = g_new (GtkWidget *, N_POPULATE_CELLS);
+
+  for (int i = 0; i < N_POPULATE_CELLS; i++)
+    cells[i] = create_sorted_cell (g_test_rand_int ());
+
+  eos_flexy_grid_insert_many (grid, cells, N_POPULATE_CELLS, -1);
+  get_layout_height (grid, 320);
+
+  g_free (cells);
+  destroy_grid (grid);
+}
+
+static void
+flexy_grid_populate_bench (void)
+{
+  g_autoptr(EosProfileBenchOptions) options = eos_profile_bench_options_new ();
+  options->max_iterations = 20;
+
+  double one_by_one = eos_profile_bench_run ("/sdk/flexy-grid/populate/one-by-one",
+                                             bench_populate_one_by_one,
+                                             GINT_TO_POINTER (FALSE),
+                                             options);
+  double frozen = eos_profile_bench_run ("/sdk/flexy-grid/populate/frozen",
+                                         bench_populate_one_by_one,
+                                         GINT_TO_POINTER (TRUE),
+                                         options);
+  double many = eos_profile_bench_run ("/sdk/flexy-grid/populate/insert-many",
+                                       bench_populate_many,
+                                       NULL,
+                                       options);
+
+  g_test_message ("Populating %d sorted cells: %.1f ms one by one, %.1f ms frozen, "
+                  "%.1f ms with eos_flexy_grid_insert_many()",
+                  N_POPULATE_CELLS,
+                  one_by_one / 1000.0,
+                  frozen / 1000.0,
+                  many / 1000.0);
+}
+
 void
 add_flexy_grid_test (void)
 {
   ADD_FLEXY_GRID_TEST ("/flexy-grid/get-set-cell-size", flexy_grid_cell_size_access);
   ADD_FLEXY_GRID_TEST ("/flexy-grid/get-set-cell-spacing", flexy_grid_cell_spacing_access);
+  g_test_add_func ("/flexy-grid/layout-holes", flexy_grid_layout_holes);
+  ADD_FLEXY_GRID_TEST ("/flexy-grid/layout-cache", flexy_grid_layout_cache);
+  ADD_FLEXY_GRID_TEST ("/flexy-grid/hit-test", flexy_grid_hit_test);
+  g_test_add_func ("/flexy-grid/bind-model", flexy_grid_bind_model);
+  ADD_FLEXY_GRID_TEST ("/flexy-grid/insert-many", flexy_grid_insert_many);
+  ADD_FLEXY_GRID_TEST ("/flexy-grid/freeze-layout", flexy_grid_freeze_layout);
+  ADD_FLEXY_GRID_TEST ("/flexy-grid/freeze-allocate", flexy_grid_freeze_allocate);
+
+  /* Run with -m perf */
+  if (g_test_perf ())
+    {
+      ADD_FLEXY_GRID_TEST ("/flexy-grid/layout-bench", flexy_grid_layout_bench);
+      ADD_FLEXY_GRID_TEST ("/flexy-grid/append-bench", flexy_grid_append_bench);
+      g_test_add_func ("/flexy-grid/populate-bench", flexy_grid_populate_bench);
+    }
 }
 
 G_GNUC_END_IGNORE_DEPRECATIONS
@@ -1,10 +1,24 @@
 /* Copyright 2017 Endless Mobile, Inc. */
 
 #include <stdlib.h>
+#include <glib/gstdio.h>
 #include <endless/endless.h>
+#include "endless/eosattribution-private.h"
+#include "endless/gvdb/gvdb-reader.h"
 
 #include "run-tests.h"
 
+/* The probes in the hot paths of the SDK */
+static const char *sdk_probes[] = {
+  "/com/endlessm/Sdk/application/startup",
+  "/com/endlessm/Sdk/attribution/load",
+  "/com/endlessm/Sdk/flexy-grid/distribute-layout/measure",
+  "/com/endlessm/Sdk/flexy-grid/distribute-layout/allocate",
+  "/com/endlessm/Sdk/window/font-scale",
+  "/com/endlessm/Sdk/window/update-page-background",
+  "/com/endlessm/Sdk/window/override-background-css",
+};
+
 static void
 test_profile_stdout (void)
 {
@@ -23,8 +37,172 @@ test_profile_stdout (void)
     }
 }
 
+static void
+bench_append (gpointer data)
+{
+  guint *n_calls = data;
+
+  GArray *array = g_array_new (FALSE, FALSE, sizeof (int));
+
+  for (int j = 0; j < 1000; j++)
+    g_array_append_val (array, j);
+
+  g_array_unref (array);
+
+  *n_calls += 1;
+}
+
+static void
+test_profile_bench (void)
+{
+  g_autoptr(EosProfileBenchOptions) options = eos_profile_bench_options_new ();
+  guint n_calls = 0;
+
+  options->warmup_iterations = 5;
+  options->min_iterations = 10;
+  options->max_iterations = 100;
+
+  double median = eos_profile_bench_run ("/sdk/profile/bench", bench_append, &n_calls, options);
+
+  g_assert_cmpuint (n_calls, >=, 15);
+  g_assert_cmpuint (n_calls, <=, 105);
+  g_assert_cmpfloat (median, >=, 0.0);
+
+  /* Iterations stop at the minimum if the duration does not matter */
+  options->max_relative_error = G_MAXDOUBLE;
+  n_calls = 0;
+
+  eos_profile_bench_run ("/sdk/profile/bench", bench_append, &n_calls, options);
+
+  g_assert_cmpuint (n_calls, ==, 15);
+}
+
+static char *
+get_test_image_uri (const char *basename)
+{
+  const char *srcdir = g_getenv ("TOP_SRCDIR");
+  g_autofree char *path = g_build_filename (srcdir != NULL ? srcdir : ".",
+                                            "test", "smoke-tests", "images",
+                                            basename,
+                                            NULL);
+
+  return g_filename_to_uri (path, NULL, NULL);
+}
+
+static gboolean
+quit_probes_app (gpointer data)
+{
+  g_application_quit (data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+switch_probes_page (gpointer data)
+{
+  GtkWidget *win = data;
+  EosPageManager *pm = eos_window_get_page_manager (EOS_WINDOW (win));
+
+  gtk_stack_set_visible_child_name (GTK_STACK (pm), "page1");
+
+  g_timeout_add (500, quit_probes_app, gtk_window_get_application (GTK_WINDOW (win)));
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Goes through every code path with a probe */
+static void
+run_probes (GApplication *app)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GFileIOStream) stream = NULL;
+  g_autoptr(GFile) credits = g_file_new_tmp ("profile-probes-XXXXXX.json", &stream, &error);
+  g_assert_no_error (error);
+
+  g_file_replace_contents (credits, "[]", 2, NULL, FALSE, G_FILE_CREATE_NONE,
+                           NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  GtkWidget *attribution = eos_attribution_new_sync (credits, NULL, &error);
+  g_assert_no_error (error);
+  g_object_ref_sink (attribution);
+  gtk_widget_destroy (attribution);
+  g_object_unref (attribution);
+  g_file_delete (credits, NULL, NULL);
+
+  GtkWidget *win = eos_window_new (EOS_APPLICATION (app));
+  eos_window_set_font_scaling_active (EOS_WINDOW (win), TRUE);
+
+  GtkWidget *grid = eos_flexy_grid_new ();
+  for (int i = 0; i < 20; i++)
+    {
+      GtkWidget *cell = eos_flexy_grid_cell_new ();
+      eos_flexy_grid_cell_set_shape (EOS_FLEXY_GRID_CELL (cell), i % 4);
+      gtk_container_add (GTK_CONTAINER (cell), gtk_label_new ("Cell"));
+      gtk_container_add (GTK_CONTAINER (grid), cell);
+    }
+
+  GtkWidget *page1 = gtk_label_new ("Second page");
+
+  EosPageManager *pm = eos_window_get_page_manager (EOS_WINDOW (win));
+  gtk_stack_add_named (GTK_STACK (pm), grid, "page0");
+  gtk_stack_add_named (GTK_STACK (pm), page1, "page1");
+
+  g_autofree char *background0 = get_test_image_uri ("test1.jpg");
+  g_autofree char *background1 = get_test_image_uri ("test2.jpg");
+  eos_page_manager_set_page_background_uri (pm, grid, background0);
+  eos_page_manager_set_page_background_uri (pm, page1, background1);
+
+  gtk_widget_show_all (win);
+
+  g_timeout_add (500, switch_probes_page, win);
+}
+
+static void
+test_profile_probes (void)
+{
+  if (g_test_subprocess ())
+    {
+      g_autofree char *app_id = generate_unique_app_id ();
+      EosApplication *app = eos_application_new (app_id, G_APPLICATION_NON_UNIQUE);
+
+      g_signal_connect (app, "startup", G_CALLBACK (run_probes), NULL);
+      g_application_run (G_APPLICATION (app), 0, NULL);
+      g_object_unref (app);
+      return;
+    }
+
+  g_autofree char *tmpdir = g_dir_make_tmp ("profile-probes-XXXXXX", NULL);
+  g_autofree char *capture = g_build_filename (tmpdir, "capture.db", NULL);
+  g_autofree char *option = g_strconcat ("capture:", capture, NULL);
+
+  /* Profiling is set up when the library is loaded, so the probes have
+   * to run in a process that starts with EOS_PROFILE in its environment
+   */
+  g_setenv ("EOS_PROFILE", option, TRUE);
+  g_test_trap_subprocess (NULL, 0, 0);
+  g_unsetenv ("EOS_PROFILE");
+  g_test_trap_assert_passed ();
+
+  g_autoptr(GError) error = NULL;
+  GvdbTable *db = gvdb_table_new (capture, TRUE, &error);
+  g_assert_no_error (error);
+
+  for (int i = 0; i < G_N_ELEMENTS (sdk_probes); i++)
+    {
+      if (!gvdb_table_has_value (db, sdk_probes[i]))
+        g_error ("Probe '%s' is missing from the capture", sdk_probes[i]);
+    }
+
+  gvdb_table_free (db);
+  g_unlink (capture);
+  g_rmdir (tmpdir);
+}
+
 void
 add_profile_tests (void)
 {
   g_test_add_func ("/profile/stdout", test_profile_stdout);
+  g_test_add_func ("/profile/bench", test_profile_bench);
+  g_test_add_func ("/profile/probes", test_profile_probes);
 }
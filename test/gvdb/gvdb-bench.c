@@ -0,0 +1,288 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+/* Measures the cost of GVDB tables of growing sizes, written with the
+ * chained and the perfect hash layouts: the time to build and write the
+ * table, the size of the file, the time to open it, the throughput of
+ * lookups for keys that are in the table and for keys that are not, and
+ * the cost of listing all the names in the table.
+ *
+ * The keys are nested paths, like the ones of a capture, so each table
+ * also has the lists of children of every path.
+ *
+ * Usage:
+ *   test/gvdb/gvdb-bench [--min-items=N] [--max-items=N]
+ *   EOS_PROFILE=capture:/tmp/gvdb.db test/gvdb/gvdb-bench
+ *
+ * Tables of 10 million items need a few gigabytes of memory to build.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <endless/endless.h>
+#include "endless/eosprofile-private.h"
+
+#include "gvdb-builder.h"
+#include "gvdb-reader.h"
+
+#define DEFAULT_MIN_ITEMS       1000
+#define DEFAULT_MAX_ITEMS       10000000
+
+/* Lookups are measured on a sample of the keys, so that their cost does
+ * not depend on the size of the table
+ */
+#define N_LOOKUPS               10000
+
+#define KEY_FORMAT              "/com/endlessm/Sdk/%u/%u/probe-%u"
+#define MISSING_KEY_FORMAT      "/com/endlessm/Sdk/%u/%u/missing-%u"
+
+typedef struct {
+  GvdbTable *table;
+  GPtrArray *keys;
+  guint found;
+} Lookups;
+
+static char *
+make_key (const char *format,
+          guint       i)
+{
+  return g_strdup_printf (format, i / 10000, (i / 100) % 100, i);
+}
+
+static GHashTable *
+build_table (guint n_items)
+{
+  GHashTable *db_table = gvdb_hash_table_new (NULL, NULL);
+
+  /* All the items share the same value, to save memory */
+  g_autoptr(GVariant) value = g_variant_ref_sink (g_variant_new_uint32 (42));
+
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autofree char *key = make_key (KEY_FORMAT, i);
+
+      gvdb_item_set_value (eos_profile_db_insert (db_table, key), value);
+    }
+
+  return db_table;
+}
+
+static GPtrArray *
+sample_keys (const char *format,
+             guint       n_items)
+{
+  guint n_keys = MIN (n_items, N_LOOKUPS);
+  GPtrArray *keys = g_ptr_array_new_full (n_keys, g_free);
+
+  for (guint i = 0; i < n_keys; i++)
+    g_ptr_array_add (keys, make_key (format, (guint) ((guint64) i * n_items / n_keys)));
+
+  return keys;
+}
+
+static void
+bench_open (gpointer data)
+{
+  const char *filename = data;
+
+  GvdbTable *table = gvdb_table_new (filename, TRUE, NULL);
+
+  gvdb_table_free (table);
+}
+
+static void
+bench_lookups (gpointer data)
+{
+  Lookups *lookups = data;
+
+  for (guint i = 0; i < lookups->keys->len; i++)
+    {
+      const char *key = g_ptr_array_index (lookups->keys, i);
+
+      if (gvdb_table_has_value (lookups->table, key))
+        lookups->found += 1;
+    }
+}
+
+static void
+bench_names (gpointer data)
+{
+  GvdbTable *table = data;
+
+  g_strfreev (gvdb_table_get_names (table, NULL));
+}
+
+static EosProfileBenchOptions *
+bench_options_new (guint max_iterations)
+{
+  EosProfileBenchOptions *options = eos_profile_bench_options_new ();
+
+  options->warmup_iterations = MIN (options->warmup_iterations, max_iterations);
+  options->min_iterations = MIN (10, max_iterations);
+  options->max_iterations = max_iterations;
+
+  return options;
+}
+
+static void
+run_lookups (const char *name,
+             const char *kind,
+             GvdbTable  *table,
+             GPtrArray  *keys,
+             guint       expected)
+{
+  Lookups lookups = { table, keys, 0 };
+
+  /* Check the results once, outside of the measurements */
+  bench_lookups (&lookups);
+  if (lookups.found != expected)
+    {
+      g_printerr ("%s %s: found %u keys instead of %u\n",
+                  name, kind, lookups.found, expected);
+      exit (EXIT_FAILURE);
+    }
+
+  g_autoptr(EosProfileBenchOptions) options = bench_options_new (1000);
+
+  g_autofree char *probe_name = g_strdup_printf ("%s/%s", name, kind);
+  double median = eos_profile_bench_run (probe_name, bench_lookups, &lookups, options);
+
+  g_print ("  %-8s %10.1f ns per lookup\n", kind, median * 1000.0 / keys->len);
+}
+
+static void
+bench_layout (const char     *layout,
+              GvdbWriteFlags  flags,
+              guint           n_items)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *name = g_strdup_printf ("/gvdb/bench/%u/%s", n_items, layout);
+
+  gint64 start_time = g_get_monotonic_time ();
+  g_autoptr(GHashTable) db_table = build_table (n_items);
+  gint64 built_time = g_get_monotonic_time ();
+
+  g_autofree char *filename = NULL;
+  int fd = g_file_open_tmp ("gvdb-bench-XXXXXX.db", &filename, &error);
+  if (fd < 0)
+    {
+      g_printerr ("Unable to create a temporary file: %s\n", error->message);
+      exit (EXIT_FAILURE);
+    }
+
+  close (fd);
+
+  gint64 write_time = g_get_monotonic_time ();
+  if (!gvdb_table_write_contents_with_flags (db_table, filename, FALSE, flags, &error))
+    {
+      g_printerr ("Unable to write the %s table: %s\n", layout, error->message);
+      exit (EXIT_FAILURE);
+    }
+  gint64 written_time = g_get_monotonic_time ();
+
+  /* The children of each path are items too */
+  guint n_table_items = g_hash_table_size (db_table);
+  g_clear_pointer (&db_table, g_hash_table_unref);
+
+  GStatBuf buf;
+  if (g_stat (filename, &buf) < 0)
+    {
+      g_printerr ("Unable to stat '%s': %s\n", filename, g_strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+
+  g_print ("%s layout, %u items: %" G_GOFFSET_FORMAT " bytes, %.1f bytes per item\n",
+           layout,
+           n_items,
+           (goffset) buf.st_size,
+           (double) buf.st_size / n_table_items);
+  g_print ("  %-8s %10.1f ms\n", "build", (built_time - start_time) / 1000.0);
+  g_print ("  %-8s %10.1f ms\n", "write", (written_time - write_time) / 1000.0);
+
+  GvdbTable *table = gvdb_table_new (filename, TRUE, &error);
+  if (table == NULL)
+    {
+      g_printerr ("Unable to read the %s table: %s\n", layout, error->message);
+      exit (EXIT_FAILURE);
+    }
+
+  g_autoptr(EosProfileBenchOptions) open_options = bench_options_new (1000);
+  g_autofree char *open_name = g_strconcat (name, "/open", NULL);
+  double open_median = eos_profile_bench_run (open_name, bench_open, filename, open_options);
+
+  g_print ("  %-8s %10.1f µs\n", "open", open_median);
+
+  g_autoptr(GPtrArray) hits = sample_keys (KEY_FORMAT, n_items);
+  g_autoptr(GPtrArray) misses = sample_keys (MISSING_KEY_FORMAT, n_items);
+
+  run_lookups (name, "hits", table, hits, hits->len);
+  run_lookups (name, "misses", table, misses, 0);
+
+  /* Listing all the names of a large table takes seconds */
+  g_autoptr(EosProfileBenchOptions) names_options = bench_options_new (n_items >= 1000000 ? 3 : 100);
+  g_autofree char *names_name = g_strconcat (name, "/names", NULL);
+  double names_median = eos_profile_bench_run (names_name, bench_names, table, names_options);
+
+  g_print ("  %-8s %10.1f ms, %.1f ns per item\n",
+           "names",
+           names_median / 1000.0,
+           names_median * 1000.0 / n_table_items);
+
+  gvdb_table_free (table);
+  g_unlink (filename);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  int min_items = DEFAULT_MIN_ITEMS;
+  int max_items = DEFAULT_MAX_ITEMS;
+
+  const GOptionEntry entries[] = {
+    {
+      .long_name = "min-items",
+      .short_name = 'm',
+      .arg = G_OPTION_ARG_INT,
+      .arg_data = &min_items,
+      .description = "Number of items in the smallest table",
+      .arg_description = "N",
+    },
+    {
+      .long_name = "max-items",
+      .short_name = 'M',
+      .arg = G_OPTION_ARG_INT,
+      .arg_data = &max_items,
+      .description = "Number of items in the largest table; each table is ten times larger than the previous one",
+      .arg_description = "N",
+    },
+
+    { NULL },
+  };
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  g_autoptr(GError) error = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (min_items <= 0 || max_items < min_items)
+    {
+      g_printerr ("Invalid number of items: %d to %d\n", min_items, max_items);
+      return EXIT_FAILURE;
+    }
+
+  for (guint64 n_items = min_items; n_items <= (guint64) max_items; n_items *= 10)
+    {
+      bench_layout ("chained", GVDB_WRITE_FLAGS_NONE, n_items);
+      bench_layout ("perfect", GVDB_WRITE_FLAGS_PERFECT_HASH, n_items);
+    }
+
+  return EXIT_SUCCESS;
+}
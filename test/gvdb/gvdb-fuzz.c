@@ -0,0 +1,463 @@
+/* Copyright 2017 Endless Mobile, Inc. */
+
+/* Feeds mutated GVDB files to the reader, without trusting them, and
+ * calls every function of the reader on the tables that it accepts; the
+ * reader must neither crash nor hang.
+ *
+ * The mutations depend on the random seed of the test, so a failure can
+ * be reproduced with its --seed argument; -m slow runs more mutations.
+ *
+ * Usage:
+ *   test/gvdb/gvdb-fuzz [-m slow] [--seed=SEED]
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "endless/eosprofile-private.h"
+
+#include "gvdb-builder.h"
+#include "gvdb-reader.h"
+
+#define N_PROBES                64
+#define N_MUTATIONS             2000
+#define N_SLOW_MUTATIONS        100000
+
+/* Tables inside of tables are only exercised this deep */
+#define MAX_TABLE_DEPTH         2
+
+static void
+db_insert (GHashTable *db_table,
+           const char *key,
+           GVariant   *value)
+{
+  gvdb_item_set_value (eos_profile_db_insert (db_table, key), value);
+}
+
+/* A table like a capture: nested probes with their samples, a few
+ * counters, and a table inside of the table
+ */
+static GHashTable *
+build_table (const char *prefix)
+{
+  GHashTable *db_table = gvdb_hash_table_new (NULL, NULL);
+
+  for (guint i = 0; i < N_PROBES; i++)
+    {
+      g_autofree char *key = g_strdup_printf ("%s/%u/probe-%u", prefix, i / 8, i);
+
+      GVariantBuilder samples;
+      g_variant_builder_init (&samples, G_VARIANT_TYPE ("a(xx)"));
+
+      for (guint j = 0; j < i % 5; j++)
+        g_variant_builder_add (&samples, "(xx)", (gint64) j, (gint64) j * 2);
+
+      db_insert (db_table, key,
+                 g_variant_new ("(sssuua(xx))",
+                                "gvdb-fuzz.c", "build_table", key,
+                                i, i % 5, &samples));
+    }
+
+  g_autofree char *counter_key = g_strconcat (prefix, "/counters/allocations", NULL);
+  db_insert (db_table, counter_key, g_variant_new_uint32 (N_PROBES));
+
+  g_autofree char *version_key = g_strconcat (prefix, "/version", NULL);
+  db_insert (db_table, version_key, g_variant_new_string ("2"));
+
+  g_autofree char *modules_key = g_strconcat (prefix, "/samples/modules", NULL);
+  db_insert (db_table, modules_key, g_variant_new_strv (NULL, 0));
+
+  GHashTable *nested = gvdb_hash_table_new (db_table, "/nested");
+  gvdb_hash_table_insert_string (nested, "/nested/key", "value");
+  g_hash_table_unref (nested);
+
+  return db_table;
+}
+
+static GBytes *
+write_table (GvdbWriteFlags flags)
+{
+  g_autoptr(GHashTable) db_table = build_table ("/com/endlessm/Sdk");
+
+  return gvdb_table_write_bytes_with_flags (db_table, FALSE, flags);
+}
+
+/* A base table followed by an appended segment, like a live capture */
+static GBytes *
+write_segments (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *filename = NULL;
+
+  int fd = g_file_open_tmp ("gvdb-fuzz-XXXXXX.db", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  g_autoptr(GHashTable) base = build_table ("/com/endlessm/Sdk");
+  gvdb_table_write_contents_with_flags (base, filename, FALSE,
+                                        GVDB_WRITE_FLAGS_PERFECT_HASH,
+                                        &error);
+  g_assert_no_error (error);
+
+  g_autoptr(GHashTable) delta = build_table ("/com/endlessm/Delta");
+  if (!gvdb_table_append_contents (delta, filename, FALSE,
+                                   GVDB_WRITE_FLAGS_NONE,
+                                   &error))
+    {
+      g_unlink (filename);
+      g_test_skip (error->message);
+      return NULL;
+    }
+
+  char *contents;
+  gsize length;
+  g_file_get_contents (filename, &contents, &length, &error);
+  g_assert_no_error (error);
+  g_unlink (filename);
+
+  return g_bytes_new_take (contents, length);
+}
+
+static GvdbWalkResult
+count_walked (GvdbTableIter *iter,
+              const char    *path,
+              gpointer       user_data)
+{
+  guint *n_walked = user_data;
+
+  g_assert_nonnull (path);
+
+  *n_walked += 1;
+
+  return GVDB_WALK_CONTINUE;
+}
+
+static void
+exercise_table (GvdbTable *table,
+                guint      depth)
+{
+  gvdb_table_is_valid (table);
+
+  gint n_names;
+  g_auto(GStrv) names = gvdb_table_get_names (table, &n_names);
+  g_assert_cmpint (n_names, ==, g_strv_length (names));
+
+  for (gint i = 0; i < n_names; i++)
+    {
+      const char *name = names[i];
+
+      gvdb_table_has_value (table, name);
+
+      GVariant *value = gvdb_table_get_value (table, name);
+      g_clear_pointer (&value, g_variant_unref);
+
+      value = gvdb_table_get_raw_value (table, name);
+      g_clear_pointer (&value, g_variant_unref);
+
+      g_ptr_array_unref (gvdb_table_get_raw_values (table, name));
+
+      g_strfreev (gvdb_table_list (table, name));
+
+      GvdbTable *child = gvdb_table_get_table (table, name);
+      if (child != NULL)
+        {
+          if (depth < MAX_TABLE_DEPTH)
+            exercise_table (child, depth + 1);
+
+          gvdb_table_free (child);
+        }
+    }
+
+  GvdbTableIter iter;
+  gvdb_table_iter_init (&iter, table);
+
+  while (gvdb_table_iter_next (&iter))
+    {
+      gsize length;
+
+      gvdb_table_iter_get_index (&iter);
+      gvdb_table_iter_get_key (&iter, &length);
+      gvdb_table_iter_get_parent (&iter);
+      gvdb_table_iter_get_item_type (&iter);
+      gvdb_table_iter_get_value_data (&iter, &length);
+
+      GVariant *value = gvdb_table_iter_get_raw_value (&iter);
+      g_clear_pointer (&value, g_variant_unref);
+    }
+
+  guint n_walked = 0;
+  gvdb_table_walk (table, "/", count_walked, &n_walked);
+
+  /* Segments hold complete tables, which may have segments themselves */
+  guint n_segments = gvdb_table_get_n_segments (table);
+
+  for (guint i = 0; i < n_segments && depth < MAX_TABLE_DEPTH; i++)
+    {
+      GvdbTable *segment = gvdb_table_get_segment (table, i);
+
+      if (segment != NULL)
+        {
+          exercise_table (segment, depth + 1);
+          gvdb_table_free (segment);
+        }
+    }
+}
+
+static void
+mutate (guint8 *data,
+        gsize  *size)
+{
+  guint n_words = *size / 4;
+
+  if (*size == 0)
+    return;
+
+  switch (g_test_rand_int_range (0, 4))
+    {
+    case 0:
+      /* Flip a few bits */
+      for (gint n = g_test_rand_int_range (1, 9); n > 0; n--)
+        {
+          guint bit = g_test_rand_int_range (0, *size * 8);
+
+          data[bit / 8] ^= 1 << (bit % 8);
+        }
+      break;
+
+    case 1:
+      /* Replace a word, like an offset or a length, by an edge case */
+      if (n_words > 0)
+        {
+          static const guint32 values[] = { 0, 1, 7, 8, 0x7fffffff, 0x80000000, 0xffffffff };
+          guint32 value;
+
+          if (g_test_rand_bit ())
+            value = values[g_test_rand_int_range (0, G_N_ELEMENTS (values))];
+          else
+            value = g_test_rand_int_range (0, *size + 16);
+
+          value = GUINT32_TO_LE (value);
+          memcpy (data + g_test_rand_int_range (0, n_words) * 4, &value, 4);
+        }
+      break;
+
+    case 2:
+      /* Copy a word elsewhere, which makes pointers reference other items */
+      if (n_words > 1)
+        {
+          guint from = g_test_rand_int_range (0, n_words);
+          guint to = g_test_rand_int_range (0, n_words);
+
+          memmove (data + to * 4, data + from * 4, 4);
+        }
+      break;
+
+    case 3:
+      /* Truncate the file, like an interrupted write */
+      *size = g_test_rand_int_range (0, *size + 1);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+fuzz_bytes (GBytes *bytes)
+{
+  g_autoptr(GError) error = NULL;
+
+  /* The unmutated file must be read completely */
+  GvdbTable *table = gvdb_table_new_from_bytes (bytes, FALSE, &error);
+  g_assert_no_error (error);
+  g_assert_true (gvdb_table_has_value (table, "/com/endlessm/Sdk/version"));
+  exercise_table (table, 0);
+  gvdb_table_free (table);
+
+  gsize original_size;
+  const guint8 *original = g_bytes_get_data (bytes, &original_size);
+  guint n_mutations = g_test_slow () ? N_SLOW_MUTATIONS : N_MUTATIONS;
+
+  for (guint i = 0; i < n_mutations; i++)
+    {
+      gsize size = original_size;
+      guint8 *data = g_memdup (original, original_size);
+
+      for (gint n = g_test_rand_int_range (1, 4); n > 0; n--)
+        mutate (data, &size);
+
+      /* The copy keeps the data aligned, as the reader expects */
+      g_autoptr(GBytes) mutated = g_bytes_new_take (data, size);
+
+      table = gvdb_table_new_from_bytes (mutated, FALSE, NULL);
+      if (table == NULL)
+        continue;
+
+      exercise_table (table, 0);
+      gvdb_table_free (table);
+    }
+}
+
+static void
+test_fuzz_chained (void)
+{
+  g_autoptr(GBytes) bytes = write_table (GVDB_WRITE_FLAGS_NONE);
+
+  fuzz_bytes (bytes);
+}
+
+static void
+test_fuzz_perfect (void)
+{
+  g_autoptr(GBytes) bytes = write_table (GVDB_WRITE_FLAGS_PERFECT_HASH);
+
+  fuzz_bytes (bytes);
+}
+
+static void
+test_fuzz_segments (void)
+{
+  g_autoptr(GBytes) bytes = write_segments ();
+
+  if (bytes == NULL)
+    return;
+
+  fuzz_bytes (bytes);
+}
+
+/* Lookups go through every segment, without scanning the file */
+static void
+test_fuzz_segment_lookups (void)
+{
+  g_autoptr(GBytes) bytes = write_segments ();
+
+  if (bytes == NULL)
+    return;
+
+  GvdbTable *table = gvdb_table_new_from_bytes (bytes, TRUE, NULL);
+  g_assert_nonnull (table);
+  g_assert_cmpuint (gvdb_table_get_n_segments (table), ==, 2);
+
+  g_assert_true (gvdb_table_has_value (table, "/com/endlessm/Sdk/version"));
+  g_assert_true (gvdb_table_has_value (table, "/com/endlessm/Delta/version"));
+
+  g_autoptr(GVariant) value = gvdb_table_get_value (table, "/com/endlessm/Delta/0/probe-1");
+  g_assert_nonnull (value);
+
+  g_autoptr(GPtrArray) values = gvdb_table_get_raw_values (table, "/com/endlessm/Sdk/0/probe-1");
+  g_assert_cmpuint (values->len, ==, 1);
+
+  g_auto(GStrv) names = gvdb_table_list (table, "/com/endlessm/");
+  g_assert_nonnull (names);
+  g_assert_cmpuint (g_strv_length (names), ==, 2);
+
+  gvdb_table_free (table);
+
+  /* Anything after the last footer hides the segments */
+  gsize size;
+  const char *data = g_bytes_get_data (bytes, &size);
+  char *padded = g_malloc0 (size + 8);
+  memcpy (padded, data, size);
+
+  g_autoptr(GBytes) padded_bytes = g_bytes_new_take (padded, size + 8);
+
+  table = gvdb_table_new_from_bytes (padded_bytes, TRUE, NULL);
+  g_assert_nonnull (table);
+  g_assert_cmpuint (gvdb_table_get_n_segments (table), ==, 1);
+  g_assert_false (gvdb_table_has_value (table, "/com/endlessm/Delta/version"));
+
+  gvdb_table_free (table);
+}
+
+static GvdbWalkResult
+find_list (GvdbTableIter *iter,
+           const char    *path,
+           gpointer       user_data)
+{
+  GvdbTableIter *found = user_data;
+
+  if (g_strcmp0 (path, "/com/endlessm/Sdk/0/") != 0)
+    return GVDB_WALK_CONTINUE;
+
+  *found = *iter;
+
+  return GVDB_WALK_STOP;
+}
+
+/* Empty values must be readable back, in both byte orders */
+static void
+test_fuzz_empty_value (void)
+{
+  for (int byteswap = 0; byteswap < 2; byteswap++)
+    {
+      g_autoptr(GHashTable) db_table = build_table ("/com/endlessm/Sdk");
+      g_autoptr(GBytes) bytes =
+        gvdb_table_write_bytes_with_flags (db_table, byteswap, GVDB_WRITE_FLAGS_NONE);
+
+      GvdbTable *table = gvdb_table_new_from_bytes (bytes, TRUE, NULL);
+      g_assert_nonnull (table);
+
+      g_autoptr(GVariant) value = gvdb_table_get_value (table, "/com/endlessm/Sdk/samples/modules");
+      g_assert_nonnull (value);
+      g_assert_true (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY));
+      g_assert_cmpuint (g_variant_n_children (value), ==, 0);
+
+      gvdb_table_free (table);
+    }
+}
+
+/* A list containing itself many times used to make walks exponential */
+static void
+test_fuzz_list_loop (void)
+{
+  g_autoptr(GBytes) bytes = write_table (GVDB_WRITE_FLAGS_NONE);
+
+  GvdbTable *table = gvdb_table_new_from_bytes (bytes, FALSE, NULL);
+  g_assert_nonnull (table);
+
+  GvdbTableIter list = { NULL, };
+  gvdb_table_walk (table, "/", find_list, &list);
+  g_assert_nonnull (list.table);
+
+  gsize list_size;
+  const guint8 *list_data = gvdb_table_iter_get_value_data (&list, &list_size);
+  g_assert_nonnull (list_data);
+  g_assert_cmpuint (list_size, ==, 8 * sizeof (guint32));
+
+  gsize size;
+  const guint8 *data = g_bytes_get_data (bytes, &size);
+  gsize offset = list_data - data;
+  guint32 self = GUINT32_TO_LE (gvdb_table_iter_get_index (&list));
+
+  gvdb_table_free (table);
+
+  guint8 *looped = g_memdup (data, size);
+  for (gsize i = 0; i < list_size; i += sizeof (guint32))
+    memcpy (looped + offset + i, &self, sizeof (guint32));
+
+  g_autoptr(GBytes) looped_bytes = g_bytes_new_take (looped, size);
+
+  table = gvdb_table_new_from_bytes (looped_bytes, FALSE, NULL);
+  g_assert_nonnull (table);
+
+  exercise_table (table, 0);
+
+  gvdb_table_free (table);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/gvdb/fuzz/chained", test_fuzz_chained);
+  g_test_add_func ("/gvdb/fuzz/perfect", test_fuzz_perfect);
+  g_test_add_func ("/gvdb/fuzz/segments", test_fuzz_segments);
+  g_test_add_func ("/gvdb/fuzz/segment-lookups", test_fuzz_segment_lookups);
+  g_test_add_func ("/gvdb/fuzz/list-loop", test_fuzz_list_loop);
+  g_test_add_func ("/gvdb/fuzz/empty-value", test_fuzz_empty_value);
+
+  return g_test_run ();
+}
@@ -0,0 +1,77 @@
+// Copyright 2017 Endless Mobile, Inc.
+
+// Measures the cost of starting and stopping a profiling probe from JS, using
+// the location parsed from a stack trace on every call, as the override of
+// Endless.ProfileProbe.start() used to do, the cached location of the current
+// override, and a handle returned by Endless.ProfileProbe.register().
+//
+// Usage:
+//   gjs test/smoke-tests/profile-overhead.js [ITERATIONS]
+//   EOS_PROFILE=capture:/tmp/overhead.db gjs test/smoke-tests/profile-overhead.js
+//
+// Without EOS_PROFILE the probes are inert, so this measures the cost of the
+// JS side alone.
+
+const Endless = imports.gi.Endless;
+const GLib = imports.gi.GLib;
+const System = imports.system;
+
+const DEFAULT_ITERATIONS = 100000;
+
+// The previous implementation of Endless.ProfileProbe.start()
+function startWithStackTrace(name) {
+    let exc = new Error();
+    let splits = exc.stack.split('\n')[1].split(':');
+    let [line] = splits.slice(-2);
+    let loc = splits.slice(0, -2).join(':');
+    let [func, file] = loc.split('@');
+    if (func === '') {
+        func = '<main>';
+    }
+    return Endless.ProfileProbe._start_real(file, line, func, name);
+}
+
+function measure(label, iterations, func) {
+    // Warm up the JIT
+    for (let i = 0; i < iterations / 10; i++)
+        func();
+
+    let start = GLib.get_monotonic_time();
+    for (let i = 0; i < iterations; i++)
+        func();
+    let elapsed = GLib.get_monotonic_time() - start;
+
+    let perCall = elapsed * 1000 / iterations;
+    print(label + ': ' + perCall.toFixed(0) + ' ns per start/stop');
+    return perCall;
+}
+
+function main(argv) {
+    let iterations = argv.length > 0 ? parseInt(argv[0], 10) : DEFAULT_ITERATIONS;
+    if (isNaN(iterations) || iterations <= 0) {
+        printerr('Invalid number of iterations: ' + argv[0]);
+        return 1;
+    }
+
+    let before = measure('stack trace', iterations, () => {
+        let probe = startWithStackTrace('/com/endlessm/Sdk/test/stack-trace');
+        probe.stop();
+    });
+
+    let cached = measure('start()', iterations, () => {
+        let probe = Endless.ProfileProbe.start('/com/endlessm/Sdk/test/start');
+        probe.stop();
+    });
+
+    let handle = Endless.ProfileProbe.register('/com/endlessm/Sdk/test/handle');
+    let registered = measure('register()', iterations, () => {
+        handle.start();
+        handle.stop();
+    });
+
+    print('start() is ' + (before / cached).toFixed(1) + 'x faster, ' +
+        'register() is ' + (before / registered).toFixed(1) + 'x faster');
+    return 0;
+}
+
+System.exit(main(ARGV));
@@ -0,0 +1,327 @@
+#include "config.h"
+
+#include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
+#include "eos-profile-utils.h"
+
+#include "endless/eosprofile-private.h"
+#include "endless/gvdb/gvdb-reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_TOP_TYPES       20
+
+static double opt_from = 0.0;
+static double opt_to = -1.0;
+static int opt_top = DEFAULT_TOP_TYPES;
+static char *opt_input;
+
+static GOptionEntry opts[] = {
+  {
+    .long_name = "from",
+    .short_name = 'f',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_DOUBLE,
+    .arg_data = &opt_from,
+    .description = "The first point in time, in seconds since the first census (default: 0)",
+    .arg_description = "SECONDS",
+  },
+  {
+    .long_name = "to",
+    .short_name = 'T',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_DOUBLE,
+    .arg_data = &opt_to,
+    .description = "The second point in time, in seconds since the first census (default: the last census)",
+    .arg_description = "SECONDS",
+  },
+  {
+    .long_name = "top",
+    .short_name = 't',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_top,
+    .description = "The number of types to show (default: 20)",
+    .arg_description = "N",
+  },
+
+  { NULL, },
+};
+
+gboolean
+eos_profile_cmd_census_parse_args (int    argc,
+                                   char **argv)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_top <= 0)
+    {
+      eos_profile_util_print_error ("Invalid number of types");
+      return FALSE;
+    }
+
+  if (opt_from < 0.0 || (opt_to >= 0.0 && opt_to < opt_from))
+    {
+      eos_profile_util_print_error ("Invalid time range");
+      return FALSE;
+    }
+
+  if (argc < 2)
+    return FALSE;
+
+  opt_input = argv[1];
+
+  return TRUE;
+}
+
+typedef struct {
+  char *name;
+
+  /* a(xx), or NULL if the type was not recorded */
+  GVariant *live;
+  GVariant *constructed;
+
+  gint64 live_delta;
+  gint64 live_after;
+  gint64 constructed_delta;
+} CensusType;
+
+static void
+census_type_free (gpointer data)
+{
+  CensusType *type = data;
+
+  g_free (type->name);
+  g_clear_pointer (&type->live, g_variant_unref);
+  g_clear_pointer (&type->constructed, g_variant_unref);
+  g_free (type);
+}
+
+typedef struct {
+  /* element-type (key utf8) (value CensusType) */
+  GHashTable *types;
+
+  gint64 first_time;
+  gint64 last_time;
+} CensusData;
+
+static CensusType *
+census_data_get_type (CensusData *data,
+                      const char *name)
+{
+  CensusType *type = g_hash_table_lookup (data->types, name);
+
+  if (type == NULL)
+    {
+      type = g_new0 (CensusType, 1);
+      type->name = g_strdup (name);
+      g_hash_table_insert (data->types, type->name, type);
+    }
+
+  return type;
+}
+
+static gboolean
+collect_census_counters (const char *counter_name,
+                         GVariant   *samples,
+                         gpointer    user_data)
+{
+  CensusData *data = user_data;
+  CensusType *type;
+
+  if (g_str_has_prefix (counter_name, PROBE_DB_CENSUS_LIVE_KEY "/"))
+    {
+      type = census_data_get_type (data, counter_name + strlen (PROBE_DB_CENSUS_LIVE_KEY "/"));
+      g_clear_pointer (&type->live, g_variant_unref);
+      type->live = g_variant_ref (samples);
+    }
+  else if (g_str_has_prefix (counter_name, PROBE_DB_CENSUS_CONSTRUCTED_KEY "/"))
+    {
+      type = census_data_get_type (data, counter_name + strlen (PROBE_DB_CENSUS_CONSTRUCTED_KEY "/"));
+      g_clear_pointer (&type->constructed, g_variant_unref);
+      type->constructed = g_variant_ref (samples);
+    }
+  else
+    return TRUE;
+
+  GVariantIter iter;
+  gint64 time, value;
+  g_variant_iter_init (&iter, samples);
+  while (g_variant_iter_next (&iter, "(xx)", &time, &value))
+    {
+      data->first_time = MIN (data->first_time, time);
+      data->last_time = MAX (data->last_time, time);
+    }
+
+  return TRUE;
+}
+
+/* Returns the last value recorded at or before @time; types are only
+ * recorded once they have a non-zero count, so anything before the first
+ * value is 0
+ */
+static gint64
+get_value_at (GVariant *samples,
+              gint64    time)
+{
+  if (samples == NULL)
+    return 0;
+
+  gint64 best_time = G_MININT64;
+  gint64 best_value = 0;
+
+  GVariantIter iter;
+  gint64 sample_time, sample_value;
+  g_variant_iter_init (&iter, samples);
+  while (g_variant_iter_next (&iter, "(xx)", &sample_time, &sample_value))
+    {
+      if (sample_time <= time && sample_time >= best_time)
+        {
+          best_time = sample_time;
+          best_value = sample_value;
+        }
+    }
+
+  return best_value;
+}
+
+static int
+census_type_compare (gconstpointer a,
+                     gconstpointer b)
+{
+  const CensusType *type_a = *(const CensusType **) a;
+  const CensusType *type_b = *(const CensusType **) b;
+
+  if (type_a->live_delta != type_b->live_delta)
+    return type_a->live_delta > type_b->live_delta ? -1 : 1;
+
+  if (type_a->constructed_delta != type_b->constructed_delta)
+    return type_a->constructed_delta > type_b->constructed_delta ? -1 : 1;
+
+  return g_strcmp0 (type_a->name, type_b->name);
+}
+
+int
+eos_profile_cmd_census_main (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_assert (opt_input != NULL);
+
+  GvdbTable *db = eos_profile_session_open_capture (opt_input, &error);
+  if (error != NULL)
+    {
+      eos_profile_util_print_error ("Unable to load '%s': %s\n", opt_input, error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (!eos_profile_session_check_version (db, opt_input, &error))
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      gvdb_table_free (db);
+      return EXIT_FAILURE;
+    }
+
+  CensusData data = {
+    .types = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, census_type_free),
+    .first_time = G_MAXINT64,
+    .last_time = G_MININT64,
+  };
+
+  eos_profile_util_foreach_counter_v1 (db, collect_census_counters, &data);
+
+  gvdb_table_free (db);
+
+  if (g_hash_table_size (data.types) == 0)
+    {
+      eos_profile_util_print_warning ("No census found in '%s'; use EOS_PROFILE=census",
+                                      opt_input);
+      g_hash_table_unref (data.types);
+      return EXIT_FAILURE;
+    }
+
+  gint64 from = data.first_time + (gint64) (opt_from * G_USEC_PER_SEC);
+  gint64 to = opt_to >= 0.0
+    ? data.first_time + (gint64) (opt_to * G_USEC_PER_SEC)
+    : data.last_time;
+
+  to = MIN (to, data.last_time);
+
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "Census from '%s', between %.1f s and %.1f s",
+                                  opt_input,
+                                  (from - data.first_time) / (double) G_USEC_PER_SEC,
+                                  (to - data.first_time) / (double) G_USEC_PER_SEC);
+
+  g_autoptr(GPtrArray) growing = g_ptr_array_new ();
+  gboolean has_live = FALSE;
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init (&iter, data.types);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      CensusType *type = value;
+
+      if (type->live != NULL)
+        has_live = TRUE;
+
+      gint64 live_before = get_value_at (type->live, from);
+      type->live_after = get_value_at (type->live, to);
+      type->live_delta = type->live_after - live_before;
+      type->constructed_delta =
+        get_value_at (type->constructed, to) - get_value_at (type->constructed, from);
+
+      if (type->live_delta > 0 || (type->live == NULL && type->constructed_delta > 0))
+        g_ptr_array_add (growing, type);
+    }
+
+  if (!has_live)
+    eos_profile_util_print_warning ("No live instance counts found; "
+                                    "use GOBJECT_DEBUG=instance-count");
+
+  g_ptr_array_sort (growing, census_type_compare);
+
+  if (growing->len == 0)
+    eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                    "No type grew in this interval");
+
+  for (int i = 0; i < growing->len && i < opt_top; i++)
+    {
+      const CensusType *type = g_ptr_array_index (growing, i);
+
+      eos_profile_util_print_message ("TYPE", EOS_PRINT_COLOR_GREEN, "%s", type->name);
+
+      if (type->live != NULL)
+        eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                        "  ┕━ • live: %+" G_GINT64_FORMAT " (%" G_GINT64_FORMAT " instances)",
+                                        type->live_delta,
+                                        type->live_after);
+
+      if (type->constructed != NULL)
+        eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                        "  ┕━ • constructed: %+" G_GINT64_FORMAT,
+                                        type->constructed_delta);
+    }
+
+  if (growing->len > opt_top)
+    eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                    "… and %u more types",
+                                    growing->len - opt_top);
+
+  g_hash_table_unref (data.types);
+
+  return EXIT_SUCCESS;
+}
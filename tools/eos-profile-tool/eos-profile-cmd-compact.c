@@ -0,0 +1,112 @@
+#include "config.h"
+
+#include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
+#include "eos-profile-utils.h"
+
+#include "endless/gvdb/gvdb-builder.h"
+#include "endless/gvdb/gvdb-reader.h"
+
+#include <stdlib.h>
+
+static char *opt_output;
+static char **opt_files;
+
+static GOptionEntry opts[] = {
+  {
+    .long_name = "output",
+    .short_name = 'o',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_output,
+    .description = "The compacted capture file, instead of replacing FILE",
+    .arg_description = "FILE",
+  },
+  {
+    .long_name = G_OPTION_REMAINING,
+    .short_name = 0,
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME_ARRAY,
+    .arg_data = &opt_files,
+    .description = "The capture file to compact",
+    .arg_description = "FILE",
+  },
+
+  { NULL, },
+};
+
+gboolean
+eos_profile_cmd_compact_parse_args (int    argc,
+                                    char **argv)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_files == NULL || g_strv_length (opt_files) != 1)
+    return FALSE;
+
+  return TRUE;
+}
+
+int
+eos_profile_cmd_compact_main (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  const char *input = opt_files[0];
+  const char *output = opt_output != NULL ? opt_output : input;
+
+  GvdbTable *db = gvdb_table_new (input, TRUE, &error);
+  if (db == NULL)
+    {
+      eos_profile_util_print_error ("Unable to load '%s': %s\n", input, error->message);
+      return EXIT_FAILURE;
+    }
+
+  guint n_segments = gvdb_table_get_n_segments (db);
+  gvdb_table_free (db);
+
+  if (n_segments == 1 && output == input)
+    {
+      eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                      "'%s' is already compact",
+                                      input);
+      return EXIT_SUCCESS;
+    }
+
+  char *files[] = { (char *) input, NULL };
+
+  g_autoptr(GHashTable) db_table = eos_profile_session_merge (files, &error);
+  if (db_table == NULL)
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  /* Replaces the input atomically, like the final capture of a process */
+  if (!gvdb_table_write_contents_with_flags (db_table, output,
+                                             G_BYTE_ORDER != G_LITTLE_ENDIAN,
+                                             GVDB_WRITE_FLAGS_PERFECT_HASH,
+                                             &error))
+    {
+      eos_profile_util_print_error ("Unable to write '%s': %s\n", output, error->message);
+      return EXIT_FAILURE;
+    }
+
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "Compacted %u segments into '%s'",
+                                  n_segments,
+                                  output);
+
+  return EXIT_SUCCESS;
+}
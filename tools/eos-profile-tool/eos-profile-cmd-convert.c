@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
 #include "eos-profile-utils.h"
 
 #include "endless/eosprofile-private.h"
@@ -214,7 +215,7 @@ eos_profile_cmd_convert_main (void)
 
   g_autoptr(GError) error = NULL;
 
-  GvdbTable *db = gvdb_table_new (opt_input, TRUE, &error);
+  GvdbTable *db = eos_profile_session_open_capture (opt_input, &error);
   if (error != NULL)
     {
       eos_profile_util_print_error ("Unable to load '%s': %s\n",
@@ -223,18 +224,14 @@ eos_profile_cmd_convert_main (void)
       return 1;
     }
 
-  GVariant *v = gvdb_table_get_raw_value (db, PROBE_DB_META_VERSION_KEY);
-  gint32 version = v != NULL ? g_variant_get_int32 (v) : -1;
-  g_clear_pointer (&v, g_variant_unref);
-
-  if (version != PROBE_DB_VERSION)
+  if (!eos_profile_session_check_version (db, opt_input, &error))
     {
-      eos_profile_util_print_error ("Unable to load '%s': invalid version\n", opt_input);
+      eos_profile_util_print_error ("%s\n", error->message);
       gvdb_table_free (db);
       return 1;
     }
 
-  v = gvdb_table_get_raw_value (db, PROBE_DB_META_APPID_KEY);
+  GVariant *v = gvdb_table_get_raw_value (db, PROBE_DB_META_APPID_KEY);
   g_autofree char *appid = v != NULL ? g_variant_dup_string (v, NULL) : NULL;
   g_clear_pointer (&v, g_variant_unref);
 
@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
 #include "eos-profile-utils.h"
 
 #include "endless/eosprofile-private.h"
@@ -265,6 +266,133 @@ append_probe (const char *probe_name,
   return TRUE;
 }
 
+/* Memory counters growing more than this between the first file and any
+ * of the others are flagged as regressions
+ */
+#define MEMORY_REGRESSION_THRESHOLD     0.05
+
+typedef struct {
+  gint64 peak;
+  double avg;
+} CounterResult;
+
+typedef struct {
+  char *counter_name;
+
+  /* element-type CounterResult, one for each file; files without the
+   * counter have a negative peak
+   */
+  GArray *results;
+} CounterData;
+
+static void
+counter_data_free (gpointer data)
+{
+  CounterData *c = data;
+
+  g_free (c->counter_name);
+  g_array_unref (c->results);
+
+  g_free (c);
+}
+
+typedef struct {
+  int file_index;
+  int n_files;
+  GHashTable *counters;
+} CounterClosure;
+
+static gboolean
+append_counter (const char *counter_name,
+                GVariant   *samples,
+                gpointer    data)
+{
+  CounterClosure *clos = data;
+
+  EosProfileCounterStats stats;
+  if (!eos_profile_util_get_counter_stats (samples, &stats))
+    return TRUE;
+
+  CounterData *c = g_hash_table_lookup (clos->counters, counter_name);
+  if (c == NULL)
+    {
+      c = g_new0 (CounterData, 1);
+      c->counter_name = g_strdup (counter_name);
+      c->results = g_array_sized_new (FALSE, FALSE, sizeof (CounterResult), clos->n_files);
+
+      for (int i = 0; i < clos->n_files; i++)
+        g_array_append_vals (c->results, &(CounterResult) { .peak = -1, .avg = -1.0 }, 1);
+
+      g_hash_table_insert (clos->counters, c->counter_name, c);
+    }
+
+  CounterResult *r = &g_array_index (c->results, CounterResult, clos->file_index);
+  r->peak = stats.max_value;
+  r->avg = stats.weighted_avg;
+
+  return TRUE;
+}
+
+static gboolean
+counter_is_regression (const CounterData *c)
+{
+  if (!g_str_has_prefix (c->counter_name, PROBE_DB_MEMORY_BASE_KEY "/"))
+    return FALSE;
+
+  const CounterResult *base = &g_array_index (c->results, CounterResult, 0);
+  if (base->peak <= 0)
+    return FALSE;
+
+  for (int i = 1; i < c->results->len; i++)
+    {
+      const CounterResult *r = &g_array_index (c->results, CounterResult, i);
+
+      if (r->peak < 0)
+        continue;
+
+      if (r->peak > base->peak * (1.0 + MEMORY_REGRESSION_THRESHOLD) ||
+          r->avg > base->avg * (1.0 + MEMORY_REGRESSION_THRESHOLD))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+append_counter_results (GString           *buf,
+                        const CounterData *c,
+                        const char        *label,
+                        gboolean           use_peak)
+{
+  const CounterResult *base = &g_array_index (c->results, CounterResult, 0);
+  double base_value = use_peak ? base->peak : base->avg;
+
+  g_string_append_printf (buf, "  ┕━ • %s: ", label);
+
+  for (int j = 0; j < c->results->len; j++)
+    {
+      const CounterResult *r = &g_array_index (c->results, CounterResult, j);
+
+      if (r->peak < 0)
+        g_string_append (buf, "-");
+      else
+        {
+          double value = use_peak ? r->peak : r->avg;
+          g_autofree char *str = eos_profile_util_format_counter_value (c->counter_name, value);
+
+          g_string_append (buf, str);
+
+          if (j > 0 && base->peak >= 0 && base_value > 0)
+            g_string_append_printf (buf, " [%+.1f%%]", (value - base_value) / base_value * 100.0);
+        }
+
+      if (j == c->results->len - 1)
+        g_string_append (buf, "\n");
+      else
+        g_string_append (buf, ", ");
+    }
+}
+
 #define AUTO_FD_INVALID (-1)
 
 typedef int AutoFd;
@@ -349,12 +477,17 @@ eos_profile_cmd_diff_main (void)
     g_hash_table_new_full (g_str_hash, g_str_equal,
                            NULL,
                            probe_data_free);
+  g_autoptr(GHashTable) counters =
+    g_hash_table_new_full (g_str_hash, g_str_equal,
+                           NULL,
+                           counter_data_free);
 
   while (i < n_files)
     {
       g_autoptr(GError) error = NULL;
 
-      GvdbTable *db = gvdb_table_new (opt_files[i], TRUE, &error);
+      /* Sessions are compared as a whole */
+      GvdbTable *db = eos_profile_session_open (opt_files[i], &error);
       if (error != NULL)
         {
           eos_profile_util_print_error ("Unable to load '%s': %s\n",
@@ -363,13 +496,9 @@ eos_profile_cmd_diff_main (void)
           return 1;
         }
 
-      GVariant *v = gvdb_table_get_raw_value (db, PROBE_DB_META_VERSION_KEY);
-      gint32 version = v != NULL ? g_variant_get_int32 (v) : -1;
-      g_clear_pointer (&v, g_variant_unref);
-
-      if (version != PROBE_DB_VERSION)
+      if (!eos_profile_session_check_version (db, opt_files[i], &error))
         {
-          eos_profile_util_print_error ("Unable to load '%s': invalid version\n", opt_files[i]);
+          eos_profile_util_print_error ("%s\n", error->message);
           gvdb_table_free (db);
           return 1;
         }
@@ -381,6 +510,14 @@ eos_profile_cmd_diff_main (void)
 
       eos_profile_util_foreach_probe_v1 (db, append_probe, &clos);
 
+      CounterClosure counter_clos = {
+        .file_index = i,
+        .n_files = n_files,
+        .counters = counters,
+      };
+
+      eos_profile_util_foreach_counter_v1 (db, append_counter, &counter_clos);
+
       gvdb_table_free (db);
 
       i += 1;
@@ -459,6 +596,54 @@ eos_profile_cmd_diff_main (void)
         }
     }
 
+  g_hash_table_iter_init (&iter, counters);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      CounterData *c = value;
+      gboolean regression = counter_is_regression (c);
+
+      if (json_res != NULL)
+        {
+          JsonArray *res_array = json_node_get_array (json_res);
+          JsonObject *obj = json_object_new ();
+          json_array_add_object_element (res_array, obj);
+
+          json_object_set_string_member (obj, "counterName", c->counter_name);
+          json_object_set_boolean_member (obj, "regression", regression);
+
+          JsonArray *peak_array = json_array_sized_new (c->results->len);
+          JsonArray *avg_array = json_array_sized_new (c->results->len);
+
+          for (int j = 0; j < c->results->len; j++)
+            {
+              const CounterResult *r = &g_array_index (c->results, CounterResult, j);
+
+              if (r->peak < 0)
+                {
+                  json_array_add_null_element (peak_array);
+                  json_array_add_null_element (avg_array);
+                }
+              else
+                {
+                  json_array_add_int_element (peak_array, r->peak);
+                  json_array_add_double_element (avg_array, r->avg);
+                }
+            }
+
+          json_object_set_array_member (obj, "peakResults", peak_array);
+          json_object_set_array_member (obj, "averageResults", avg_array);
+        }
+      else
+        {
+          g_string_append_printf (buf, "Counter: %s%s\n",
+                                  c->counter_name,
+                                  regression ? " [regression]" : "");
+
+          append_counter_results (buf, c, "peak", TRUE);
+          append_counter_results (buf, c, "avg", FALSE);
+        }
+    }
+
   g_autofree char *data = NULL;
 
   if (json_res != NULL)
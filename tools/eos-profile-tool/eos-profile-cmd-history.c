@@ -0,0 +1,859 @@
+#include "config.h"
+
+#include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
+#include "eos-profile-utils.h"
+
+#include "endless/eosprofile-private.h"
+#include "endless/gvdb/gvdb-builder.h"
+#include "endless/gvdb/gvdb-reader.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Probe history
+ *
+ * The history is a GVDB file holding the list of builds, in the order in
+ * which they were added, and the summary of each probe for each build:
+ *
+ *  - /builds: a(sx), the build ID and its timestamp
+ *  - /probes/<probe name>: a(uudxxx), the index of the build, the number
+ *    of samples, and the mean, median, minimum and maximum durations
+ *
+ * Adding a build that is already in the history replaces its results.
+ */
+
+#define HISTORY_VERSION                 1
+
+#define HISTORY_VERSION_KEY             "/version"
+#define HISTORY_BUILDS_KEY              "/builds"
+#define HISTORY_PROBES_PREFIX           "/probes"
+
+#define HISTORY_BUILDS_TYPE             "a(sx)"
+#define HISTORY_ENTRIES_TYPE            "a(uudxxx)"
+
+/* Each side of a change point needs at least this many builds */
+#define MIN_SEGMENT_LEN                 2
+
+#define DEFAULT_THRESHOLD               5.0
+
+/* Changes smaller than this are not reported, however significant */
+#define MIN_RELATIVE_CHANGE             0.05
+
+static const char *sparks[] = {
+  "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█",
+};
+
+static const char *opt_action;
+static char *opt_db;
+static char *opt_build;
+static gint64 opt_timestamp = -1;
+static char *opt_probe;
+static double opt_threshold = DEFAULT_THRESHOLD;
+static char **opt_files;
+
+static GOptionEntry opts[] = {
+  {
+    .long_name = "db",
+    .short_name = 'd',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_db,
+    .description = "The history file (default: $XDG_DATA_HOME/com.endlessm.Sdk.Profile/history.db)",
+    .arg_description = "FILE",
+  },
+  {
+    .long_name = "build",
+    .short_name = 'b',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_build,
+    .description = "The ID of the build to add",
+    .arg_description = "ID",
+  },
+  {
+    .long_name = "timestamp",
+    .short_name = 0,
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_INT64,
+    .arg_data = &opt_timestamp,
+    .description = "The time of the build, in seconds since the epoch (default: now)",
+    .arg_description = "SECONDS",
+  },
+  {
+    .long_name = "probe",
+    .short_name = 'p',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_probe,
+    .description = "Only show the probes matching this prefix",
+    .arg_description = "NAME",
+  },
+  {
+    .long_name = "threshold",
+    .short_name = 't',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_DOUBLE,
+    .arg_data = &opt_threshold,
+    .description = "The t statistic above which a change is reported (default: 5)",
+    .arg_description = "T",
+  },
+  {
+    .long_name = G_OPTION_REMAINING,
+    .short_name = 0,
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME_ARRAY,
+    .arg_data = &opt_files,
+    .description = "The capture files and sessions of the build",
+    .arg_description = "FILES",
+  },
+
+  { NULL, },
+};
+
+gboolean
+eos_profile_cmd_history_parse_args (int    argc,
+                                    char **argv)
+{
+  g_autoptr(GError) error = NULL;
+
+  if (argc < 2)
+    return FALSE;
+
+  opt_action = argv[1];
+
+  if (g_strcmp0 (opt_action, "add") != 0 &&
+      g_strcmp0 (opt_action, "show") != 0)
+    return FALSE;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  argc -= 1;
+  argv += 1;
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_db == NULL)
+    opt_db = g_build_filename (g_get_user_data_dir (),
+                               PROBE_SESSION_BASE_DIR,
+                               "history.db",
+                               NULL);
+
+  if (g_strcmp0 (opt_action, "add") == 0)
+    {
+      if (opt_build == NULL || *opt_build == '\0')
+        {
+          eos_profile_util_print_error ("The build ID is required");
+          return FALSE;
+        }
+
+      if (opt_files == NULL || g_strv_length (opt_files) == 0)
+        return FALSE;
+
+      if (opt_timestamp < 0)
+        opt_timestamp = g_get_real_time () / G_USEC_PER_SEC;
+    }
+  else if (opt_threshold <= 0.0)
+    {
+      eos_profile_util_print_error ("Invalid threshold");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static const double
+scale_val (double val)
+{
+  if (val >= G_USEC_PER_SEC)
+    return val / G_USEC_PER_SEC;
+
+  if (val >= 1000)
+    return val / 1000.0;
+
+  return val;
+}
+
+static const char *
+unit_for (double val)
+{
+  enum {
+    SECONDS,
+    MILLISECONDS,
+    MICROSECONDS
+  };
+
+  const char *units[] = {
+    [SECONDS] = "s",
+    [MILLISECONDS] = "ms",
+    [MICROSECONDS] = "µs",
+  };
+
+  if (val >= G_USEC_PER_SEC)
+    return units[SECONDS];
+
+  if (val >= 1000)
+    return units[MILLISECONDS];
+
+  return units[MICROSECONDS];
+}
+
+typedef struct {
+  char *build_id;
+  gint64 timestamp;
+} HistoryBuild;
+
+typedef struct {
+  guint build;
+  guint n_samples;
+  double mean;
+  gint64 median;
+  gint64 min;
+  gint64 max;
+} HistoryEntry;
+
+typedef struct {
+  /* element-type HistoryBuild */
+  GArray *builds;
+
+  /* element-type (key utf8) (value GArray<HistoryEntry>) */
+  GHashTable *probes;
+} History;
+
+static void
+history_build_clear (gpointer data)
+{
+  HistoryBuild *build = data;
+
+  g_free (build->build_id);
+}
+
+static void
+history_free (History *history)
+{
+  g_array_unref (history->builds);
+  g_hash_table_unref (history->probes);
+  g_free (history);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (History, history_free)
+
+static GArray *
+history_get_entries (History    *history,
+                     const char *probe_name)
+{
+  GArray *entries = g_hash_table_lookup (history->probes, probe_name);
+
+  if (entries == NULL)
+    {
+      entries = g_array_new (FALSE, FALSE, sizeof (HistoryEntry));
+      g_hash_table_insert (history->probes, g_strdup (probe_name), entries);
+    }
+
+  return entries;
+}
+
+/* A missing history file is an empty history */
+static History *
+history_load (const char  *filename,
+              GError     **error)
+{
+  g_autoptr(History) history = g_new0 (History, 1);
+
+  history->builds = g_array_new (FALSE, FALSE, sizeof (HistoryBuild));
+  g_array_set_clear_func (history->builds, history_build_clear);
+  history->probes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free,
+                                           (GDestroyNotify) g_array_unref);
+
+  if (!g_file_test (filename, G_FILE_TEST_EXISTS))
+    return g_steal_pointer (&history);
+
+  GvdbTable *db = gvdb_table_new (filename, TRUE, error);
+  if (db == NULL)
+    return NULL;
+
+  g_autoptr(GVariant) version = gvdb_table_get_raw_value (db, HISTORY_VERSION_KEY);
+  if (version == NULL ||
+      !g_variant_is_of_type (version, G_VARIANT_TYPE_INT32) ||
+      g_variant_get_int32 (version) != HISTORY_VERSION)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "'%s' is not a probe history",
+                   filename);
+      gvdb_table_free (db);
+      return NULL;
+    }
+
+  g_autoptr(GVariant) builds = gvdb_table_get_raw_value (db, HISTORY_BUILDS_KEY);
+  if (builds != NULL && g_variant_is_of_type (builds, G_VARIANT_TYPE (HISTORY_BUILDS_TYPE)))
+    {
+      GVariantIter iter;
+      const char *build_id;
+      gint64 timestamp;
+
+      g_variant_iter_init (&iter, builds);
+      while (g_variant_iter_next (&iter, "(&sx)", &build_id, &timestamp))
+        {
+          g_array_append_vals (history->builds,
+                               &(HistoryBuild) {
+                                 .build_id = g_strdup (build_id),
+                                 .timestamp = timestamp,
+                               }, 1);
+        }
+    }
+
+  int names_len = 0;
+  g_auto(GStrv) names = gvdb_table_get_names (db, &names_len);
+
+  for (int i = 0; i < names_len; i++)
+    {
+      if (!g_str_has_prefix (names[i], HISTORY_PROBES_PREFIX "/"))
+        continue;
+
+      g_autoptr(GVariant) value = gvdb_table_get_raw_value (db, names[i]);
+      if (value == NULL || !g_variant_is_of_type (value, G_VARIANT_TYPE (HISTORY_ENTRIES_TYPE)))
+        continue;
+
+      GArray *entries = history_get_entries (history, names[i] + strlen (HISTORY_PROBES_PREFIX));
+
+      GVariantIter iter;
+      HistoryEntry entry;
+
+      g_variant_iter_init (&iter, value);
+      while (g_variant_iter_next (&iter, "(uudxxx)",
+                                  &entry.build,
+                                  &entry.n_samples,
+                                  &entry.mean,
+                                  &entry.median,
+                                  &entry.min,
+                                  &entry.max))
+        {
+          if (entry.build < history->builds->len)
+            g_array_append_val (entries, entry);
+        }
+    }
+
+  gvdb_table_free (db);
+
+  return g_steal_pointer (&history);
+}
+
+static gboolean
+history_save (History     *history,
+              const char  *filename,
+              GError     **error)
+{
+  g_autofree char *dirname = g_path_get_dirname (filename);
+  if (g_mkdir_with_parents (dirname, 0755) < 0)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   "Unable to create '%s': %s",
+                   dirname,
+                   g_strerror (errno));
+      return FALSE;
+    }
+
+  g_autoptr(GHashTable) db_table = gvdb_hash_table_new (NULL, NULL);
+
+  GvdbItem *item = gvdb_hash_table_insert (db_table, HISTORY_VERSION_KEY);
+  gvdb_item_set_value (item, g_variant_new_int32 (HISTORY_VERSION));
+
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (HISTORY_BUILDS_TYPE));
+
+  for (int i = 0; i < history->builds->len; i++)
+    {
+      const HistoryBuild *build = &g_array_index (history->builds, HistoryBuild, i);
+
+      g_variant_builder_add (&builder, "(sx)", build->build_id, build->timestamp);
+    }
+
+  item = gvdb_hash_table_insert (db_table, HISTORY_BUILDS_KEY);
+  gvdb_item_set_value (item, g_variant_builder_end (&builder));
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init (&iter, history->probes);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const char *probe_name = key;
+      GArray *entries = value;
+
+      g_variant_builder_init (&builder, G_VARIANT_TYPE (HISTORY_ENTRIES_TYPE));
+
+      for (int i = 0; i < entries->len; i++)
+        {
+          const HistoryEntry *entry = &g_array_index (entries, HistoryEntry, i);
+
+          g_variant_builder_add (&builder, "(uudxxx)",
+                                 entry->build,
+                                 entry->n_samples,
+                                 entry->mean,
+                                 entry->median,
+                                 entry->min,
+                                 entry->max);
+        }
+
+      g_autofree char *probe_key = g_strconcat (HISTORY_PROBES_PREFIX, probe_name, NULL);
+
+      item = gvdb_hash_table_insert (db_table, probe_key);
+      gvdb_item_set_value (item, g_variant_builder_end (&builder));
+    }
+
+  return gvdb_table_write_contents (db_table, filename,
+                                    G_BYTE_ORDER != G_LITTLE_ENDIAN,
+                                    error);
+}
+
+static gboolean
+collect_durations (const char *probe_name,
+                   const char *function,
+                   const char *file,
+                   gint32      line,
+                   gint32      n_samples,
+                   GVariant   *samples,
+                   gpointer    user_data)
+{
+  GHashTable *durations = user_data;
+
+  GArray *probe_durations = g_hash_table_lookup (durations, probe_name);
+  if (probe_durations == NULL)
+    {
+      probe_durations = g_array_new (FALSE, FALSE, sizeof (gint64));
+      g_hash_table_insert (durations, g_strdup (probe_name), probe_durations);
+    }
+
+  GVariantIter iter;
+  gint64 start_time, end_time;
+  g_variant_iter_init (&iter, samples);
+  while (g_variant_iter_next (&iter, "(xx)", &start_time, &end_time))
+    {
+      /* Skip the samples of probes that were never stopped */
+      if (end_time < start_time)
+        continue;
+
+      gint64 duration = end_time - start_time;
+      g_array_append_val (probe_durations, duration);
+    }
+
+  return TRUE;
+}
+
+static int
+duration_compare (gconstpointer a,
+                  gconstpointer b)
+{
+  gint64 duration_a = *(const gint64 *) a;
+  gint64 duration_b = *(const gint64 *) b;
+
+  if (duration_a < duration_b)
+    return -1;
+
+  if (duration_a > duration_b)
+    return 1;
+
+  return 0;
+}
+
+static guint
+history_get_build (History    *history,
+                   const char *build_id,
+                   gint64      timestamp)
+{
+  for (guint i = 0; i < history->builds->len; i++)
+    {
+      HistoryBuild *build = &g_array_index (history->builds, HistoryBuild, i);
+
+      if (g_strcmp0 (build->build_id, build_id) == 0)
+        {
+          build->timestamp = timestamp;
+          return i;
+        }
+    }
+
+  g_array_append_vals (history->builds,
+                       &(HistoryBuild) {
+                         .build_id = g_strdup (build_id),
+                         .timestamp = timestamp,
+                       }, 1);
+
+  return history->builds->len - 1;
+}
+
+static int
+history_add (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(History) history = history_load (opt_db, &error);
+  if (history == NULL)
+    {
+      eos_profile_util_print_error ("Unable to load '%s': %s\n", opt_db, error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_auto(GStrv) files = eos_profile_session_expand (opt_files, &error);
+  if (files == NULL)
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  /* The samples of all the captures of a build are summarized together */
+  g_autoptr(GHashTable) durations =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+
+  for (int i = 0; files[i] != NULL; i++)
+    {
+      GvdbTable *db = eos_profile_session_open_capture (files[i], &error);
+      if (db == NULL)
+        {
+          eos_profile_util_print_error ("Unable to load '%s': %s\n", files[i], error->message);
+          return EXIT_FAILURE;
+        }
+
+      if (!eos_profile_session_check_version (db, files[i], &error))
+        {
+          eos_profile_util_print_error ("%s\n", error->message);
+          gvdb_table_free (db);
+          return EXIT_FAILURE;
+        }
+
+      eos_profile_util_foreach_probe_v1 (db, collect_durations, durations);
+
+      gvdb_table_free (db);
+    }
+
+  guint build = history_get_build (history, opt_build, opt_timestamp);
+  guint n_probes = 0;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init (&iter, durations);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const char *probe_name = key;
+      GArray *probe_durations = value;
+
+      if (probe_durations->len == 0)
+        continue;
+
+      g_array_sort (probe_durations, duration_compare);
+
+      double total = 0;
+      for (int i = 0; i < probe_durations->len; i++)
+        total += g_array_index (probe_durations, gint64, i);
+
+      HistoryEntry entry = {
+        .build = build,
+        .n_samples = probe_durations->len,
+        .mean = total / probe_durations->len,
+        .median = g_array_index (probe_durations, gint64, probe_durations->len / 2),
+        .min = g_array_index (probe_durations, gint64, 0),
+        .max = g_array_index (probe_durations, gint64, probe_durations->len - 1),
+      };
+
+      GArray *entries = history_get_entries (history, probe_name);
+
+      /* Replace the previous results of the same build */
+      gboolean replaced = FALSE;
+      for (int i = 0; i < entries->len; i++)
+        {
+          HistoryEntry *old_entry = &g_array_index (entries, HistoryEntry, i);
+
+          if (old_entry->build == build)
+            {
+              *old_entry = entry;
+              replaced = TRUE;
+              break;
+            }
+        }
+
+      if (!replaced)
+        g_array_append_val (entries, entry);
+
+      n_probes += 1;
+    }
+
+  if (!history_save (history, opt_db, &error))
+    {
+      eos_profile_util_print_error ("Unable to write '%s': %s\n", opt_db, error->message);
+      return EXIT_FAILURE;
+    }
+
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "Added %u probes of build '%s' to '%s'",
+                                  n_probes,
+                                  opt_build,
+                                  opt_db);
+
+  return EXIT_SUCCESS;
+}
+
+typedef struct {
+  const HistoryBuild *build;
+  gint64 median;
+} HistoryPoint;
+
+static int
+history_point_compare (gconstpointer a,
+                       gconstpointer b)
+{
+  const HistoryPoint *point_a = a;
+  const HistoryPoint *point_b = b;
+
+  if (point_a->build->timestamp != point_b->build->timestamp)
+    return point_a->build->timestamp < point_b->build->timestamp ? -1 : 1;
+
+  return 0;
+}
+
+static void
+segment_stats (const HistoryPoint *points,
+               int                 len,
+               double             *mean,
+               double             *variance)
+{
+  double total = 0;
+
+  for (int i = 0; i < len; i++)
+    total += points[i].median;
+
+  *mean = total / len;
+
+  double squares = 0;
+  for (int i = 0; i < len; i++)
+    {
+      double deviation = points[i].median - *mean;
+
+      squares += deviation * deviation;
+    }
+
+  *variance = len > 1 ? squares / (len - 1) : 0.0;
+}
+
+/* Finds the build splitting the series in the two segments whose means
+ * differ the most, according to Welch's t statistic
+ */
+static gboolean
+find_change_point (const GArray *points,
+                   int          *split,
+                   double       *t_stat)
+{
+  const HistoryPoint *data = (const HistoryPoint *) points->data;
+  int len = points->len;
+  double best_t = 0.0;
+  int best_split = -1;
+
+  for (int k = MIN_SEGMENT_LEN; k <= len - MIN_SEGMENT_LEN; k++)
+    {
+      double mean_before, var_before, mean_after, var_after;
+
+      segment_stats (data, k, &mean_before, &var_before);
+      segment_stats (data + k, len - k, &mean_after, &var_after);
+
+      double delta = mean_after - mean_before;
+      double stderr_sq = var_before / k + var_after / (len - k);
+
+      /* Perfectly stable segments make any difference significant */
+      double t = stderr_sq > 0.0
+        ? delta / sqrt (stderr_sq)
+        : (delta != 0.0 ? copysign (G_MAXDOUBLE, delta) : 0.0);
+
+      if (fabs (t) > fabs (best_t))
+        {
+          best_t = t;
+          best_split = k;
+        }
+    }
+
+  if (best_split < 0)
+    return FALSE;
+
+  *split = best_split;
+  *t_stat = best_t;
+
+  return TRUE;
+}
+
+static char *
+format_sparkline (const GArray *points,
+                  int           max_len)
+{
+  int start = MAX ((int) points->len - max_len, 0);
+  gint64 min_value = G_MAXINT64, max_value = G_MININT64;
+
+  for (int i = start; i < points->len; i++)
+    {
+      const HistoryPoint *point = &g_array_index (points, HistoryPoint, i);
+
+      min_value = MIN (min_value, point->median);
+      max_value = MAX (max_value, point->median);
+    }
+
+  GString *res = g_string_new (NULL);
+
+  for (int i = start; i < points->len; i++)
+    {
+      const HistoryPoint *point = &g_array_index (points, HistoryPoint, i);
+      int level = 0;
+
+      if (max_value > min_value)
+        level = (int) ((point->median - min_value) * (G_N_ELEMENTS (sparks) - 1) /
+                       (double) (max_value - min_value));
+
+      g_string_append (res, sparks[level]);
+    }
+
+  return g_string_free (res, FALSE);
+}
+
+static char *
+format_build (const HistoryBuild *build)
+{
+  g_autoptr(GDateTime) dt = g_date_time_new_from_unix_local (build->timestamp);
+  g_autofree char *date = g_date_time_format (dt, "%Y-%m-%d %H:%M");
+
+  return g_strdup_printf ("'%s' (%s)", build->build_id, date);
+}
+
+static void
+show_probe (History    *history,
+            const char *probe_name,
+            GArray     *entries,
+            int         width)
+{
+  g_autoptr(GArray) points = g_array_sized_new (FALSE, FALSE, sizeof (HistoryPoint), entries->len);
+
+  for (int i = 0; i < entries->len; i++)
+    {
+      const HistoryEntry *entry = &g_array_index (entries, HistoryEntry, i);
+
+      g_array_append_vals (points,
+                           &(HistoryPoint) {
+                             .build = &g_array_index (history->builds, HistoryBuild, entry->build),
+                             .median = entry->median,
+                           }, 1);
+    }
+
+  g_array_sort (points, history_point_compare);
+
+  const HistoryPoint *first = &g_array_index (points, HistoryPoint, 0);
+  const HistoryPoint *last = &g_array_index (points, HistoryPoint, points->len - 1);
+
+  eos_profile_util_print_message ("PROBE", EOS_PRINT_COLOR_GREEN, "%s", probe_name);
+
+  g_autofree char *sparkline = format_sparkline (points, MAX (width - 8, 8));
+  double ratio = first->median != 0
+    ? (last->median - first->median) / (double) first->median
+    : 0.0;
+
+  eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                  "  %s  %u builds, median %.2f %s → %.2f %s (%+.1f%%)",
+                                  sparkline,
+                                  points->len,
+                                  scale_val (first->median), unit_for (first->median),
+                                  scale_val (last->median), unit_for (last->median),
+                                  ratio * 100.0);
+
+  int split = 0;
+  double t_stat = 0.0;
+  if (!find_change_point (points, &split, &t_stat) || fabs (t_stat) < opt_threshold)
+    return;
+
+  double mean_before, var_before, mean_after, var_after;
+  const HistoryPoint *data = (const HistoryPoint *) points->data;
+
+  segment_stats (data, split, &mean_before, &var_before);
+  segment_stats (data + split, points->len - split, &mean_after, &var_after);
+
+  double change = mean_before != 0.0 ? (mean_after - mean_before) / mean_before : 0.0;
+  if (fabs (change) < MIN_RELATIVE_CHANGE)
+    return;
+
+  g_autofree char *build = format_build (data[split].build);
+  g_autofree char *t_str = fabs (t_stat) < G_MAXDOUBLE
+    ? g_strdup_printf ("%.1f", t_stat)
+    : g_strdup (t_stat > 0 ? "∞" : "-∞");
+
+  eos_profile_util_print_message (change > 0 ? "SLOWER" : "FASTER",
+                                  change > 0 ? EOS_PRINT_COLOR_RED : EOS_PRINT_COLOR_GREEN,
+                                  "since build %s: %.2f %s → %.2f %s (%+.1f%%, t=%s)",
+                                  build,
+                                  scale_val (mean_before), unit_for (mean_before),
+                                  scale_val (mean_after), unit_for (mean_after),
+                                  change * 100.0,
+                                  t_str);
+}
+
+static int
+probe_name_compare (gconstpointer a,
+                    gconstpointer b,
+                    gpointer      data G_GNUC_UNUSED)
+{
+  return g_strcmp0 (*(const char * const *) a, *(const char * const *) b);
+}
+
+static int
+history_show (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(History) history = history_load (opt_db, &error);
+  if (history == NULL)
+    {
+      eos_profile_util_print_error ("Unable to load '%s': %s\n", opt_db, error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (history->builds->len == 0)
+    {
+      eos_profile_util_print_warning ("No builds in '%s'", opt_db);
+      return EXIT_SUCCESS;
+    }
+
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "%u builds in '%s'",
+                                  history->builds->len,
+                                  opt_db);
+
+  g_autofree const char **names =
+    (const char **) g_hash_table_get_keys_as_array (history->probes, NULL);
+  g_qsort_with_data (names, g_hash_table_size (history->probes), sizeof (char *),
+                     probe_name_compare, NULL);
+
+  int width = eos_profile_util_get_terminal_width ();
+
+  for (int i = 0; names[i] != NULL; i++)
+    {
+      if (opt_probe != NULL && !g_str_has_prefix (names[i], opt_probe))
+        continue;
+
+      GArray *entries = g_hash_table_lookup (history->probes, names[i]);
+      if (entries->len == 0)
+        continue;
+
+      show_probe (history, names[i], entries, width);
+    }
+
+  return EXIT_SUCCESS;
+}
+
+int
+eos_profile_cmd_history_main (void)
+{
+  if (g_strcmp0 (opt_action, "add") == 0)
+    return history_add ();
+
+  return history_show ();
+}
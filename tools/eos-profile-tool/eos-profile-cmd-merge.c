@@ -0,0 +1,105 @@
+#include "config.h"
+
+#include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
+#include "eos-profile-utils.h"
+
+#include "endless/gvdb/gvdb-builder.h"
+
+#include <stdlib.h>
+
+static char *opt_output;
+static char **opt_files;
+
+static GOptionEntry opts[] = {
+  {
+    .long_name = "output",
+    .short_name = 'o',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME,
+    .arg_data = &opt_output,
+    .description = "The merged capture file",
+    .arg_description = "FILE",
+  },
+  {
+    .long_name = G_OPTION_REMAINING,
+    .short_name = 0,
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME_ARRAY,
+    .arg_data = &opt_files,
+    .description = "The capture files and sessions to merge",
+    .arg_description = "FILES",
+  },
+
+  { NULL, },
+};
+
+gboolean
+eos_profile_cmd_merge_parse_args (int    argc,
+                                  char **argv)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_output == NULL)
+    {
+      eos_profile_util_print_error ("The output file is required");
+      return FALSE;
+    }
+
+  if (opt_files == NULL || g_strv_length (opt_files) == 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+int
+eos_profile_cmd_merge_main (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_auto(GStrv) files = eos_profile_session_expand (opt_files, &error);
+  if (files == NULL)
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  for (int i = 0; files[i] != NULL; i++)
+    eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                    "Merging '%s'",
+                                    files[i]);
+
+  g_autoptr(GHashTable) db_table = eos_profile_session_merge (files, &error);
+  if (db_table == NULL)
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (!gvdb_table_write_contents_with_flags (db_table, opt_output,
+                                             G_BYTE_ORDER != G_LITTLE_ENDIAN,
+                                             GVDB_WRITE_FLAGS_PERFECT_HASH,
+                                             &error))
+    {
+      eos_profile_util_print_error ("Unable to write '%s': %s\n", opt_output, error->message);
+      return EXIT_FAILURE;
+    }
+
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "Merged %u captures into '%s'",
+                                  g_strv_length (files),
+                                  opt_output);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,380 @@
+#include "config.h"
+
+#include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
+#include "eos-profile-symbols.h"
+#include "eos-profile-utils.h"
+
+#include "endless/eosprofile-private.h"
+#include "endless/gvdb/gvdb-reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_TOP_FUNCTIONS   20
+#define PROBE_TOP_FUNCTIONS     5
+
+static char *opt_probe;
+static int opt_top = DEFAULT_TOP_FUNCTIONS;
+static char *opt_input;
+
+static GOptionEntry opts[] = {
+  {
+    .long_name = "probe",
+    .short_name = 'p',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_probe,
+    .description = "Only consider the samples taken inside the probes matching this prefix",
+    .arg_description = "NAME",
+  },
+  {
+    .long_name = "top",
+    .short_name = 't',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_top,
+    .description = "The number of functions to show (default: 20)",
+    .arg_description = "N",
+  },
+
+  { NULL, },
+};
+
+gboolean
+eos_profile_cmd_samples_parse_args (int    argc,
+                                    char **argv)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_top <= 0)
+    {
+      eos_profile_util_print_error ("Invalid number of functions");
+      return FALSE;
+    }
+
+  if (argc < 2)
+    return FALSE;
+
+  opt_input = argv[1];
+
+  return TRUE;
+}
+
+typedef struct {
+  const char *function;
+  guint self;
+  guint total;
+} FunctionCount;
+
+typedef struct {
+  char *name;
+  guint n_samples;
+
+  /* element-type (key utf8) (value FunctionCount) */
+  GHashTable *functions;
+} ProbeSamples;
+
+static ProbeSamples *
+probe_samples_new (const char *name)
+{
+  ProbeSamples *res = g_new0 (ProbeSamples, 1);
+
+  res->name = g_strdup (name);
+  res->functions = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+  return res;
+}
+
+static void
+probe_samples_free (gpointer data)
+{
+  ProbeSamples *p = data;
+
+  g_hash_table_unref (p->functions);
+  g_free (p->name);
+  g_free (p);
+}
+
+static FunctionCount *
+probe_samples_get_function (ProbeSamples *p,
+                            const char   *function)
+{
+  FunctionCount *res = g_hash_table_lookup (p->functions, function);
+
+  if (res == NULL)
+    {
+      res = g_new0 (FunctionCount, 1);
+      res->function = function;
+      g_hash_table_insert (p->functions, (gpointer) function, res);
+    }
+
+  return res;
+}
+
+static void
+probe_samples_add (ProbeSamples          *p,
+                   EosProfileSymbolizer  *symbolizer,
+                   GVariant              *frames)
+{
+  gsize n_frames = 0;
+  const guint64 *addresses = g_variant_get_fixed_array (frames, &n_frames, sizeof (guint64));
+
+  if (n_frames == 0)
+    return;
+
+  g_autoptr(GHashTable) seen = g_hash_table_new (NULL, NULL);
+
+  p->n_samples += 1;
+
+  for (gsize i = 0; i < n_frames; i++)
+    {
+      /* Everything but the innermost frame is a return address, which
+       * points to the instruction after the call
+       */
+      guint64 address = i == 0 ? addresses[i] : addresses[i] - 1;
+      const char *function = eos_profile_symbolizer_lookup (symbolizer, address);
+
+      FunctionCount *count = probe_samples_get_function (p, function);
+
+      if (i == 0)
+        count->self += 1;
+
+      /* Recursive functions only count once per sample */
+      if (g_hash_table_add (seen, (gpointer) function))
+        count->total += 1;
+    }
+}
+
+static int
+function_count_compare_self (gconstpointer a,
+                             gconstpointer b)
+{
+  const FunctionCount *count_a = *(const FunctionCount **) a;
+  const FunctionCount *count_b = *(const FunctionCount **) b;
+
+  if (count_a->self != count_b->self)
+    return count_a->self < count_b->self ? 1 : -1;
+
+  return g_strcmp0 (count_a->function, count_b->function);
+}
+
+static int
+function_count_compare_total (gconstpointer a,
+                              gconstpointer b)
+{
+  const FunctionCount *count_a = *(const FunctionCount **) a;
+  const FunctionCount *count_b = *(const FunctionCount **) b;
+
+  if (count_a->total != count_b->total)
+    return count_a->total < count_b->total ? 1 : -1;
+
+  return g_strcmp0 (count_a->function, count_b->function);
+}
+
+static void
+print_functions (ProbeSamples     *p,
+                 GCompareFunc      compare_func,
+                 gboolean          self,
+                 int               max_functions,
+                 const char       *indent)
+{
+  g_autoptr(GPtrArray) counts = g_ptr_array_new ();
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init (&iter, p->functions);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (counts, value);
+
+  g_ptr_array_sort (counts, compare_func);
+
+  for (int i = 0; i < counts->len && i < max_functions; i++)
+    {
+      const FunctionCount *count = g_ptr_array_index (counts, i);
+      guint n = self ? count->self : count->total;
+
+      if (n == 0)
+        break;
+
+      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                      "%s%6.2f%% %8u  %s",
+                                      indent,
+                                      100.0 * n / p->n_samples,
+                                      n,
+                                      count->function);
+    }
+}
+
+static int
+probe_samples_compare (gconstpointer a,
+                       gconstpointer b)
+{
+  const ProbeSamples *p_a = *(const ProbeSamples **) a;
+  const ProbeSamples *p_b = *(const ProbeSamples **) b;
+
+  if (p_a->n_samples != p_b->n_samples)
+    return p_a->n_samples < p_b->n_samples ? 1 : -1;
+
+  return g_strcmp0 (p_a->name, p_b->name);
+}
+
+int
+eos_profile_cmd_samples_main (void)
+{
+  g_assert (opt_input != NULL);
+
+  g_autoptr(GError) error = NULL;
+
+  GvdbTable *db = eos_profile_session_open_capture (opt_input, &error);
+  if (error != NULL)
+    {
+      eos_profile_util_print_error ("Unable to load '%s': %s\n",
+                                    opt_input,
+                                    error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (!eos_profile_session_check_version (db, opt_input, &error))
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      gvdb_table_free (db);
+      return EXIT_FAILURE;
+    }
+
+  GVariant *v = gvdb_table_get_raw_value (db, PROBE_DB_SAMPLES_FREQUENCY_KEY);
+  guint32 frequency = v != NULL ? g_variant_get_uint32 (v) : 0;
+  g_clear_pointer (&v, g_variant_unref);
+
+  if (frequency == 0)
+    {
+      eos_profile_util_print_error ("No stack samples found in '%s'; "
+                                    "did you use EOS_PROFILE=sample?",
+                                    opt_input);
+      gvdb_table_free (db);
+      return EXIT_FAILURE;
+    }
+
+  g_autoptr(GVariant) modules = gvdb_table_get_raw_value (db, PROBE_DB_SAMPLES_MODULES_KEY);
+  if (modules != NULL &&
+      !g_variant_is_of_type (modules, G_VARIANT_TYPE (PROBE_DB_SAMPLES_MODULES_TYPE)))
+    g_clear_pointer (&modules, g_variant_unref);
+
+  g_autoptr(EosProfileSymbolizer) symbolizer = eos_profile_symbolizer_new (modules);
+
+  g_autoptr(GHashTable) probes =
+    g_hash_table_new_full (g_str_hash, g_str_equal, NULL, probe_samples_free);
+
+  ProbeSamples *all = probe_samples_new ("");
+  g_hash_table_insert (probes, all->name, all);
+
+  guint n_threads = 0, n_dropped = 0;
+
+  g_auto(GStrv) threads = gvdb_table_list (db, PROBE_DB_SAMPLES_THREADS_KEY "/");
+  for (int i = 0; threads != NULL && threads[i] != NULL; i++)
+    {
+      g_autofree char *key = g_strconcat (PROBE_DB_SAMPLES_THREADS_KEY "/", threads[i], NULL);
+      g_autoptr(GVariant) thread = gvdb_table_get_raw_value (db, key);
+
+      if (thread == NULL ||
+          !g_variant_is_of_type (thread, G_VARIANT_TYPE (PROBE_DB_SAMPLES_THREAD_TYPE)))
+        continue;
+
+      guint32 dropped;
+      g_autoptr(GVariant) samples = NULL;
+      g_variant_get (thread, "(u@a(xsat))", &dropped, &samples);
+
+      n_threads += 1;
+      n_dropped += dropped;
+
+      GVariantIter iter;
+      g_variant_iter_init (&iter, samples);
+
+      gint64 time;
+      const char *probe_name;
+      GVariant *frames;
+      while (g_variant_iter_next (&iter, "(x&s@at)", &time, &probe_name, &frames))
+        {
+          if (opt_probe != NULL && !g_str_has_prefix (probe_name, opt_probe))
+            {
+              g_variant_unref (frames);
+              continue;
+            }
+
+          probe_samples_add (all, symbolizer, frames);
+
+          if (*probe_name != '\0')
+            {
+              ProbeSamples *p = g_hash_table_lookup (probes, probe_name);
+
+              if (p == NULL)
+                {
+                  p = probe_samples_new (probe_name);
+                  g_hash_table_insert (probes, p->name, p);
+                }
+
+              probe_samples_add (p, symbolizer, frames);
+            }
+
+          g_variant_unref (frames);
+        }
+    }
+
+  gvdb_table_free (db);
+
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "Stack samples from '%s'",
+                                  opt_input);
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "%u samples at %u Hz on %u threads (%u dropped)",
+                                  all->n_samples, frequency, n_threads, n_dropped);
+
+  if (all->n_samples == 0)
+    return EXIT_SUCCESS;
+
+  eos_profile_util_print_message ("SELF", EOS_PRINT_COLOR_GREEN,
+                                  "Functions running when the sample was taken");
+  print_functions (all, function_count_compare_self, TRUE, opt_top, "  ");
+
+  eos_profile_util_print_message ("TOTAL", EOS_PRINT_COLOR_GREEN,
+                                  "Functions on the stack when the sample was taken");
+  print_functions (all, function_count_compare_total, FALSE, opt_top, "  ");
+
+  g_autoptr(GPtrArray) sorted_probes = g_ptr_array_new ();
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init (&iter, probes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      if (value != all)
+        g_ptr_array_add (sorted_probes, value);
+    }
+
+  g_ptr_array_sort (sorted_probes, probe_samples_compare);
+
+  for (int i = 0; i < sorted_probes->len; i++)
+    {
+      ProbeSamples *p = g_ptr_array_index (sorted_probes, i);
+
+      eos_profile_util_print_message ("PROBE", EOS_PRINT_COLOR_GREEN,
+                                      "%s (%u samples, %.2f%%)",
+                                      p->name,
+                                      p->n_samples,
+                                      100.0 * p->n_samples / all->n_samples);
+      print_functions (p, function_count_compare_self, TRUE, PROBE_TOP_FUNCTIONS, "  ┕━ • ");
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -1,15 +1,116 @@
 #include "config.h"
 
 #include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
 #include "eos-profile-utils.h"
 
 #include "endless/eosprofile-private.h"
 #include "endless/gvdb/gvdb-reader.h"
 
 #include <math.h>
-
+#include <string.h>
+
+/* The width of the longest bar of a histogram */
+#define HISTOGRAM_WIDTH         40
+
+typedef enum {
+  SORT_NONE,
+  SORT_TOTAL,
+  SORT_AVG,
+  SORT_P99,
+  SORT_COUNT,
+} SortKey;
+
+static char *opt_prefix;
+static char *opt_filter;
+static char *opt_sort;
+static int opt_top;
+static gboolean opt_tree;
+static gboolean opt_histogram;
+static int opt_warmup;
+static char **opt_files;
+
+static SortKey sort_key = SORT_NONE;
+static GPatternSpec *filter_pattern;
 static GPtrArray *files;
 
+static GOptionEntry opts[] = {
+  {
+    .long_name = "prefix",
+    .short_name = 'p',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_prefix,
+    .description = "Only show the probes whose name starts with PREFIX",
+    .arg_description = "PREFIX",
+  },
+  {
+    .long_name = "filter",
+    .short_name = 'f',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_filter,
+    .description = "Only show the probes whose name matches PATTERN, using '*' and '?' wildcards",
+    .arg_description = "PATTERN",
+  },
+  {
+    .long_name = "sort",
+    .short_name = 's',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_sort,
+    .description = "Sort the probes by 'total', 'avg', 'p99' or 'count'",
+    .arg_description = "KEY",
+  },
+  {
+    .long_name = "top",
+    .short_name = 't',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_top,
+    .description = "The number of probes to show, or of entries per level with --tree",
+    .arg_description = "N",
+  },
+  {
+    .long_name = "tree",
+    .short_name = 0,
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_NONE,
+    .arg_data = &opt_tree,
+    .description = "Show the total time of each level of the probe names",
+    .arg_description = NULL,
+  },
+  {
+    .long_name = "histogram",
+    .short_name = 'H',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_NONE,
+    .arg_data = &opt_histogram,
+    .description = "Show a histogram of the durations of each probe",
+    .arg_description = NULL,
+  },
+  {
+    .long_name = "warmup",
+    .short_name = 'w',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_warmup,
+    .description = "Show the first N samples of each probe separately from the rest",
+    .arg_description = "N",
+  },
+  {
+    .long_name = G_OPTION_REMAINING,
+    .short_name = 0,
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME_ARRAY,
+    .arg_data = &opt_files,
+    .description = "The capture files and sessions to show",
+    .arg_description = "FILES",
+  },
+
+  { NULL, },
+};
+
 static const double
 scale_val (double val)
 {
@@ -50,17 +151,60 @@ gboolean
 eos_profile_cmd_show_parse_args (int    argc,
                                  char **argv)
 {
-  files = g_ptr_array_new ();
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_top < 0 || opt_warmup < 0)
+    {
+      eos_profile_util_print_error ("Invalid argument");
+      return FALSE;
+    }
+
+  if (opt_sort == NULL)
+    sort_key = opt_tree ? SORT_TOTAL : SORT_NONE;
+  else if (g_strcmp0 (opt_sort, "total") == 0)
+    sort_key = SORT_TOTAL;
+  else if (g_strcmp0 (opt_sort, "avg") == 0)
+    sort_key = SORT_AVG;
+  else if (g_strcmp0 (opt_sort, "p99") == 0)
+    sort_key = SORT_P99;
+  else if (g_strcmp0 (opt_sort, "count") == 0)
+    sort_key = SORT_COUNT;
+  else
+    {
+      eos_profile_util_print_error ("Invalid sort key '%s'", opt_sort);
+      return FALSE;
+    }
 
-  for (int i = 1; i < argc; i++)
-    g_ptr_array_add (files, argv[i]);
+  if (opt_filter != NULL)
+    filter_pattern = g_pattern_spec_new (opt_filter);
 
-  if (files->len == 0)
+  if (opt_files == NULL || g_strv_length (opt_files) == 0)
+    return FALSE;
+
+  /* Each process of a session is shown separately */
+  g_auto(GStrv) captures = eos_profile_session_expand (opt_files, &error);
+  if (captures == NULL)
     {
-      g_ptr_array_unref (files);
+      eos_profile_util_print_error ("%s\n", error->message);
       return FALSE;
     }
 
+  files = g_ptr_array_new_with_free_func (g_free);
+
+  for (int i = 0; captures[i] != NULL; i++)
+    g_ptr_array_add (files, g_steal_pointer (&captures[i]));
+
   return TRUE;
 }
 
@@ -85,121 +229,488 @@ print_location (const char *file,
 }
 
 static void
-print_samples (const char *name,
-               gint32      n_samples,
-               GVariant   *array)
+print_samples (const EosProfileProbeStats *stats)
 {
-  g_autoptr(GArray) samples = g_array_new (FALSE, FALSE, sizeof (ProfileSample));
-
-  GVariantIter iter;
-  g_variant_iter_init (&iter, array);
+  if (stats->n_samples > 1)
+    {
+      g_autofree char *stddev = g_strdup_printf (", σ: %g", stats->stddev);
 
-  gint64 start, end;
-  while (g_variant_iter_next (&iter, "(xx)", &start, &end))
+      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                      "  ┕━ • %u samples",
+                                      stats->n_samples);
+      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                      "     ┕━ • total time: %d %s\n"
+                                      "     ┕━ • avg: %g %s, min: %d %s, max: %d %s%s\n"
+                                      "     ┕━ • p50: %d %s, p90: %d %s, p99: %d %s, p99.9: %d %s",
+                                      (int) scale_val (stats->total), unit_for (stats->total),
+                                      scale_val (stats->avg), unit_for (stats->avg),
+                                      (int) scale_val (stats->min), unit_for (stats->min),
+                                      (int) scale_val (stats->max), unit_for (stats->max),
+                                      stats->stddev == 0.0 ? "" : stddev,
+                                      (int) scale_val (stats->p50), unit_for (stats->p50),
+                                      (int) scale_val (stats->p90), unit_for (stats->p90),
+                                      (int) scale_val (stats->p99), unit_for (stats->p99),
+                                      (int) scale_val (stats->p999), unit_for (stats->p999));
+    }
+  else if (stats->n_samples == 1)
     {
-      g_array_append_vals (samples,
-                           &(ProfileSample) {
-                             .start_time = start,
-                             .end_time = end,
-                           },
-                           1);
-   }
+      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                      "  ┕━ • 1 sample");
+      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                      "     ┕━ • total time: %d %s",
+                                      (int) scale_val (stats->total),
+                                      unit_for (stats->total));
+    }
+  else
+    {
+      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                      "  ┕━ • Not enough valid samples found");
+    }
+}
+
+typedef struct {
+  char *name;
+  char *file;
+  char *function;
+  gint32 line;
+
+  /* element-type gint64, in the order in which the samples started */
+  GArray *durations;
 
- gint64 min_sample = G_MAXINT64, max_sample = 0;
- gint64 total = 0;
+  EosProfileProbeStats stats;
+} ShowProbe;
 
- g_autoptr(GArray) valid_samples = g_array_new (FALSE, FALSE, sizeof (guint));
+static char *
+format_duration (double val)
+{
+  return g_strdup_printf ("%g %s", scale_val (val), unit_for (val));
+}
 
- for (int i = 0; i < samples->len; i++)
-   {
-     const ProfileSample *sample = &g_array_index (samples, ProfileSample, i);
+static void
+print_warmup (const ShowProbe *probe)
+{
+  EosProfileProbeStats cold, warm;
 
-     gint64 delta = sample->end_time - sample->start_time;
+  if (!eos_profile_util_get_duration_stats (probe->durations, 0, opt_warmup, &cold) ||
+      !eos_profile_util_get_duration_stats (probe->durations, opt_warmup, -1, &warm))
+    return;
 
-     /* If the probe never got stopped we need to skip this sample */
-     if (delta < 0)
-       continue;
+  g_autofree char *cold_avg = format_duration (cold.avg);
+  g_autofree char *cold_max = format_duration (cold.max);
+  g_autofree char *warm_avg = format_duration (warm.avg);
+  g_autofree char *warm_p50 = format_duration (warm.p50);
+  g_autofree char *warm_p99 = format_duration (warm.p99);
+
+  eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                  "  ┕━ • cold (first %u): avg: %s, max: %s\n"
+                                  "  ┕━ • warm (%u): avg: %s, p50: %s, p99: %s",
+                                  cold.n_samples, cold_avg, cold_max,
+                                  warm.n_samples, warm_avg, warm_p50, warm_p99);
+}
 
-     g_array_append_val (valid_samples, i);
+/* Bucket 0 holds the durations under 1µs, and bucket N the durations
+ * from 2^(N-1) µs to 2^N µs
+ */
+static int
+histogram_bucket (gint64 duration)
+{
+  if (duration < 1)
+    return 0;
+
+  return (int) floor (log2 ((double) duration)) + 1;
+}
+
+static void
+print_histogram (const ShowProbe *probe)
+{
+  GArray *durations = probe->durations;
 
-     if (delta < min_sample)
-       min_sample = delta;
-     if (delta > max_sample)
-       max_sample = delta;
+  if (durations->len < 2)
+    return;
 
-     total += delta;
-   }
+  int min_bucket = histogram_bucket (probe->stats.min);
+  int max_bucket = histogram_bucket (probe->stats.max);
+  int n_buckets = max_bucket - min_bucket + 1;
 
-  g_autofree char *msg = NULL;
+  g_autofree guint *counts = g_new0 (guint, n_buckets);
+  g_autofree guint *cold_counts = g_new0 (guint, n_buckets);
+  guint max_count = 0;
 
-  if (valid_samples->len > 1)
+  for (int i = 0; i < durations->len; i++)
     {
-      double avg = total / (double) valid_samples->len;
-      double s = 0;
-      double s_part = 0;
+      int bucket = histogram_bucket (g_array_index (durations, gint64, i)) - min_bucket;
 
-      for (int i = 1; i < valid_samples->len - 1; i++)
-        {
-          guint idx = g_array_index (valid_samples, guint, i);
-          const ProfileSample *sample = &g_array_index (samples, ProfileSample, idx);
+      counts[bucket] += 1;
+      max_count = MAX (max_count, counts[bucket]);
 
-          gint64 delta = sample->end_time - sample->start_time;
-          g_assert (delta >= 0);
+      if (i < opt_warmup)
+        cold_counts[bucket] += 1;
+    }
 
-          double deviation = delta - avg;
-          s_part += (deviation * deviation);
-        }
+  for (int i = 0; i < n_buckets; i++)
+    {
+      int bucket = min_bucket + i;
+      gint64 lower = bucket > 0 ? (G_GINT64_CONSTANT (1) << (bucket - 1)) : 0;
 
-      if (valid_samples->len > 1)
-        s = sqrt (s_part / (double) valid_samples->len - 1);
-      else
-        s = 0.0;
+      g_autofree char *bound = format_duration (lower);
 
-      g_autofree char *stddev = g_strdup_printf (", σ: %g", s);
+      int width = counts[i] > 0 ? MAX (counts[i] * HISTOGRAM_WIDTH / max_count, 1) : 0;
+      int cold_width = counts[i] > 0 ? (int) round (width * cold_counts[i] / (double) counts[i]) : 0;
+
+      g_autoptr(GString) bar = g_string_new (NULL);
+      for (int j = 0; j < width; j++)
+        g_string_append (bar, j < cold_width ? "░" : "█");
 
       eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
-                                      "  ┕━ • %d samples",
-                                      valid_samples->len);
-      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
-                                      "     ┕━ • total time: %d %s\n"
-                                      "     ┕━ • avg: %g %s, min: %d %s, max: %d %s%s",
-                                      (int) scale_val (total), unit_for (total),
-                                      scale_val (avg), unit_for (avg),
-                                      (int) scale_val (min_sample), unit_for (min_sample),
-                                      (int) scale_val (max_sample), unit_for (max_sample),
-                                      s == 0.0 || isnan (s) ? "" : stddev);
+                                      "     ≥ %10s │%s %u",
+                                      bound,
+                                      bar->str,
+                                      counts[i]);
     }
-  else if (valid_samples->len == 1)
+}
+
+static void
+show_probe_clear (gpointer data)
+{
+  ShowProbe *probe = data;
+
+  g_free (probe->name);
+  g_free (probe->file);
+  g_free (probe->function);
+  g_clear_pointer (&probe->durations, g_array_unref);
+}
+
+static gboolean
+collect_probes (const char *probe_name,
+                const char *file,
+                const char *function,
+                gint32      line,
+                gint32      n_samples,
+                GVariant   *samples,
+                gpointer    data)
+{
+  GArray *probes = data;
+
+  if (filter_pattern != NULL && !g_pattern_match_string (filter_pattern, probe_name))
+    return TRUE;
+
+  ShowProbe probe = {
+    .name = g_strdup (probe_name),
+    .file = g_strdup (file),
+    .function = g_strdup (function),
+    .line = line,
+  };
+
+  probe.durations = eos_profile_util_get_probe_durations (samples);
+  eos_profile_util_get_duration_stats (probe.durations, 0, -1, &probe.stats);
+
+  g_array_append_val (probes, probe);
+
+  return TRUE;
+}
+
+static double
+sort_value (const EosProfileProbeStats *stats)
+{
+  switch (sort_key)
     {
-      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
-                                      "  ┕━ • 1 sample");
-      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
-                                      "     ┕━ • total time: %d %s",
-                                      (int) scale_val (total),
-                                      unit_for (total));
+    case SORT_TOTAL:
+      return stats->total;
+
+    case SORT_AVG:
+      return stats->avg;
+
+    case SORT_P99:
+      return stats->p99;
+
+    case SORT_COUNT:
+      return stats->n_samples;
+
+    case SORT_NONE:
+    default:
+      return 0;
+    }
+}
+
+static int
+show_probe_compare (gconstpointer a,
+                    gconstpointer b)
+{
+  const ShowProbe *probe_a = a;
+  const ShowProbe *probe_b = b;
+
+  double value_a = sort_value (&probe_a->stats);
+  double value_b = sort_value (&probe_b->stats);
+
+  if (value_a != value_b)
+    return value_a < value_b ? 1 : -1;
+
+  return g_strcmp0 (probe_a->name, probe_b->name);
+}
+
+/* The shortest prefix of the probe names that can be looked up, either
+ * the one given, or the part of the pattern before its first wildcard
+ */
+static char *
+get_lookup_prefix (void)
+{
+  g_autofree char *pattern_prefix = NULL;
+
+  if (opt_filter != NULL)
+    pattern_prefix = g_strndup (opt_filter, strcspn (opt_filter, "*?"));
+
+  if (opt_prefix == NULL)
+    return g_steal_pointer (&pattern_prefix);
+
+  if (pattern_prefix == NULL)
+    return g_strdup (opt_prefix);
+
+  /* Both must match, so the longest one is the most selective */
+  if (g_str_has_prefix (pattern_prefix, opt_prefix))
+    return g_steal_pointer (&pattern_prefix);
+
+  if (g_str_has_prefix (opt_prefix, pattern_prefix))
+    return g_strdup (opt_prefix);
+
+  return NULL;
+}
+
+typedef struct _TreeNode TreeNode;
+
+struct _TreeNode {
+  char *name;
+
+  /* The probe with the name of this node, if any */
+  const ShowProbe *probe;
+
+  gint64 total;
+  guint count;
+
+  /* element-type TreeNode */
+  GPtrArray *children;
+};
+
+static void
+tree_node_free (TreeNode *node)
+{
+  g_free (node->name);
+  g_clear_pointer (&node->children, g_ptr_array_unref);
+  g_free (node);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TreeNode, tree_node_free)
+
+static TreeNode *
+tree_node_new (const char *name)
+{
+  TreeNode *node = g_new0 (TreeNode, 1);
+
+  node->name = g_strdup (name);
+  node->children = g_ptr_array_new_with_free_func ((GDestroyNotify) tree_node_free);
+
+  return node;
+}
+
+static TreeNode *
+tree_node_get_child (TreeNode   *node,
+                     const char *name)
+{
+  for (int i = 0; i < node->children->len; i++)
+    {
+      TreeNode *child = g_ptr_array_index (node->children, i);
+
+      if (g_strcmp0 (child->name, name) == 0)
+        return child;
+    }
+
+  TreeNode *child = tree_node_new (name);
+  g_ptr_array_add (node->children, child);
+
+  return child;
+}
+
+/* The probes nested under another one by name are assumed to run while
+ * it runs, so a level with its own probe reports the time of that probe
+ * rather than the sum of the levels below it
+ */
+static void
+tree_node_roll_up (TreeNode *node)
+{
+  gint64 total = 0;
+  guint count = 0;
+
+  for (int i = 0; i < node->children->len; i++)
+    {
+      TreeNode *child = g_ptr_array_index (node->children, i);
+
+      tree_node_roll_up (child);
+
+      total += child->total;
+      count += child->count;
+    }
+
+  if (node->probe != NULL)
+    {
+      node->total = node->probe->stats.total;
+      node->count = node->probe->stats.n_samples;
     }
   else
     {
-      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
-                                      "  ┕━ • Not enough valid samples found");
+      node->total = total;
+      node->count = count;
+    }
+}
+
+static int
+tree_node_compare (gconstpointer a,
+                   gconstpointer b)
+{
+  const TreeNode *node_a = *(const TreeNode * const *) a;
+  const TreeNode *node_b = *(const TreeNode * const *) b;
+
+  /* Only the total time and the number of samples add up */
+  gint64 value_a = sort_key == SORT_COUNT ? node_a->count : node_a->total;
+  gint64 value_b = sort_key == SORT_COUNT ? node_b->count : node_b->total;
+
+  if (value_a != value_b)
+    return value_a < value_b ? 1 : -1;
+
+  return g_strcmp0 (node_a->name, node_b->name);
+}
+
+static void
+print_tree_node (TreeNode   *node,
+                 const char *label,
+                 gint64      parent_total,
+                 int         depth)
+{
+  g_autofree char *indent = g_strnfill (depth * 2, ' ');
+  g_autofree char *share = NULL;
+
+  if (parent_total > 0)
+    share = g_strdup_printf (", %.1f%%", node->total * 100.0 / parent_total);
+
+  eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                  "%s%s%s: %d %s (%u samples%s)",
+                                  indent,
+                                  label,
+                                  node->children->len > 0 && node->probe == NULL ? "/" : "",
+                                  (int) scale_val (node->total), unit_for (node->total),
+                                  node->count,
+                                  share != NULL ? share : "");
+
+  g_ptr_array_sort (node->children, tree_node_compare);
+
+  guint n_children = node->children->len;
+  if (opt_top > 0)
+    n_children = MIN (n_children, (guint) opt_top);
+
+  for (int i = 0; i < n_children; i++)
+    {
+      TreeNode *child = g_ptr_array_index (node->children, i);
+
+      print_tree_node (child, child->name, node->total, depth + 1);
+    }
+
+  if (n_children < node->children->len)
+    eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                    "%s  … %u more",
+                                    indent,
+                                    node->children->len - n_children);
+}
+
+static void
+print_tree (GArray *probes)
+{
+  g_autoptr(TreeNode) root = tree_node_new ("");
+
+  for (int i = 0; i < probes->len; i++)
+    {
+      const ShowProbe *probe = &g_array_index (probes, ShowProbe, i);
+      g_auto(GStrv) components = g_strsplit (probe->name, "/", -1);
+      TreeNode *node = root;
+
+      for (int j = 0; components[j] != NULL; j++)
+        {
+          if (*components[j] == '\0')
+            continue;
+
+          node = tree_node_get_child (node, components[j]);
+        }
+
+      node->probe = probe;
+    }
+
+  tree_node_roll_up (root);
+
+  /* Skip the levels that all the probes have in common */
+  g_autoptr(GString) label = g_string_new (NULL);
+  TreeNode *node = root;
+  while (node->probe == NULL && node->children->len == 1)
+    {
+      node = g_ptr_array_index (node->children, 0);
+      g_string_append_printf (label, "/%s", node->name);
+    }
+
+  print_tree_node (node, label->len > 0 ? label->str : "/", 0, 0);
+}
+
+static void
+print_probe_list (GArray *probes)
+{
+  if (sort_key != SORT_NONE)
+    g_array_sort (probes, show_probe_compare);
+
+  guint n_probes = probes->len;
+  if (opt_top > 0)
+    n_probes = MIN (n_probes, (guint) opt_top);
+
+  for (int i = 0; i < n_probes; i++)
+    {
+      const ShowProbe *probe = &g_array_index (probes, ShowProbe, i);
+
+      print_probe (probe->name);
+      print_location (probe->file, probe->line, probe->function);
+      print_samples (&probe->stats);
+
+      if (opt_warmup > 0)
+        print_warmup (probe);
+
+      if (opt_histogram)
+        print_histogram (probe);
     }
 }
 
 static gboolean
-print_probes (const char *probe_name,
-              const char *file,
-              const char *function,
-              gint32      line,
-              gint32      n_samples,
-              GVariant   *samples,
-              gpointer    data G_GNUC_UNUSED)
+print_counters (const char *counter_name,
+                GVariant   *samples,
+                gpointer    data G_GNUC_UNUSED)
 {
-  print_probe (probe_name);
+  eos_profile_util_print_message ("COUNTER", EOS_PRINT_COLOR_GREEN,
+                                  "%s",
+                                  counter_name);
 
-  print_location (file, line, function);
+  EosProfileCounterStats stats;
+  if (!eos_profile_util_get_counter_stats (samples, &stats))
+    {
+      eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                      "  ┕━ • No values found");
+      return TRUE;
+    }
 
-  if (n_samples > 0)
-    print_samples (probe_name, n_samples, samples);
+  g_autofree char *last = eos_profile_util_format_counter_value (counter_name, stats.last_value);
+  g_autofree char *min = eos_profile_util_format_counter_value (counter_name, stats.min_value);
+  g_autofree char *peak = eos_profile_util_format_counter_value (counter_name, stats.max_value);
+  g_autofree char *avg = eos_profile_util_format_counter_value (counter_name, stats.weighted_avg);
+
+  eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                  "  ┕━ • %u values",
+                                  stats.n_values);
+  eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                  "     ┕━ • peak: %s, time-weighted avg: %s\n"
+                                  "     ┕━ • last: %s, min: %s",
+                                  peak, avg,
+                                  last, min);
 
   return TRUE;
 }
@@ -218,7 +729,7 @@ eos_profile_cmd_show_main (void)
                                       "Loading profiling data from '%s'",
                                       filename);
 
-      GvdbTable *db = gvdb_table_new (filename, TRUE, &error);
+      GvdbTable *db = eos_profile_session_open_capture (filename, &error);
 
       if (error != NULL)
         {
@@ -226,16 +737,14 @@ eos_profile_cmd_show_main (void)
           return 1;
         }
 
-      GVariant *v = gvdb_table_get_raw_value (db, PROBE_DB_META_VERSION_KEY);
-      gint32 version = v != NULL ? g_variant_get_int32 (v) : -1;
-
-      if (version != PROBE_DB_VERSION)
+      if (!eos_profile_session_check_version (db, filename, &error))
         {
-          eos_profile_util_print_error ("Unable to load '%s': invalid version\n");
+          eos_profile_util_print_error ("%s\n", error->message);
+          gvdb_table_free (db);
           return 1;
         }
 
-      v = gvdb_table_get_raw_value (db, PROBE_DB_META_APPID_KEY);
+      GVariant *v = gvdb_table_get_raw_value (db, PROBE_DB_META_APPID_KEY);
       if (v != NULL)
         {
           const char *appid = g_variant_get_string (v, NULL);
@@ -247,6 +756,18 @@ eos_profile_cmd_show_main (void)
         }
 
       g_clear_pointer (&v, g_variant_unref);
+      v = gvdb_table_get_raw_value (db, PROBE_DB_META_PID_KEY);
+      if (v != NULL)
+        {
+          g_autoptr(GVariant) ppid = gvdb_table_get_raw_value (db, PROBE_DB_META_PPID_KEY);
+
+          eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                          "Process: %d (parent: %d)",
+                                          g_variant_get_int32 (v),
+                                          ppid != NULL ? g_variant_get_int32 (ppid) : 0);
+          g_clear_pointer (&v, g_variant_unref);
+        }
+
       v = gvdb_table_get_raw_value (db, PROBE_DB_META_PROFILE_KEY);
       if (v != NULL)
         {
@@ -273,7 +794,23 @@ eos_profile_cmd_show_main (void)
           g_clear_pointer (&v, g_variant_unref);
         }
 
-      eos_profile_util_foreach_probe_v1 (db, print_probes, NULL);
+      g_autoptr(GArray) probes = g_array_new (FALSE, FALSE, sizeof (ShowProbe));
+      g_array_set_clear_func (probes, show_probe_clear);
+
+      g_autofree char *prefix = get_lookup_prefix ();
+
+      /* A prefix and a pattern that cannot both match select nothing */
+      if (prefix != NULL || (opt_prefix == NULL && opt_filter == NULL))
+        eos_profile_util_foreach_probe_prefix (db, prefix, collect_probes, probes);
+
+      if (opt_tree)
+        print_tree (probes);
+      else
+        print_probe_list (probes);
+
+      /* Counters are not probes, and are only shown with all the probes */
+      if (opt_prefix == NULL && opt_filter == NULL && !opt_tree)
+        eos_profile_util_foreach_counter_v1 (db, print_counters, NULL);
 
       gvdb_table_free (db);
     }
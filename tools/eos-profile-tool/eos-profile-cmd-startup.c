@@ -0,0 +1,348 @@
+#include "config.h"
+
+#include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
+#include "eos-profile-utils.h"
+
+#include "endless/eosprofile-private.h"
+#include "endless/gvdb/gvdb-reader.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Phases that got slower by more than this are highlighted */
+#define REGRESSION_THRESHOLD    0.1
+
+static char **opt_files;
+
+static GOptionEntry opts[] = {
+  {
+    .long_name = G_OPTION_REMAINING,
+    .short_name = 0,
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_FILENAME_ARRAY,
+    .arg_data = &opt_files,
+    .description = "The files to compare",
+    .arg_description = "FILES",
+  },
+
+  { NULL, },
+};
+
+gboolean
+eos_profile_cmd_startup_parse_args (int    argc,
+                                    char **argv)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_files == NULL || g_strv_length (opt_files) == 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+typedef struct {
+  /* Relative to the start of the process */
+  gint64 offset;
+  gint64 duration;
+} StartupPhase;
+
+typedef struct {
+  const char *filename;
+
+  /* element-type (key utf8) (value StartupPhase) */
+  GHashTable *phases;
+} StartupRun;
+
+static void
+startup_run_clear (gpointer data)
+{
+  StartupRun *run = data;
+
+  g_clear_pointer (&run->phases, g_hash_table_unref);
+}
+
+static gboolean
+load_startup_run (const char *filename,
+                  StartupRun *run)
+{
+  g_autoptr(GError) error = NULL;
+
+  GvdbTable *db = eos_profile_session_open_capture (filename, &error);
+  if (error != NULL)
+    {
+      eos_profile_util_print_error ("Unable to load '%s': %s\n", filename, error->message);
+      return FALSE;
+    }
+
+  if (!eos_profile_session_check_version (db, filename, &error))
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      gvdb_table_free (db);
+      return FALSE;
+    }
+
+  run->filename = filename;
+  run->phases = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  gint64 origin = G_MAXINT64;
+  gboolean has_process_start = FALSE;
+
+  g_auto(GStrv) names = gvdb_table_list (db, PROBE_DB_STARTUP_BASE_KEY "/");
+  for (int i = 0; names != NULL && names[i] != NULL; i++)
+    {
+      /* Nested tables are not phases */
+      if (g_str_has_suffix (names[i], "/"))
+        continue;
+
+      g_autofree char *key = g_strconcat (PROBE_DB_STARTUP_BASE_KEY "/", names[i], NULL);
+      g_autoptr(GVariant) value = gvdb_table_get_raw_value (db, key);
+
+      if (value == NULL ||
+          !g_variant_is_of_type (value, G_VARIANT_TYPE (PROBE_DB_META_PROBE_TYPE)))
+        continue;
+
+      g_autoptr(GVariant) samples = g_variant_get_child_value (value, 5);
+      if (g_variant_n_children (samples) == 0)
+        continue;
+
+      /* Each phase is only recorded once */
+      gint64 start, end;
+      g_variant_get_child (samples, 0, "(xx)", &start, &end);
+
+      if (end < start)
+        continue;
+
+      StartupPhase *phase = g_new0 (StartupPhase, 1);
+      phase->offset = start;
+      phase->duration = end - start;
+
+      g_hash_table_insert (run->phases, g_strdup (names[i]), phase);
+
+      if (g_strcmp0 (names[i], PROBE_DB_STARTUP_PROCESS_START) == 0)
+        {
+          origin = start;
+          has_process_start = TRUE;
+        }
+      else if (!has_process_start)
+        origin = MIN (origin, start);
+    }
+
+  gvdb_table_free (db);
+
+  if (g_hash_table_size (run->phases) == 0)
+    {
+      eos_profile_util_print_warning ("No startup timeline found in '%s'", filename);
+      return TRUE;
+    }
+
+  if (!has_process_start)
+    eos_profile_util_print_warning ("The start of the process is missing from '%s'; "
+                                    "times are relative to the first phase",
+                                    filename);
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init (&iter, run->phases);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      StartupPhase *phase = value;
+
+      phase->offset -= origin;
+    }
+
+  return TRUE;
+}
+
+typedef struct {
+  const char *name;
+  double offset;
+} PhaseOrder;
+
+static int
+phase_order_compare (gconstpointer a,
+                     gconstpointer b)
+{
+  const PhaseOrder *order_a = a;
+  const PhaseOrder *order_b = b;
+
+  if (order_a->offset != order_b->offset)
+    return order_a->offset < order_b->offset ? -1 : 1;
+
+  return g_strcmp0 (order_a->name, order_b->name);
+}
+
+/* Sorts all the phases found in @runs by their average offset */
+static GArray *
+collect_phases (GArray *runs)
+{
+  g_autoptr(GHashTable) offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr(GHashTable) counts = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (int i = 0; i < runs->len; i++)
+    {
+      const StartupRun *run = &g_array_index (runs, StartupRun, i);
+
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init (&iter, run->phases);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          const StartupPhase *phase = value;
+          gint64 *offset = g_hash_table_lookup (offsets, key);
+
+          if (offset == NULL)
+            {
+              offset = g_new0 (gint64, 1);
+              g_hash_table_insert (offsets, key, offset);
+            }
+
+          *offset += phase->offset;
+
+          guint count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, key));
+          g_hash_table_insert (counts, key, GUINT_TO_POINTER (count + 1));
+        }
+    }
+
+  GArray *res = g_array_new (FALSE, FALSE, sizeof (PhaseOrder));
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init (&iter, offsets);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      guint count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, key));
+      gint64 *offset = value;
+
+      g_array_append_vals (res,
+                           &(PhaseOrder) {
+                             .name = key,
+                             .offset = *offset / (double) count,
+                           }, 1);
+
+      g_free (offset);
+    }
+
+  g_array_sort (res, phase_order_compare);
+
+  return res;
+}
+
+static void
+print_phase (const char   *name,
+             const GArray *runs)
+{
+  const StartupPhase *first = NULL, *last = NULL;
+
+  eos_profile_util_print_message ("PHASE", EOS_PRINT_COLOR_GREEN, "%s", name);
+
+  for (int i = 0; i < runs->len; i++)
+    {
+      const StartupRun *run = &g_array_index (runs, StartupRun, i);
+      const StartupPhase *phase = g_hash_table_lookup (run->phases, name);
+      g_autofree char *label = NULL;
+
+      if (runs->len > 1)
+        label = g_strdup_printf ("run %d: ", i + 1);
+      else
+        label = g_strdup ("");
+
+      if (phase == NULL)
+        {
+          eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                          "  ┕━ • %smissing",
+                                          label);
+          continue;
+        }
+
+      if (first == NULL)
+        first = phase;
+      last = phase;
+
+      if (phase->duration == 0)
+        eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                        "  ┕━ • %sat %.1f ms",
+                                        label,
+                                        phase->offset / 1000.0);
+      else
+        eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                        "  ┕━ • %sat %.1f ms, took %.1f ms",
+                                        label,
+                                        phase->offset / 1000.0,
+                                        phase->duration / 1000.0);
+    }
+
+  if (runs->len < 2 || first == NULL || first == last)
+    return;
+
+  /* Marks are compared by their offset, spans by their duration */
+  gint64 before = first->duration != 0 ? first->duration : first->offset;
+  gint64 after = last->duration != 0 ? last->duration : last->offset;
+  gint64 delta = after - before;
+  double ratio = before != 0 ? delta / (double) before : 0.0;
+
+  if (ratio > REGRESSION_THRESHOLD)
+    eos_profile_util_print_message ("SLOWER", EOS_PRINT_COLOR_RED,
+                                    "%+.1f ms (%+.1f%%)",
+                                    delta / 1000.0, ratio * 100.0);
+  else if (ratio < -REGRESSION_THRESHOLD)
+    eos_profile_util_print_message ("FASTER", EOS_PRINT_COLOR_GREEN,
+                                    "%+.1f ms (%+.1f%%)",
+                                    delta / 1000.0, ratio * 100.0);
+  else
+    eos_profile_util_print_message (NULL, EOS_PRINT_COLOR_NONE,
+                                    "     %+.1f ms (%+.1f%%)",
+                                    delta / 1000.0, ratio * 100.0);
+}
+
+int
+eos_profile_cmd_startup_main (void)
+{
+  g_assert (opt_files != NULL);
+
+  g_autoptr(GArray) runs = g_array_new (FALSE, TRUE, sizeof (StartupRun));
+  g_array_set_clear_func (runs, startup_run_clear);
+
+  for (int i = 0; opt_files[i] != NULL; i++)
+    {
+      StartupRun run = { NULL, };
+
+      if (!load_startup_run (opt_files[i], &run))
+        return EXIT_FAILURE;
+
+      g_array_append_val (runs, run);
+
+      if (g_strv_length (opt_files) > 1)
+        eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                        "Run %d: '%s'",
+                                        i + 1,
+                                        opt_files[i]);
+      else
+        eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                        "Startup timeline from '%s'",
+                                        opt_files[i]);
+    }
+
+  g_autoptr(GArray) phases = collect_phases (runs);
+
+  for (int i = 0; i < phases->len; i++)
+    {
+      const PhaseOrder *order = &g_array_index (phases, PhaseOrder, i);
+
+      print_phase (order->name, runs);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,537 @@
+#include "config.h"
+
+#include "eos-profile-cmds.h"
+#include "eos-profile-session.h"
+#include "eos-profile-utils.h"
+
+#include "endless/eosprofile-private.h"
+#include "endless/gvdb/gvdb-reader.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_INTERVAL        1.0
+#define DEFAULT_WINDOW          10.0
+
+/* The width of each statistics column, including the separator */
+#define STAT_COLUMN_WIDTH       11
+#define N_STAT_COLUMNS          5
+
+typedef enum {
+  SORT_TOTAL,
+  SORT_SELF,
+  SORT_RATE,
+  SORT_P99,
+} SortKey;
+
+static double opt_interval = DEFAULT_INTERVAL;
+static double opt_window = DEFAULT_WINDOW;
+static char *opt_sort;
+static int opt_top;
+static char *opt_target;
+
+static SortKey sort_key = SORT_TOTAL;
+
+static GOptionEntry opts[] = {
+  {
+    .long_name = "interval",
+    .short_name = 'i',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_DOUBLE,
+    .arg_data = &opt_interval,
+    .description = "The refresh interval, in seconds (default: 1)",
+    .arg_description = "SECONDS",
+  },
+  {
+    .long_name = "window",
+    .short_name = 'w',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_DOUBLE,
+    .arg_data = &opt_window,
+    .description = "Only consider the samples of the last SECONDS (default: 10)",
+    .arg_description = "SECONDS",
+  },
+  {
+    .long_name = "sort",
+    .short_name = 's',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_STRING,
+    .arg_data = &opt_sort,
+    .description = "Sort the probes by 'total', 'self', 'rate' or 'p99' (default: total)",
+    .arg_description = "KEY",
+  },
+  {
+    .long_name = "top",
+    .short_name = 't',
+    .flags = G_OPTION_FLAG_NONE,
+    .arg = G_OPTION_ARG_INT,
+    .arg_data = &opt_top,
+    .description = "The number of probes to show (default: as many as fit)",
+    .arg_description = "N",
+  },
+
+  { NULL, },
+};
+
+gboolean
+eos_profile_cmd_top_parse_args (int    argc,
+                                char **argv)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(GOptionContext) context = g_option_context_new (NULL);
+
+  g_option_context_set_help_enabled (context, TRUE);
+  g_option_context_add_main_entries (context, opts, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      eos_profile_util_print_error ("Invalid argument: %s", error->message);
+      return FALSE;
+    }
+
+  if (opt_interval <= 0.0 || opt_window <= 0.0 || opt_top < 0)
+    {
+      eos_profile_util_print_error ("Invalid argument");
+      return FALSE;
+    }
+
+  if (opt_sort == NULL || g_strcmp0 (opt_sort, "total") == 0)
+    sort_key = SORT_TOTAL;
+  else if (g_strcmp0 (opt_sort, "self") == 0)
+    sort_key = SORT_SELF;
+  else if (g_strcmp0 (opt_sort, "rate") == 0)
+    sort_key = SORT_RATE;
+  else if (g_strcmp0 (opt_sort, "p99") == 0)
+    sort_key = SORT_P99;
+  else
+    {
+      eos_profile_util_print_error ("Invalid sort key '%s'", opt_sort);
+      return FALSE;
+    }
+
+  if (argc < 2)
+    return FALSE;
+
+  opt_target = argv[1];
+
+  return TRUE;
+}
+
+static const double
+scale_val (double val)
+{
+  if (val >= G_USEC_PER_SEC)
+    return val / G_USEC_PER_SEC;
+
+  if (val >= 1000)
+    return val / 1000.0;
+
+  return val;
+}
+
+static const char *
+unit_for (double val)
+{
+  enum {
+    SECONDS,
+    MILLISECONDS,
+    MICROSECONDS
+  };
+
+  const char *units[] = {
+    [SECONDS] = "s",
+    [MILLISECONDS] = "ms",
+    [MICROSECONDS] = "µs",
+  };
+
+  if (val >= G_USEC_PER_SEC)
+    return units[SECONDS];
+
+  if (val >= 1000)
+    return units[MILLISECONDS];
+
+  return units[MICROSECONDS];
+}
+
+typedef struct {
+  char *name;
+
+  /* a(xx) */
+  GVariant *samples;
+
+  guint n_samples;
+  gint64 total;
+  gint64 children_total;
+  gint64 self;
+  gint64 p99;
+  double rate;
+} TopProbe;
+
+static void
+top_probe_clear (gpointer data)
+{
+  TopProbe *probe = data;
+
+  g_free (probe->name);
+  g_clear_pointer (&probe->samples, g_variant_unref);
+}
+
+static gboolean
+collect_probe (const char *probe_name,
+               const char *function,
+               const char *file,
+               gint32      line,
+               gint32      n_samples,
+               GVariant   *samples,
+               gpointer    user_data)
+{
+  GArray *probes = user_data;
+
+  g_array_append_vals (probes,
+                       &(TopProbe) {
+                         .name = g_strdup (probe_name),
+                         .samples = g_variant_ref (samples),
+                       }, 1);
+
+  return TRUE;
+}
+
+static int
+duration_compare (gconstpointer a,
+                  gconstpointer b)
+{
+  gint64 duration_a = *(const gint64 *) a;
+  gint64 duration_b = *(const gint64 *) b;
+
+  if (duration_a < duration_b)
+    return -1;
+
+  if (duration_a > duration_b)
+    return 1;
+
+  return 0;
+}
+
+/* Computes the statistics of the samples ending inside the window */
+static void
+top_probe_compute (TopProbe *probe,
+                   gint64    window_start,
+                   gint64    window_size)
+{
+  g_autoptr(GArray) durations = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  GVariantIter iter;
+  gint64 start_time, end_time;
+  g_variant_iter_init (&iter, probe->samples);
+  while (g_variant_iter_next (&iter, "(xx)", &start_time, &end_time))
+    {
+      if (end_time < window_start || end_time < start_time)
+        continue;
+
+      gint64 duration = end_time - start_time;
+      g_array_append_val (durations, duration);
+
+      probe->total += duration;
+    }
+
+  probe->n_samples = durations->len;
+  probe->rate = durations->len / ((double) window_size / G_USEC_PER_SEC);
+
+  if (durations->len == 0)
+    return;
+
+  g_array_sort (durations, duration_compare);
+
+  guint idx = (guint) ceil (durations->len * 0.99) - 1;
+  probe->p99 = g_array_index (durations, gint64, MIN (idx, durations->len - 1));
+}
+
+/* The time of a probe not spent inside the nearest probes nested under
+ * it, using the name hierarchy
+ */
+static void
+compute_self_times (GArray *probes)
+{
+  g_autoptr(GHashTable) by_name = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (int i = 0; i < probes->len; i++)
+    {
+      TopProbe *probe = &g_array_index (probes, TopProbe, i);
+
+      g_hash_table_insert (by_name, probe->name, probe);
+    }
+
+  for (int i = 0; i < probes->len; i++)
+    {
+      TopProbe *probe = &g_array_index (probes, TopProbe, i);
+      g_autofree char *parent_name = g_strdup (probe->name);
+
+      char *slash;
+      while ((slash = strrchr (parent_name, '/')) != NULL && slash != parent_name)
+        {
+          *slash = '\0';
+
+          TopProbe *parent = g_hash_table_lookup (by_name, parent_name);
+          if (parent != NULL)
+            {
+              parent->children_total += probe->total;
+              break;
+            }
+        }
+    }
+
+  for (int i = 0; i < probes->len; i++)
+    {
+      TopProbe *probe = &g_array_index (probes, TopProbe, i);
+
+      probe->self = MAX (probe->total - probe->children_total, 0);
+    }
+}
+
+static int
+top_probe_compare (gconstpointer a,
+                   gconstpointer b)
+{
+  const TopProbe *probe_a = a;
+  const TopProbe *probe_b = b;
+  double value_a = 0, value_b = 0;
+
+  switch (sort_key)
+    {
+    case SORT_TOTAL:
+      value_a = probe_a->total;
+      value_b = probe_b->total;
+      break;
+
+    case SORT_SELF:
+      value_a = probe_a->self;
+      value_b = probe_b->self;
+      break;
+
+    case SORT_RATE:
+      value_a = probe_a->rate;
+      value_b = probe_b->rate;
+      break;
+
+    case SORT_P99:
+      value_a = probe_a->p99;
+      value_b = probe_b->p99;
+      break;
+    }
+
+  if (value_a != value_b)
+    return value_a > value_b ? -1 : 1;
+
+  return g_strcmp0 (probe_a->name, probe_b->name);
+}
+
+static char *
+format_duration (gint64 duration)
+{
+  return g_strdup_printf ("%.1f %s", scale_val (duration), unit_for (duration));
+}
+
+static void
+print_row (const char *name,
+           int         name_width,
+           const char *calls,
+           const char *rate,
+           const char *total,
+           const char *self,
+           const char *p99)
+{
+  g_autofree char *truncated = eos_profile_util_truncate_name (name, name_width);
+
+  g_print ("%-*s%*s%*s%*s%*s%*s\n",
+           name_width, truncated,
+           STAT_COLUMN_WIDTH, calls,
+           STAT_COLUMN_WIDTH, rate,
+           STAT_COLUMN_WIDTH, total,
+           STAT_COLUMN_WIDTH, self,
+           STAT_COLUMN_WIDTH, p99);
+}
+
+static char *capture_file;
+static gboolean is_terminal;
+
+/* Returns FALSE if the capture cannot be used */
+static gboolean
+refresh_view (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  if (is_terminal)
+    g_print ("\033[H\033[2J");
+
+  g_autoptr(GDateTime) now = g_date_time_new_now_local ();
+  g_autofree char *now_str = g_date_time_format (now, "%T");
+
+  GvdbTable *db = eos_profile_session_open (capture_file, &error);
+  if (db == NULL)
+    {
+      /* The capture is replaced atomically, so it's either not there yet,
+       * or the process has not written its first snapshot
+       */
+      eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                      "%s: waiting for '%s' (%s)",
+                                      now_str,
+                                      capture_file,
+                                      error->message);
+      return TRUE;
+    }
+
+  if (!eos_profile_session_check_version (db, capture_file, &error))
+    {
+      eos_profile_util_print_error ("%s\n", error->message);
+      gvdb_table_free (db);
+      return FALSE;
+    }
+
+  g_autoptr(GArray) probes = g_array_new (FALSE, TRUE, sizeof (TopProbe));
+  g_array_set_clear_func (probes, top_probe_clear);
+
+  eos_profile_util_foreach_probe_v1 (db, collect_probe, probes);
+
+  gvdb_table_free (db);
+
+  /* The window ends with the most recent sample, as the clock of the
+   * process is only meaningful on the same boot
+   */
+  gint64 window_end = G_MININT64;
+  for (int i = 0; i < probes->len; i++)
+    {
+      const TopProbe *probe = &g_array_index (probes, TopProbe, i);
+
+      GVariantIter iter;
+      gint64 start_time, end_time;
+      g_variant_iter_init (&iter, probe->samples);
+      while (g_variant_iter_next (&iter, "(xx)", &start_time, &end_time))
+        window_end = MAX (window_end, end_time);
+    }
+
+  if (window_end == G_MININT64)
+    window_end = 0;
+
+  gint64 window_size = (gint64) (opt_window * G_USEC_PER_SEC);
+
+  for (int i = 0; i < probes->len; i++)
+    top_probe_compute (&g_array_index (probes, TopProbe, i),
+                       window_end - window_size,
+                       window_size);
+
+  compute_self_times (probes);
+
+  g_array_sort (probes, top_probe_compare);
+
+  eos_profile_util_print_message ("INFO", EOS_PRINT_COLOR_BLUE,
+                                  "%s: %u probes in '%s', last %g s",
+                                  now_str,
+                                  probes->len,
+                                  capture_file,
+                                  opt_window);
+
+  int width = eos_profile_util_get_terminal_width ();
+  int name_width = MAX (width - STAT_COLUMN_WIDTH * N_STAT_COLUMNS, 16);
+
+  print_row ("PROBE", name_width, "CALLS", "RATE", "TOTAL", "SELF", "P99");
+
+  int max_rows = opt_top;
+  if (max_rows == 0)
+    {
+      int height = eos_profile_util_get_terminal_height ();
+
+      /* Leave room for the header and the prompt */
+      max_rows = height > 3 ? height - 3 : G_MAXINT;
+    }
+
+  for (int i = 0, rows = 0; i < probes->len && rows < max_rows; i++)
+    {
+      const TopProbe *probe = &g_array_index (probes, TopProbe, i);
+
+      if (probe->n_samples == 0)
+        continue;
+
+      g_autofree char *calls = g_strdup_printf ("%u", probe->n_samples);
+      g_autofree char *rate = g_strdup_printf ("%.1f/s", probe->rate);
+      g_autofree char *total = format_duration (probe->total);
+      g_autofree char *self = format_duration (probe->self);
+      g_autofree char *p99 = format_duration (probe->p99);
+
+      print_row (probe->name, name_width, calls, rate, total, self, p99);
+
+      rows += 1;
+    }
+
+  return TRUE;
+}
+
+static GMainLoop *main_loop;
+static int exit_status = EXIT_SUCCESS;
+
+static gboolean
+on_refresh_timeout (gpointer data)
+{
+  if (!refresh_view ())
+    {
+      exit_status = EXIT_FAILURE;
+      g_main_loop_quit (main_loop);
+      return G_SOURCE_REMOVE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* The target can be a capture file, a session, or the ID of a process
+ * whose capture is part of a session
+ */
+static char *
+resolve_target (const char *target)
+{
+  if (g_file_test (target, G_FILE_TEST_EXISTS))
+    return g_strdup (target);
+
+  char *end = NULL;
+  guint64 pid = g_ascii_strtoull (target, &end, 10);
+
+  if (end != target && *end == '\0' && pid > 0 && pid <= G_MAXINT)
+    return eos_profile_session_find_process ((int) pid);
+
+  return eos_profile_session_find (target);
+}
+
+int
+eos_profile_cmd_top_main (void)
+{
+  g_assert (opt_target != NULL);
+
+  capture_file = resolve_target (opt_target);
+  if (capture_file == NULL)
+    {
+      eos_profile_util_print_error ("No capture found for '%s'; the process must "
+                                    "run with EOS_PROFILE=live",
+                                    opt_target);
+      return EXIT_FAILURE;
+    }
+
+  is_terminal = isatty (STDOUT_FILENO);
+
+  /* Print a single report when not attached to a terminal */
+  if (!is_terminal)
+    return refresh_view () ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  if (!refresh_view ())
+    return EXIT_FAILURE;
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+  g_timeout_add ((guint) (opt_interval * 1000), on_refresh_timeout, NULL);
+
+  g_main_loop_run (main_loop);
+
+  g_clear_pointer (&main_loop, g_main_loop_unref);
+  g_clear_pointer (&capture_file, g_free);
+
+  return exit_status;
+}
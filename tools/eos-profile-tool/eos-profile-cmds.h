@@ -29,5 +29,26 @@ int             eos_profile_cmd_convert_main            (void);
 gboolean        eos_profile_cmd_diff_parse_args         (int argc, char **argv);
 int             eos_profile_cmd_diff_main               (void);
 
+gboolean        eos_profile_cmd_samples_parse_args      (int argc, char **argv);
+int             eos_profile_cmd_samples_main            (void);
+
+gboolean        eos_profile_cmd_startup_parse_args      (int argc, char **argv);
+int             eos_profile_cmd_startup_main            (void);
+
+gboolean        eos_profile_cmd_census_parse_args       (int argc, char **argv);
+int             eos_profile_cmd_census_main             (void);
+
+gboolean        eos_profile_cmd_merge_parse_args        (int argc, char **argv);
+int             eos_profile_cmd_merge_main              (void);
+
+gboolean        eos_profile_cmd_compact_parse_args      (int argc, char **argv);
+int             eos_profile_cmd_compact_main            (void);
+
+gboolean        eos_profile_cmd_top_parse_args          (int argc, char **argv);
+int             eos_profile_cmd_top_main                (void);
+
+gboolean        eos_profile_cmd_history_parse_args      (int argc, char **argv);
+int             eos_profile_cmd_history_main            (void);
+
 void            eos_profile_foreach_cmd         (EosProfileCmdCallback cb,
                                                  gpointer              data);
@@ -20,8 +20,8 @@ static const EosProfileCmd profile_commands[] = {
   },
   {
     .name = "show",
-    .description = "Prints a report from a capture file",
-    .usage = "show <FILE> [FILE…]",
+    .description = "Prints a report from a capture file or session",
+    .usage = "show [OPTIONS…] <FILE|SESSION> [FILE…]",
     .parse_args = eos_profile_cmd_show_parse_args,
     .main = eos_profile_cmd_show_main,
   },
@@ -34,11 +34,60 @@ static const EosProfileCmd profile_commands[] = {
   },
   {
     .name = "diff",
-    .description = "Compares FILES",
+    .description = "Compares FILES; each session is compared as a whole",
     .usage = "diff [OPTIONS…] <FILES>",
     .parse_args = eos_profile_cmd_diff_parse_args,
     .main = eos_profile_cmd_diff_main,
   },
+  {
+    .name = "samples",
+    .description = "Prints a report of the stack samples in a capture file",
+    .usage = "samples [OPTIONS…] <FILE>",
+    .parse_args = eos_profile_cmd_samples_parse_args,
+    .main = eos_profile_cmd_samples_main,
+  },
+  {
+    .name = "startup",
+    .description = "Prints the startup timeline of FILES, and compares them",
+    .usage = "startup <FILE> [FILE…]",
+    .parse_args = eos_profile_cmd_startup_parse_args,
+    .main = eos_profile_cmd_startup_main,
+  },
+  {
+    .name = "census",
+    .description = "Lists the types whose instances grew in a capture file",
+    .usage = "census [OPTIONS…] <FILE>",
+    .parse_args = eos_profile_cmd_census_parse_args,
+    .main = eos_profile_cmd_census_main,
+  },
+  {
+    .name = "merge",
+    .description = "Merges capture files and sessions into a single capture file",
+    .usage = "merge --output=<FILE> <FILES>",
+    .parse_args = eos_profile_cmd_merge_parse_args,
+    .main = eos_profile_cmd_merge_main,
+  },
+  {
+    .name = "compact",
+    .description = "Turns the snapshots of a live capture file into a single capture",
+    .usage = "compact [--output=<FILE>] <FILE>",
+    .parse_args = eos_profile_cmd_compact_parse_args,
+    .main = eos_profile_cmd_compact_main,
+  },
+  {
+    .name = "top",
+    .description = "Shows the probes of a running process",
+    .usage = "top [OPTIONS…] <PID|SESSION|FILE>",
+    .parse_args = eos_profile_cmd_top_parse_args,
+    .main = eos_profile_cmd_top_main,
+  },
+  {
+    .name = "history",
+    .description = "Records probe results across builds and shows their trends",
+    .usage = "history add --build=<ID> [OPTIONS…] <FILES> | history show [OPTIONS…]",
+    .parse_args = eos_profile_cmd_history_parse_args,
+    .main = eos_profile_cmd_history_main,
+  },
 };
 
 void
@@ -0,0 +1,697 @@
+#include "config.h"
+
+#include "eos-profile-session.h"
+#include "eos-profile-utils.h"
+
+#include "endless/eosprofile-private.h"
+#include "endless/gvdb/gvdb-builder.h"
+
+#include <string.h>
+
+/* Capture sessions
+ *
+ * A session is a directory holding the capture files of every process
+ * that ran with the same EOS_PROFILE_SESSION, and a manifest describing
+ * each process. Sessions can be merged into a single capture: the samples
+ * of probes with the same name are combined, while counters can only be
+ * compared within the same process, so the counters of every process
+ * except the first one to start are renamed after their process ID.
+ * Stack samples are not merged, as they can only be symbolized using the
+ * memory mappings of their own process.
+ */
+
+/**
+ * eos_profile_session_find:
+ * @path: a path, or the name of a session
+ *
+ * Checks whether @path refers to a capture session, either as a directory
+ * or as the name of a session in the user's cache directory.
+ *
+ * Returns: (transfer full) (nullable): the session directory
+ */
+char *
+eos_profile_session_find (const char *path)
+{
+  if (g_file_test (path, G_FILE_TEST_IS_DIR))
+    return g_strdup (path);
+
+  if (strchr (path, G_DIR_SEPARATOR) != NULL || g_file_test (path, G_FILE_TEST_EXISTS))
+    return NULL;
+
+  g_autofree char *session_dir = g_build_filename (g_get_user_cache_dir (),
+                                                   PROBE_SESSION_BASE_DIR,
+                                                   path,
+                                                   NULL);
+
+  if (g_file_test (session_dir, G_FILE_TEST_IS_DIR))
+    return g_steal_pointer (&session_dir);
+
+  return NULL;
+}
+
+/**
+ * eos_profile_session_find_process:
+ * @pid: a process ID
+ *
+ * Looks for the capture file of the process @pid in the sessions of the
+ * user's cache directory; if more than one process had the same ID, the
+ * most recent one is picked.
+ *
+ * Returns: (transfer full) (nullable): the path of the capture file
+ */
+char *
+eos_profile_session_find_process (int pid)
+{
+  g_autofree char *base_dir = g_build_filename (g_get_user_cache_dir (),
+                                                PROBE_SESSION_BASE_DIR,
+                                                NULL);
+
+  g_autoptr(GDir) dir = g_dir_open (base_dir, 0, NULL);
+  if (dir == NULL)
+    return NULL;
+
+  g_autofree char *group = g_strdup_printf (PROBE_SESSION_PROCESS_GROUP "%d", pid);
+  g_autofree char *res = NULL;
+  gint64 res_start_time = G_MININT64;
+
+  const char *name;
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *manifest =
+        g_build_filename (base_dir, name, PROBE_SESSION_MANIFEST, NULL);
+      g_autoptr(GKeyFile) keyfile = g_key_file_new ();
+
+      if (!g_key_file_load_from_file (keyfile, manifest, G_KEY_FILE_NONE, NULL))
+        continue;
+
+      g_autofree char *basename = g_key_file_get_string (keyfile, group, "CaptureFile", NULL);
+      if (basename == NULL || strchr (basename, G_DIR_SEPARATOR) != NULL)
+        continue;
+
+      gint64 start_time = g_key_file_get_int64 (keyfile, group, "StartTime", NULL);
+      if (start_time < res_start_time)
+        continue;
+
+      g_free (res);
+      res = g_build_filename (base_dir, name, basename, NULL);
+      res_start_time = start_time;
+    }
+
+  return g_steal_pointer (&res);
+}
+
+typedef struct {
+  char *path;
+
+  /* Monotonic time */
+  gint64 profile_start;
+} SessionCapture;
+
+static void
+session_capture_clear (gpointer data)
+{
+  SessionCapture *capture = data;
+
+  g_free (capture->path);
+}
+
+static int
+session_capture_compare (gconstpointer a,
+                         gconstpointer b)
+{
+  const SessionCapture *capture_a = a;
+  const SessionCapture *capture_b = b;
+
+  if (capture_a->profile_start != capture_b->profile_start)
+    return capture_a->profile_start < capture_b->profile_start ? -1 : 1;
+
+  return g_strcmp0 (capture_a->path, capture_b->path);
+}
+
+/**
+ * eos_profile_session_list_captures:
+ * @session_dir: the directory of a session
+ * @error: return location for a #GError
+ *
+ * Lists the capture files of @session_dir, in the order in which their
+ * processes started; sessions without a manifest are listed by name.
+ *
+ * Returns: (transfer full): the paths of the capture files
+ */
+char **
+eos_profile_session_list_captures (const char  *session_dir,
+                                   GError     **error)
+{
+  g_autoptr(GArray) captures = g_array_new (FALSE, FALSE, sizeof (SessionCapture));
+  g_array_set_clear_func (captures, session_capture_clear);
+
+  g_autofree char *manifest = g_build_filename (session_dir, PROBE_SESSION_MANIFEST, NULL);
+  g_autoptr(GKeyFile) keyfile = g_key_file_new ();
+
+  if (g_key_file_load_from_file (keyfile, manifest, G_KEY_FILE_NONE, NULL))
+    {
+      g_auto(GStrv) groups = g_key_file_get_groups (keyfile, NULL);
+
+      for (int i = 0; groups[i] != NULL; i++)
+        {
+          if (!g_str_has_prefix (groups[i], PROBE_SESSION_PROCESS_GROUP))
+            continue;
+
+          g_autofree char *basename =
+            g_key_file_get_string (keyfile, groups[i], "CaptureFile", NULL);
+
+          if (basename == NULL || strchr (basename, G_DIR_SEPARATOR) != NULL)
+            continue;
+
+          g_autofree char *path = g_build_filename (session_dir, basename, NULL);
+
+          /* The capture may have been removed after the manifest was written */
+          if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
+            continue;
+
+          g_array_append_vals (captures,
+                               &(SessionCapture) {
+                                 .path = g_steal_pointer (&path),
+                                 .profile_start = g_key_file_get_int64 (keyfile, groups[i],
+                                                                        "ProfileStart",
+                                                                        NULL),
+                               }, 1);
+        }
+    }
+  else
+    {
+      g_autoptr(GDir) dir = g_dir_open (session_dir, 0, error);
+      if (dir == NULL)
+        return NULL;
+
+      const char *name;
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          if (!g_str_has_suffix (name, ".db"))
+            continue;
+
+          g_array_append_vals (captures,
+                               &(SessionCapture) {
+                                 .path = g_build_filename (session_dir, name, NULL),
+                                 .profile_start = 0,
+                               }, 1);
+        }
+    }
+
+  if (captures->len == 0)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                   "No capture files in session '%s'",
+                   session_dir);
+      return NULL;
+    }
+
+  g_array_sort (captures, session_capture_compare);
+
+  char **res = g_new0 (char *, captures->len + 1);
+  for (int i = 0; i < captures->len; i++)
+    res[i] = g_steal_pointer (&g_array_index (captures, SessionCapture, i).path);
+
+  return res;
+}
+
+/**
+ * eos_profile_session_expand:
+ * @paths: a %NULL-terminated list of capture files and sessions
+ * @error: return location for a #GError
+ *
+ * Replaces every session in @paths with its capture files.
+ *
+ * Returns: (transfer full): the paths of the capture files
+ */
+char **
+eos_profile_session_expand (char   **paths,
+                            GError **error)
+{
+  g_autoptr(GPtrArray) res = g_ptr_array_new_with_free_func (g_free);
+
+  for (int i = 0; paths[i] != NULL; i++)
+    {
+      g_autofree char *session_dir = eos_profile_session_find (paths[i]);
+
+      if (session_dir == NULL)
+        {
+          g_ptr_array_add (res, g_strdup (paths[i]));
+          continue;
+        }
+
+      g_auto(GStrv) captures = eos_profile_session_list_captures (session_dir, error);
+      if (captures == NULL)
+        return NULL;
+
+      for (int j = 0; captures[j] != NULL; j++)
+        g_ptr_array_add (res, g_steal_pointer (&captures[j]));
+    }
+
+  g_ptr_array_add (res, NULL);
+
+  return (char **) g_ptr_array_free (g_steal_pointer (&res), FALSE);
+}
+
+typedef struct {
+  char *function;
+  char *file;
+  guint32 line;
+
+  /* element-type ProfileSample */
+  GArray *samples;
+} MergedProbe;
+
+static void
+merged_probe_free (gpointer data)
+{
+  MergedProbe *probe = data;
+
+  g_free (probe->function);
+  g_free (probe->file);
+  g_array_unref (probe->samples);
+  g_free (probe);
+}
+
+typedef struct {
+  /* element-type (key utf8) (value MergedProbe) */
+  GHashTable *probes;
+
+  /* element-type (key utf8) (value GArray<ProfileCounterSample>) */
+  GHashTable *counters;
+
+  /* Appended to the names of the counters; NULL for the first process */
+  const char *counter_suffix;
+} MergeClosure;
+
+static gboolean
+merge_probe (const char *probe_name,
+             const char *function,
+             const char *file,
+             gint32      line,
+             gint32      n_samples,
+             GVariant   *samples,
+             gpointer    user_data)
+{
+  MergeClosure *clos = user_data;
+
+  MergedProbe *probe = g_hash_table_lookup (clos->probes, probe_name);
+  if (probe == NULL)
+    {
+      probe = g_new0 (MergedProbe, 1);
+      probe->function = g_strdup (function);
+      probe->file = g_strdup (file);
+      probe->line = line;
+      probe->samples = g_array_new (FALSE, FALSE, sizeof (ProfileSample));
+
+      g_hash_table_insert (clos->probes, g_strdup (probe_name), probe);
+    }
+
+  GVariantIter iter;
+  gint64 start_time, end_time;
+  g_variant_iter_init (&iter, samples);
+  while (g_variant_iter_next (&iter, "(xx)", &start_time, &end_time))
+    {
+      g_array_append_vals (probe->samples,
+                           &(ProfileSample) {
+                             .start_time = start_time,
+                             .end_time = end_time,
+                           }, 1);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+merge_counter (const char *counter_name,
+               GVariant   *samples,
+               gpointer    user_data)
+{
+  MergeClosure *clos = user_data;
+  g_autofree char *name = g_strconcat (counter_name, clos->counter_suffix, NULL);
+
+  GArray *values = g_hash_table_lookup (clos->counters, name);
+  if (values == NULL)
+    {
+      values = g_array_new (FALSE, FALSE, sizeof (ProfileCounterSample));
+      g_hash_table_insert (clos->counters, g_steal_pointer (&name), values);
+    }
+
+  GVariantIter iter;
+  gint64 time, value;
+  g_variant_iter_init (&iter, samples);
+  while (g_variant_iter_next (&iter, "(xx)", &time, &value))
+    {
+      g_array_append_vals (values,
+                           &(ProfileCounterSample) {
+                             .time = time,
+                             .value = value,
+                           }, 1);
+    }
+
+  return TRUE;
+}
+
+static int
+sample_compare (gconstpointer a,
+                gconstpointer b)
+{
+  const ProfileSample *sample_a = a;
+  const ProfileSample *sample_b = b;
+
+  gint64 delta_a = sample_a->end_time - sample_a->start_time;
+  gint64 delta_b = sample_b->end_time - sample_b->start_time;
+
+  if (delta_a < delta_b)
+    return -1;
+
+  if (delta_a > delta_b)
+    return 1;
+
+  return 0;
+}
+
+static int
+counter_sample_compare (gconstpointer a,
+                        gconstpointer b)
+{
+  const ProfileCounterSample *sample_a = a;
+  const ProfileCounterSample *sample_b = b;
+
+  if (sample_a->time < sample_b->time)
+    return -1;
+
+  if (sample_a->time > sample_b->time)
+    return 1;
+
+  return 0;
+}
+
+static char *
+get_meta_string (GvdbTable  *db,
+                 const char *key)
+{
+  g_autoptr(GVariant) v = gvdb_table_get_raw_value (db, key);
+
+  if (v == NULL || !g_variant_is_of_type (v, G_VARIANT_TYPE_STRING))
+    return NULL;
+
+  return g_variant_dup_string (v, NULL);
+}
+
+static gint64
+get_meta_int64 (GvdbTable  *db,
+                const char *key)
+{
+  g_autoptr(GVariant) v = gvdb_table_get_raw_value (db, key);
+
+  if (v == NULL)
+    return -1;
+
+  if (g_variant_is_of_type (v, G_VARIANT_TYPE_INT64))
+    return g_variant_get_int64 (v);
+
+  if (g_variant_is_of_type (v, G_VARIANT_TYPE_INT32))
+    return g_variant_get_int32 (v);
+
+  return -1;
+}
+
+/**
+ * eos_profile_session_check_version:
+ * @db: a capture
+ * @path: the path of @db, for error messages
+ * @error: return location for a #GError
+ *
+ * Checks that this tool can read the probes of @db.
+ *
+ * Returns: %TRUE if the version of @db is supported
+ */
+gboolean
+eos_profile_session_check_version (GvdbTable   *db,
+                                   const char  *path,
+                                   GError     **error)
+{
+  gint64 version = get_meta_int64 (db, PROBE_DB_META_VERSION_KEY);
+
+  if (version > PROBE_DB_VERSION)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Unable to load '%s': the capture format (version %" G_GINT64_FORMAT ") "
+                   "is newer than the one supported by this tool (version %d)",
+                   path, version, PROBE_DB_VERSION);
+      return FALSE;
+    }
+
+  if (version < PROBE_DB_MIN_VERSION)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Unable to load '%s': invalid version",
+                   path);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Keeps @value only as long as every capture agrees on it */
+static void
+merge_meta_string (char       **merged,
+                   gboolean    *is_first,
+                   const char  *value)
+{
+  if (*is_first)
+    {
+      *merged = g_strdup (value);
+      *is_first = FALSE;
+    }
+  else if (g_strcmp0 (*merged, value) != 0)
+    {
+      g_clear_pointer (merged, g_free);
+    }
+}
+
+/**
+ * eos_profile_session_merge:
+ * @files: a %NULL-terminated list of capture files, the first one being
+ *   the main process
+ * @error: return location for a #GError
+ *
+ * Merges the probes and counters of @files into a single capture.
+ *
+ * Returns: (transfer full): the GVDB table of the merged capture
+ */
+GHashTable *
+eos_profile_session_merge (char   **files,
+                           GError **error)
+{
+  g_autoptr(GHashTable) probes =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, merged_probe_free);
+  g_autoptr(GHashTable) counters =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+
+  g_autofree char *app_id = NULL;
+  g_autofree char *session = NULL;
+  g_autofree char *boot_id = NULL;
+  gboolean first_session = TRUE, first_boot_id = TRUE;
+  gint64 start_time = G_MAXINT64;
+  gint64 profile_time = 0;
+
+  for (int i = 0; files[i] != NULL; i++)
+    {
+      GvdbTable *db = gvdb_table_new (files[i], TRUE, error);
+      if (db == NULL)
+        return NULL;
+
+      if (!eos_profile_session_check_version (db, files[i], error))
+        {
+          gvdb_table_free (db);
+          return NULL;
+        }
+
+      if (app_id == NULL)
+        app_id = get_meta_string (db, PROBE_DB_META_APPID_KEY);
+
+      g_autofree char *file_session = get_meta_string (db, PROBE_DB_META_SESSION_KEY);
+      merge_meta_string (&session, &first_session, file_session);
+
+      g_autofree char *file_boot_id = get_meta_string (db, PROBE_DB_META_BOOT_ID_KEY);
+      if (!first_boot_id && g_strcmp0 (boot_id, file_boot_id) != 0)
+        eos_profile_util_print_warning ("'%s' was captured during a different boot; "
+                                        "its times cannot be compared with the others",
+                                        files[i]);
+      merge_meta_string (&boot_id, &first_boot_id, file_boot_id);
+
+      gint64 file_start_time = get_meta_int64 (db, PROBE_DB_META_START_KEY);
+      if (file_start_time >= 0)
+        start_time = MIN (start_time, file_start_time);
+
+      profile_time = MAX (profile_time, get_meta_int64 (db, PROBE_DB_META_PROFILE_KEY));
+
+      g_autofree char *counter_suffix = NULL;
+      if (i > 0)
+        {
+          gint64 pid = get_meta_int64 (db, PROBE_DB_META_PID_KEY);
+
+          if (pid > 0)
+            counter_suffix = g_strdup_printf ("@%" G_GINT64_FORMAT, pid);
+          else
+            counter_suffix = g_strdup_printf ("@%d", i);
+        }
+
+      MergeClosure clos = {
+        .probes = probes,
+        .counters = counters,
+        .counter_suffix = counter_suffix,
+      };
+
+      /* The samples of the segments appended by live snapshots are
+       * visited together
+       */
+      eos_profile_util_foreach_probe_v1 (db, merge_probe, &clos);
+      eos_profile_util_foreach_counter_v1 (db, merge_counter, &clos);
+
+      gvdb_table_free (db);
+    }
+
+  GHashTable *db_table = gvdb_hash_table_new (NULL, NULL);
+  GvdbItem *item;
+
+  item = eos_profile_db_insert (db_table, PROBE_DB_META_VERSION_KEY);
+  gvdb_item_set_value (item, g_variant_new_int32 (PROBE_DB_VERSION));
+
+  if (app_id != NULL)
+    {
+      item = eos_profile_db_insert (db_table, PROBE_DB_META_APPID_KEY);
+      gvdb_item_set_value (item, g_variant_new_string (app_id));
+    }
+
+  item = eos_profile_db_insert (db_table, PROBE_DB_META_START_KEY);
+  gvdb_item_set_value (item, g_variant_new_int64 (start_time != G_MAXINT64 ? start_time : 0));
+
+  item = eos_profile_db_insert (db_table, PROBE_DB_META_PROFILE_KEY);
+  gvdb_item_set_value (item, g_variant_new_int64 (profile_time));
+
+  if (session != NULL)
+    {
+      item = eos_profile_db_insert (db_table, PROBE_DB_META_SESSION_KEY);
+      gvdb_item_set_value (item, g_variant_new_string (session));
+    }
+
+  if (boot_id != NULL)
+    {
+      item = eos_profile_db_insert (db_table, PROBE_DB_META_BOOT_ID_KEY);
+      gvdb_item_set_value (item, g_variant_new_string (boot_id));
+    }
+
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, probes);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const char *name = key;
+      MergedProbe *probe = value;
+
+      /* Samples are sorted by duration, like the captures themselves */
+      g_array_sort (probe->samples, sample_compare);
+
+      GVariantBuilder builder;
+      g_variant_builder_init (&builder, G_VARIANT_TYPE (PROBE_DB_META_PROBE_TYPE));
+      g_variant_builder_add (&builder, "s", name);
+      g_variant_builder_add (&builder, "s", probe->function);
+      g_variant_builder_add (&builder, "s", probe->file);
+      g_variant_builder_add (&builder, "u", probe->line);
+      g_variant_builder_add (&builder, "u", probe->samples->len);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(xx)"));
+      for (int i = 0; i < probe->samples->len; i++)
+        {
+          const ProfileSample *sample = &g_array_index (probe->samples, ProfileSample, i);
+
+          g_variant_builder_add (&builder, "(xx)", sample->start_time, sample->end_time);
+        }
+      g_variant_builder_close (&builder);
+
+      item = eos_profile_db_insert (db_table, name);
+      gvdb_item_set_value (item, g_variant_builder_end (&builder));
+    }
+
+  g_hash_table_iter_init (&iter, counters);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const char *name = key;
+      GArray *samples = value;
+
+      g_array_sort (samples, counter_sample_compare);
+
+      GVariantBuilder builder;
+      g_variant_builder_init (&builder, G_VARIANT_TYPE (PROBE_DB_META_COUNTER_TYPE));
+      g_variant_builder_add (&builder, "s", name);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(xx)"));
+      for (int i = 0; i < samples->len; i++)
+        {
+          const ProfileCounterSample *sample = &g_array_index (samples, ProfileCounterSample, i);
+
+          g_variant_builder_add (&builder, "(xx)", sample->time, sample->value);
+        }
+      g_variant_builder_close (&builder);
+
+      item = eos_profile_db_insert (db_table, name);
+      gvdb_item_set_value (item, g_variant_builder_end (&builder));
+    }
+
+  return db_table;
+}
+
+/**
+ * eos_profile_session_open:
+ * @path: a capture file, or a session
+ * @error: return location for a #GError
+ *
+ * Opens a capture file; sessions are merged into a single capture.
+ *
+ * Returns: (transfer full) (nullable): the capture
+ */
+GvdbTable *
+eos_profile_session_open (const char  *path,
+                          GError     **error)
+{
+  g_autofree char *session_dir = eos_profile_session_find (path);
+
+  if (session_dir == NULL)
+    return eos_profile_session_open_capture (path, error);
+
+  g_auto(GStrv) files = eos_profile_session_list_captures (session_dir, error);
+  if (files == NULL)
+    return NULL;
+
+  g_autoptr(GHashTable) db_table = eos_profile_session_merge (files, error);
+  if (db_table == NULL)
+    return NULL;
+
+  g_autoptr(GBytes) bytes = gvdb_table_write_bytes (db_table, FALSE);
+
+  return gvdb_table_new_from_bytes (bytes, TRUE, error);
+}
+
+/**
+ * eos_profile_session_open_capture:
+ * @path: a capture file
+ * @error: return location for a #GError
+ *
+ * Opens a capture file. The file is mapped as it is: the metadata is
+ * read from the newest snapshot of a live capture, and the
+ * eos_profile_util_foreach_probe_v1() and
+ * eos_profile_util_foreach_counter_v1() functions visit the samples of
+ * every snapshot.
+ *
+ * Returns: (transfer full) (nullable): the capture
+ */
+GvdbTable *
+eos_profile_session_open_capture (const char  *path,
+                                  GError     **error)
+{
+  return gvdb_table_new (path, TRUE, error);
+}
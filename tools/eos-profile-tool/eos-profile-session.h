@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glib.h>
+
+#include "endless/gvdb/gvdb-reader.h"
+
+char *          eos_profile_session_find                (const char  *path);
+
+char *          eos_profile_session_find_process        (int          pid);
+
+char **         eos_profile_session_list_captures       (const char  *session_dir,
+                                                         GError     **error);
+
+char **         eos_profile_session_expand              (char       **paths,
+                                                         GError     **error);
+
+gboolean        eos_profile_session_check_version       (GvdbTable   *db,
+                                                         const char  *path,
+                                                         GError     **error);
+
+GHashTable *    eos_profile_session_merge               (char       **files,
+                                                         GError     **error);
+
+GvdbTable *     eos_profile_session_open                (const char  *path,
+                                                         GError     **error);
+
+GvdbTable *     eos_profile_session_open_capture        (const char  *path,
+                                                         GError     **error);
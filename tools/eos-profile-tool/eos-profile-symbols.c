@@ -0,0 +1,392 @@
+#include "config.h"
+
+#include "eos-profile-symbols.h"
+
+#include <link.h>
+#include <string.h>
+
+/* A minimal ELF symbolizer
+ *
+ * Stack samples store the raw return addresses, alongside the list of
+ * executable mappings of the process at the time the capture was written;
+ * we map each address back to the file offset inside the ELF object, and
+ * then to the virtual address used by the symbol tables of the object.
+ *
+ * We only support ELF objects of the same class as the tool, and we only
+ * look at the .symtab section, falling back to .dynsym for stripped objects.
+ */
+
+#if __ELF_NATIVE_CLASS == 64
+# define NATIVE_ELF_CLASS       ELFCLASS64
+#else
+# define NATIVE_ELF_CLASS       ELFCLASS32
+#endif
+
+typedef struct {
+  guint64 address;
+  guint64 size;
+  const char *name;
+} ElfSymbol;
+
+typedef struct {
+  guint64 offset;
+  guint64 size;
+  guint64 address;
+} ElfSegment;
+
+typedef struct {
+  char *basename;
+  GMappedFile *file;
+
+  /* element-type ElfSegment */
+  GArray *segments;
+  /* element-type ElfSymbol, sorted by address */
+  GArray *symbols;
+} ElfImage;
+
+typedef struct {
+  guint64 start;
+  guint64 end;
+  guint64 offset;
+
+  ElfImage *image;
+} Mapping;
+
+struct _EosProfileSymbolizer {
+  /* element-type Mapping, sorted by start address */
+  GArray *mappings;
+
+  /* element-type (key filename) (value ElfImage) */
+  GHashTable *images;
+
+  /* element-type (key guint64) (value utf8) */
+  GHashTable *names;
+};
+
+static void
+elf_image_free (gpointer data)
+{
+  ElfImage *image = data;
+
+  g_clear_pointer (&image->symbols, g_array_unref);
+  g_clear_pointer (&image->segments, g_array_unref);
+  g_clear_pointer (&image->file, g_mapped_file_unref);
+  g_free (image->basename);
+  g_free (image);
+}
+
+static int
+elf_symbol_compare (gconstpointer a,
+                    gconstpointer b)
+{
+  const ElfSymbol *sym_a = a;
+  const ElfSymbol *sym_b = b;
+
+  if (sym_a->address < sym_b->address)
+    return -1;
+
+  if (sym_a->address > sym_b->address)
+    return 1;
+
+  return 0;
+}
+
+static gboolean
+elf_range_is_valid (gsize   file_size,
+                    guint64 offset,
+                    guint64 size)
+{
+  return offset <= file_size && size <= file_size - offset;
+}
+
+static void
+elf_image_load_symbols (ElfImage         *image,
+                        const ElfW(Ehdr) *ehdr,
+                        gsize             file_size,
+                        guint32           section_type)
+{
+  const char *data = (const char *) ehdr;
+
+  if (ehdr->e_shentsize != sizeof (ElfW(Shdr)) ||
+      !elf_range_is_valid (file_size, ehdr->e_shoff, (guint64) ehdr->e_shnum * sizeof (ElfW(Shdr))))
+    return;
+
+  const ElfW(Shdr) *sections = (const ElfW(Shdr) *) (data + ehdr->e_shoff);
+
+  for (int i = 0; i < ehdr->e_shnum; i++)
+    {
+      const ElfW(Shdr) *section = &sections[i];
+
+      if (section->sh_type != section_type)
+        continue;
+
+      if (section->sh_link >= ehdr->e_shnum ||
+          section->sh_entsize != sizeof (ElfW(Sym)) ||
+          !elf_range_is_valid (file_size, section->sh_offset, section->sh_size))
+        continue;
+
+      const ElfW(Shdr) *strtab = &sections[section->sh_link];
+      if (!elf_range_is_valid (file_size, strtab->sh_offset, strtab->sh_size) ||
+          strtab->sh_size == 0)
+        continue;
+
+      const char *strings = data + strtab->sh_offset;
+      const ElfW(Sym) *symbols = (const ElfW(Sym) *) (data + section->sh_offset);
+      gsize n_symbols = section->sh_size / sizeof (ElfW(Sym));
+
+      for (gsize j = 0; j < n_symbols; j++)
+        {
+          const ElfW(Sym) *sym = &symbols[j];
+
+          if (ELF32_ST_TYPE (sym->st_info) != STT_FUNC ||
+              sym->st_value == 0 ||
+              sym->st_name >= strtab->sh_size)
+            continue;
+
+          /* The string table must be nul-terminated */
+          if (memchr (strings + sym->st_name, '\0', strtab->sh_size - sym->st_name) == NULL)
+            continue;
+
+          g_array_append_vals (image->symbols,
+                               &(ElfSymbol) {
+                                 .address = sym->st_value,
+                                 .size = sym->st_size,
+                                 .name = strings + sym->st_name,
+                               }, 1);
+        }
+    }
+}
+
+static ElfImage *
+elf_image_new (const char *filename)
+{
+  ElfImage *image = g_new0 (ElfImage, 1);
+
+  image->basename = g_path_get_basename (filename);
+  image->segments = g_array_new (FALSE, FALSE, sizeof (ElfSegment));
+  image->symbols = g_array_new (FALSE, FALSE, sizeof (ElfSymbol));
+  image->file = g_mapped_file_new (filename, FALSE, NULL);
+
+  if (image->file == NULL)
+    return image;
+
+  gsize file_size = g_mapped_file_get_length (image->file);
+  const char *data = g_mapped_file_get_contents (image->file);
+
+  if (file_size < sizeof (ElfW(Ehdr)))
+    return image;
+
+  const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *) data;
+
+  if (memcmp (ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != NATIVE_ELF_CLASS ||
+      ehdr->e_phentsize != sizeof (ElfW(Phdr)) ||
+      !elf_range_is_valid (file_size, ehdr->e_phoff, (guint64) ehdr->e_phnum * sizeof (ElfW(Phdr))))
+    return image;
+
+  const ElfW(Phdr) *phdrs = (const ElfW(Phdr) *) (data + ehdr->e_phoff);
+  for (int i = 0; i < ehdr->e_phnum; i++)
+    {
+      if (phdrs[i].p_type != PT_LOAD)
+        continue;
+
+      g_array_append_vals (image->segments,
+                           &(ElfSegment) {
+                             .offset = phdrs[i].p_offset,
+                             .size = phdrs[i].p_filesz,
+                             .address = phdrs[i].p_vaddr,
+                           }, 1);
+    }
+
+  elf_image_load_symbols (image, ehdr, file_size, SHT_SYMTAB);
+  if (image->symbols->len == 0)
+    elf_image_load_symbols (image, ehdr, file_size, SHT_DYNSYM);
+
+  g_array_sort (image->symbols, elf_symbol_compare);
+
+  return image;
+}
+
+static const ElfSymbol *
+elf_image_find_symbol (ElfImage *image,
+                       guint64   file_offset)
+{
+  guint64 address = 0;
+  gboolean found = FALSE;
+
+  for (int i = 0; i < image->segments->len; i++)
+    {
+      const ElfSegment *segment = &g_array_index (image->segments, ElfSegment, i);
+
+      if (file_offset >= segment->offset &&
+          file_offset < segment->offset + segment->size)
+        {
+          address = file_offset - segment->offset + segment->address;
+          found = TRUE;
+          break;
+        }
+    }
+
+  if (!found || image->symbols->len == 0)
+    return NULL;
+
+  /* Find the last symbol starting at or before the address */
+  guint lo = 0, hi = image->symbols->len;
+  while (hi - lo > 1)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (g_array_index (image->symbols, ElfSymbol, mid).address <= address)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  const ElfSymbol *sym = &g_array_index (image->symbols, ElfSymbol, lo);
+
+  if (address < sym->address)
+    return NULL;
+
+  if (address >= sym->address + MAX (sym->size, 1))
+    return NULL;
+
+  return sym;
+}
+
+static int
+mapping_compare (gconstpointer a,
+                 gconstpointer b)
+{
+  const Mapping *map_a = a;
+  const Mapping *map_b = b;
+
+  if (map_a->start < map_b->start)
+    return -1;
+
+  if (map_a->start > map_b->start)
+    return 1;
+
+  return 0;
+}
+
+EosProfileSymbolizer *
+eos_profile_symbolizer_new (GVariant *modules)
+{
+  EosProfileSymbolizer *res = g_new0 (EosProfileSymbolizer, 1);
+
+  res->mappings = g_array_new (FALSE, FALSE, sizeof (Mapping));
+  res->images = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, elf_image_free);
+  res->names = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_free);
+
+  if (modules == NULL)
+    return res;
+
+  GVariantIter iter;
+  g_variant_iter_init (&iter, modules);
+
+  guint64 start, end, offset;
+  const char *path;
+  while (g_variant_iter_next (&iter, "(ttt&s)", &start, &end, &offset, &path))
+    {
+      ElfImage *image = g_hash_table_lookup (res->images, path);
+
+      if (image == NULL)
+        {
+          image = elf_image_new (path);
+          g_hash_table_insert (res->images, g_strdup (path), image);
+        }
+
+      g_array_append_vals (res->mappings,
+                           &(Mapping) {
+                             .start = start,
+                             .end = end,
+                             .offset = offset,
+                             .image = image,
+                           }, 1);
+    }
+
+  g_array_sort (res->mappings, mapping_compare);
+
+  return res;
+}
+
+void
+eos_profile_symbolizer_free (EosProfileSymbolizer *symbolizer)
+{
+  if (symbolizer == NULL)
+    return;
+
+  g_array_unref (symbolizer->mappings);
+  g_hash_table_unref (symbolizer->images);
+  g_hash_table_unref (symbolizer->names);
+
+  g_free (symbolizer);
+}
+
+static const Mapping *
+find_mapping (EosProfileSymbolizer *symbolizer,
+              guint64               address)
+{
+  guint lo = 0, hi = symbolizer->mappings->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      const Mapping *mapping = &g_array_index (symbolizer->mappings, Mapping, mid);
+
+      if (address < mapping->start)
+        hi = mid;
+      else if (address >= mapping->end)
+        lo = mid + 1;
+      else
+        return mapping;
+    }
+
+  return NULL;
+}
+
+/**
+ * eos_profile_symbolizer_lookup:
+ * @symbolizer: the symbolizer
+ * @address: an address inside the profiled process
+ *
+ * Resolves @address to the function containing it.
+ *
+ * Returns: (transfer none): a description of the function containing
+ *   @address, or its hexadecimal representation if the function could
+ *   not be resolved
+ */
+const char *
+eos_profile_symbolizer_lookup (EosProfileSymbolizer *symbolizer,
+                               guint64               address)
+{
+  const char *res = g_hash_table_lookup (symbolizer->names, &address);
+
+  if (res != NULL)
+    return res;
+
+  char *name = NULL;
+  const Mapping *mapping = find_mapping (symbolizer, address);
+
+  if (mapping != NULL)
+    {
+      const ElfSymbol *sym =
+        elf_image_find_symbol (mapping->image, address - mapping->start + mapping->offset);
+
+      if (sym != NULL)
+        name = g_strdup_printf ("%s (%s)", sym->name, mapping->image->basename);
+      else
+        name = g_strdup_printf ("0x%" G_GINT64_MODIFIER "x (%s)",
+                                address - mapping->start + mapping->offset,
+                                mapping->image->basename);
+    }
+  else
+    name = g_strdup_printf ("0x%" G_GINT64_MODIFIER "x", address);
+
+  gint64 *key = g_new (gint64, 1);
+  *key = (gint64) address;
+
+  g_hash_table_insert (symbolizer->names, key, name);
+
+  return name;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <glib.h>
+
+typedef struct _EosProfileSymbolizer EosProfileSymbolizer;
+
+EosProfileSymbolizer *  eos_profile_symbolizer_new      (GVariant             *modules);
+
+void                    eos_profile_symbolizer_free     (EosProfileSymbolizer *symbolizer);
+
+const char *            eos_profile_symbolizer_lookup   (EosProfileSymbolizer *symbolizer,
+                                                         guint64               address);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EosProfileSymbolizer, eos_profile_symbolizer_free)
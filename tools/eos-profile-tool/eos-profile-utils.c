@@ -94,51 +94,705 @@ eos_profile_util_print_warning (const char *fmt,
   g_printerr ("%s\n", msg);
 }
 
+static gboolean
+visit_probe (GVariant                *value,
+             EosProfileProbeCallback  callback,
+             gpointer                 callback_data)
+{
+  /* Captures can contain data that is not a probe, like stack samples */
+  if (!g_variant_is_of_type (value, G_VARIANT_TYPE (PROBE_DB_META_PROBE_TYPE)))
+    return TRUE;
+
+  const char *file = NULL;
+  const char *function = NULL;
+  const char *probe_name = NULL;
+  g_autoptr(GVariant) samples = NULL;
+  gint32 line, n_samples;
+
+  g_variant_get (value, "(&s&s&suu@a(xx))",
+                 &probe_name,
+                 &function,
+                 &file,
+                 &line,
+                 &n_samples,
+                 &samples);
+
+  return callback (probe_name, function, file, line, n_samples, samples, callback_data);
+}
+
+/* Concatenates the `a(xx)` samples at @index in each of @values; the
+ * samples have a fixed size, so their serialized data can be joined
+ */
+static GVariant *
+merge_segment_samples (GPtrArray *values,
+                       gsize      index)
+{
+  g_autoptr(GByteArray) data = g_byte_array_new ();
+
+  for (guint i = 0; i < values->len; i++)
+    {
+      g_autoptr(GVariant) samples = g_variant_get_child_value (values->pdata[i], index);
+
+      g_byte_array_append (data,
+                           g_variant_get_data (samples),
+                           g_variant_get_size (samples));
+    }
+
+  g_autoptr(GBytes) bytes = g_byte_array_free_to_bytes (g_steal_pointer (&data));
+
+  return g_variant_new_from_bytes (G_VARIANT_TYPE ("a(xx)"), bytes, FALSE);
+}
+
+typedef gboolean (* SegmentValueVisitor) (GvdbTable  *db,
+                                          const char *name,
+                                          GPtrArray  *values,
+                                          gpointer    user_data);
+
+/* Live captures append the samples completed since the previous snapshot
+ * as segments of the file; every probe and counter is visited once, with
+ * its values in each of the segments
+ */
+static void
+foreach_segment_value (GvdbTable           *db,
+                       const char          *type,
+                       SegmentValueVisitor  visit,
+                       gpointer             user_data)
+{
+  g_autoptr(GHashTable) visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  guint n_segments = gvdb_table_get_n_segments (db);
+
+  for (guint i = 0; i < n_segments; i++)
+    {
+      GvdbTable *segment = gvdb_table_get_segment (db, i);
+      gboolean keep_going = TRUE;
+      GvdbTableIter iter;
+
+      if (segment == NULL)
+        continue;
+
+      gvdb_table_iter_init (&iter, segment);
+      while (keep_going && gvdb_table_iter_next (&iter))
+        {
+          if (gvdb_table_iter_get_item_type (&iter) != 'v')
+            continue;
+
+          g_autoptr(GVariant) value = gvdb_table_iter_get_raw_value (&iter);
+          if (value == NULL || !g_variant_is_of_type (value, G_VARIANT_TYPE (type)))
+            continue;
+
+          /* Probes and counters are stored under their own name */
+          const char *name = NULL;
+          g_variant_get_child (value, 0, "&s", &name);
+
+          if (g_hash_table_contains (visited, name))
+            continue;
+
+          g_hash_table_add (visited, g_strdup (name));
+
+          g_autoptr(GPtrArray) values = gvdb_table_get_raw_values (db, name);
+          if (values->len == 0)
+            continue;
+
+          keep_going = visit (db, name, values, user_data);
+        }
+
+      gvdb_table_free (segment);
+
+      if (!keep_going)
+        break;
+    }
+}
+
+typedef struct {
+  EosProfileProbeCallback callback;
+  gpointer callback_data;
+} ProbeVisit;
+
+static gboolean
+visit_segment_probe (GvdbTable  *db,
+                     const char *name,
+                     GPtrArray  *values,
+                     gpointer    user_data)
+{
+  ProbeVisit *visit = user_data;
+  guint32 line, n_samples = 0;
+  const char *file = NULL;
+  const char *function = NULL;
+
+  /* The location of the probe does not change between segments */
+  g_variant_get_child (values->pdata[0], 1, "&s", &function);
+  g_variant_get_child (values->pdata[0], 2, "&s", &file);
+  g_variant_get_child (values->pdata[0], 3, "u", &line);
+
+  for (guint i = 0; i < values->len; i++)
+    {
+      guint32 segment_samples;
+
+      g_variant_get_child (values->pdata[i], 4, "u", &segment_samples);
+      n_samples += segment_samples;
+    }
+
+  g_autoptr(GVariant) samples = g_variant_ref_sink (merge_segment_samples (values, 5));
+
+  return visit->callback (name, function, file, line, n_samples, samples,
+                          visit->callback_data);
+}
+
 void
 eos_profile_util_foreach_probe_v1 (GvdbTable               *db,
                                    EosProfileProbeCallback  callback,
                                    gpointer                 callback_data)
 {
-  int names_len = 0;
-  g_auto(GStrv) names = gvdb_table_get_names (db, &names_len);
+  GvdbTableIter iter;
 
-  const char * const meta_keys[] = {
-    PROBE_DB_META_VERSION_KEY,
-    PROBE_DB_META_APPID_KEY,
-    PROBE_DB_META_PROFILE_KEY,
-    PROBE_DB_META_START_KEY,
-    NULL,
-  };
+  if (gvdb_table_get_n_segments (db) > 1)
+    {
+      ProbeVisit visit = {
+        .callback = callback,
+        .callback_data = callback_data,
+      };
+
+      foreach_segment_value (db, PROBE_DB_META_PROBE_TYPE, visit_segment_probe, &visit);
+      return;
+    }
 
-  for (int i = 0; i < names_len; i++)
+  /* Probes carry their own name, so there is no need to build the keys */
+  gvdb_table_iter_init (&iter, db);
+  while (gvdb_table_iter_next (&iter))
     {
-      const char *key_name = names[i];
+      if (gvdb_table_iter_get_item_type (&iter) != 'v')
+        continue;
 
-      if (g_strv_contains (meta_keys, key_name))
+      g_autoptr(GVariant) value = gvdb_table_iter_get_raw_value (&iter);
+      if (value == NULL)
         continue;
 
-      if (!gvdb_table_has_value (db, key_name))
+      if (!visit_probe (value, callback, callback_data))
+        break;
+    }
+}
+
+typedef struct {
+  const char *prefix;
+  gsize prefix_len;
+  EosProfileProbeCallback callback;
+  gpointer callback_data;
+} PrefixWalk;
+
+static GvdbWalkResult
+walk_probes (GvdbTableIter *iter,
+             const char    *path,
+             gpointer       user_data)
+{
+  PrefixWalk *walk = user_data;
+
+  /* Only descend into the levels that can lead to the prefix, or that
+   * are already under it
+   */
+  gsize path_len = strlen (path);
+  if (strncmp (path, walk->prefix, MIN (path_len, walk->prefix_len)) != 0)
+    return GVDB_WALK_SKIP;
+
+  if (gvdb_table_iter_get_item_type (iter) != 'v' || path_len < walk->prefix_len)
+    return GVDB_WALK_CONTINUE;
+
+  g_autoptr(GVariant) value = gvdb_table_iter_get_raw_value (iter);
+  if (value == NULL)
+    return GVDB_WALK_CONTINUE;
+
+  if (!visit_probe (value, walk->callback, walk->callback_data))
+    return GVDB_WALK_STOP;
+
+  return GVDB_WALK_CONTINUE;
+}
+
+typedef struct {
+  const char *prefix;
+  EosProfileProbeCallback callback;
+  gpointer callback_data;
+} PrefixFilter;
+
+static gboolean
+filter_by_prefix (const char *probe_name,
+                  const char *function,
+                  const char *file,
+                  gint32      line,
+                  gint32      n_samples,
+                  GVariant   *samples,
+                  gpointer    user_data)
+{
+  PrefixFilter *filter = user_data;
+
+  if (!g_str_has_prefix (probe_name, filter->prefix))
+    return TRUE;
+
+  return filter->callback (probe_name, function, file, line, n_samples, samples,
+                           filter->callback_data);
+}
+
+/**
+ * eos_profile_util_foreach_probe_prefix:
+ * @db: a capture file
+ * @prefix: (nullable): the prefix of the probe names
+ * @callback: the function to call for each probe
+ * @callback_data: data for @callback
+ *
+ * Like eos_profile_util_foreach_probe_v1(), but only visits the probes
+ * whose name starts with @prefix. Only the levels of the name hierarchy
+ * under @prefix are looked up, so this does not depend on the number of
+ * probes outside of it.
+ */
+void
+eos_profile_util_foreach_probe_prefix (GvdbTable               *db,
+                                       const char              *prefix,
+                                       EosProfileProbeCallback  callback,
+                                       gpointer                 callback_data)
+{
+  if (prefix == NULL || *prefix == '\0')
+    prefix = "/";
+
+  /* Files written without the intermediate lists can only be scanned, and
+   * so can the segments of live captures, as walks only see the first one
+   */
+  g_auto(GStrv) roots = gvdb_table_list (db, "/");
+  if (roots == NULL || gvdb_table_get_n_segments (db) > 1)
+    {
+      PrefixFilter filter = {
+        .prefix = prefix,
+        .callback = callback,
+        .callback_data = callback_data,
+      };
+
+      eos_profile_util_foreach_probe_v1 (db, filter_by_prefix, &filter);
+      return;
+    }
+
+  const char *basename = strrchr (prefix, '/');
+  if (basename == NULL)
+    return;
+
+  g_autofree char *dir = g_strndup (prefix, basename - prefix + 1);
+
+  PrefixWalk walk = {
+    .prefix = prefix,
+    .prefix_len = strlen (prefix),
+    .callback = callback,
+    .callback_data = callback_data,
+  };
+
+  gvdb_table_walk (db, dir, walk_probes, &walk);
+}
+
+typedef struct {
+  EosProfileCounterCallback callback;
+  gpointer callback_data;
+} CounterVisit;
+
+static gboolean
+visit_segment_counter (GvdbTable  *db,
+                       const char *name,
+                       GPtrArray  *values,
+                       gpointer    user_data)
+{
+  CounterVisit *visit = user_data;
+
+  g_autoptr(GVariant) samples = g_variant_ref_sink (merge_segment_samples (values, 1));
+
+  return visit->callback (name, samples, visit->callback_data);
+}
+
+void
+eos_profile_util_foreach_counter_v1 (GvdbTable                 *db,
+                                     EosProfileCounterCallback  callback,
+                                     gpointer                   callback_data)
+{
+  GvdbTableIter iter;
+
+  if (gvdb_table_get_n_segments (db) > 1)
+    {
+      CounterVisit visit = {
+        .callback = callback,
+        .callback_data = callback_data,
+      };
+
+      foreach_segment_value (db, PROBE_DB_META_COUNTER_TYPE, visit_segment_counter, &visit);
+      return;
+    }
+
+  gvdb_table_iter_init (&iter, db);
+  while (gvdb_table_iter_next (&iter))
+    {
+      if (gvdb_table_iter_get_item_type (&iter) != 'v')
         continue;
 
-      g_autoptr(GVariant) value = gvdb_table_get_raw_value (db, key_name);
+      g_autoptr(GVariant) value = gvdb_table_iter_get_raw_value (&iter);
       if (value == NULL)
         continue;
 
-      const char *file = NULL;
-      const char *function = NULL;
-      const char *probe_name = NULL;
+      if (!g_variant_is_of_type (value, G_VARIANT_TYPE (PROBE_DB_META_COUNTER_TYPE)))
+        continue;
+
+      const char *counter_name = NULL;
       g_autoptr(GVariant) samples = NULL;
-      gint32 line, n_samples;
 
-      g_variant_get (value, "(&s&s&suu@a(xx))",
-                     &probe_name,
-                     &function,
-                     &file,
-                     &line,
-                     &n_samples,
-                     &samples);
+      g_variant_get (value, "(&s@a(xx))", &counter_name, &samples);
 
-      if (!callback (probe_name, function, file, line, n_samples, samples, callback_data))
+      if (!callback (counter_name, samples, callback_data))
         break;
-   }
+    }
+}
+
+typedef struct {
+  gint64 time;
+  gint64 value;
+} CounterValue;
+
+static int
+counter_value_compare (gconstpointer a,
+                       gconstpointer b)
+{
+  const CounterValue *value_a = a;
+  const CounterValue *value_b = b;
+
+  if (value_a->time < value_b->time)
+    return -1;
+
+  if (value_a->time > value_b->time)
+    return 1;
+
+  return 0;
+}
+
+/**
+ * eos_profile_util_get_counter_stats:
+ * @samples: the `a(xx)` samples of a counter
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Computes the statistics of the values of a counter.
+ *
+ * Returns: %TRUE if the counter has at least one value
+ */
+gboolean
+eos_profile_util_get_counter_stats (GVariant               *samples,
+                                    EosProfileCounterStats *stats)
+{
+  memset (stats, 0, sizeof (EosProfileCounterStats));
+
+  gsize n_values = g_variant_n_children (samples);
+  if (n_values == 0)
+    return FALSE;
+
+  g_autoptr(GArray) values = g_array_sized_new (FALSE, FALSE, sizeof (CounterValue), n_values);
+
+  GVariantIter iter;
+  g_variant_iter_init (&iter, samples);
+
+  gint64 time, value;
+  while (g_variant_iter_next (&iter, "(xx)", &time, &value))
+    {
+      g_array_append_vals (values,
+                           &(CounterValue) {
+                             .time = time,
+                             .value = value,
+                           }, 1);
+    }
+
+  /* Counters can be updated from different threads */
+  g_array_sort (values, counter_value_compare);
+
+  stats->n_values = values->len;
+  stats->min_value = G_MAXINT64;
+  stats->max_value = G_MININT64;
+
+  double weighted_total = 0.0;
+  double plain_total = 0.0;
+
+  for (int i = 0; i < values->len; i++)
+    {
+      const CounterValue *v = &g_array_index (values, CounterValue, i);
+
+      stats->min_value = MIN (stats->min_value, v->value);
+      stats->max_value = MAX (stats->max_value, v->value);
+
+      plain_total += v->value;
+
+      if (i < values->len - 1)
+        {
+          const CounterValue *next = &g_array_index (values, CounterValue, i + 1);
+
+          weighted_total += (double) v->value * (next->time - v->time);
+        }
+    }
+
+  const CounterValue *first = &g_array_index (values, CounterValue, 0);
+  const CounterValue *last = &g_array_index (values, CounterValue, values->len - 1);
+
+  stats->last_value = last->value;
+
+  if (last->time > first->time)
+    stats->weighted_avg = weighted_total / (last->time - first->time);
+  else
+    stats->weighted_avg = plain_total / values->len;
+
+  return TRUE;
+}
+
+static int
+duration_compare (gconstpointer a,
+                  gconstpointer b)
+{
+  gint64 duration_a = *(const gint64 *) a;
+  gint64 duration_b = *(const gint64 *) b;
+
+  if (duration_a < duration_b)
+    return -1;
+
+  if (duration_a > duration_b)
+    return 1;
+
+  return 0;
+}
+
+static int
+sample_compare (gconstpointer a,
+                gconstpointer b)
+{
+  const ProfileSample *sample_a = a;
+  const ProfileSample *sample_b = b;
+
+  if (sample_a->start_time < sample_b->start_time)
+    return -1;
+
+  if (sample_a->start_time > sample_b->start_time)
+    return 1;
+
+  return 0;
+}
+
+static gint64
+percentile (GArray *durations,
+            double  p)
+{
+  guint idx = (guint) ceil (durations->len * p);
+
+  idx = CLAMP (idx, 1, durations->len) - 1;
+
+  return g_array_index (durations, gint64, idx);
+}
+
+/**
+ * eos_profile_util_get_probe_durations:
+ * @samples: the `a(xx)` samples of a probe
+ *
+ * Gets the durations of the samples of a probe, in the order in which
+ * they started, skipping the samples of probes that were never stopped.
+ *
+ * Returns: (transfer full) (element-type gint64): the durations
+ */
+GArray *
+eos_profile_util_get_probe_durations (GVariant *samples)
+{
+  gsize n_samples = g_variant_n_children (samples);
+
+  g_autoptr(GArray) sorted = g_array_sized_new (FALSE, FALSE, sizeof (ProfileSample), n_samples);
+  GArray *durations = g_array_sized_new (FALSE, FALSE, sizeof (gint64), n_samples);
+
+  GVariantIter iter;
+  g_variant_iter_init (&iter, samples);
+
+  gint64 start, end;
+  while (g_variant_iter_next (&iter, "(xx)", &start, &end))
+    {
+      if (end < start)
+        continue;
+
+      g_array_append_vals (sorted,
+                           &(ProfileSample) {
+                             .start_time = start,
+                             .end_time = end,
+                           }, 1);
+    }
+
+  /* Samples are recorded when they stop, and nested samples stop first */
+  g_array_sort (sorted, sample_compare);
+
+  for (int i = 0; i < sorted->len; i++)
+    {
+      const ProfileSample *sample = &g_array_index (sorted, ProfileSample, i);
+      gint64 delta = sample->end_time - sample->start_time;
+
+      g_array_append_val (durations, delta);
+    }
+
+  return durations;
+}
+
+/**
+ * eos_profile_util_get_duration_stats:
+ * @durations: (element-type gint64): durations, as returned by
+ *   eos_profile_util_get_probe_durations()
+ * @first: the index of the first duration to consider
+ * @len: the number of durations to consider, or -1 for all the
+ *   durations after @first
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Computes the statistics of a range of durations, which makes it
+ * possible to consider the first samples of a probe separately.
+ *
+ * Returns: %TRUE if the range contains at least one duration
+ */
+gboolean
+eos_profile_util_get_duration_stats (GArray               *durations,
+                                     guint                 first,
+                                     int                   len,
+                                     EosProfileProbeStats *stats)
+{
+  memset (stats, 0, sizeof (EosProfileProbeStats));
+
+  if (first >= durations->len)
+    return FALSE;
+
+  if (len < 0 || first + len > durations->len)
+    len = durations->len - first;
+
+  if (len == 0)
+    return FALSE;
+
+  g_autoptr(GArray) sorted = g_array_sized_new (FALSE, FALSE, sizeof (gint64), len);
+  g_array_append_vals (sorted, &g_array_index (durations, gint64, first), len);
+  g_array_sort (sorted, duration_compare);
+
+  stats->n_samples = sorted->len;
+  stats->min = g_array_index (sorted, gint64, 0);
+  stats->max = g_array_index (sorted, gint64, sorted->len - 1);
+
+  for (int i = 0; i < sorted->len; i++)
+    stats->total += g_array_index (sorted, gint64, i);
+
+  stats->avg = stats->total / (double) sorted->len;
+
+  if (sorted->len > 1)
+    {
+      double squares = 0.0;
+
+      for (int i = 0; i < sorted->len; i++)
+        {
+          double deviation = g_array_index (sorted, gint64, i) - stats->avg;
+
+          squares += deviation * deviation;
+        }
+
+      stats->stddev = sqrt (squares / (sorted->len - 1));
+    }
+
+  stats->p50 = percentile (sorted, 0.50);
+  stats->p90 = percentile (sorted, 0.90);
+  stats->p99 = percentile (sorted, 0.99);
+  stats->p999 = percentile (sorted, 0.999);
+
+  return TRUE;
+}
+
+/**
+ * eos_profile_util_get_probe_stats:
+ * @samples: the `a(xx)` samples of a probe
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Computes the statistics of the durations of a probe, skipping the
+ * samples of probes that were never stopped.
+ *
+ * Returns: %TRUE if the probe has at least one valid sample
+ */
+gboolean
+eos_profile_util_get_probe_stats (GVariant              *samples,
+                                  EosProfileProbeStats  *stats)
+{
+  g_autoptr(GArray) durations = eos_profile_util_get_probe_durations (samples);
+
+  return eos_profile_util_get_duration_stats (durations, 0, -1, stats);
+}
+
+/**
+ * eos_profile_util_format_counter_value:
+ * @counter_name: the name of the counter
+ * @value: a value of the counter
+ *
+ * Formats @value according to the unit of the counter.
+ *
+ * Returns: (transfer full): the formatted value
+ */
+char *
+eos_profile_util_format_counter_value (const char *counter_name,
+                                       double      value)
+{
+  if (g_str_has_prefix (counter_name, PROBE_DB_MEMORY_BASE_KEY "/"))
+    return g_format_size_full ((guint64) MAX (value, 0), G_FORMAT_SIZE_IEC_UNITS);
+
+  if (value == floor (value))
+    return g_strdup_printf ("%.0f", value);
+
+  return g_strdup_printf ("%.2f", value);
+}
+
+/**
+ * eos_profile_util_get_terminal_width:
+ *
+ * Gets the number of columns of the terminal connected to the standard
+ * output; the output is not limited if it's not a terminal.
+ *
+ * Returns: the number of columns
+ */
+guint
+eos_profile_util_get_terminal_width (void)
+{
+  guint columns;
+
+  if (eos_profile_get_terminal_size (&columns, NULL) && columns > 0)
+    return columns;
+
+  return 256;
+}
+
+/**
+ * eos_profile_util_get_terminal_height:
+ *
+ * Gets the number of rows of the terminal connected to the standard
+ * output.
+ *
+ * Returns: the number of rows, or 0 if the output is not a terminal
+ */
+guint
+eos_profile_util_get_terminal_height (void)
+{
+  guint rows;
+
+  if (eos_profile_get_terminal_size (NULL, &rows))
+    return rows;
+
+  return 0;
+}
+
+/**
+ * eos_profile_util_truncate_name:
+ * @name: a probe or counter name
+ * @max_len: the maximum length
+ *
+ * Truncates @name to @max_len characters, replacing the last one with
+ * a `~` to mark the truncation.
+ *
+ * Returns: (transfer full): the truncated name
+ */
+char *
+eos_profile_util_truncate_name (const char *name,
+                                int         max_len)
+{
+  max_len = MAX (max_len, 2);
+
+  if ((int) strlen (name) <= max_len)
+    return g_strdup (name);
+
+  char *res = g_strndup (name, max_len);
+  res[max_len - 1] = '~';
+
+  return res;
 }
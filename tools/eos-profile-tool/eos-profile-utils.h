@@ -35,3 +35,66 @@ typedef gboolean (* EosProfileProbeCallback) (const char *probe_name,
 void    eos_profile_util_foreach_probe_v1       (GvdbTable               *db,
                                                  EosProfileProbeCallback  callback,
                                                  gpointer                 callback_data);
+
+void    eos_profile_util_foreach_probe_prefix   (GvdbTable               *db,
+                                                 const char              *prefix,
+                                                 EosProfileProbeCallback  callback,
+                                                 gpointer                 callback_data);
+
+typedef struct {
+  guint n_samples;
+
+  gint64 total;
+  gint64 min;
+  gint64 max;
+
+  double avg;
+  double stddev;
+
+  gint64 p50;
+  gint64 p90;
+  gint64 p99;
+  gint64 p999;
+} EosProfileProbeStats;
+
+gboolean eos_profile_util_get_probe_stats (GVariant             *samples,
+                                           EosProfileProbeStats *stats);
+
+GArray * eos_profile_util_get_probe_durations (GVariant *samples);
+
+gboolean eos_profile_util_get_duration_stats (GArray               *durations,
+                                              guint                 first,
+                                              int                   len,
+                                              EosProfileProbeStats *stats);
+
+typedef gboolean (* EosProfileCounterCallback) (const char *counter_name,
+                                                GVariant   *samples,
+                                                gpointer    user_data);
+
+void    eos_profile_util_foreach_counter_v1     (GvdbTable                 *db,
+                                                 EosProfileCounterCallback  callback,
+                                                 gpointer                   callback_data);
+
+typedef struct {
+  guint n_values;
+
+  gint64 min_value;
+  gint64 max_value;
+  gint64 last_value;
+
+  /* Each value weighted by how long the counter kept it */
+  double weighted_avg;
+} EosProfileCounterStats;
+
+gboolean eos_profile_util_get_counter_stats (GVariant               *samples,
+                                             EosProfileCounterStats *stats);
+
+char *  eos_profile_util_format_counter_value (const char *counter_name,
+                                               double      value);
+
+guint   eos_profile_util_get_terminal_width     (void);
+
+guint   eos_profile_util_get_terminal_height    (void);
+
+char *  eos_profile_util_truncate_name          (const char *name,
+                                                 int         max_len);